@@ -28,6 +28,10 @@
 #include <osvr/ClientKit/InterfaceStateC.h>
 #include <osvr/Client/RenderManagerConfig.h>
 #include "osvr/RenderKit/RenderManager.h"
+#include "frame_timer.h"
+#include "font.h"
+#include "sphere_batch.h"
+#include "command_socket.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -43,7 +47,10 @@
 
 // Standard includes
 #include <iostream>
+#include <sstream>
+#include <iomanip>
 #include <string>
+#include <vector>
 #include <stdlib.h> // For exit()
 #include <chrono>
 #include <thread>
@@ -64,8 +71,8 @@ static osvr::clientkit::ClientContext context(
 
 static osvr::renderkit::RenderManager *render = nullptr;
 
-// Quadric and sphere to use for rendering.
-static GLUquadric *sphere = nullptr;
+// Draws the spheres of the pattern.
+static SphereBatch *sphereBatch = nullptr;
 
 // X,Y location
 typedef struct {
@@ -130,6 +137,124 @@ static float cyn_col[] = { 0.0, 1.0, 1.0 };
 static float mag_col[] = { 1.0, 0.0, 1.0 };
 static float wht_col[] = { 1.0, 1.0, 1.0 };
 
+// Colors that can be named on the command line.
+static const struct {
+  const char *name;
+  const float *color;
+} namedColors[] = {
+  { "red", red_col },
+  { "green", grn_col },
+  { "blue", blu_col },
+  { "white", wht_col },
+  { "cyan", cyn_col },
+  { "magenta", mag_col },
+  { "yellow", yel_col },
+  { nullptr, nullptr }
+};
+
+static const float *ColorByName(const std::string &name)
+{
+  for (size_t i = 0; namedColors[i].name != nullptr; i++) {
+    if (name == namedColors[i].name) {
+      return namedColors[i].color;
+    }
+  }
+  return nullptr;
+}
+
+// Splits a comma-separated command-line list.
+static std::vector<std::string> SplitList(const std::string &list)
+{
+  std::vector<std::string> items;
+  std::string item;
+  std::istringstream s(list);
+  while (std::getline(s, item, ',')) {
+    if (!item.empty()) { items.push_back(item); }
+  }
+  return items;
+}
+
+// One pattern of a sequence: the color of the spheres, how many fit
+// across half the viewport width, and their radius as a fraction of
+// the spacing between them.
+struct Pattern {
+  std::string colorName;
+  const float *color;
+  int numSpheresX;
+  float radiusFraction;
+};
+
+// Where the spheres for one grid density go, in pixels.
+struct SphereLayout {
+  float sphereSpace;
+  std::vector<XY> spheres;
+  XY xSphere, ySphere;
+};
+
+// Use the width of the first eye to figure out the spacing for the
+// spheres based on the number requested across the viewport.
+static SphereLayout MakeSphereLayout(int numSpheresX, int width, int height)
+{
+  SphereLayout layout;
+  layout.sphereSpace = (width / 2.0f) / (numSpheresX - 0.5f);
+
+  // Make sure we have enough spheres to cover the space in height
+  // as well as width.
+  int numSpheresY = static_cast<int>(0.5 + (numSpheresX * height) / width);
+  for (int x = -numSpheresX + 1; x < numSpheresX; x++) {
+    for (int y = -numSpheresY + 1; y < numSpheresY; y++) {
+      XY sphere;
+      sphere.x = x * layout.sphereSpace;
+      sphere.y = y * layout.sphereSpace;
+      layout.spheres.push_back(sphere);
+    }
+  }
+  layout.xSphere.x = layout.sphereSpace / 2;
+  layout.xSphere.y = 0;
+  layout.ySphere.x = 0;
+  layout.ySphere.y = layout.sphereSpace / 2;
+  return layout;
+}
+
+// Presses of the sequence-advance button, counted by its callback and
+// consumed by the render loop.
+static int advancePresses = 0;
+
+void advancePattern(void * /*userdata*/, const OSVR_TimeValue * /*timestamp*/,
+  const OSVR_ButtonReport *report)
+{
+  if (report->state == 1) {
+    advancePresses++;
+  }
+}
+
+// Draws a line of text into the bound framebuffer at the specified
+// fraction of the viewport, leaving the OpenGL state as it found it.
+static void DrawStamp(int fontOffset, const std::string &text, double x, double y)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TRANSFORM_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, viewport[2], 0, viewport[3], -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor3d(1, 1, 1);
+  glRasterPos2d(x * viewport[2], y * viewport[3]);
+  drawStringInFont(fontOffset, text.c_str());
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glPopAttrib();
+}
+
 bool SetupRendering(osvr::renderkit::GraphicsLibrary library)
 {
   // Make sure our pointers are filled in correctly.  The config file selects
@@ -166,8 +291,8 @@ bool SetupRendering(osvr::renderkit::GraphicsLibrary library)
 
   glEnable(GL_COLOR_MATERIAL);
 
-  // Construct the quadric for the sphere primitive to draw to show spacing
-  sphere = gluNewQuadric();
+  // Construct the batch that draws all of the spheres at once.
+  sphereBatch = new SphereBatch(32, 16);
 
   return true;
 }
@@ -262,41 +387,54 @@ void RenderView(
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
 
-  // Draw a set of spheres at the specified locations in viewport space.
-  // They are offset so that (0,0) is at the center of projection for
-  // the eye.
-  glColor3f(color[0], color[1], color[2]);
+  // Draw a set of spheres at the specified locations in viewport space,
+  // along with the axis spheres: the x sphere in red and the y in green
+  // at half the radius.  They are offset so that (0,0) is at the center
+  // of projection for the eye.  The batch only re-uploads the list when
+  // it changes, and draws them all at once.
+  static std::vector<SphereBatch::Instance> instances;
+  instances.clear();
+  SphereBatch::Instance s = { 0, 0, radius, { color[0], color[1], color[2] } };
+  for (size_t i = 0; i < spheres.size(); i++) {
+    s.x = static_cast<float>(spheres[i].x);
+    s.y = static_cast<float>(spheres[i].y);
+    instances.push_back(s);
+  }
+  SphereBatch::Instance xMarker = { static_cast<float>(xSphere.x), static_cast<float>(xSphere.y),
+    radius / 2, { red_col[0], red_col[1], red_col[2] } };
+  SphereBatch::Instance yMarker = { static_cast<float>(ySphere.x), static_cast<float>(ySphere.y),
+    radius / 2, { grn_col[0], grn_col[1], grn_col[2] } };
+  instances.push_back(xMarker);
+  instances.push_back(yMarker);
+
   double xCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjX;
   double yCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjY;
   double xOffset = xCOP - 0.5;
   double yOffset = yCOP - 0.5;
-  for (size_t i = 0; i < spheres.size(); i++) {
-    glPushMatrix();
-    glTranslated(spheres[i].x + xOffset, spheres[i].y + yOffset, 0);
-    gluSphere(sphere, radius, 40, 40);
-    glPopMatrix();
-  }
-
-  // Draw the axis spheres at the specified locations in viewport space.
-  // They are offset so that (0,0) is at the center of projection for
-  // the eye.
-  // Draw the x sphere in red and the y in green.
-  glPushMatrix();
-    glColor3f(red_col[0], red_col[1], red_col[2]);
-    glTranslated(xSphere.x + xOffset, xSphere.y + yOffset, 0);
-    gluSphere(sphere, radius/2, 40, 40);
-  glPopMatrix();
-  glPushMatrix();
-    glColor3f(grn_col[0], grn_col[1], grn_col[2]);
-    glTranslated(ySphere.x + xOffset, ySphere.y + yOffset, 0);
-    gluSphere(sphere, radius/2, 40, 40);
-  glPopMatrix();
+  sphereBatch->setInstances(instances);
+  sphereBatch->draw(xOffset, yOffset, 0);
 }
 
 void Usage(std::string name)
 {
   std::cerr << "Usage: " << name
+    << " [-timing] [-timing_csv file.csv] [-refresh_hz HZ]"
+    << " [-sequence color,color,...] [-radii fraction,...] [-densities count,...]"
+    << " [-period seconds] [-trigger_button path] [-udp_port port] [-once] [-no_stamp]"
     << " [color (one of red, green, blue, white, cyan, magenta, yellow)]"
+    << std::endl
+    << "  -timing shows frame timing, -timing_csv also logs it, and -refresh_hz"
+    << " sets the display rate used to count missed vsyncs (default 60)."
+    << std::endl
+    << "  -sequence cycles through the colors, for each of the sphere radii"
+    << " (fractions of the spacing, default 0.25) and densities (spheres across"
+    << " half the view, default 20).  It moves on every -period seconds"
+    << " (default 2, 0 for never), on each press of the -trigger_button"
+    << " interface (for example /controller/1), or on a UDP command"
+    << " (next, prev, goto N, status, quit) to -udp_port, which is answered"
+    << " with the current pattern.  -once quits after the last pattern."
+    << "  Each change is printed on standard output and, unless -no_stamp,"
+    << " the pattern, frame number and time are drawn in each view."
     << std::endl;
   exit(-1);
 }
@@ -305,10 +443,68 @@ int main(int argc, char *argv[])
 {
     // Parse the command line
     std::string colorName = "red";
-    const float *color = red_col;
+    std::vector<std::string> colorNames;
+    std::vector<float> radii(1, 0.25f);
+    std::vector<int> densities(1, 20);
+    double period = -1;   //< Negative means not given
+    std::string triggerButton;
+    int udpPort = 0;
+    bool once = false;
+    bool stamp = true;
+    bool timing = false;
+    std::string timingFileName;
+    double refreshHz = 60;
     int realParams = 0;
     for (int i = 1; i < argc; i++) {
-      if (argv[i][0] == '-') {
+      if (std::string("-timing") == argv[i]) {
+        timing = true;
+      } else if (std::string("-timing_csv") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        timing = true;
+        timingFileName = argv[i];
+      } else if (std::string("-refresh_hz") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        refreshHz = atof(argv[i]);
+      } else if (std::string("-sequence") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        colorNames = SplitList(argv[i]);
+      } else if (std::string("-radii") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        radii.clear();
+        std::vector<std::string> items = SplitList(argv[i]);
+        for (size_t r = 0; r < items.size(); r++) {
+          radii.push_back(static_cast<float>(atof(items[r].c_str())));
+          if ((radii.back() <= 0) || (radii.back() > 0.5)) {
+            std::cerr << "Sphere radii must be between 0 and 0.5 of the spacing" << std::endl;
+            Usage(argv[0]);
+          }
+        }
+      } else if (std::string("-densities") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        densities.clear();
+        std::vector<std::string> items = SplitList(argv[i]);
+        for (size_t d = 0; d < items.size(); d++) {
+          densities.push_back(atoi(items[d].c_str()));
+          if (densities.back() < 2) {
+            std::cerr << "Sphere densities must be at least 2" << std::endl;
+            Usage(argv[0]);
+          }
+        }
+      } else if (std::string("-period") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        period = atof(argv[i]);
+      } else if (std::string("-trigger_button") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        triggerButton = argv[i];
+      } else if (std::string("-udp_port") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        udpPort = atoi(argv[i]);
+        if ((udpPort <= 0) || (udpPort > 65535)) { Usage(argv[0]); }
+      } else if (std::string("-once") == argv[i]) {
+        once = true;
+      } else if (std::string("-no_stamp") == argv[i]) {
+        stamp = false;
+      } else if (argv[i][0] == '-') {
         Usage(argv[0]);
       }
       else switch (++realParams) {
@@ -320,26 +516,36 @@ int main(int argc, char *argv[])
       }
     }
     if (realParams > 1) { Usage(argv[0]); }
-
-    if (colorName == "red") {
-      color = red_col;
-    } else if (colorName == "green") {
-      color = grn_col;
-    } else if (colorName == "blue") {
-      color = blu_col;
-    } else if (colorName == "white") {
-      color = wht_col;
-    } else if (colorName == "cyan") {
-      color = cyn_col;
-    } else if (colorName == "magenta") {
-      color = mag_col;
-    } else if (colorName == "yellow") {
-      color = yel_col;
-    } else {
-      std::cerr << "Unrecognized color: " << colorName << std::endl;
-      Usage(argv[0]);
+    if (colorNames.empty()) { colorNames.push_back(colorName); }
+    if (radii.empty() || densities.empty()) { Usage(argv[0]); }
+
+    // Build the sequence, with the colors changing fastest so that all
+    // of the colors of one grid are captured together.
+    std::vector<Pattern> patterns;
+    for (size_t d = 0; d < densities.size(); d++) {
+      for (size_t r = 0; r < radii.size(); r++) {
+        for (size_t c = 0; c < colorNames.size(); c++) {
+          Pattern pattern;
+          pattern.colorName = colorNames[c];
+          pattern.color = ColorByName(colorNames[c]);
+          pattern.numSpheresX = densities[d];
+          pattern.radiusFraction = radii[r];
+          if (pattern.color == nullptr) {
+            std::cerr << "Unrecognized color: " << colorNames[c] << std::endl;
+            Usage(argv[0]);
+          }
+          patterns.push_back(pattern);
+        }
+      }
     }
 
+    // A single pattern with no way to change it is the original
+    // behavior: no stamp, and nothing printed.
+    bool sequencing = (patterns.size() > 1) || !triggerButton.empty()
+      || (udpPort != 0) || (period > 0);
+    if (period < 0) { period = sequencing ? 2.0 : 0.0; }
+    stamp = stamp && sequencing;
+
     // Open RenderManager and set up the context for rendering to
     // an HMD.  Do this using the OSVR RenderManager interface,
     // which maps to the nVidia or other vendor direct mode
@@ -419,31 +625,15 @@ int main(int argc, char *argv[])
     std::vector<osvr::renderkit::RenderBuffer> colorBuffers;
     std::vector<GLuint> depthBuffers; //< Depth/stencil buffers to render into
 
-    // Use the width of the first eye to figure out the spacing for the
-    // spheres based on the number requested across the viewport.
-    // Both the radius and position are in pixels.
-    const int numSpheresX = 20;
+    // Lay out the spheres for each density in the sequence, based on
+    // the width of the first eye.  Both the radius and position are in
+    // pixels.
     int width = static_cast<int>(renderInfo[0].viewport.width);
     int height = static_cast<int>(renderInfo[0].viewport.width);
-    const float sphereSpace = (width / 2.0f) / (numSpheresX - 0.5f);
-
-    // Make sure we have enough spheres to cover the space in height
-    // as well as width.
-    int numSpheresY = static_cast<int>(0.5 + (numSpheresX * height) / width);
-    std::vector<XY> spheres; //< Where to draw the spheres
-    for (int x = -numSpheresX + 1; x < numSpheresX; x++) {
-      for (int y = -numSpheresY + 1; y < numSpheresY; y++) {
-        XY sphere;
-        sphere.x = x * sphereSpace;
-        sphere.y = y * sphereSpace;
-        spheres.push_back(sphere);
-      }
+    std::vector<SphereLayout> layouts;
+    for (size_t i = 0; i < patterns.size(); i++) {
+      layouts.push_back(MakeSphereLayout(patterns[i].numSpheresX, width, height));
     }
-    XY xSphere, ySphere;
-    xSphere.x = sphereSpace / 2;
-    xSphere.y = 0;
-    ySphere.x = 0;
-    ySphere.y = sphereSpace / 2;
 
     // Construct the buffers we're going to need for our render-to-texture
     // code.
@@ -509,30 +699,139 @@ int main(int argc, char *argv[])
       quit = true;
     }
 
+    // Set up frame timing if it was asked for.
+    FrameTimer timer;
+    timer.setEnabled(timing);
+    timer.setRefreshRate(refreshHz);
+    if (!timingFileName.empty() && !timer.openLog(timingFileName)) {
+      delete render;
+      return 4;
+    }
+
+    // Set up the ways the sequence can be advanced.
+    osvr::clientkit::Interface advanceButton;
+    if (!triggerButton.empty()) {
+      advanceButton = context.getInterface(triggerButton);
+      advanceButton.registerCallback(&advancePattern, nullptr);
+    }
+    CommandSocket commands;
+    if ((udpPort != 0) && !commands.open(static_cast<unsigned short>(udpPort))) {
+      delete render;
+      return 5;
+    }
+    int fontOffset = 0;
+    if (stamp && ((fontOffset = loadFont(nullptr)) == 0)) {
+      stamp = false;
+    }
+
+    // Keeps track of which pattern is showing, since when, and what
+    // frame it first appeared on.  Patterns are numbered from 1 when
+    // they are described.
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point sequenceStart = Clock::now();
+    Clock::time_point patternStart = sequenceStart;
+    size_t current = 0;
+    long long frame = 0;
+    auto describe = [&]() {
+      std::ostringstream s;
+      s << "pattern " << (current + 1) << " of " << patterns.size()
+        << " color " << patterns[current].colorName
+        << " spheres " << patterns[current].numSpheresX
+        << " radius " << patterns[current].radiusFraction
+        << " frame " << frame
+        << " time " << std::fixed << std::setprecision(3)
+        << std::chrono::duration<double>(Clock::now() - sequenceStart).count();
+      return s.str();
+    };
+    auto show = [&](long long index) {
+      long long count = static_cast<long long>(patterns.size());
+      if (once && ((index >= count) || (index < 0))) {
+        quit = true;
+        return;
+      }
+      current = static_cast<size_t>(((index % count) + count) % count);
+      patternStart = Clock::now();
+      std::cout << describe() << std::endl;
+    };
+    if (sequencing) {
+      std::cout << describe() << std::endl;
+    }
+
     // Continue rendering until it is time to quit.
     while (!quit) {
+        timer.beginFrame();
+
         // Update the context so we get our callbacks called and
         // update analog and button states.
         context.update();
 
+        // Move through the sequence on button presses, commands, and
+        // the timer.  The new pattern is shown starting with this frame.
+        for (; advancePresses > 0; advancePresses--) {
+          show(static_cast<long long>(current) + 1);
+        }
+        std::string command;
+        while (!quit && commands.poll(command)) {
+          if (command == "next") {
+            show(static_cast<long long>(current) + 1);
+          } else if (command == "prev") {
+            show(static_cast<long long>(current) - 1);
+          } else if (command.compare(0, 5, "goto ") == 0) {
+            show(atoll(command.c_str() + 5) - 1);
+          } else if (command == "quit") {
+            quit = true;
+          } else if (command != "status") {
+            commands.reply("error unknown command: " + command + "\n");
+            continue;
+          }
+          commands.reply(describe() + "\n");
+        }
+        if ((period > 0) && (std::chrono::duration<double>(Clock::now() - patternStart).count()
+              >= period)) {
+          show(static_cast<long long>(current) + 1);
+        }
+        if (quit) { break; }
+        timer.endStage(FrameTimer::STAGE_UPDATE);
+
         renderInfo = render->GetRenderInfo();
+        timer.endStage(FrameTimer::STAGE_RENDER_INFO);
 
         // Render into each buffer using the specified information.
-        // @todo Pass the color as a command-line argument
+        const Pattern &pattern = patterns[current];
+        const SphereLayout &layout = layouts[current];
+        std::string stampText;
+        if (stamp) {
+          std::ostringstream s;
+          s << "P" << (current + 1) << " " << pattern.colorName
+            << " N" << pattern.numSpheresX << " R" << pattern.radiusFraction
+            << " F" << frame << " T" << std::fixed << std::setprecision(3)
+            << std::chrono::duration<double>(Clock::now() - sequenceStart).count();
+          stampText = s.str();
+        }
         for (size_t i = 0; i < renderInfo.size(); i++) {
+          timer.beginGPU(i);
           RenderView(i, displayConfiguration, renderManagerConfig,
             renderInfo[i], frameBuffer,
             colorBuffers[i].OpenGL->colorBufferName,
             depthBuffers[i],
-            xSphere, ySphere,
-            spheres, color, sphereSpace / 4);
+            layout.xSphere, layout.ySphere,
+            layout.spheres, pattern.color,
+            layout.sphereSpace * pattern.radiusFraction);
+          if (stamp) {
+            DrawStamp(fontOffset, stampText, 0.3, 0.25);
+          }
+          timer.endGPU(i);
+          timer.drawOverlay();
         }
+        timer.endStage(FrameTimer::STAGE_RENDER);
 
         // Send the rendered results to the screen
         if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
           std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
           quit = true;
         }
+        timer.endStage(FrameTimer::STAGE_PRESENT);
+        frame++;
     }
 
     // Clean up after ourselves.
@@ -543,6 +842,8 @@ int main(int argc, char *argv[])
       glDeleteRenderbuffers(1, &depthBuffers[i]);
     }
 
+    delete sphereBatch;
+
     // Close the Renderer interface cleanly.
     delete render;
 
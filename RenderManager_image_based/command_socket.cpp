@@ -0,0 +1,136 @@
+/** @file
+    @brief Implementation of the UDP command socket.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "command_socket.h"
+
+#ifdef _WIN32
+  #include <winsock2.h>
+  #pragma comment(lib, "ws2_32.lib")
+  typedef int socklen_t;
+  typedef SOCKET SocketHandle;
+  static void closeSocket(SocketHandle s) { closesocket(s); }
+#else
+  #include <arpa/inet.h>
+  #include <fcntl.h>
+  #include <netinet/in.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+  typedef int SocketHandle;
+  static void closeSocket(SocketHandle s) { close(s); }
+#endif
+
+#include <cstring>
+#include <iostream>
+
+CommandSocket::CommandSocket()
+{
+  memset(d_from, 0, sizeof(d_from));
+}
+
+CommandSocket::~CommandSocket()
+{
+  if (isOpen()) {
+    closeSocket(static_cast<SocketHandle>(d_socket));
+#ifdef _WIN32
+    WSACleanup();
+#endif
+  }
+}
+
+bool CommandSocket::open(unsigned short port)
+{
+#ifdef _WIN32
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    std::cerr << "CommandSocket: Could not start Winsock" << std::endl;
+    return false;
+  }
+  SocketHandle s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == INVALID_SOCKET) {
+    std::cerr << "CommandSocket: Could not create socket" << std::endl;
+    WSACleanup();
+    return false;
+  }
+#else
+  SocketHandle s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s < 0) {
+    std::cerr << "CommandSocket: Could not create socket" << std::endl;
+    return false;
+  }
+#endif
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  bool ok = bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+  if (ok) {
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ok = ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+    ok = fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+  }
+  if (!ok) {
+    std::cerr << "CommandSocket: Could not listen on UDP port " << port << std::endl;
+    closeSocket(s);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return false;
+  }
+  d_socket = static_cast<long long>(s);
+  return true;
+}
+
+bool CommandSocket::poll(std::string &command)
+{
+  if (!isOpen()) { return false; }
+  char buffer[512];
+  socklen_t fromLength = sizeof(d_from);
+  int got = static_cast<int>(recvfrom(static_cast<SocketHandle>(d_socket), buffer,
+    sizeof(buffer) - 1, 0, reinterpret_cast<sockaddr *>(d_from), &fromLength));
+  if (got < 0) { return false; }
+  d_fromLength = static_cast<int>(fromLength);
+
+  buffer[got] = '\0';
+  command = buffer;
+  const char *space = " \t\r\n";
+  size_t first = command.find_first_not_of(space);
+  if (first == std::string::npos) {
+    command.clear();
+  } else {
+    command = command.substr(first, command.find_last_not_of(space) - first + 1);
+  }
+  return true;
+}
+
+void CommandSocket::reply(const std::string &text)
+{
+  if (!isOpen() || (d_fromLength == 0)) { return; }
+  sendto(static_cast<SocketHandle>(d_socket), text.c_str(), static_cast<int>(text.size()), 0,
+    reinterpret_cast<sockaddr *>(d_from), static_cast<socklen_t>(d_fromLength));
+}
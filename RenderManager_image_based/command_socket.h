@@ -0,0 +1,59 @@
+/** @file
+    @brief Non-blocking UDP socket that receives one-line text commands,
+           used to step PresentPatternRenderManager from a capture rig.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+/// Listens on a UDP port for datagrams, each holding one command, and
+/// can answer the sender of the most recent one.  poll() never blocks,
+/// so it can be called once per frame.  The platform socket headers are
+/// kept out of this file so that it can be included next to windows.h.
+class CommandSocket {
+public:
+  CommandSocket();
+  ~CommandSocket();
+
+  /// Binds to the port on all interfaces.
+  ///   @return false (with a message on std::cerr) on failure.
+  bool open(unsigned short port);
+
+  bool isOpen() const { return d_socket >= 0; }
+
+  /// Gets the next waiting command, with surrounding whitespace removed.
+  ///   @return false if there is none.
+  bool poll(std::string &command);
+
+  /// Sends a reply to whoever sent the last command returned by poll().
+  void reply(const std::string &text);
+
+private:
+  CommandSocket(const CommandSocket &) = delete;
+  CommandSocket &operator=(const CommandSocket &) = delete;
+
+  long long d_socket = -1;        //!< Platform socket handle, or -1
+  unsigned char d_from[128];      //!< Address of the last sender
+  int d_fromLength = 0;
+};
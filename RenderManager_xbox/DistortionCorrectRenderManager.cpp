@@ -29,6 +29,10 @@
 #include <osvr/Client/RenderManagerConfig.h>
 #include "osvr/RenderKit/RenderManager.h"
 #include "font.h" // Simple helper functions to generate and draw OpenGL bitmapped text
+#include "frame_timer.h"
+#include "sphere_batch.h"
+#include "point_transform.h"
+#include "param_session.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -48,6 +52,7 @@
 #include <stdlib.h> // For exit()
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 //This must come after we include <GL/GL.h> so its pointer types are defined.
 #include "osvr/RenderKit/GraphicsLibraryOpenGL.h"
@@ -68,8 +73,8 @@ static osvr::clientkit::ClientContext context(
 
 static osvr::renderkit::RenderManager *render = nullptr;
 
-// Quadric and sphere to use for rendering.
-static GLUquadric *sphere = nullptr;
+// Draws the spheres that show the spacing.
+static SphereBatch *sphereBatch = nullptr;
 
 // X,Y location
 typedef struct {
@@ -80,6 +85,16 @@ typedef struct {
 static std::vector<float> params;  //< Distortion parameters
 static int activeParam = 0;  //< Which parameter are we adjusting?
 
+// History of the parameter sets that were tried, kept with -session.
+// When one of them is shown, RenderManager is given the identity
+// distortion and the rendering is warped through the set's cached mesh
+// here instead, so that moving between sets does not build any meshes.
+static ParamSession session;
+static bool useSession = false;
+static int currentSet = -1;  //< Stored set the parameters came from
+static int otherSet = -1;    //< Set the A/B button switches to
+static bool showingStored = false;  //< Drawing currentSet's cached mesh
+
 static std::string osvrGetString(OSVR_ClientContext context, const std::string& path)
 {
   size_t len;
@@ -148,6 +163,139 @@ void nextParam(void * /*userdata*/, const OSVR_TimeValue * /*timestamp*/,
   }
 }
 
+// The full-resolution mesh is what gets built when parameters are set
+// with the button.  While the trigger is adjusting a parameter, a much
+// coarser mesh is rebuilt every frame so that the effect is visible
+// without stalling the frame loop.
+static const size_t fullMeshTriangles = 200 * 64;
+static const size_t previewMeshTriangles = 4 * 64;
+
+// How long the trigger must be released before the full-resolution
+// mesh replaces the preview mesh.
+static const double settleSeconds = 0.25;
+
+// The cached meshes have about as many triangles as the full-resolution
+// mesh.
+static const uint32_t warpMeshCells = 80;
+
+// Send the polynomial to RenderManager, building meshes with about the
+// specified number of triangles.
+static void updateDistortion(
+  const OSVRDisplayConfiguration &displayConfiguration,
+  const std::vector<float> &polynomial, size_t triangles)
+{
+  // Create a new set of distortion parameters that has the
+  // specified parameters, but using the center of projection
+  // from the read-in values.
+
+  // Get the original distortion correction
+  osvr::renderkit::DistortionParameters distortionLeft;
+  distortionLeft.m_desiredTriangles = triangles;
+  std::vector<float> Ds;
+  Ds.push_back(1.0);
+  Ds.push_back(1.0);
+  distortionLeft.m_distortionD = Ds;
+  distortionLeft.m_distortionPolynomialRed = polynomial;
+  distortionLeft.m_distortionPolynomialGreen = polynomial;
+  distortionLeft.m_distortionPolynomialBlue = polynomial;
+  distortionLeft.m_distortionCOP[0] =
+    static_cast<float>(displayConfiguration.getEyes()[0].m_CenterProjX);
+  distortionLeft.m_distortionCOP[1] =
+    static_cast<float>(displayConfiguration.getEyes()[0].m_CenterProjY);
+
+  osvr::renderkit::DistortionParameters distortionRight;
+  distortionRight = distortionLeft;
+  distortionRight.m_distortionCOP[0] =
+    static_cast<float>(displayConfiguration.getEyes()[1].m_CenterProjX);
+  distortionRight.m_distortionCOP[1] =
+    static_cast<float>(displayConfiguration.getEyes()[1].m_CenterProjY);
+
+  // Push the same distortion back for each eye.
+  std::vector<osvr::renderkit::DistortionParameters> distortionParams;
+  distortionParams.push_back(distortionLeft);
+  distortionParams.push_back(distortionRight);
+
+  // Send a new set of parameters to construct a distortion mesh.
+  render->UpdateDistortionMeshes(osvr::renderkit::DistortionMeshType::SQUARE,
+    distortionParams);
+}
+
+// Print the parameters to the console, so we can know what was set.
+static void printParams()
+{
+  std::cout << "Params: ";
+  if (params.size() > 0) {
+    std::cout << params[0];
+  }
+  for (size_t i = 1; i < params.size(); i++) {
+    std::cout << ", " << params[i];
+  }
+  std::cout << std::endl;
+
+  // The mesh is only well-behaved where the polynomial can be undone,
+  // which is out to the radius where it stops increasing.  The radius
+  // is in units of D, and the screen corners are at sqrt(2) / 2.
+  RadialInverse inverse;
+  std::vector<double> coefficients(params.begin(), params.end());
+  if (inverse.build(coefficients, 1.0)) {
+    std::cout << "Invertible out to radius " << inverse.maxRadius()
+      << " (distorted radius " << inverse.maxDistortedRadius() << ")"
+      << std::endl;
+  }
+}
+
+// Have RenderManager build meshes for the current parameters, which
+// stops showing a stored set.
+static void showCurrent(
+  const OSVRDisplayConfiguration &displayConfiguration, size_t triangles)
+{
+  showingStored = false;
+  updateDistortion(displayConfiguration, params, triangles);
+}
+
+// Show a stored set through its cached mesh and make its parameters the
+// current ones.  RenderManager only needs to be told once to stop
+// distorting; the identity is exact with two triangles, so that is
+// cheap too.
+static void showSet(
+  const OSVRDisplayConfiguration &displayConfiguration, int index)
+{
+  if (!showingStored) {
+    std::vector<float> identity;
+    identity.push_back(0);
+    identity.push_back(1);
+    updateDistortion(displayConfiguration, identity, 2);
+    showingStored = true;
+  }
+  currentSet = index;
+  params = session.set(index).params;
+  if (activeParam >= static_cast<int>(params.size())) { activeParam = 0; }
+  std::cout << "Showing " << session.set(index).name;
+  if (otherSet >= 0) {
+    std::cout << " (A/B with " << session.set(otherSet).name << ")";
+  }
+  std::cout << std::endl;
+  printParams();
+}
+
+// Add the current parameters to the history, making them the A side of
+// the A/B comparison and whatever was there before the B side.
+static void saveCurrent(const OSVRDisplayConfiguration &displayConfiguration)
+{
+  float cop[2][2];
+  for (int eye = 0; eye < 2; eye++) {
+    cop[eye][0] = static_cast<float>(displayConfiguration.getEyes()[eye].m_CenterProjX);
+    cop[eye][1] = static_cast<float>(displayConfiguration.getEyes()[eye].m_CenterProjY);
+  }
+  int index = session.add(params, cop);
+  if (index < 0) { return; }
+  if (index != currentSet) {
+    otherSet = currentSet;
+    currentSet = index;
+  }
+  std::cout << "Saved as " << session.set(index).name << std::endl;
+}
+
 void setParams(void *userdata, const OSVR_TimeValue * /*timestamp*/,
     const OSVR_ButtonReport *report)
 {
@@ -155,51 +303,46 @@ void setParams(void *userdata, const OSVR_TimeValue * /*timestamp*/,
     reinterpret_cast<OSVRDisplayConfiguration *>(userdata);
 
   if (report->state == 1) {
+    showCurrent(*displayConfiguration, fullMeshTriangles);
+    printParams();
+    if (useSession) { saveCurrent(*displayConfiguration); }
+  }
+}
+
+// Switch between the two sets being compared.
+void toggleSets(void *userdata, const OSVR_TimeValue * /*timestamp*/,
+  const OSVR_ButtonReport *report)
+{
+  OSVRDisplayConfiguration *displayConfiguration =
+    reinterpret_cast<OSVRDisplayConfiguration *>(userdata);
 
-    // Create a new set of distortion parameters that has the
-    // specified parameters, but using the center of projection
-    // from the read-in values.
-
-    // Get the original distortion correction
-    osvr::renderkit::DistortionParameters distortionLeft;
-    distortionLeft.m_desiredTriangles = 200 * 64;
-    std::vector<float> Ds;
-    Ds.push_back(1.0);
-    Ds.push_back(1.0);
-    distortionLeft.m_distortionD = Ds;
-    distortionLeft.m_distortionPolynomialRed = params;
-    distortionLeft.m_distortionPolynomialGreen = params;
-    distortionLeft.m_distortionPolynomialBlue = params;
-    distortionLeft.m_distortionCOP[0] =
-      static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjX);
-    distortionLeft.m_distortionCOP[1] =
-      static_cast<float>(displayConfiguration->getEyes()[0].m_CenterProjY);
+  if ((report->state == 1) && (otherSet >= 0)) {
+    std::swap(currentSet, otherSet);
+    showSet(*displayConfiguration, currentSet);
+  }
+}
 
-    osvr::renderkit::DistortionParameters distortionRight;
-    distortionRight = distortionLeft;
-    distortionRight.m_distortionCOP[0] =
-      static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjX);
-    distortionRight.m_distortionCOP[1] =
-      static_cast<float>(displayConfiguration->getEyes()[1].m_CenterProjY);
+// Step back and forward through the history.
+void prevSet(void *userdata, const OSVR_TimeValue * /*timestamp*/,
+  const OSVR_ButtonReport *report)
+{
+  OSVRDisplayConfiguration *displayConfiguration =
+    reinterpret_cast<OSVRDisplayConfiguration *>(userdata);
 
-    // Push the same distortion back for each eye.
-    std::vector<osvr::renderkit::DistortionParameters> distortionParams;
-    distortionParams.push_back(distortionLeft);
-    distortionParams.push_back(distortionRight);
-
-    // Send a new set of parameters to construct a distortion mesh.
-    render->UpdateDistortionMeshes(osvr::renderkit::DistortionMeshType::SQUARE,
-      distortionParams);
-
-    // Print the parameters to the console, so we can know what was set.
-    std::cout << "Params: ";
-    if (params.size() > 0) {
-      std::cout << params[0];
-    }
-    for (size_t i = 1; i < params.size(); i++) {
-      std::cout << ", " << params[i];
-    }
-    std::cout << std::endl;
+  if ((report->state == 1) && (session.size() > 0)) {
+    showSet(*displayConfiguration, std::max(currentSet - 1, 0));
+  }
+}
+
+void nextSet(void *userdata, const OSVR_TimeValue * /*timestamp*/,
+  const OSVR_ButtonReport *report)
+{
+  OSVRDisplayConfiguration *displayConfiguration =
+    reinterpret_cast<OSVRDisplayConfiguration *>(userdata);
+
+  if ((report->state == 1) && (session.size() > 0)) {
+    int last = static_cast<int>(session.size()) - 1;
+    showSet(*displayConfiguration, std::min(currentSet + 1, last));
   }
 }
 
@@ -231,8 +374,8 @@ bool SetupRendering(osvr::renderkit::GraphicsLibrary library)
   // Turn on depth testing, so we get correct ordering.
   glEnable(GL_DEPTH_TEST);
 
-  // Construct the quadric for the sphere primitive to draw to show spacing
-  sphere = gluNewQuadric();
+  // Construct the batch that draws all of the spheres used to show spacing
+  sphereBatch = new SphereBatch(10, 10);
 
   return true;
 }
@@ -337,20 +480,23 @@ void RenderView(
   // Draw the spheres in front of us, so we can see them.
   glTranslated(0, 0, 0.5);
 
-  // Draw a set of spheres at the specified locations in viewport space.
-  // They are offset so that (0,0) is at the center of projection for
-  // the eye.
-  glColor3d(1, 1, 1);
+  // Draw a set of white spheres at the specified locations in viewport
+  // space, all at once.  They are offset so that (0,0) is at the center of
+  // projection for the eye.
+  static std::vector<SphereBatch::Instance> instances;
+  instances.clear();
+  SphereBatch::Instance s = { 0, 0, 0.01f, { 1, 1, 1 } };
+  for (size_t i = 0; i < spheres.size(); i++) {
+    s.x = static_cast<float>(spheres[i].x);
+    s.y = static_cast<float>(spheres[i].y);
+    instances.push_back(s);
+  }
   double xCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjX;
   double yCOP = displayConfiguration.getEyes()[whichEye].m_CenterProjY;
   double xOffset = xCOP - 0.5;
   double yOffset = yCOP - 0.5;
-  for (size_t i = 0; i < spheres.size(); i++) {
-    glPushMatrix();
-    glTranslated(spheres[i].x + xOffset, spheres[i].y + yOffset, 0);
-    gluSphere(sphere, 0.01, 10, 10);
-    glPopMatrix();
-  }
+  sphereBatch->setInstances(instances);
+  sphereBatch->draw(xOffset, yOffset, 0);
 
   // Draw a set of horizontal and vertical lines
   glColor3d(0,0,0);
@@ -384,8 +530,164 @@ void RenderView(
 
 }
 
+// Draws the rendering of one eye from sceneTexture into colorBuffer
+// through the cached mesh of the current set, for RenderManager to
+// present with its identity distortion.  Both buffers cover the
+// overfilled viewport, so the screen and the rendering are each in the
+// middle of them.  Each set's vertices are uploaded the first time it
+// is drawn and kept; all sets share one index buffer.
+static void drawWarp(size_t whichEye, double overFill,
+  const osvr::renderkit::RenderInfo &renderInfo, GLuint frameBuffer,
+  GLuint colorBuffer, GLuint sceneTexture)
+{
+  const WarpMesh &mesh = session.set(currentSet).meshes[whichEye];
+  static GLuint indexBuffer = 0;
+  static GLsizei indexCount = 0;
+  static std::vector<GLuint> vertexBuffers;
+  if (indexBuffer == 0) {
+    std::vector<GLuint> indices;
+    for (GLuint r = 0; r < mesh.rows; r++) {
+      for (GLuint c = 0; c < mesh.cols; c++) {
+        GLuint a = r * (mesh.cols + 1) + c;
+        GLuint b = a + mesh.cols + 1;
+        indices.push_back(a);
+        indices.push_back(a + 1);
+        indices.push_back(b + 1);
+        indices.push_back(a);
+        indices.push_back(b + 1);
+        indices.push_back(b);
+      }
+    }
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+      indices.data(), GL_STATIC_DRAW);
+    indexCount = static_cast<GLsizei>(indices.size());
+  }
+  size_t key = 2 * currentSet + whichEye;
+  if (vertexBuffers.size() <= key) { vertexBuffers.resize(key + 1, 0); }
+  if (vertexBuffers[key] == 0) {
+    glGenBuffers(1, &vertexBuffers[key]);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[key]);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(GLfloat),
+      mesh.vertices.data(), GL_STATIC_DRAW);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+    colorBuffer, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+    GL_RENDERBUFFER, 0);
+  glViewport(0, 0,
+    static_cast<GLsizei>(renderInfo.viewport.width),
+    static_cast<GLsizei>(renderInfo.viewport.height));
+  glClearColor(0, 0, 0, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, sceneTexture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  gluOrtho2D(0.5 - overFill / 2, 0.5 + overFill / 2,
+    0.5 - overFill / 2, 0.5 + overFill / 2);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glMatrixMode(GL_TEXTURE);
+  glPushMatrix();
+  glLoadIdentity();
+  glTranslated(0.5, 0.5, 0);
+  glScaled(1 / overFill, 1 / overFill, 1);
+  glTranslated(-0.5, -0.5, 0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[key]);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), nullptr);
+  glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat),
+    reinterpret_cast<const GLvoid *>(2 * sizeof(GLfloat)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopClientAttrib();
+  glPopAttrib();
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-timing] (show frame timing)"
+    << " [-timing_csv file.csv] (also log frame timing)"
+    << " [-refresh_hz HZ] (display refresh rate for missed-vsync counts, default 60)"
+    << " [-session directory] (keep the parameter history there, default is not)"
+    << " [-export set_name|latest out.json] (write a set from the session as an"
+    << " OSVR display descriptor and exit)"
+    << std::endl;
+  exit(1);
+}
+
 int main(int argc, char *argv[])
 {
+    // Parse the command line
+    bool timing = false;
+    std::string timingFileName;
+    double refreshHz = 60;
+    std::string sessionDirectory;
+    std::string exportName, exportFileName;
+    for (int i = 1; i < argc; i++) {
+      if (std::string("-timing") == argv[i]) {
+        timing = true;
+      } else if (std::string("-timing_csv") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        timing = true;
+        timingFileName = argv[i];
+      } else if (std::string("-refresh_hz") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        refreshHz = atof(argv[i]);
+      } else if (std::string("-session") == argv[i]) {
+        if (++i >= argc) { Usage(argv[0]); }
+        sessionDirectory = argv[i];
+      } else if (std::string("-export") == argv[i]) {
+        if (i + 2 >= argc) { Usage(argv[0]); }
+        exportName = argv[++i];
+        exportFileName = argv[++i];
+      } else {
+        Usage(argv[0]);
+      }
+    }
+
+    // Read the parameter history, and export from it if asked to; that
+    // does not need the server or a display.
+    if (!sessionDirectory.empty()) {
+      if (!session.open(sessionDirectory, warpMeshCells, warpMeshCells)) {
+        return 5;
+      }
+      useSession = true;
+    }
+    if (!exportName.empty()) {
+      if (!useSession) {
+        std::cerr << "Error: -export needs -session" << std::endl;
+        Usage(argv[0]);
+      }
+      int index = (exportName == "latest") ?
+        static_cast<int>(session.size()) - 1 : session.find(exportName);
+      if (index < 0) {
+        std::cerr << "Error: No set " << exportName << " in "
+          << sessionDirectory << std::endl;
+        return 6;
+      }
+      return session.exportDisplayDescriptor(index, exportFileName) ? 0 : 7;
+    }
+
     // Open RenderManager and set up the context for rendering to
     // an HMD.  Do this using the OSVR RenderManager interface,
     // which maps to the nVidia or other vendor direct mode
@@ -460,6 +762,18 @@ int main(int argc, char *argv[])
       context.getInterface("/controller/6");
     button6.registerCallback(&nextParam, nullptr);
 
+    // With a session, "2" switches between the two sets being compared
+    // and "3" and "4" step back and forward through the history.
+    osvr::clientkit::Interface button2 =
+      context.getInterface("/controller/2");
+    button2.registerCallback(&toggleSets, &displayConfiguration);
+    osvr::clientkit::Interface button3 =
+      context.getInterface("/controller/3");
+    button3.registerCallback(&prevSet, &displayConfiguration);
+    osvr::clientkit::Interface button4 =
+      context.getInterface("/controller/4");
+    button4.registerCallback(&nextSet, &displayConfiguration);
+
     // Read the analog trigger, which will let us increase
     // or decrease our D parameters for distortion correction.
     osvr::clientkit::Interface analogTrigger =
@@ -490,6 +804,7 @@ int main(int argc, char *argv[])
     renderInfo = render->GetRenderInfo();
     std::vector<osvr::renderkit::RenderBuffer> colorBuffers;
     std::vector<GLuint> depthBuffers; //< Depth/stencil buffers to render into
+    std::vector<GLuint> sceneTextures; //< Rendering to warp for stored sets
 
     // Construct the buffers we're going to need for our render-to-texture
     // code.
@@ -546,6 +861,23 @@ int main(int argc, char *argv[])
         width,
         height);
       depthBuffers.push_back(depthrenderbuffer);
+
+      // Where the scene is rendered when a stored set is shown.  Outside
+      // the rendering is black.
+      GLuint sceneTexture = 0;
+      if (useSession) {
+        GLfloat black[4] = { 0, 0, 0, 1 };
+        glGenTextures(1, &sceneTexture);
+        glBindTexture(GL_TEXTURE_2D, sceneTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+          GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, black);
+      }
+      sceneTextures.push_back(sceneTexture);
     }
 
     // Register our constructed buffers so that we can use them for
@@ -587,13 +919,42 @@ int main(int argc, char *argv[])
     params.push_back(-1.27);
     params.push_back(-2.23);
 
+    // A session picks up where it left off, with the last set it saved.
+    if (useSession && (session.size() > 0)) {
+      currentSet = static_cast<int>(session.size()) - 1;
+      params = session.set(currentSet).params;
+    }
+
     // Keep track of time so we can scale UI analog adjustments
     // properly.
     std::chrono::time_point<std::chrono::system_clock> lastTime;
     lastTime = std::chrono::system_clock::now();
 
+    // Set while a preview mesh is being shown in place of the
+    // full-resolution one, along with when the trigger was last used.
+    bool previewing = false;
+    std::chrono::time_point<std::chrono::system_clock> lastAdjustTime = lastTime;
+
+    // Set up frame timing if it was asked for.
+    FrameTimer timer;
+    timer.setEnabled(timing);
+    timer.setRefreshRate(refreshHz);
+    if (!timingFileName.empty() && !timer.openLog(timingFileName)) {
+      delete render;
+      return 4;
+    }
+
+    // Show the set we started from through its cached mesh, without
+    // waiting for a full-resolution mesh to be built.
+    if (currentSet >= 0) {
+      showSet(displayConfiguration, currentSet);
+    }
+    double overFill = renderManagerConfig->getRenderOverfillFactor();
+
     // Continue rendering until it is time to quit.
     while (!quit) {
+        timer.beginFrame();
+
         // Update the context so we get our callbacks called and
         // update analog and button states.
         context.update();
@@ -617,25 +978,62 @@ int main(int argc, char *argv[])
             double changeScale = 1.0; pow(1.5, activeParam);
             params[activeParam] -= static_cast<float>(
               elapsed_sec.count() * triggerValue / (10 * changeScale));
+
+            // Show the change right away using a coarse mesh.
+            showCurrent(displayConfiguration, previewMeshTriangles);
+            previewing = true;
+            lastAdjustTime = now;
           }
         }
 
+        timer.endStage(FrameTimer::STAGE_UPDATE);
+
         renderInfo = render->GetRenderInfo();
+        timer.endStage(FrameTimer::STAGE_RENDER_INFO);
 
         // Render into each buffer using the specified information.
         for (size_t i = 0; i < renderInfo.size(); i++) {
-          RenderView(i, displayConfiguration, renderManagerConfig,
-            renderInfo[i], frameBuffer,
-            colorBuffers[i].OpenGL->colorBufferName,
-            depthBuffers[i],
-            spheres);
+          timer.beginGPU(i);
+          if (showingStored) {
+            RenderView(i, displayConfiguration, renderManagerConfig,
+              renderInfo[i], frameBuffer,
+              sceneTextures[i],
+              depthBuffers[i],
+              spheres);
+            drawWarp(i, overFill, renderInfo[i], frameBuffer,
+              colorBuffers[i].OpenGL->colorBufferName, sceneTextures[i]);
+          } else {
+            RenderView(i, displayConfiguration, renderManagerConfig,
+              renderInfo[i], frameBuffer,
+              colorBuffers[i].OpenGL->colorBufferName,
+              depthBuffers[i],
+              spheres);
+          }
+          timer.endGPU(i);
+          timer.drawOverlay();
         }
+        timer.endStage(FrameTimer::STAGE_RENDER);
 
         // Send the rendered results to the screen
         if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
           std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
           quit = true;
         }
+        timer.endStage(FrameTimer::STAGE_PRESENT);
+
+        // Once the trigger has been left alone for a bit, replace the
+        // preview mesh with a full-resolution one.  This is done right
+        // after presenting so the one slow frame it causes happens when
+        // nothing is changing.
+        if (previewing) {
+          std::chrono::duration<double> idle =
+            std::chrono::system_clock::now() - lastAdjustTime;
+          if (idle.count() >= settleSeconds) {
+            showCurrent(displayConfiguration, fullMeshTriangles);
+            printParams();
+            previewing = false;
+          }
+        }
     }
 
     // Clean up after ourselves.
@@ -644,8 +1042,11 @@ int main(int argc, char *argv[])
       glDeleteTextures(1, &colorBuffers[i].OpenGL->colorBufferName);
       delete colorBuffers[i].OpenGL;
       glDeleteRenderbuffers(1, &depthBuffers[i]);
+      if (sceneTextures[i] != 0) { glDeleteTextures(1, &sceneTextures[i]); }
     }
 
+    delete sphereBatch;
+
     // Close the Renderer interface cleanly.
     delete render;
 
@@ -0,0 +1,309 @@
+/** @file
+    @brief Implementation of the xbox tuner's parameter history.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "param_session.h"
+#include "point_transform.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static const char LIST_FILE[] = "session.txt";
+static const char MESH_MAGIC[8] = { 'X', 'B', 'O', 'X', 'W', 'A', 'R', 'P' };
+static const uint32_t MESH_VERSION = 1;
+
+// Farthest a screen corner can be from a center of projection that is
+// on the screen, in units of the distance scale.
+static const double MAX_SCREEN_RADIUS = 1.5;
+
+// Shortest text that reads back as the same float, so that the files
+// show the values as they were typed.
+static std::string float_text(float value)
+{
+  for (int digits = 6; ; digits++) {
+    std::ostringstream s;
+    s << std::setprecision(digits) << value;
+    if ((digits >= 9) || (strtof(s.str().c_str(), nullptr) == value)) {
+      return s.str();
+    }
+  }
+}
+
+bool build_warp_mesh(const std::vector<float> &params,
+  float copX, float copY, uint32_t cols, uint32_t rows, WarpMesh &mesh)
+{
+  RadialInverse radial;
+  std::vector<double> coefficients(params.begin(), params.end());
+  if ((cols < 1) || (rows < 1) ||
+      !radial.build(coefficients, MAX_SCREEN_RADIUS)) {
+    std::cerr << "build_warp_mesh(): Error: Cannot make a mesh for these"
+      << " parameters" << std::endl;
+    return false;
+  }
+
+  size_t n = static_cast<size_t>(cols + 1) * (rows + 1);
+  std::vector<float> x(n), y(n), u(n), v(n);
+  for (uint32_t r = 0; r <= rows; r++) {
+    for (uint32_t c = 0; c <= cols; c++) {
+      size_t i = static_cast<size_t>(r) * (cols + 1) + c;
+      x[i] = static_cast<float>(c) / cols;
+      y[i] = static_cast<float>(r) / rows;
+    }
+  }
+  radial.distortPoints(x.data(), y.data(), n, copX, copY, u.data(), v.data());
+
+  mesh.cols = cols;
+  mesh.rows = rows;
+  mesh.vertices.resize(4 * n);
+  for (size_t i = 0; i < n; i++) {
+    mesh.vertices[4 * i + 0] = x[i];
+    mesh.vertices[4 * i + 1] = y[i];
+    mesh.vertices[4 * i + 2] = u[i];
+    mesh.vertices[4 * i + 3] = v[i];
+  }
+  return true;
+}
+
+std::string ParamSession::path(const std::string &fileName) const
+{
+  if (d_directory.empty()) { return fileName; }
+  char last = d_directory[d_directory.size() - 1];
+  if ((last == '/') || (last == '\\')) { return d_directory + fileName; }
+  return d_directory + "/" + fileName;
+}
+
+bool ParamSession::buildMeshes(ParamSet &set) const
+{
+  for (int eye = 0; eye < 2; eye++) {
+    if (!build_warp_mesh(set.params, set.cop[eye][0], set.cop[eye][1],
+          d_cols, d_rows, set.meshes[eye])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParamSession::open(const std::string &directory, uint32_t cols, uint32_t rows)
+{
+  d_directory = directory;
+  d_cols = cols;
+  d_rows = rows;
+  d_sets.clear();
+
+  std::ifstream in(path(LIST_FILE).c_str());
+  if (!in.good()) { return true; }
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(in, line)) {
+    lineNumber++;
+    std::istringstream s(line);
+    ParamSet set;
+    if (!(s >> set.name) || (set.name[0] == '#')) { continue; }
+    size_t count = 0;
+    s >> set.cop[0][0] >> set.cop[0][1] >> set.cop[1][0] >> set.cop[1][1] >> count;
+    set.params.resize(count);
+    for (size_t i = 0; i < count; i++) { s >> set.params[i]; }
+    if (s.fail()) {
+      std::cerr << "ParamSession::open(): Error: Bad entry on line "
+        << lineNumber << " of " << path(LIST_FILE) << std::endl;
+      return false;
+    }
+
+    // Rebuild the cache if it is missing or was made from something else.
+    if (!readMeshes(set)) {
+      if (!buildMeshes(set) || !writeMeshes(set)) { return false; }
+    }
+    d_sets.push_back(set);
+  }
+  return true;
+}
+
+int ParamSession::find(const std::string &name) const
+{
+  for (size_t i = 0; i < d_sets.size(); i++) {
+    if (d_sets[i].name == name) { return static_cast<int>(i); }
+  }
+  return -1;
+}
+
+int ParamSession::add(const std::vector<float> &params, const float cop[2][2])
+{
+  if (!d_sets.empty()) {
+    const ParamSet &last = d_sets.back();
+    if ((last.params == params) &&
+        (memcmp(last.cop, cop, sizeof(last.cop)) == 0)) {
+      return static_cast<int>(d_sets.size()) - 1;
+    }
+  }
+
+  ParamSet set;
+  set.params = params;
+  memcpy(set.cop, cop, sizeof(set.cop));
+  for (size_t number = d_sets.size() + 1; ; number++) {
+    std::ostringstream name;
+    name << "set_" << std::setw(3) << std::setfill('0') << number;
+    if (find(name.str()) < 0) {
+      set.name = name.str();
+      break;
+    }
+  }
+  if (!buildMeshes(set) || !writeMeshes(set)) { return -1; }
+  d_sets.push_back(set);
+  if (!writeList()) {
+    d_sets.pop_back();
+    return -1;
+  }
+  return static_cast<int>(d_sets.size()) - 1;
+}
+
+bool ParamSession::writeList() const
+{
+  std::ofstream out(path(LIST_FILE).c_str());
+  if (!out.good()) {
+    std::cerr << "ParamSession: Error: Could not write " << path(LIST_FILE)
+      << std::endl;
+    return false;
+  }
+  out << "# Distortion parameter history, oldest first\n"
+    << "# name cop_left_x cop_left_y cop_right_x cop_right_y count params...\n";
+  for (size_t i = 0; i < d_sets.size(); i++) {
+    const ParamSet &set = d_sets[i];
+    out << set.name << " " << float_text(set.cop[0][0])
+      << " " << float_text(set.cop[0][1])
+      << " " << float_text(set.cop[1][0])
+      << " " << float_text(set.cop[1][1])
+      << " " << set.params.size();
+    for (size_t p = 0; p < set.params.size(); p++) {
+      out << " " << float_text(set.params[p]);
+    }
+    out << "\n";
+  }
+  out.close();
+  if (out.fail()) {
+    std::cerr << "ParamSession: Error: Could not finish writing "
+      << path(LIST_FILE) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ParamSession::writeMeshes(const ParamSet &set) const
+{
+  std::string fileName = path(set.name + ".warp");
+  std::ofstream out(fileName.c_str(), std::ios::binary);
+  uint32_t header[4] = { MESH_VERSION, d_cols, d_rows,
+    static_cast<uint32_t>(set.params.size()) };
+  out.write(MESH_MAGIC, sizeof(MESH_MAGIC));
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(set.params.data()),
+    set.params.size() * sizeof(float));
+  out.write(reinterpret_cast<const char *>(set.cop), sizeof(set.cop));
+  for (int eye = 0; eye < 2; eye++) {
+    out.write(reinterpret_cast<const char *>(set.meshes[eye].vertices.data()),
+      set.meshes[eye].vertices.size() * sizeof(float));
+  }
+  out.close();
+  if (out.fail()) {
+    std::cerr << "ParamSession: Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool ParamSession::readMeshes(ParamSet &set) const
+{
+  std::ifstream in(path(set.name + ".warp").c_str(), std::ios::binary);
+  char magic[sizeof(MESH_MAGIC)];
+  uint32_t header[4];
+  if (!in.read(magic, sizeof(magic)) ||
+      (memcmp(magic, MESH_MAGIC, sizeof(magic)) != 0) ||
+      !in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      (header[0] != MESH_VERSION) || (header[1] != d_cols) ||
+      (header[2] != d_rows) || (header[3] != set.params.size())) {
+    return false;
+  }
+  std::vector<float> params(set.params.size());
+  float cop[2][2];
+  in.read(reinterpret_cast<char *>(params.data()), params.size() * sizeof(float));
+  in.read(reinterpret_cast<char *>(cop), sizeof(cop));
+  if (!in || (params != set.params) || (memcmp(cop, set.cop, sizeof(cop)) != 0)) {
+    return false;
+  }
+  size_t n = static_cast<size_t>(d_cols + 1) * (d_rows + 1);
+  for (int eye = 0; eye < 2; eye++) {
+    WarpMesh &mesh = set.meshes[eye];
+    mesh.cols = d_cols;
+    mesh.rows = d_rows;
+    mesh.vertices.resize(4 * n);
+    if (!in.read(reinterpret_cast<char *>(mesh.vertices.data()),
+          mesh.vertices.size() * sizeof(float))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParamSession::exportDisplayDescriptor(size_t i, const std::string &fileName) const
+{
+  const ParamSet &set = d_sets[i];
+  std::ostringstream coeffs;
+  coeffs << "[ ";
+  for (size_t p = 0; p < set.params.size(); p++) {
+    coeffs << (p > 0 ? ", " : "") << float_text(set.params[p]);
+  }
+  coeffs << " ]";
+
+  std::ofstream out(fileName.c_str());
+  out << "{\n";
+  out << " \"display\": {\n";
+  out << "  \"hmd\": {\n";
+  out << "   \"distortion\": {\n";
+  out << "    \"distance_scale_x\": 1,\n";
+  out << "    \"distance_scale_y\": 1,\n";
+  out << "    \"polynomial_coeffs_red\": " << coeffs.str() << ",\n";
+  out << "    \"polynomial_coeffs_green\": " << coeffs.str() << ",\n";
+  out << "    \"polynomial_coeffs_blue\": " << coeffs.str() << "\n";
+  out << "   },\n"; // distortion
+  out << "   \"eyes\": [\n";
+  for (int eye = 0; eye < 2; eye++) {
+    out << "    {\n";
+    out << "     \"center_proj_x\": " << float_text(set.cop[eye][0]) << ",\n";
+    out << "     \"center_proj_y\": " << float_text(set.cop[eye][1]) << ",\n";
+    out << "     \"rotate_180\": 0\n";
+    out << "    }" << (eye == 0 ? "," : "") << "\n";
+  }
+  out << "   ]\n"; // eyes
+  out << "  }\n"; // hmd
+  out << " }\n"; // display
+  out << "}\n";
+  out.close();
+  if (out.fail()) {
+    std::cerr << "ParamSession: Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,106 @@
+/** @file
+    @brief On-disk history of distortion parameter sets for the xbox
+           tuner, each with the warp mesh generated from it.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Mesh that warps one eye's undistorted rendering onto its screen the
+/// way RenderManager's rgb_symmetric_polynomials distortion does with
+/// distance scales of 1: the screen point p shows the rendering at
+///    cop + f(r) / r (p - cop),  r = |p - cop|
+/// where f is the polynomial.  The vertices are on a (cols + 1) by
+/// (rows + 1) grid covering the screen from (0, 0) to (1, 1), in rows
+/// from the bottom, each as x, y on the screen followed by u, v in the
+/// rendering, all in normalized eye-viewport units.
+struct WarpMesh {
+  uint32_t cols = 0;
+  uint32_t rows = 0;
+  std::vector<float> vertices;        //!< 4 floats per vertex
+
+  size_t numVertices() const { return vertices.size() / 4; }
+};
+
+/// Fills in the mesh for the polynomial about the center of projection.
+///   @return false (with a message on std::cerr) if the polynomial does
+/// not increase away from the center.
+extern bool build_warp_mesh(const std::vector<float> &params,
+  float copX, float copY, uint32_t cols, uint32_t rows, WarpMesh &mesh);
+
+/// One parameter set in the history.
+struct ParamSet {
+  std::string name;                   //!< Also the base name of its mesh file
+  std::vector<float> params;
+  float cop[2][2];                    //!< X and Y center of projection per eye
+  WarpMesh meshes[2];                 //!< Left and right eye
+};
+
+/// History of the parameter sets that were tried, kept in a directory.
+/// The list is a text file, session.txt, with one set per line:
+///    name cop_left_x cop_left_y cop_right_x cop_right_y count params...
+/// Each set's meshes are cached next to it in name.warp, a binary file
+/// in the machine's byte order that starts with the parameters it was
+/// made from, so that a stale or missing cache is rebuilt on open().
+class ParamSession {
+public:
+  /// Reads the list in the directory, which must already exist, and the
+  /// meshes of each set, making meshes of the specified size where they
+  /// are missing or out of date.  A directory without a list starts an
+  /// empty session.
+  ///   @return false (with a message on std::cerr) on error.
+  bool open(const std::string &directory, uint32_t cols, uint32_t rows);
+
+  /// Adds a set to the end of the history, builds and writes its meshes
+  /// and rewrites the list.  A set that is the same as the last one is
+  /// not added again.
+  ///   @return The index of the set, or -1 (with a message on std::cerr)
+  /// on error.
+  int add(const std::vector<float> &params, const float cop[2][2]);
+
+  size_t size() const { return d_sets.size(); }
+  const ParamSet &set(size_t i) const { return d_sets[i]; }
+
+  /// @return The index of the named set, or -1 if there is none.
+  int find(const std::string &name) const;
+
+  /// Writes the set as the distortion and eyes sections of an OSVR
+  /// display descriptor, the way the server's display files hold them.
+  ///   @return false (with a message on std::cerr) on error.
+  bool exportDisplayDescriptor(size_t i, const std::string &fileName) const;
+
+private:
+  std::string path(const std::string &fileName) const;
+  bool buildMeshes(ParamSet &set) const;
+  bool writeList() const;
+  bool writeMeshes(const ParamSet &set) const;
+  bool readMeshes(ParamSet &set) const;
+
+  std::string d_directory;
+  uint32_t d_cols = 0;
+  uint32_t d_rows = 0;
+  std::vector<ParamSet> d_sets;
+};
@@ -32,7 +32,21 @@
 #include <fstream>
 #include <cmath>
 #include <vector>
+#include <sstream>
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
 #include <stdlib.h> // For exit()
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+#endif
 
 // Global constants and variables
 static bool g_verbose = false;
@@ -42,34 +56,44 @@ static int testAlgorithms();
 
 #include "types.h"
 #include "helper.h"
+#include "threads.h"
+#include "json_writer.h"
+#include "mesh_io.h"
+#include "mesh_interpolator.h"
+#include "lut_export.h"
+#include "profiler.h"
 
-static void writeMesh(std::ostream &s, MeshDescription const &mesh)
-{
-  s << "[" << std::endl;
-  for (size_t i = 0; i < mesh.size(); i++) {
-    if (i == 0) { s << " "; }
-    else { s << ","; }
-    s << std::setprecision(4)
-      << "[ [" << mesh[i][0][0] << "," << mesh[i][0][1] << "], ["
-      << mesh[i][1][0] << "," << mesh[i][1][1] << "] ]"
-      << std::endl;
-  }
-  s << "]" << std::endl;
-}
-
-// Produce a mapping that is reflected around X=0 in both angles and
-// screen coordinates.
-static std::vector<Mapping> reflect_mapping(std::vector<Mapping> mapping)
-{
-  std::vector<Mapping> ret;
-  for (size_t i = 0; i < mapping.size(); i++) {
-    ret.push_back(mapping[i]);
-    ret[i].xyLatLong.longitude *= -1;
-    ret[i].xyLatLong.x *= -1;
-  }
-
-  return ret;
-}
+// Settings for one run of the pipeline, filled in from the command line
+// or from one line of a batch list.
+struct Options {
+  std::vector<std::string> inputFileNames;
+  bool useRightEye = true;
+  bool computeBounds = true;
+  bool useFieldAngles = true;
+  bool verifyAngles = false;
+  bool verbose = false;
+  double xx = 0, xy = 0, yx = 0, yy = 0;
+  double maxAngleDiffDegrees = 0;
+  double outlierK = 0;                 //!< Used when outlierPasses > 0
+  unsigned outlierPasses = 0;          //!< Zero means no local-fit filter
+  double left = 0, right = 0, bottom = 0, top = 0;
+  double depth = 2.0;
+  double toMeters = 1.0;
+  int meshPrecision = 4;
+  size_t gridCols = 0, gridRows = 0;   //!< Zero means no resampling
+  double adaptiveTolerance = 0;        //!< Used when adaptivePoints > 0
+  size_t adaptivePoints = 0;           //!< Zero means no adaptive resampling
+  size_t lutWidth = 0, lutHeight = 0;  //!< Zero means no lookup textures
+  std::string lutPrefix;
+  LutFormat lutFormat = LUT_PFM;
+  unsigned threads = TaskPool::default_thread_count();
+  size_t streamTile = 0;               //!< Zero means read whole tables
+  std::string outputFileName;
+  std::string binaryFileName;
+  std::string batchFileName;
+  bool watch = false;
+  std::string profileFileName;         //!< Empty means no profiling
+};
 
 void Usage(std::string name)
 {
@@ -85,8 +109,29 @@ void Usage(std::string name)
     << "   The vector (xx, xy) points in screen space in the direction of +longitude (left)"
     << "   The vector (yx, yy) points in screen space in the direction of +latitude (up)"
     << "   The max_degrees tells how far the screen-space neighbor vector can differ from it corresponding angle-space vector"
+    << " [-fit_outliers k passes] (remove points more than k deviations from a local"
+    << " fit to their neighbors, in up to passes passes, default is not)"
     << " [-mono in_config_mono_file_name ] (default standard input)"
     << " [-rgb in_config_red_file_name in_config_green_file_name in_config_blue_file_name]"
+    << " [-precision N] (significant digits in mesh coordinates, default 4)"
+    << " [-grid cols rows] (resample each mesh onto a regular grid, default is not)"
+    << " [-adaptive tolerance max_points] (resample each mesh densely only where it"
+    << " bends more than tolerance, default is not)"
+    << " [-lut width height file_prefix] (also bake lookup textures, default is not)"
+    << " [-lut_format pfm|rg32f|rg16f] (default pfm)"
+    << " [-o out_file_name] (default standard output)"
+    << " [-binary out_dmesh_file_name] (also write the meshes in binary form)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-stream entries_per_tile] (read the input files a tile at a time"
+    << " to bound memory use, default is to read them whole)"
+    << " [-profile out_trace_file_name] (print the time spent in each stage"
+    << " and write a Chrome trace of them, for the whole run)"
+    << " [-watch] (keep running, rewriting the output whenever an input file changes)"
+    << " [-batch list_file_name]"
+    << "   Each non-empty line of the list that does not start with # is"
+    << "   output_file_name followed by options (including -mono or -rgb) for that job;"
+    << "   options given on the command line apply to every job, except -binary"
+    << "   and -lut, which each line must name for itself"
     << std::endl
     << "  This program reads one or three configurations with lists of" << std::endl
     << "x,y screen coordinates in meters followed by long,lat angles in" << std::endl
@@ -95,140 +140,421 @@ void Usage(std::string name)
     << "  A single color from standard input is the default, input files" << std::endl
     << "can be optionally specified." << std::endl
     << "  It produces on standard output a partial OSVR display configuration file." << std::endl
+    << "  In batch mode, it instead writes one file per job in the list." << std::endl
     << std::endl;
   exit(1);
 }
 
-int main(int argc, char *argv[])
+// Advances i to the next argument and converts it to a number,
+// printing a message and returning false if there isn't one.
+static bool nextNumber(const std::vector<std::string> &args, size_t &i, double &value)
 {
-  // Parse the command line
-  std::vector<std::string> inputFileNames;
-  bool useRightEye = true;
-  bool computeBounds = true;
-  bool useFieldAngles = true;
-  bool verifyAngles = false;
-  double xx, xy, yx, yy;
-  double maxAngleDiffDegrees;
-  double left, right, bottom, top;
-  double depth = 2.0;
-  double toMeters = 1.0;
-  int realParams = 0;
-  for (int i = 1; i < argc; i++) {
-    if (std::string("-mm") == argv[i]) {
-      toMeters = 1e-3;  // Convert input in millimeters to meters
-    } else if (std::string("-verbose") == argv[i]) {
-      g_verbose = true;
-    } else if (std::string("-latlong") == argv[i]) {
-      useFieldAngles = false;
-    } else if (std::string("-depth_meters") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      depth = atof(argv[i]);
-    } else if (std::string("-mono") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-    } else if (std::string("-rgb") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      inputFileNames.push_back(argv[i]);
-    } else if (std::string("-screen") == argv[i]) {
-      computeBounds = false;
-      if (++i >= argc) { Usage(argv[0]); }
-      left = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      bottom = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      right = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      top = atof(argv[i]);
-    } else if (std::string("-eye") == argv[i]) {
-      if (++i >= argc) { Usage(argv[0]); }
-      std::string eye = argv[i];
+  if (++i >= args.size()) {
+    std::cerr << "Error: Missing value after " << args[i - 1] << std::endl;
+    return false;
+  }
+  value = atof(args[i].c_str());
+  return true;
+}
+
+// Parses the options in args into opt, leaving values that are not
+// mentioned unchanged.  Prints a message and returns false if there is
+// a problem with the arguments.
+static bool parseOptions(const std::vector<std::string> &args, Options &opt)
+{
+  for (size_t i = 0; i < args.size(); i++) {
+    if ("-mm" == args[i]) {
+      opt.toMeters = 1e-3;  // Convert input in millimeters to meters
+    } else if ("-verbose" == args[i]) {
+      opt.verbose = true;
+    } else if ("-latlong" == args[i]) {
+      opt.useFieldAngles = false;
+    } else if ("-threads" == args[i]) {
+      double n;
+      if (!nextNumber(args, i, n)) { return false; }
+      if (n < 1) {
+        std::cerr << "Bad value for -threads: " << args[i] << ", expected a positive integer" << std::endl;
+        return false;
+      }
+      opt.threads = static_cast<unsigned>(n);
+    } else if ("-precision" == args[i]) {
+      double n;
+      if (!nextNumber(args, i, n)) { return false; }
+      if ((n < 1) || (n > 17)) {
+        std::cerr << "Bad value for -precision: " << args[i] << ", expected 1 through 17" << std::endl;
+        return false;
+      }
+      opt.meshPrecision = static_cast<int>(n);
+    } else if ("-grid" == args[i]) {
+      double cols, rows;
+      if (!nextNumber(args, i, cols)) { return false; }
+      if (!nextNumber(args, i, rows)) { return false; }
+      if ((cols < 2) || (rows < 2)) {
+        std::cerr << "Bad value for -grid: " << cols << " x " << rows
+          << ", expected at least 2 x 2" << std::endl;
+        return false;
+      }
+      opt.gridCols = static_cast<size_t>(cols);
+      opt.gridRows = static_cast<size_t>(rows);
+      opt.adaptivePoints = 0;
+    } else if ("-adaptive" == args[i]) {
+      double tolerance, points;
+      if (!nextNumber(args, i, tolerance)) { return false; }
+      if (!nextNumber(args, i, points)) { return false; }
+      if ((tolerance <= 0) || (points < 25)) {
+        std::cerr << "Bad value for -adaptive: " << tolerance << " " << points
+          << ", expected a positive tolerance and at least 25 points" << std::endl;
+        return false;
+      }
+      opt.adaptiveTolerance = tolerance;
+      opt.adaptivePoints = static_cast<size_t>(points);
+      opt.gridCols = opt.gridRows = 0;
+    } else if ("-lut" == args[i]) {
+      double width, height;
+      if (!nextNumber(args, i, width)) { return false; }
+      if (!nextNumber(args, i, height)) { return false; }
+      if ((width < 1) || (height < 1)) {
+        std::cerr << "Bad value for -lut: " << width << " x " << height
+          << ", expected at least 1 x 1" << std::endl;
+        return false;
+      }
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing file prefix after -lut" << std::endl;
+        return false;
+      }
+      opt.lutWidth = static_cast<size_t>(width);
+      opt.lutHeight = static_cast<size_t>(height);
+      opt.lutPrefix = args[i];
+    } else if ("-lut_format" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing value after -lut_format" << std::endl;
+        return false;
+      }
+      if (args[i] == "pfm") {
+        opt.lutFormat = LUT_PFM;
+      } else if (args[i] == "rg32f") {
+        opt.lutFormat = LUT_RG32F;
+      } else if (args[i] == "rg16f") {
+        opt.lutFormat = LUT_RG16F;
+      } else {
+        std::cerr << "Bad value for -lut_format: " << args[i]
+          << ", expected pfm, rg32f or rg16f" << std::endl;
+        return false;
+      }
+    } else if ("-o" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing file name after -o" << std::endl;
+        return false;
+      }
+      opt.outputFileName = args[i];
+    } else if ("-binary" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing file name after -binary" << std::endl;
+        return false;
+      }
+      opt.binaryFileName = args[i];
+    } else if ("-stream" == args[i]) {
+      double n;
+      if (!nextNumber(args, i, n)) { return false; }
+      if (n < 1) {
+        std::cerr << "Bad value for -stream: " << n
+          << ", expected at least 1 entry per tile" << std::endl;
+        return false;
+      }
+      opt.streamTile = static_cast<size_t>(n);
+    } else if ("-watch" == args[i]) {
+      opt.watch = true;
+    } else if ("-profile" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing value after -profile" << std::endl;
+        return false;
+      }
+      opt.profileFileName = args[i];
+    } else if ("-batch" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing value after -batch" << std::endl;
+        return false;
+      }
+      opt.batchFileName = args[i];
+    } else if ("-depth_meters" == args[i]) {
+      if (!nextNumber(args, i, opt.depth)) { return false; }
+    } else if ("-mono" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing file name after -mono" << std::endl;
+        return false;
+      }
+      opt.inputFileNames.clear();
+      opt.inputFileNames.push_back(args[i]);
+    } else if ("-rgb" == args[i]) {
+      if (i + 3 >= args.size()) {
+        std::cerr << "Error: Expected three file names after -rgb" << std::endl;
+        return false;
+      }
+      opt.inputFileNames.clear();
+      opt.inputFileNames.push_back(args[++i]);
+      opt.inputFileNames.push_back(args[++i]);
+      opt.inputFileNames.push_back(args[++i]);
+    } else if ("-screen" == args[i]) {
+      opt.computeBounds = false;
+      if (!nextNumber(args, i, opt.left)) { return false; }
+      if (!nextNumber(args, i, opt.bottom)) { return false; }
+      if (!nextNumber(args, i, opt.right)) { return false; }
+      if (!nextNumber(args, i, opt.top)) { return false; }
+    } else if ("-eye" == args[i]) {
+      if (++i >= args.size()) {
+        std::cerr << "Error: Missing value after -eye" << std::endl;
+        return false;
+      }
+      const std::string &eye = args[i];
       if (eye == "left") {
-        useRightEye = false;
+        opt.useRightEye = false;
       } else if (eye == "right") {
-        useRightEye = true;
+        opt.useRightEye = true;
       } else {
         std::cerr << "Bad value for -eye: " << eye << ", expected left or right" << std::endl;
-        Usage(argv[0]);
-      }
-    } else if (std::string("-verify_angles") == argv[i]) {
-      verifyAngles = true;
-      if (++i >= argc) { Usage(argv[0]); }
-      xx = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      xy = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      yx = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      yy = atof(argv[i]);
-      if (++i >= argc) { Usage(argv[0]); }
-      maxAngleDiffDegrees = atof(argv[i]);
-    }
-    else if ((argv[i][0] == '-') && (atof(argv[i]) == 0.0)) {
-      Usage(argv[0]);
-    }
-    else switch (++realParams) {
-    case 1:
-    default:
+        return false;
+      }
+    } else if ("-verify_angles" == args[i]) {
+      opt.verifyAngles = true;
+      if (!nextNumber(args, i, opt.xx)) { return false; }
+      if (!nextNumber(args, i, opt.xy)) { return false; }
+      if (!nextNumber(args, i, opt.yx)) { return false; }
+      if (!nextNumber(args, i, opt.yy)) { return false; }
+      if (!nextNumber(args, i, opt.maxAngleDiffDegrees)) { return false; }
+    } else if ("-fit_outliers" == args[i]) {
+      double k, passes;
+      if (!nextNumber(args, i, k)) { return false; }
+      if (!nextNumber(args, i, passes)) { return false; }
+      if ((k <= 0) || (passes < 1)) {
+        std::cerr << "Bad value for -fit_outliers: " << k << " " << passes
+          << ", expected a positive k and at least 1 pass" << std::endl;
+        return false;
+      }
+      opt.outlierK = k;
+      opt.outlierPasses = static_cast<unsigned>(passes);
+    } else if ((args[i][0] == '-') && (atof(args[i].c_str()) == 0.0)) {
+      std::cerr << "Error: Unrecognized option " << args[i] << std::endl;
+      return false;
+    } else {
       std::cerr << "Error: Expected no non-flag parameters, got "
-        << argv[i] << std::endl;
-      Usage(argv[0]);
+        << args[i] << std::endl;
+      return false;
     }
   }
-  if (realParams != 0) { Usage(argv[0]); }
+  return true;
+}
 
-  //====================================================================
-  // Run our algorithm test to make sure things are working properly.
-  int ret;
-  if ((ret = testAlgorithms()) != 0) {
-    std::cerr << "Error testing basic algorithms, code " << ret << std::endl;
-    return 100;
+// What runJob() keeps from one run of a job to the next, so that -watch
+// only redoes the work for the colors whose files changed.  A new state
+// holds nothing and has runJob() do everything.
+struct JobState {
+  /// Read and filtered entries for each color.
+  std::vector< std::vector<Mapping> > mappings;
+  /// Colors whose files are to be read again; empty means all of them.
+  std::vector<char> changed;
+  /// Converted entries for all colors, as findScreen() uses them, with
+  /// color i starting at offsets[i], and the bounds they were made with.
+  MappingSet leftFullMapping, rightFullMapping;
+  std::vector<size_t> offsets;
+  double left = 0, bottom = 0, right = 0, top = 0;
+  bool converted = false;
+  /// The results that are written out.
+  ScreenDescription leftScreen{}, rightScreen{};
+  std::vector<MeshDescription> leftMeshes, rightMeshes;
+};
+
+// Copies count entries of one set into another.
+static void copyMappings(const MappingSet &from, size_t fromOffset,
+  MappingSet &to, size_t toOffset, size_t count)
+{
+  std::vector<double> MappingSet::*fields[] = { &MappingSet::x,
+    &MappingSet::y, &MappingSet::latitude, &MappingSet::longitude,
+    &MappingSet::px, &MappingSet::py, &MappingSet::pz };
+  for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+    const std::vector<double> &src = from.*fields[f];
+    std::copy(src.begin() + fromOffset, src.begin() + fromOffset + count,
+      (to.*fields[f]).begin() + toOffset);
   }
+}
+
+static bool sameScreen(const ScreenDescription &a, const ScreenDescription &b)
+{
+  return (a.hFOVDegrees == b.hFOVDegrees) && (a.vFOVDegrees == b.vFOVDegrees) &&
+    (a.overlapPercent == b.overlapPercent) && (a.xCOP == b.xCOP) &&
+    (a.yCOP == b.yCOP) && (a.A == b.A) && (a.B == b.B) && (a.C == b.C) &&
+    (a.D == b.D) && (a.maxY == b.maxY) &&
+    (a.screenLeft.x == b.screenLeft.x) && (a.screenLeft.y == b.screenLeft.y) &&
+    (a.screenLeft.z == b.screenLeft.z) && (a.screenRight.x == b.screenRight.x) &&
+    (a.screenRight.y == b.screenRight.y) && (a.screenRight.z == b.screenRight.z);
+}
+
+// Writes a file next to the one named and then moves it into place, so
+// that a program reading the file never sees part of it.  Where rename()
+// will not replace a file, the old one is removed first.
+static bool replaceFile(const std::string &tempName, const std::string &fileName)
+{
+  if ((rename(tempName.c_str(), fileName.c_str()) != 0) &&
+      ((remove(fileName.c_str()) != 0) ||
+       (rename(tempName.c_str(), fileName.c_str()) != 0))) {
+    std::cerr << "Error: Could not replace " << fileName << " with "
+      << tempName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// The parts of the Json display description around the meshes, shared
+// by runJob() and runStreamedJob().  writeJsonStart() writes everything
+// up to the first color's array of meshes, and writeJsonEnd() everything
+// after the last one.  Between them, each color's array holds its left
+// and then its right mesh.
+static void writeJsonStart(JsonWriter &out, const ScreenDescription &rightScreen,
+  size_t numColors)
+{
+  out << "{\n";
+  out << " \"display\": {\n";
+  out << "  \"hmd\": {\n";
+
+  out << "   \"field_of_view\": {\n";
+  out << "    \"monocular_horizontal\": "
+    << rightScreen.hFOVDegrees
+    << ",\n";
+  out << "    \"monocular_vertical\": "
+    << rightScreen.vFOVDegrees
+    << ",\n";
+  out << "    \"overlap_percent\": "
+    << rightScreen.overlapPercent
+    << ",\n";
+  out << "    \"pitch_tilt\": 0\n";
+  out << "   },\n"; // field_of_view
+
+  out << "   \"distortion\": {\n";
+  if (numColors == 1) {
+    out << "    \"type\": \"mono_point_samples\",\n";
+  } else {
+    out << "    \"type\": \"rgb_point_samples\",\n";
+  }
+}
+
+static const char *meshArrayName(size_t numColors, size_t color)
+{
+  static const char *rgbNames[] = {
+    "red_point_samples", "green_point_samples", "blue_point_samples" };
+  return (numColors == 1) ? "mono_point_samples" : rgbNames[color];
+}
+
+static void writeJsonEnd(JsonWriter &out, const ScreenDescription &leftScreen,
+  const ScreenDescription &rightScreen)
+{
+  out << "   },\n"; // distortion
+
+  // The centers of projection are written with four significant
+  // digits, as they always have been.
+  out.setPrecision(4);
+  out << "   \"eyes\": [\n";
+  out << "    {\n";
+  out << "     \"center_proj_x\": "
+    << leftScreen.xCOP
+    << ",\n";
+  out << "     \"center_proj_y\": "
+    << leftScreen.yCOP
+    << ",\n";
+  out << "     \"rotate_180\": 0\n";
+  out << "    },\n";
+  out << "    {\n";
+  out << "     \"center_proj_x\": "
+    << rightScreen.xCOP
+    << ",\n";
+  out << "     \"center_proj_y\": "
+    << rightScreen.yCOP
+    << ",\n";
+  out << "     \"rotate_180\": 0\n";
+  out << "    }\n";
+  out << "   ]\n"; // eyes
+
+  out << "  }\n";  // hmd
+  out << " }\n";   // display
+  out << "}\n";    // Closes outer object
+}
+
+// Names the color, or the eye and color, that a -profile stage handled.
+static std::string colorDetail(size_t color)
+{
+  return "mesh " + std::to_string(color);
+}
+
+static std::string eyeDetail(bool left, size_t color)
+{
+  return (left ? "left mesh " : "right mesh ") + std::to_string(color);
+}
+
+// Runs the pipeline for one set of options, writing the configuration
+// to the output file or to standard output.  The work for colors that
+// have not changed since the last run with the same state is skipped.
+// Returns 0 on success and the program's exit code on failure.
+static int runJob(const Options &opt, TaskPool &pool, JobState &state)
+{
+  ProfileScope profileJob("job", opt.outputFileName);
+  std::vector<std::string> inputFileNames = opt.inputFileNames;
+  bool useRightEye = opt.useRightEye;
+  bool computeBounds = opt.computeBounds;
+  bool useFieldAngles = opt.useFieldAngles;
+  bool verifyAngles = opt.verifyAngles;
+  bool verbose = opt.verbose;
+  double xx = opt.xx, xy = opt.xy, yx = opt.yx, yy = opt.yy;
+  double maxAngleDiffDegrees = opt.maxAngleDiffDegrees;
+  double left = opt.left, right = opt.right, bottom = opt.bottom, top = opt.top;
+  double depth = opt.depth;
+  double toMeters = opt.toMeters;
 
   //====================================================================
   // The output screens and meshes.  There is one mesh per color, so one
   // for mono and three for RGB.
-  ScreenDescription leftScreen, rightScreen;
-  std::vector<MeshDescription> leftMeshes, rightMeshes;
+  ScreenDescription &leftScreen = state.leftScreen;
+  ScreenDescription &rightScreen = state.rightScreen;
+  std::vector<MeshDescription> &leftMeshes = state.leftMeshes;
+  std::vector<MeshDescription> &rightMeshes = state.rightMeshes;
 
   //====================================================================
   // Parse the angle-configuration information from standard or from the set
   // of input files specified.  Expect white-space separation between numbers
-  // and also between entries (which may be on separate lines).
-  std::vector<std::istream *> inFiles;
+  // and also between entries (which may be on separate lines).  Only the
+  // colors that changed are read again.
+  std::vector< std::vector<Mapping> > &mappings = state.mappings;
+  size_t numColors = std::max(inputFileNames.size(), static_cast<size_t>(1));
+  std::vector<char> &changed = state.changed;
+  if (changed.size() != numColors) { changed.assign(numColors, 1); }
+  mappings.resize(numColors);
   if (inputFileNames.size() == 0) {
-    inFiles.push_back(&std::cin);
     inputFileNames.push_back("standard input");
+    ProfileScope profile("read", inputFileNames[0]);
+    mappings[0] = read_from_infile(std::cin);
+    profile.count("points", static_cast<double>(mappings[0].size()));
   } else {
     for (size_t i = 0; i < inputFileNames.size(); i++) {
-      if (g_verbose) {
+      if (!changed[i]) { continue; }
+      if (verbose) {
         std::cerr << "Opening file " << inputFileNames[i] << std::endl;
       }
-      std::ifstream *inFile = new std::ifstream;
-      inFile->open(inputFileNames[i].c_str(), std::ifstream::in);
-      if (!inFile->good()) {
-        std::cerr << "Error: Could not open " << inputFileNames[i] << std::endl;
+      mappings[i].clear();
+      ProfileScope profile("read", inputFileNames[i]);
+      if (!read_from_file(inputFileNames[i], mappings[i])) {
         return 1;
       }
-      inFiles.push_back(inFile);
+      profile.count("points", static_cast<double>(mappings[i].size()));
     }
   }
-  std::vector< std::vector<Mapping> > mappings;
-  for (size_t i = 0; i < inFiles.size(); i++) {
-    std::vector<Mapping> mapping = read_from_infile(*inFiles[i]);
-    if (g_verbose) {
-      std::cerr << "Found " << mapping.size() << " points in "
+  for (size_t i = 0; i < mappings.size(); i++) {
+    if (!changed[i]) { continue; }
+    if (verbose) {
+      std::cerr << "Found " << mappings[i].size() << " points in "
         << inputFileNames[i] << std::endl;
     }
-    if (mapping.size() == 0) {
+    if (mappings[i].size() == 0) {
       std::cerr << "Error: No input points found in " << inputFileNames[i]
         << std::endl;
       return 2;
     }
-    mappings.push_back(mapping);
   }
 
   //====================================================================
@@ -238,45 +564,82 @@ int main(int argc, char *argv[])
   // that don't satisfy the criterion.  This removes inconsistent points
   // from the simulation (caused by multiple ray bounces or other
   // singularities in the simulation).
+  //  Each color is independent, so they are trimmed concurrently and
+  // the results are reported afterwards in color order.
   if (verifyAngles) {
-    for (size_t m = 0; m < mappings.size(); m++) {
-      int ret = remove_invalid_points_based_on_angle(
+    std::vector<int> removed(mappings.size());
+    pool.parallel_for(mappings.size(), [&](size_t m) {
+      if (!changed[m]) { return; }
+      ProfileScope profile("verify angles", colorDetail(m));
+      removed[m] = remove_invalid_points_based_on_angle(
         mappings[m], xx, xy, yx, yy, maxAngleDiffDegrees);
-      if (ret < 0) {
+      profile.count("removed", removed[m]);
+    });
+    for (size_t m = 0; m < mappings.size(); m++) {
+      if (!changed[m]) { continue; }
+      if (removed[m] < 0) {
         std::cerr << "Error verifying angles for mesh "
           << m << std::endl;
         return 60;
       }
-      if (g_verbose) {
-        std::cerr << "Removed " << ret
+      if (verbose) {
+        std::cerr << "Removed " << removed[m]
           << " points from mesh " << m << std::endl;
       }
     }
   }
 
+  //====================================================================
+  // If we've been asked to, remove the points that are far from a smooth
+  // fit to their neighbors.  Like the angle check, this catches points
+  // that fold over their neighbors, but it does not need to know which
+  // way the screen is oriented.  The neighborhoods are fit in parallel
+  // within each color as well as across colors.
+  if (opt.outlierPasses > 0) {
+    std::vector<int> removed(mappings.size());
+    std::vector< std::vector<OutlierReport> > reports(mappings.size());
+    pool.parallel_for(mappings.size(), [&](size_t m) {
+      if (!changed[m]) { return; }
+      ProfileScope profile("fit outliers", colorDetail(m));
+      removed[m] = remove_outliers_by_local_fit(mappings[m], opt.outlierK,
+        opt.outlierPasses, pool, &reports[m]);
+      profile.count("removed", removed[m]);
+    });
+    for (size_t m = 0; m < mappings.size(); m++) {
+      if (!changed[m]) { continue; }
+      if (removed[m] < 0) {
+        std::cerr << "Error fitting outliers for mesh "
+          << m << std::endl;
+        return 61;
+      }
+      if (verbose) {
+        std::cerr << "Removed " << removed[m]
+          << " outliers from mesh " << m << std::endl;
+        for (size_t r = 0; r < reports[m].size(); r++) {
+          const OutlierReport &report = reports[m][r];
+          const XYLatLong &p = report.mapping.xyLatLong;
+          std::cerr << "  pass " << report.pass << ": entry " << report.index
+            << " (" << p.longitude << ", " << p.latitude << ") -> ("
+            << p.x << ", " << p.y << "), ";
+          if (report.folded) {
+            std::cerr << "folded" << std::endl;
+          } else {
+            std::cerr << "residual " << report.residual
+              << " > " << report.threshold << std::endl;
+          }
+        }
+      }
+    }
+  }
+
   //====================================================================
   // If we've been asked to auto-range the screen coordinates, compute
   // them here.  Look at all of the points from all of the colors and
   // make a bound on all of them.
   if (computeBounds) {
-    left = right = mappings[0][0].xyLatLong.x;
-    bottom = top = mappings[0][0].xyLatLong.y;
-    for (size_t m = 0; m < mappings.size(); m++) {
-      for (size_t i = 1; i < mappings[m].size(); i++) {
-        double x = mappings[m][i].xyLatLong.x;
-        double y = mappings[m][i].xyLatLong.y;
-        if (x < left) { left = x; }
-        if (x > right) { right = x; }
-        if (y < bottom) { bottom = y; }
-        if (y > top) { top = y; }
-      }
-    }
-    left *= toMeters;
-    right *= toMeters;
-    bottom *= toMeters;
-    top *= toMeters;
+    find_table_bounds(mappings, toMeters, left, bottom, right, top);
   }
-  if (g_verbose) {
+  if (verbose) {
     std::cerr << "Left, bottom, right, top = " << left << ", "
       << bottom << ", " << right << ", " << top << std::endl;
   }
@@ -284,223 +647,944 @@ int main(int argc, char *argv[])
   //====================================================================
   // Compute left and right screen boundaries that are mirror images
   // of each other.
-  double leftScreenLeft, leftScreenRight, leftScreenBottom, leftScreenTop;
-  double rightScreenLeft, rightScreenRight, rightScreenBottom, rightScreenTop;
-  rightScreenBottom = leftScreenBottom = bottom;
-  rightScreenTop = leftScreenTop = top;
-  if (useRightEye) {
-    rightScreenLeft = left;
-    rightScreenRight = right;
-
-    leftScreenLeft = -right;
-    leftScreenRight = -left;
-  } else {
-    leftScreenLeft = left;
-    leftScreenRight = right;
-
-    rightScreenLeft = -right;
-    rightScreenRight = -left;
-  }
+  double leftBounds[4], rightBounds[4];
+  mirror_screen_bounds(useRightEye, left, bottom, right, top,
+    leftBounds, rightBounds);
+  double leftScreenLeft = leftBounds[0], leftScreenBottom = leftBounds[1];
+  double leftScreenRight = leftBounds[2], leftScreenTop = leftBounds[3];
+  double rightScreenLeft = rightBounds[0], rightScreenBottom = rightBounds[1];
+  double rightScreenRight = rightBounds[2], rightScreenTop = rightBounds[3];
 
   //====================================================================
   // Compute a left- and right-eye mappings that are mirrors of each
   // other, so that we can produce distortion maps for both eyes.
-  std::vector< std::vector<Mapping> > leftMappings;
-  std::vector< std::vector<Mapping> > rightMappings;
+  //  Each eye's converted points for all colors are stored one color
+  // after another in a single set, which is used whole to determine the
+  // screen boundaries in a manner that encompasses all of them and
+  // color by color to find the meshes.  Color i starts at offsets[i].
+  //  A color is converted again if it changed or the bounds moved.  The
+  // others are kept, and only copied if a color before them changed
+  // size.
+  //  There is one task per color per eye; task 2*i handles the left eye
+  // for color i and task 2*i+1 the right eye.  Warnings from each task
+  // are collected and printed in that order once they have all finished.
+  bool boundsMoved = !state.converted || (left != state.left) ||
+    (bottom != state.bottom) || (right != state.right) || (top != state.top);
+  std::vector<char> convert(mappings.size());
+  for (size_t i = 0; i < mappings.size(); i++) {
+    convert[i] = boundsMoved || changed[i];
+  }
+  std::vector<size_t> offsets(mappings.size() + 1, 0);
   for (size_t i = 0; i < mappings.size(); i++) {
-    // Do each mapping in turn, one per color.
-    std::vector<Mapping> &mapping = mappings[i];
+    offsets[i + 1] = offsets[i] + mappings[i].size();
+  }
+  if (offsets != state.offsets) {
+    MappingSet leftSet(offsets.back()), rightSet(offsets.back());
+    for (size_t i = 0; i < mappings.size(); i++) {
+      if (convert[i]) { continue; }
+      copyMappings(state.leftFullMapping, state.offsets[i], leftSet, offsets[i],
+        mappings[i].size());
+      copyMappings(state.rightFullMapping, state.offsets[i], rightSet, offsets[i],
+        mappings[i].size());
+    }
+    state.leftFullMapping = std::move(leftSet);
+    state.rightFullMapping = std::move(rightSet);
+    state.offsets = offsets;
+  }
+  state.converted = false;
+  state.left = left;
+  state.bottom = bottom;
+  state.right = right;
+  state.top = top;
+  MappingSet &leftFullMapping = state.leftFullMapping;
+  MappingSet &rightFullMapping = state.rightFullMapping;
+  std::vector<std::string> taskLogs(2 * mappings.size());
+  pool.parallel_for(2 * mappings.size(), [&](size_t task) {
+    size_t i = task / 2;
+    bool left = (task % 2) == 0;
+    if (!convert[i]) { return; }
 
     //====================================================================
     // Make an inverse mapping for the opposite eye.  Invert around X in
     // angle and viewing direction.  Depending on whether we are using the
     // left or right eye, set the eyes appropriately.
-    //  Also make a different set of screen boundaries for each, again
-    // inverting around X = 0.
-    std::vector<Mapping> leftMapping;
-    std::vector<Mapping> rightMapping;
-    rightScreenBottom = leftScreenBottom = bottom;
-    rightScreenTop = leftScreenTop = top;
-    if (useRightEye) {
-      rightMapping = mapping;
-      leftMapping = reflect_mapping(mapping);
-    } else {
-      leftMapping = mapping;
-      rightMapping = reflect_mapping(mapping);
-    }
+    bool reflect = (left == useRightEye);
 
     //====================================================================
     // Convert the input values into normalized coordinates and into 3D
-    // locations.
-    convert_to_normalized_and_meters(leftMapping, toMeters, depth,
-      leftScreenLeft, leftScreenBottom, leftScreenRight, leftScreenTop,
-      useFieldAngles);
-    convert_to_normalized_and_meters(rightMapping, toMeters, depth,
-      rightScreenLeft, rightScreenBottom, rightScreenRight, rightScreenTop,
-      useFieldAngles);
-
-    //====================================================================
-    // Store the mappings.
-    leftMappings.push_back(leftMapping);
-    rightMappings.push_back(rightMapping);
+    // locations, reflecting them along the way if needed.
+    std::ostringstream log;
+    ProfileScope profile("convert", eyeDetail(left, i));
+    profile.count("points", static_cast<double>(mappings[i].size()));
+    if (left) {
+      convert_to_normalized_and_meters(mappings[i], reflect,
+        leftFullMapping, offsets[i], toMeters, depth,
+        leftScreenLeft, leftScreenBottom, leftScreenRight, leftScreenTop,
+        useFieldAngles, log);
+    } else {
+      convert_to_normalized_and_meters(mappings[i], reflect,
+        rightFullMapping, offsets[i], toMeters, depth,
+        rightScreenLeft, rightScreenBottom, rightScreenRight, rightScreenTop,
+        useFieldAngles, log);
+    }
+    taskLogs[task] = log.str();
+  });
+  for (size_t i = 0; i < taskLogs.size(); i++) {
+    std::cerr << taskLogs[i];
   }
 
   //====================================================================
-  // Construct mappings that include all points for all colors that
-  // we will use to determine the screen boundaries in a manner that
-  // encompasses all of them.
-  std::vector<Mapping> leftFullMapping, rightFullMapping;
-  for (size_t i = 0; i < mappings.size(); i++) {
-    for (size_t j = 0; j < leftMappings[i].size(); j++) {
-      leftFullMapping.push_back(leftMappings[i][j]);
-    }
-    for (size_t j = 0; j < rightMappings[i].size(); j++) {
-      rightFullMapping.push_back(rightMappings[i][j]);
+  // Find both screens at once, keeping the projection of each point
+  // onto its screen for the meshes.  Their messages are printed in the
+  // order they would be if the screens were found one after the other.
+  ScreenDescription oldLeftScreen = leftScreen, oldRightScreen = rightScreen;
+  ScreenProjection leftProjection, rightProjection;
+  std::ostringstream screenLogs[2];
+  char screenFound[2];
+  pool.parallel_for(2, [&](size_t eye) {
+    ProfileScope profile("find screen", eye == 0 ? "left" : "right");
+    if (eye == 0) {
+      screenFound[0] = findScreen(leftFullMapping, leftScreenLeft,
+        leftScreenBottom, leftScreenRight, leftScreenTop, leftScreen,
+        pool, leftProjection, verbose, screenLogs[0]);
+    } else {
+      screenFound[1] = findScreen(rightFullMapping, rightScreenLeft,
+        rightScreenBottom, rightScreenRight, rightScreenTop, rightScreen,
+        pool, rightProjection, verbose, screenLogs[1]);
     }
-  }
-  if (!findScreen(leftFullMapping, leftScreenLeft, leftScreenBottom,
-    leftScreenRight, leftScreenTop, leftScreen, g_verbose)) {
+  });
+  std::cerr << screenLogs[0].str();
+  if (!screenFound[0]) {
     std::cerr << "Error: Could not find left screen" << std::endl;
     return 3;
   }
-  if (g_verbose) {
+  if (verbose) {
     std::cerr << "Left screen L B R T: " << leftScreenLeft
       << ", " << leftScreenBottom
       << ", " << leftScreenRight
       << ", " << leftScreenTop << std::endl;
   }
 
-  if (!findScreen(rightFullMapping, rightScreenLeft, rightScreenBottom,
-    rightScreenRight, rightScreenTop, rightScreen, g_verbose)) {
+  std::cerr << screenLogs[1].str();
+  if (!screenFound[1]) {
     std::cerr << "Error: Could not find right screen" << std::endl;
     return 5;
   }
+  state.converted = true;
 
   //====================================================================
-  // Compute the three colored mappings based on the screen boundaries
-  // we found above.
+  // Every point can move the screens, so they are always found again,
+  // but if they did not move the meshes of colors that were not
+  // converted again still hold.
+  bool screensMoved = (leftMeshes.size() != mappings.size()) ||
+    !sameScreen(leftScreen, oldLeftScreen) ||
+    !sameScreen(rightScreen, oldRightScreen);
+  std::vector<char> meshed(mappings.size());
   for (size_t i = 0; i < mappings.size(); i++) {
-    // Do each pair of mappings in turn, one per color.
-    std::vector<Mapping> &leftMapping = leftMappings[i];
-    std::vector<Mapping> &rightMapping = rightMappings[i];
+    meshed[i] = screensMoved || convert[i];
+  }
+
+  //====================================================================
+  // Compute the three colored mappings based on the screen boundaries
+  // we found above.  As above, there is one task per color per eye.
+  leftMeshes.resize(mappings.size());
+  rightMeshes.resize(mappings.size());
+  std::vector<char> meshFound(2 * mappings.size());
+  pool.parallel_for(2 * mappings.size(), [&](size_t task) {
+    size_t i = task / 2;
+    size_t count = mappings[i].size();
+    if (!meshed[i]) { return; }
 
     //====================================================================
     // Determine the screen description and distortion mesh based on the
     // input points and screen parameters.
-    // This will re-compute the screen each time, but it will get the same
-    // answer because we're using the same bounds for each of them.
-    MeshDescription leftMesh, rightMesh;
-    if (!findMesh(leftMapping, leftScreenLeft, leftScreenBottom,
-      leftScreenRight, leftScreenTop, leftScreen, leftMesh, g_verbose)) {
+    ProfileScope profile("find mesh", eyeDetail(task % 2 == 0, i));
+    if (task % 2 == 0) {
+      meshFound[task] = findMesh(MappingSpan(leftFullMapping, offsets[i], count),
+        leftProjection, offsets[i],
+        leftScreenLeft, leftScreenBottom, leftScreenRight, leftScreenTop,
+        leftScreen, leftMeshes[i], verbose);
+    } else {
+      meshFound[task] = findMesh(MappingSpan(rightFullMapping, offsets[i], count),
+        rightProjection, offsets[i],
+        rightScreenLeft, rightScreenBottom, rightScreenRight, rightScreenTop,
+        rightScreen, rightMeshes[i], verbose);
+    }
+    profile.count("vertices", static_cast<double>(
+      (task % 2 == 0) ? leftMeshes[i].size() : rightMeshes[i].size()));
+  });
+  for (size_t i = 0; i < mappings.size(); i++) {
+    if (!meshed[i]) { continue; }
+    if (!meshFound[2 * i]) {
       std::cerr << "Error: Could not find left mesh" << std::endl;
       return 30;
     }
-    if (leftMesh.size() != leftMapping.size()) {
-      std::cerr << "Error: Left mesh size " << leftMesh.size()
-        << " does not match mapping size" << leftMapping.size() << std::endl;
+    if (leftMeshes[i].size() != mappings[i].size()) {
+      std::cerr << "Error: Left mesh size " << leftMeshes[i].size()
+        << " does not match mapping size" << mappings[i].size() << std::endl;
       return 4;
     }
-    leftMeshes.push_back(leftMesh);
-
-    if (!findMesh(rightMapping, rightScreenLeft, rightScreenBottom,
-      rightScreenRight, rightScreenTop, rightScreen, rightMesh, g_verbose)) {
+    if (!meshFound[2 * i + 1]) {
       std::cerr << "Error: Could not find right mesh" << std::endl;
       return 50;
     }
-    if (rightMesh.size() != rightMapping.size()) {
-      std::cerr << "Error: Right mesh size " << rightMesh.size()
-        << " does not match mapping size" << rightMapping.size() << std::endl;
+    if (rightMeshes[i].size() != mappings[i].size()) {
+      std::cerr << "Error: Right mesh size " << rightMeshes[i].size()
+        << " does not match mapping size" << mappings[i].size() << std::endl;
       return 6;
     }
-    rightMeshes.push_back(rightMesh);
+  }
+
+  //====================================================================
+  // If we've been asked to, bake each mesh into a lookup texture.  This
+  // uses the meshes before any grid resampling, so that it interpolates
+  // the original samples.  Each bake is spread across the threads by
+  // rows, so the meshes are done one after another.
+  if (opt.lutWidth > 0) {
+    static const char *colorNames[] = { "_red", "_green", "_blue" };
+    for (size_t i = 0; i < leftMeshes.size(); i++) {
+      if (!meshed[i]) { continue; }
+      for (int eye = 0; eye < 2; eye++) {
+        std::string name = opt.lutPrefix + (eye == 0 ? "_left" : "_right");
+        if (leftMeshes.size() == 3) { name += colorNames[i]; }
+        name += lut_format_extension(opt.lutFormat);
+
+        std::vector<float> texels;
+        ProfileScope profile("bake lut", name);
+        if (!bake_distortion_lut(eye == 0 ? leftMeshes[i] : rightMeshes[i],
+              opt.lutWidth, opt.lutHeight, pool, texels) ||
+            !write_distortion_lut(name, opt.lutFormat, opt.lutWidth,
+              opt.lutHeight, texels)) {
+          std::cerr << "Error: Could not produce lookup texture " << name << std::endl;
+          return 11;
+        }
+        if (verbose) {
+          std::cerr << "Wrote " << opt.lutWidth << " x " << opt.lutHeight
+            << " lookup texture " << name << std::endl;
+        }
+      }
+    }
+  }
+
+  //====================================================================
+  // If we've been asked to, replace each scattered-sample mesh with one
+  // interpolated onto a regular grid.  The grid is written in the same
+  // point-sample format, in row-major order.
+  if (opt.gridCols > 0) {
+    std::vector<char> resampled(2 * mappings.size(), 1);
+    pool.parallel_for(2 * mappings.size(), [&](size_t task) {
+      if (!meshed[task / 2]) { return; }
+      MeshDescription &mesh = (task % 2 == 0) ? leftMeshes[task / 2] : rightMeshes[task / 2];
+      MeshDescription grid;
+      ProfileScope profile("resample grid", eyeDetail(task % 2 == 0, task / 2));
+      resampled[task] = resample_mesh_to_grid(mesh, opt.gridCols, opt.gridRows, grid);
+      mesh.swap(grid);
+      profile.count("vertices", static_cast<double>(mesh.size()));
+    });
+    for (size_t task = 0; task < resampled.size(); task++) {
+      if (!resampled[task]) {
+        std::cerr << "Error: Could not resample " << ((task % 2 == 0) ? "left" : "right")
+          << " mesh " << task / 2 << " onto a grid" << std::endl;
+        return 10;
+      }
+    }
+    if (verbose) {
+      std::cerr << "Resampled meshes onto a " << opt.gridCols << " x "
+        << opt.gridRows << " grid" << std::endl;
+    }
+  }
+
+  //====================================================================
+  // Or replace each with one that has points packed densely only where
+  // the mapping bends.  It is also written in the point-sample format.
+  if (opt.adaptivePoints > 0) {
+    std::vector<char> resampled(2 * mappings.size());
+    std::vector<double> maxErrors(2 * mappings.size());
+    pool.parallel_for(2 * mappings.size(), [&](size_t task) {
+      if (!meshed[task / 2]) { return; }
+      MeshDescription &mesh = (task % 2 == 0) ? leftMeshes[task / 2] : rightMeshes[task / 2];
+      MeshDescription adaptive;
+      ProfileScope profile("resample adaptive", eyeDetail(task % 2 == 0, task / 2));
+      resampled[task] = resample_mesh_adaptive(mesh, opt.adaptiveTolerance,
+        opt.adaptivePoints, adaptive, &maxErrors[task]);
+      mesh.swap(adaptive);
+      profile.count("vertices", static_cast<double>(mesh.size()));
+    });
+    for (size_t task = 0; task < resampled.size(); task++) {
+      const char *eyeName = (task % 2 == 0) ? "left" : "right";
+      if (!meshed[task / 2]) { continue; }
+      if (!resampled[task]) {
+        std::cerr << "Error: Could not adaptively resample " << eyeName
+          << " mesh " << task / 2 << std::endl;
+        return 10;
+      }
+      if (maxErrors[task] > opt.adaptiveTolerance) {
+        std::cerr << "Warning: The " << eyeName << " mesh " << task / 2
+          << " reached " << opt.adaptivePoints << " points with an error of "
+          << maxErrors[task] << " (increase max_points)" << std::endl;
+      }
+      if (verbose) {
+        const MeshDescription &mesh = (task % 2 == 0) ? leftMeshes[task / 2] : rightMeshes[task / 2];
+        std::cerr << "Adaptively resampled " << eyeName << " mesh " << task / 2
+          << " onto " << mesh.size() << " points, error " << maxErrors[task]
+          << std::endl;
+      }
+    }
   }
 
   //====================================================================
   // Construct Json screen description.
   // We do this by hand rather than using JsonCPP because we need
   // to control the printed precision of the numbers to avoid making
-  // a huge file.
-  std::cout << "{" << std::endl;
-  std::cout << " \"display\": {" << std::endl;
-  std::cout << "  \"hmd\": {" << std::endl;
-
-  std::cout << "   \"field_of_view\": {" << std::endl;
-  std::cout << "    \"monocular_horizontal\": "
-    << rightScreen.hFOVDegrees
-    << "," << std::endl;
-  std::cout << "    \"monocular_vertical\": "
-    << rightScreen.vFOVDegrees
-    << "," << std::endl;
-  std::cout << "    \"overlap_percent\": "
-    << rightScreen.overlapPercent
-    << "," << std::endl;
-  std::cout << "    \"pitch_tilt\": 0" << std::endl;
-  std::cout << "   }," << std::endl; // field_of_view
-
-  std::cout << "   \"distortion\": {" << std::endl;
-  switch (leftMeshes.size()) {
-  case 1:
-    std::cout << "    \"type\": \"mono_point_samples\"," << std::endl;
-    std::cout << "    \"mono_point_samples\": [" << std::endl;
-    writeMesh(std::cout, leftMeshes[0]);
-    std::cout << "," << std::endl;
-    writeMesh(std::cout, rightMeshes[0]);
-    std::cout << "    ]" << std::endl; // mono_point_samples
-    std::cout << "   }," << std::endl; // distortion
-    break;
-  case 3:
-    std::cout << "    \"type\": \"rgb_point_samples\"," << std::endl;
-    std::cout << "    \"red_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[0]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[0]);
-    std::cout << "    ]," << std::endl; // red_point_samples
-    std::cout << "    \"green_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[1]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[1]);
-    std::cout << "    ]," << std::endl; // green_point_samples
-    std::cout << "    \"blue_point_samples\": [" << std::endl;
-      writeMesh(std::cout, leftMeshes[2]);
-      std::cout << "," << std::endl;
-      writeMesh(std::cout, rightMeshes[2]);
-    std::cout << "    ]" << std::endl; // blue_point_samples
-    std::cout << "   }," << std::endl; // distortion
-    break;
-  default:
+  // a huge file.  It is all built up in memory and written at once.
+  if ((leftMeshes.size() != 1) && (leftMeshes.size() != 3)) {
     std::cerr << "Error: Unexpected number of meshes: " << leftMeshes.size()
       << std::endl;
     return 3;
   }
+  ProfileScope profileJson("write json", opt.outputFileName.empty() ?
+    std::string("standard output") : opt.outputFileName);
+  JsonWriter out;
+  writeJsonStart(out, rightScreen, leftMeshes.size());
+  for (size_t i = 0; i < leftMeshes.size(); i++) {
+    out << "    \"" << meshArrayName(leftMeshes.size(), i) << "\": [\n";
+    write_mesh(out, leftMeshes[i], opt.meshPrecision);
+    out << ",\n";
+    write_mesh(out, rightMeshes[i], opt.meshPrecision);
+    out << ((i + 1 < leftMeshes.size()) ? "    ],\n" : "    ]\n");
+  }
+  writeJsonEnd(out, leftScreen, rightScreen);
 
-  std::cout << "   \"eyes\": [" << std::endl;
-  std::cout << "    {" << std::endl;
-  std::cout << "     \"center_proj_x\": "
-    << leftScreen.xCOP
-    << "," << std::endl;
-  std::cout << "     \"center_proj_y\": "
-    << leftScreen.yCOP
-    << "," << std::endl;
-  std::cout << "     \"rotate_180\": 0" << std::endl;
-  std::cout << "    }," << std::endl;
-  std::cout << "    {" << std::endl;
-  std::cout << "     \"center_proj_x\": "
-    << rightScreen.xCOP
-    << "," << std::endl;
-  std::cout << "     \"center_proj_y\": "
-    << rightScreen.yCOP
-    << "," << std::endl;
-  std::cout << "     \"rotate_180\": 0" << std::endl;
-  std::cout << "    }" << std::endl;
-  std::cout << "   ]" << std::endl; // eyes
+  if (opt.outputFileName.empty()) {
+    if (!out.write(std::cout)) {
+      std::cerr << "Error: Could not write to standard output" << std::endl;
+      return 7;
+    }
+  } else if (opt.watch) {
+    std::string tempName = opt.outputFileName + ".tmp";
+    if (!out.writeFile(tempName) || !replaceFile(tempName, opt.outputFileName)) {
+      return 7;
+    }
+  } else if (!out.writeFile(opt.outputFileName)) {
+    return 7;
+  }
+  profileJson.count("bytes", static_cast<double>(out.str().size()));
+  profileJson.end();
 
-  std::cout << "  }" << std::endl;  // hmd
-  std::cout << " }" << std::endl;   // display
-  std::cout << "}" << std::endl;    // Closes outer object
+  //====================================================================
+  // Write the binary version if we've been asked to.  When verbose,
+  // read it back in and make sure that it holds what we wrote.
+  if (!opt.binaryFileName.empty()) {
+    std::string binaryName = opt.watch ? opt.binaryFileName + ".tmp" :
+      opt.binaryFileName;
+    ProfileScope profile("write binary", opt.binaryFileName);
+    if (!write_distortion_mesh_file(binaryName, leftMeshes, rightMeshes,
+        leftScreen, rightScreen) ||
+        (opt.watch && !replaceFile(binaryName, opt.binaryFileName))) {
+      return 8;
+    }
+    profile.end();
+    if (verbose) {
+      std::vector<float> storage;
+      DistortionMeshView view;
+      if (!read_distortion_mesh_file(opt.binaryFileName, storage, view)) {
+        return 9;
+      }
+      bool same = (view.numColors() == leftMeshes.size()) &&
+        (view.xCOP(0) == static_cast<float>(leftScreen.xCOP)) &&
+        (view.yCOP(1) == static_cast<float>(rightScreen.yCOP));
+      for (uint32_t c = 0; same && (c < view.numColors()); c++) {
+        for (uint32_t e = 0; same && (e < 2); e++) {
+          const MeshDescription &mesh = (e == 0) ? leftMeshes[c] : rightMeshes[c];
+          const float *data = view.meshData(c, e);
+          same = (view.meshSize(c, e) == mesh.size());
+          for (size_t i = 0; same && (i < mesh.size()); i++) {
+            same = (data[4 * i + 0] == static_cast<float>(mesh[i][0][0])) &&
+              (data[4 * i + 1] == static_cast<float>(mesh[i][0][1])) &&
+              (data[4 * i + 2] == static_cast<float>(mesh[i][1][0])) &&
+              (data[4 * i + 3] == static_cast<float>(mesh[i][1][1]));
+          }
+        }
+      }
+      if (!same) {
+        std::cerr << "Error: " << opt.binaryFileName
+          << " does not match the meshes that were written" << std::endl;
+        return 9;
+      }
+      std::cerr << "Wrote and verified " << opt.binaryFileName << std::endl;
+    }
+  }
 
   return 0;
 }
 
+//====================================================================
+// -stream runs a job without ever holding a whole table, for traces too
+// large to fit in memory several times over.  Each input file is read a
+// tile at a time, several times over:
+//   1. for the bounds of the tables and the left and right points of
+//      each screen, which do not depend on the bounds;
+//   2. for the heights of the points above each screen's plane, which
+//      finishes the screens;
+//   3. once per eye, to make that eye's mesh a tile at a time and write
+//      it straight to the output.
+// This produces the same output as runJob(), except that the filters
+// and resampling that need a whole table cannot be used, the binary file
+// is not read back when verbose, and the warnings about points off the
+// screen come tile by tile for both eyes.
+
+// Converts one tile of a table for both eyes, as runJob() converts the
+// whole tables, into tileSets[0] (left) and tileSets[1] (right).
+static void convertTile(const Options &opt, TaskPool &pool,
+  const std::vector<Mapping> &tile, size_t firstIndex,
+  const double bounds[2][4], MappingSet tileSets[2], std::ostream *logs[2])
+{
+  pool.parallel_for(2, [&](size_t eye) {
+    bool reflect = ((eye == 0) == opt.useRightEye);
+    tileSets[eye].resize(tile.size());
+    convert_to_normalized_and_meters(tile, reflect, tileSets[eye], 0,
+      opt.toMeters, opt.depth, bounds[eye][0], bounds[eye][1],
+      bounds[eye][2], bounds[eye][3], opt.useFieldAngles, *logs[eye],
+      firstIndex);
+  });
+}
+
+// Writes out and empties what has been collected in a JsonWriter.
+static bool flushJson(JsonWriter &out, std::ostream &stream)
+{
+  bool ok = out.write(stream);
+  out.clear();
+  return ok;
+}
+
+static int runStreamedJob(const Options &opt, TaskPool &pool)
+{
+  ProfileScope profileJob("job", opt.outputFileName);
+  const std::vector<std::string> &inputFileNames = opt.inputFileNames;
+  bool verbose = opt.verbose;
+  if (inputFileNames.empty()) {
+    std::cerr << "Error: -stream needs -mono or -rgb input files" << std::endl;
+    return 12;
+  }
+  if (opt.verifyAngles || (opt.outlierPasses > 0) || (opt.gridCols > 0) ||
+      (opt.adaptivePoints > 0) || (opt.lutWidth > 0)) {
+    std::cerr << "Error: -stream cannot be used with -verify_angles,"
+      << " -fit_outliers, -grid, -adaptive or -lut, which need whole tables"
+      << std::endl;
+    return 12;
+  }
+  size_t numColors = inputFileNames.size();
+  size_t tileSize = opt.streamTile;
+  TableReader reader;
+  std::vector<Mapping> tile;
+  MappingSet tileSets[2];
+  std::ostream nullLog(nullptr);
+  std::ostream *quiet[2] = { &nullLog, &nullLog };
+
+  //====================================================================
+  // First pass: count the entries, find the bounds of the tables if we
+  // have been asked to, and find the left and right points of each
+  // screen.  The 3D points do not depend on the bounds, so placeholder
+  // bounds are used to convert them here.
+  std::ostringstream screenLogs[2];
+  ScreenFinder finders[2] = { ScreenFinder(verbose, screenLogs[0]),
+    ScreenFinder(verbose, screenLogs[1]) };
+  std::vector<size_t> counts(numColors);
+  double left = opt.left, bottom = opt.bottom, right = opt.right, top = opt.top;
+  double unitBounds[2][4] = { { 0, 0, 1, 1 }, { 0, 0, 1, 1 } };
+  for (size_t c = 0; c < numColors; c++) {
+    if (verbose) {
+      std::cerr << "Opening file " << inputFileNames[c] << std::endl;
+    }
+    ProfileScope profile("stream extents", inputFileNames[c]);
+    if (!reader.open(inputFileNames[c])) { return 1; }
+    for (;;) {
+      if (!reader.read(tileSize, tile)) { return 1; }
+      if (tile.empty()) { break; }
+      if (opt.computeBounds) {
+        if ((c == 0) && (reader.count() == tile.size())) {
+          left = right = tile[0].xyLatLong.x;
+          bottom = top = tile[0].xyLatLong.y;
+        }
+        for (size_t i = 0; i < tile.size(); i++) {
+          double x = tile[i].xyLatLong.x;
+          double y = tile[i].xyLatLong.y;
+          if (x < left) { left = x; }
+          if (x > right) { right = x; }
+          if (y < bottom) { bottom = y; }
+          if (y > top) { top = y; }
+        }
+      }
+      convertTile(opt, pool, tile, 0, unitBounds, tileSets, quiet);
+      finders[0].addExtents(MappingSpan(tileSets[0]));
+      finders[1].addExtents(MappingSpan(tileSets[1]));
+    }
+    counts[c] = reader.count();
+    profile.count("points", static_cast<double>(counts[c]));
+    if (verbose) {
+      std::cerr << "Found " << counts[c] << " points in "
+        << inputFileNames[c] << std::endl;
+    }
+    if (counts[c] == 0) {
+      std::cerr << "Error: No input points found in " << inputFileNames[c]
+        << std::endl;
+      return 2;
+    }
+  }
+  if (opt.computeBounds) {
+    left *= opt.toMeters;
+    right *= opt.toMeters;
+    bottom *= opt.toMeters;
+    top *= opt.toMeters;
+  }
+  if (verbose) {
+    std::cerr << "Left, bottom, right, top = " << left << ", "
+      << bottom << ", " << right << ", " << top << std::endl;
+  }
+  double bounds[2][4];
+  mirror_screen_bounds(opt.useRightEye, left, bottom, right, top,
+    bounds[0], bounds[1]);
+
+  //====================================================================
+  // Second pass: convert the tiles with the real bounds, which is where
+  // the warnings about points off the screen come from, and find how
+  // far the points reach above and below each screen's plane.
+  ScreenDescription screens[2];
+  bool found[2];
+  for (int eye = 0; eye < 2; eye++) {
+    found[eye] = finders[eye].findPlane(screens[eye]);
+  }
+  for (size_t c = 0; found[0] && found[1] && (c < numColors); c++) {
+    ProfileScope profile("stream heights", inputFileNames[c]);
+    if (!reader.open(inputFileNames[c])) { return 1; }
+    for (;;) {
+      size_t firstIndex = reader.count();
+      if (!reader.read(tileSize, tile)) { return 1; }
+      if (tile.empty()) { break; }
+      std::ostringstream tileLogs[2];
+      std::ostream *logs[2] = { &tileLogs[0], &tileLogs[1] };
+      convertTile(opt, pool, tile, firstIndex, bounds, tileSets, logs);
+      std::cerr << tileLogs[0].str() << tileLogs[1].str();
+      finders[0].addHeights(MappingSpan(tileSets[0]), screens[0]);
+      finders[1].addHeights(MappingSpan(tileSets[1]), screens[1]);
+    }
+  }
+  for (int eye = 0; eye < 2; eye++) {
+    found[eye] = found[0] && found[1] && finders[eye].finish(screens[eye]);
+  }
+  const ScreenDescription &leftScreen = screens[0];
+  const ScreenDescription &rightScreen = screens[1];
+  std::cerr << screenLogs[0].str();
+  if (!found[0]) {
+    std::cerr << "Error: Could not find left screen" << std::endl;
+    return 3;
+  }
+  if (verbose) {
+    std::cerr << "Left screen L B R T: " << bounds[0][0]
+      << ", " << bounds[0][1]
+      << ", " << bounds[0][2]
+      << ", " << bounds[0][3] << std::endl;
+  }
+  std::cerr << screenLogs[1].str();
+  if (!found[1]) {
+    std::cerr << "Error: Could not find right screen" << std::endl;
+    return 5;
+  }
+
+  //====================================================================
+  // Third pass: make each mesh a tile at a time, in the order that the
+  // Json and the binary file hold them, writing each tile as it is made.
+  std::ofstream outFile;
+  if (!opt.outputFileName.empty()) {
+    outFile.open(opt.outputFileName.c_str());
+    if (!outFile.good()) {
+      std::cerr << "Error: Could not open " << opt.outputFileName
+        << " for writing" << std::endl;
+      return 7;
+    }
+  }
+  std::ostream &outStream = opt.outputFileName.empty() ? std::cout : outFile;
+  DistortionMeshWriter binary;
+  if (!opt.binaryFileName.empty()) {
+    std::vector<size_t> sizes;
+    for (size_t c = 0; c < numColors; c++) {
+      sizes.push_back(counts[c]);
+      sizes.push_back(counts[c]);
+    }
+    if (!binary.open(opt.binaryFileName, sizes, leftScreen, rightScreen)) {
+      return 8;
+    }
+  }
+
+  JsonWriter out;
+  writeJsonStart(out, rightScreen, numColors);
+  MeshDescription meshTile;
+  for (size_t c = 0; c < numColors; c++) {
+    out << "    \"" << meshArrayName(numColors, c) << "\": [\n";
+    for (int eye = 0; eye < 2; eye++) {
+      ProfileScope profile("stream mesh", eyeDetail(eye == 0, c));
+      profile.count("vertices", static_cast<double>(counts[c]));
+      out << "[\n";
+      if (!reader.open(inputFileNames[c])) { return 1; }
+      for (;;) {
+        if (!reader.read(tileSize, tile)) { return 1; }
+        if (tile.empty()) { break; }
+        bool reflect = ((eye == 0) == opt.useRightEye);
+        tileSets[eye].resize(tile.size());
+        convert_to_normalized_and_meters(tile, reflect, tileSets[eye], 0,
+          opt.toMeters, opt.depth, bounds[eye][0], bounds[eye][1],
+          bounds[eye][2], bounds[eye][3], opt.useFieldAngles, nullLog);
+        if (!findMesh(MappingSpan(tileSets[eye]), bounds[eye][0],
+              bounds[eye][1], bounds[eye][2], bounds[eye][3], screens[eye],
+              meshTile, verbose)) {
+          std::cerr << "Error: Could not find " << (eye == 0 ? "left" : "right")
+            << " mesh" << std::endl;
+          return (eye == 0) ? 30 : 50;
+        }
+        write_mesh_samples(out, meshTile, opt.meshPrecision,
+          reader.count() == tile.size());
+        if (!flushJson(out, outStream)) {
+          std::cerr << "Error: Could not write the output" << std::endl;
+          return 7;
+        }
+        if (!opt.binaryFileName.empty() && !binary.append(meshTile)) {
+          return 8;
+        }
+      }
+      out << "]\n";
+      if (eye == 0) { out << ",\n"; }
+    }
+    out << ((c + 1 < numColors) ? "    ],\n" : "    ]\n");
+  }
+  writeJsonEnd(out, leftScreen, rightScreen);
+  if (!flushJson(out, outStream)) {
+    std::cerr << "Error: Could not write the output" << std::endl;
+    return 7;
+  }
+  if (!opt.outputFileName.empty()) {
+    outFile.close();
+    if (outFile.fail()) {
+      std::cerr << "Error: Could not write " << opt.outputFileName << std::endl;
+      return 7;
+    }
+  }
+  if (!opt.binaryFileName.empty() && !binary.close()) {
+    return 8;
+  }
+  return 0;
+}
+
+static int runJob(const Options &opt, TaskPool &pool)
+{
+  if (opt.streamTile > 0) {
+    return runStreamedJob(opt, pool);
+  }
+  JobState state;
+  return runJob(opt, pool, state);
+}
+
+// Splits a line of a batch list into whitespace-separated words.
+// Double quotes group words that contain spaces, such as the names
+// of the untrimmed HDK13 files.
+static std::vector<std::string> splitLine(const std::string &line)
+{
+  std::vector<std::string> words;
+  std::string word;
+  bool inWord = false, inQuotes = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (c == '"') {
+      inQuotes = !inQuotes;
+      inWord = true;
+    } else if (!inQuotes && isspace(static_cast<unsigned char>(c))) {
+      if (inWord) { words.push_back(word); }
+      word.clear();
+      inWord = false;
+    } else {
+      word += c;
+      inWord = true;
+    }
+  }
+  if (inWord) { words.push_back(word); }
+  return words;
+}
+
+// Returns the number of seconds since the specified start time.
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Options that set up the whole process rather than one job, so they
+// can only be given on the command line and not on a line of a batch
+// list.
+static const char *PROCESS_OPTIONS[] = {
+  "-batch", "-threads", "-o", "-watch", "-profile"
+};
+
+// Runs each job listed in the batch file, all sharing one thread pool,
+// with the options in defaults applying to every job.  Returns 0 if all
+// jobs succeeded and otherwise the exit code of the first failing job.
+static int runBatch(const Options &defaults, TaskPool &pool)
+{
+  std::ifstream list(defaults.batchFileName.c_str());
+  if (!list.good()) {
+    std::cerr << "Error: Could not open " << defaults.batchFileName << std::endl;
+    return 1;
+  }
+
+  //====================================================================
+  // Read all of the jobs before running any of them, so that a typo
+  // late in the list doesn't waste the work done before it.
+  std::vector<Options> jobs;
+  std::string line;
+  for (size_t lineNum = 1; std::getline(list, line); lineNum++) {
+    std::vector<std::string> words = splitLine(line);
+    if ((words.size() == 0) || (words[0][0] == '#')) { continue; }
+    Options job = defaults;
+    job.batchFileName.clear();
+    job.outputFileName = words[0];
+    std::vector<std::string> args(words.begin() + 1, words.end());
+    for (size_t a = 0; a < args.size(); a++) {
+      for (size_t o = 0; o < sizeof(PROCESS_OPTIONS) / sizeof(PROCESS_OPTIONS[0]); o++) {
+        if (args[a] == PROCESS_OPTIONS[o]) {
+          std::cerr << "Error: " << defaults.batchFileName << " line " << lineNum
+            << ": " << args[a] << " can only be given on the command line" << std::endl;
+          return 1;
+        }
+      }
+    }
+    if (!parseOptions(args, job)) {
+      std::cerr << "Error: " << defaults.batchFileName << " line " << lineNum
+        << ": bad options for " << words[0] << std::endl;
+      return 1;
+    }
+    if (job.inputFileNames.size() == 0) {
+      std::cerr << "Error: " << defaults.batchFileName << " line " << lineNum
+        << ": no -mono or -rgb input files for " << words[0] << std::endl;
+      return 1;
+    }
+    jobs.push_back(job);
+  }
+  if (jobs.size() == 0) {
+    std::cerr << "Error: No jobs found in " << defaults.batchFileName << std::endl;
+    return 2;
+  }
+
+  //====================================================================
+  // Run the jobs.  Each job also uses the pool for its own per-color
+  // and per-eye work, so the pool stays busy even with few jobs.
+  std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+  std::vector<int> results(jobs.size());
+  std::mutex reportMutex;
+  size_t finished = 0;
+  pool.parallel_for(jobs.size(), [&](size_t j) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    results[j] = runJob(jobs[j], pool);
+
+    std::lock_guard<std::mutex> lock(reportMutex);
+    std::cerr << "[" << ++finished << "/" << jobs.size() << "] "
+      << jobs[j].outputFileName;
+    if (results[j] == 0) {
+      std::cerr << " done";
+    } else {
+      std::cerr << " FAILED with code " << results[j];
+    }
+    std::cerr << " (" << std::fixed << std::setprecision(3)
+      << secondsSince(start) << " s)" << std::defaultfloat << std::endl;
+  });
+
+  int ret = 0;
+  size_t failed = 0;
+  for (size_t j = 0; j < results.size(); j++) {
+    if (results[j] != 0) {
+      if (ret == 0) { ret = results[j]; }
+      failed++;
+    }
+  }
+  std::cerr << "Finished " << jobs.size() << " jobs (" << failed << " failed) in "
+    << std::fixed << std::setprecision(3) << secondsSince(batchStart) << " s"
+    << std::defaultfloat << " using " << pool.size() << " threads" << std::endl;
+  return ret;
+}
+
+// Modification time and size of a file, to notice when it has been
+// written again.  Both are zero if the file cannot be seen.  The time
+// is kept to the file system's full resolution, so that a file written
+// again at the same size within a second is still noticed.
+struct FileStamp {
+  long long time = 0;     //!< Nanoseconds, or 100 ns intervals on Windows
+  long long size = 0;
+
+  bool operator==(const FileStamp &o) const { return (time == o.time) && (size == o.size); }
+  bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+
+static FileStamp fileStamp(const std::string &fileName)
+{
+  FileStamp stamp;
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA info;
+  if (GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &info)) {
+    stamp.time = (static_cast<long long>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+      info.ftLastWriteTime.dwLowDateTime;
+    stamp.size = (static_cast<long long>(info.nFileSizeHigh) << 32) |
+      info.nFileSizeLow;
+  }
+#else
+  struct stat info;
+  if (stat(fileName.c_str(), &info) == 0) {
+#ifdef __APPLE__
+    const struct timespec &modified = info.st_mtimespec;
+#else
+    const struct timespec &modified = info.st_mtim;
+#endif
+    stamp.time = static_cast<long long>(modified.tv_sec) * 1000000000LL +
+      modified.tv_nsec;
+    stamp.size = static_cast<long long>(info.st_size);
+  }
+#endif
+  return stamp;
+}
+
+// Prints the -profile summary and writes its trace, if there is one.
+//   @return ret, or 13 if it was 0 and the trace could not be written.
+static int finishProfile(const Options &opt, int ret)
+{
+  Profiler *profiler = Profiler::active();
+  if (!profiler) { return ret; }
+  profiler->report(std::cerr);
+  if (!profiler->writeTrace(opt.profileFileName)) {
+    return (ret == 0) ? 13 : ret;
+  }
+  if (opt.verbose) {
+    std::cerr << "Wrote profile trace " << opt.profileFileName << std::endl;
+  }
+  return ret;
+}
+
+// How often -watch looks at the input files.
+static const int WATCH_POLL_MILLISECONDS = 250;
+
+// Runs the job and then runs it again each time its input files change,
+// redoing only the work for the colors that did.  A file is only read
+// once it has looked the same twice in a row, so that one still being
+// written is left alone.  If a run fails, the next one starts over.
+// This returns only if the input files cannot be seen at the start.
+static int runWatch(const Options &opt, TaskPool &pool)
+{
+  size_t numFiles = opt.inputFileNames.size();
+  std::vector<FileStamp> built(numFiles), seen(numFiles);
+  for (size_t i = 0; i < numFiles; i++) {
+    built[i] = seen[i] = fileStamp(opt.inputFileNames[i]);
+    if (built[i] == FileStamp()) {
+      std::cerr << "Error: Could not find " << opt.inputFileNames[i] << std::endl;
+      return 1;
+    }
+  }
+
+  JobState state;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int ret = runJob(opt, pool, state);
+  while (true) {
+    if (ret == 0) {
+      std::cerr << "Wrote " << opt.outputFileName;
+    } else {
+      std::cerr << "FAILED with code " << ret;
+      state = JobState();
+    }
+    std::cerr << " (" << std::fixed << std::setprecision(3)
+      << secondsSince(start) << " s)" << std::defaultfloat
+      << "; watching for changes" << std::endl;
+    finishProfile(opt, ret);
+
+    // Wait until some file has changed and all of them have settled.
+    std::vector<char> changed(numFiles);
+    while (true) {
+      std::this_thread::sleep_for(
+        std::chrono::milliseconds(WATCH_POLL_MILLISECONDS));
+      bool settled = true, any = false;
+      for (size_t i = 0; i < numFiles; i++) {
+        FileStamp now = fileStamp(opt.inputFileNames[i]);
+        if ((now != seen[i]) || (now == FileStamp())) { settled = false; }
+        seen[i] = now;
+        changed[i] = (now != built[i]);
+        if (changed[i]) { any = true; }
+      }
+      if (settled && any) { break; }
+    }
+
+    for (size_t i = 0; i < numFiles; i++) {
+      if (changed[i]) {
+        std::cerr << "Changed: " << opt.inputFileNames[i] << std::endl;
+      }
+    }
+    if (!state.changed.empty()) { state.changed = changed; }
+    built = seen;
+    if (Profiler::active()) { Profiler::active()->clear(); }
+    start = std::chrono::steady_clock::now();
+    ret = runJob(opt, pool, state);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  // Parse the command line
+  Options opt;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (!parseOptions(args, opt)) { Usage(argv[0]); }
+  g_verbose = opt.verbose;
+
+  //====================================================================
+  // Run our algorithm test to make sure things are working properly.
+  int ret;
+  if ((ret = testAlgorithms()) != 0) {
+    std::cerr << "Error testing basic algorithms, code " << ret << std::endl;
+    return 100;
+  }
+
+  TaskPool pool(opt.threads);
+  if (g_verbose) {
+    std::cerr << "Using " << pool.size() << " threads" << std::endl;
+  }
+  Profiler profiler;
+  if (!opt.profileFileName.empty()) { Profiler::setActive(&profiler); }
+  if (!opt.batchFileName.empty()) {
+    if (!opt.outputFileName.empty()) {
+      std::cerr << "Error: -o cannot be used with -batch; the list names the output files" << std::endl;
+      Usage(argv[0]);
+    }
+    if (opt.watch) {
+      std::cerr << "Error: -watch cannot be used with -batch" << std::endl;
+      Usage(argv[0]);
+    }
+    if (!opt.binaryFileName.empty()) {
+      std::cerr << "Error: -binary cannot be used with -batch on the command line;"
+        << " give each line its own" << std::endl;
+      Usage(argv[0]);
+    }
+    if (opt.lutWidth > 0) {
+      std::cerr << "Error: -lut cannot be used with -batch on the command line;"
+        << " give each line its own" << std::endl;
+      Usage(argv[0]);
+    }
+    return finishProfile(opt, runBatch(opt, pool));
+  }
+  if (opt.watch) {
+    if (opt.streamTile > 0) {
+      std::cerr << "Error: -watch cannot be used with -stream" << std::endl;
+      Usage(argv[0]);
+    }
+    if (opt.inputFileNames.empty() || opt.outputFileName.empty()) {
+      std::cerr << "Error: -watch needs -mono or -rgb input files and -o" << std::endl;
+      Usage(argv[0]);
+    }
+    return runWatch(opt, pool);
+  }
+  return finishProfile(opt, runJob(opt, pool));
+}
+
 static bool small(double d)
 {
   return fabs(d) <= 1e-5;
@@ -811,6 +1895,35 @@ static int testAlgorithms()
 
   // @todo Insert a test for field angles in normalization.
 
+  //====================================================================
+  // Move one entry of a smooth table well away from where its neighbors
+  // put it and make sure that the local-fit filter removes it and only
+  // it.
+  std::vector<Mapping> fmapping;
+  for (int lon = -40; lon <= 40; lon += 4) {
+    for (int lat = -40; lat <= 40; lat += 4) {
+      Mapping m;
+      m.xyLatLong = XYLatLong(tan(lon * MY_PI / 180), tan(lat * MY_PI / 180),
+        lat, lon);
+      fmapping.push_back(m);
+    }
+  }
+  size_t moved = 7 * 21 + 12;
+  fmapping[moved].xyLatLong.x += 0.05;
+  TaskPool fpool(1);
+  std::vector<OutlierReport> freport;
+  int fremoved = remove_outliers_by_local_fit(fmapping, 5, 3, fpool, &freport);
+  if ((fremoved != 1) || (freport.size() != 1) || (freport[0].index != moved)) {
+    std::cerr << "testAlgorithms(): Local fit removed " << fremoved
+      << " points, expected only entry " << moved << std::endl;
+    return 1600;
+  }
+  if (fmapping.size() != 21 * 21 - 1) {
+    std::cerr << "testAlgorithms(): Local fit left " << fmapping.size()
+      << " points" << std::endl;
+    return 1601;
+  }
+
   if (g_verbose) {
     std::cerr << "=================== Successfully finished testAlgorithms()" << std::endl;
   }
@@ -0,0 +1,498 @@
+/** @file
+    @brief Times each stage of the AnglesToConfig pipeline and measures
+           the accuracy of the meshes it produces, on synthetic tables
+           and on measured ones.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "types.h"
+#include "helper.h"
+#include "json_writer.h"
+#include "mesh_interpolator.h"
+#include "display_config.h"
+#include "threads.h"
+
+// Standard includes
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h> // For exit()
+
+// The parser that read_from_infile() used before it read the whole
+// input at once, kept here so that we can compare against it.  Unlike
+// the original, it stops at the first unparseable entry rather than
+// looping forever on it.
+static std::vector<Mapping> legacy_read_from_infile(std::istream &in)
+{
+  std::vector<Mapping> mapping;
+
+  while (!in.eof()) {
+    Mapping map;
+    in >> map.xyLatLong.longitude >> map.xyLatLong.latitude >> map.xyLatLong.x >> map.xyLatLong.y;
+    if (in.fail() && !in.eof()) { break; }
+    mapping.push_back(map);
+  }
+  mapping.pop_back();
+
+  return mapping;
+}
+
+static bool same_mapping(const std::vector<Mapping> &a, const std::vector<Mapping> &b)
+{
+  if (a.size() != b.size()) { return false; }
+  for (size_t i = 0; i < a.size(); i++) {
+    if ((a[i].xyLatLong.longitude != b[i].xyLatLong.longitude) ||
+        (a[i].xyLatLong.latitude != b[i].xyLatLong.latitude) ||
+        (a[i].xyLatLong.x != b[i].xyLatLong.x) ||
+        (a[i].xyLatLong.y != b[i].xyLatLong.y)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the number of seconds since the specified start time.
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-repeat N] (default 20 with -parsers, 3 otherwise)"
+    << " [-parsers] (only compare the current and original parsers)"
+    << " [-synthetic N] (add an N x N synthetic table, may be repeated)"
+    << " [-mm] (screen units of the input files, default is meters)"
+    << " [-verify_angles xx xy yx yy max_degrees] (default 1 0 0 1 80)"
+    << " [-no_verify] (skip outlier removal)"
+    << " [-fit_outliers k passes] (remove outliers as AnglesToConfig -fit_outliers"
+    << " does, in place of -verify_angles)"
+    << " [-grid cols rows] (resample the mesh as AnglesToConfig -grid does)"
+    << " [-adaptive tolerance max_points] (or as AnglesToConfig -adaptive does)"
+    << " [-max_error degrees] (exit with code 5 if any maximum error is larger)"
+    << " [input_file...]"
+    << std::endl
+    << "  This program runs the AnglesToConfig pipeline for the right eye on" << std::endl
+    << "each table and reports the average time for each stage and the RMS" << std::endl
+    << "and maximum angle in degrees between each input direction and the" << std::endl
+    << "direction that the resulting mesh renders at its screen location." << std::endl
+    << "With no tables, it uses synthetic ones like MakeExampleMesh makes" << std::endl
+    << "with 11, 51, 101, 251 and 500 points on a side.  For example:" << std::endl
+    << "  " << name << " -mm -synthetic 11 -synthetic 500 HDK13/2016_02_29/*_trimmed.txt" << std::endl
+    << std::endl
+    << "  With -parsers, it instead times reading each of the input files using" << std::endl
+    << "the current parser and the original stream-based parser and reports" << std::endl
+    << "the average time for each." << std::endl
+    << std::endl;
+  exit(1);
+}
+
+// Times the current parser against the original on each file.
+static int compare_parsers(const std::vector<std::string> &inputFileNames, int repeat)
+{
+  std::cout << std::setw(40) << std::left << "file" << std::right
+    << std::setw(10) << "entries"
+    << std::setw(14) << "legacy ms"
+    << std::setw(14) << "current ms"
+    << std::setw(10) << "speedup" << std::endl;
+  int ret = 0;
+  for (size_t f = 0; f < inputFileNames.size(); f++) {
+    const std::string &name = inputFileNames[f];
+
+    std::vector<Mapping> legacy;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+      std::ifstream in(name.c_str());
+      if (!in.good()) {
+        std::cerr << "Error: Could not open " << name << std::endl;
+        return 1;
+      }
+      legacy = legacy_read_from_infile(in);
+    }
+    double legacyTime = seconds_since(start) / repeat;
+
+    std::vector<Mapping> current;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+      if (!read_from_file(name, current)) {
+        return 2;
+      }
+    }
+    double currentTime = seconds_since(start) / repeat;
+
+    std::cout << std::setw(40) << std::left << name << std::right
+      << std::setw(10) << current.size()
+      << std::fixed << std::setprecision(3)
+      << std::setw(14) << legacyTime * 1e3
+      << std::setw(14) << currentTime * 1e3
+      << std::setprecision(1)
+      << std::setw(9) << legacyTime / currentTime << "x"
+      << std::defaultfloat << std::endl;
+    if (!same_mapping(legacy, current)) {
+      std::cerr << "Error: Parsers disagree on " << name << std::endl;
+      ret = 3;
+    }
+  }
+  return ret;
+}
+
+//====================================================================
+// Pipeline benchmark.
+
+// Settings shared by all of the tables.
+struct Settings {
+  bool verifyAngles = true;
+  double xx = 1, xy = 0, yx = 0, yy = 1;
+  double maxAngleDiffDegrees = 80;
+  double outlierK = 0;
+  unsigned outlierPasses = 0; //!< Used in place of verifyAngles when not 0
+  double toMeters = 1.0;
+  double depth = 2.0;         //!< As AnglesToConfig's default
+  size_t gridCols = 0, gridRows = 0;
+  double adaptiveTolerance = 0;
+  size_t adaptivePoints = 0;
+};
+
+// One table to run through the pipeline.  Synthetic tables are held in
+// memory, so their read time does not include the disk.
+struct Dataset {
+  std::string name;
+  std::string fileName;       //!< Empty for synthetic tables
+  std::string text;
+  double toMeters = 1.0;
+};
+
+// Average seconds spent in each stage.
+enum Stage { READ, OUTLIERS, NORMALIZE, SCREEN, MESH, OUTPUT, NUM_STAGES };
+static const char *stageNames[NUM_STAGES] = {
+  "read ms", "outliers ms", "normalize ms", "screen ms", "mesh ms", "output ms"
+};
+
+struct Result {
+  size_t points = 0;          //!< Read from the table
+  size_t kept = 0;            //!< Left after removing outliers
+  size_t vertices = 0;        //!< Points in the finished mesh
+  double seconds[NUM_STAGES] = {};
+  size_t checked = 0;         //!< On-screen points the error is measured at
+  double rmsDegrees = 0;
+  double maxDegrees = 0;
+};
+
+// Makes a table with count x count entries covering a 90-degree field
+// of view with no distortion, in the format MakeExampleMesh writes.
+static std::string synthetic_table(int count)
+{
+  std::ostringstream s;
+  double step = 90.0 / (count - 1);
+  for (int x = 0; x < count; x++) {
+    double xDeg = -45 + x * step;
+    for (int y = 0; y < count; y++) {
+      double yDeg = -45 + y * step;
+      s << xDeg << " " << yDeg << " "
+        << tan(xDeg * MY_PI / 180) << " " << tan(yDeg * MY_PI / 180) << "\n";
+    }
+  }
+  return s.str();
+}
+
+// Measures the angle between each input direction and what the mesh
+// renders at its location on the screen.
+static void measure_accuracy(const MappingSet &mapping,
+  const ScreenDescription &screen, const MeshDescription &mesh, Result &result)
+{
+  DisplayConfig config;
+  config.hFOVDegrees = screen.hFOVDegrees;
+  config.vFOVDegrees = screen.vFOVDegrees;
+  config.overlapPercent = screen.overlapPercent;
+  config.xCOP[1] = screen.xCOP;
+  config.yCOP[1] = screen.yCOP;
+  EyeProjection projection(config, 1);
+
+  MeshInterpolator interpolator;
+  if (!interpolator.build(mesh)) { return; }
+  MeshInterpolator::Hint hint;
+  double sum = 0;
+  for (size_t i = 0; i < mapping.size(); i++) {
+    double x = mapping.x[i];
+    double y = mapping.y[i];
+    if ((x < 0) || (x > 1) || (y < 0) || (y > 1)) { continue; }
+    std::array<double, 2> uv;
+    interpolator.interpolate(x, y, uv, hint);
+    double error = angle_between_degrees(mapping.point(i), projection.direction(uv[0], uv[1]));
+    sum += error * error;
+    result.maxDegrees = std::max(result.maxDegrees, error);
+    result.checked++;
+  }
+  if (result.checked > 0) { result.rmsDegrees = sqrt(sum / result.checked); }
+}
+
+// Runs the pipeline the way AnglesToConfig does for one table and the
+// right eye, adding the time for each stage to the result.
+//   @return false (with a message on std::cerr) if a stage fails.
+static bool run_pipeline(const Dataset &data, const Settings &settings,
+  TaskPool &pool, bool measure, Result &result)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<Mapping> mapping;
+  if (data.fileName.empty()) {
+    if (!read_from_buffer(data.text.data(), data.text.size(), mapping, data.name)) {
+      return false;
+    }
+  } else if (!read_from_file(data.fileName, mapping)) {
+    return false;
+  }
+  if (mapping.empty()) {
+    std::cerr << "Error: No input points found in " << data.name << std::endl;
+    return false;
+  }
+  result.points = mapping.size();
+  result.seconds[READ] += seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  if (settings.verifyAngles && (remove_invalid_points_based_on_angle(mapping,
+      settings.xx, settings.xy, settings.yx, settings.yy,
+      settings.maxAngleDiffDegrees) < 0)) {
+    std::cerr << "Error verifying angles for " << data.name << std::endl;
+    return false;
+  }
+  if ((settings.outlierPasses > 0) && (remove_outliers_by_local_fit(mapping,
+      settings.outlierK, settings.outlierPasses, pool) < 0)) {
+    std::cerr << "Error fitting outliers for " << data.name << std::endl;
+    return false;
+  }
+  result.kept = mapping.size();
+  result.seconds[OUTLIERS] += seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  double left = mapping[0].xyLatLong.x, right = left;
+  double bottom = mapping[0].xyLatLong.y, top = bottom;
+  for (size_t i = 1; i < mapping.size(); i++) {
+    left = std::min(left, mapping[i].xyLatLong.x);
+    right = std::max(right, mapping[i].xyLatLong.x);
+    bottom = std::min(bottom, mapping[i].xyLatLong.y);
+    top = std::max(top, mapping[i].xyLatLong.y);
+  }
+  left *= data.toMeters;
+  right *= data.toMeters;
+  bottom *= data.toMeters;
+  top *= data.toMeters;
+  std::ostringstream log;
+  MappingSet converted(mapping.size());
+  if (!convert_to_normalized_and_meters(mapping, false, converted, 0,
+      data.toMeters, settings.depth, left, bottom, right, top, true, log)) {
+    std::cerr << "Error: Could not normalize " << data.name << std::endl;
+    return false;
+  }
+  result.seconds[NORMALIZE] += seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  ScreenDescription screen;
+  ScreenProjection projection;
+  if (!findScreen(converted, left, bottom, right, top, screen, pool,
+      projection)) {
+    std::cerr << "Error: Could not find screen for " << data.name << std::endl;
+    return false;
+  }
+  result.seconds[SCREEN] += seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  MeshDescription mesh;
+  if (!findMesh(converted, projection, 0, left, bottom, right, top,
+      screen, mesh)) {
+    std::cerr << "Error: Could not find mesh for " << data.name << std::endl;
+    return false;
+  }
+  if (settings.gridCols > 0) {
+    MeshDescription grid;
+    if (!resample_mesh_to_grid(mesh, settings.gridCols, settings.gridRows, grid)) {
+      return false;
+    }
+    mesh.swap(grid);
+  } else if (settings.adaptivePoints > 0) {
+    MeshDescription adaptive;
+    if (!resample_mesh_adaptive(mesh, settings.adaptiveTolerance,
+          settings.adaptivePoints, adaptive)) {
+      return false;
+    }
+    mesh.swap(adaptive);
+  }
+  result.vertices = mesh.size();
+  result.seconds[MESH] += seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  JsonWriter out;
+  write_mesh(out, mesh, 4);
+  result.seconds[OUTPUT] += seconds_since(start);
+
+  if (measure) {
+    measure_accuracy(converted, screen, mesh, result);
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  // Parse the command line
+  std::vector<std::string> inputFileNames;
+  std::vector<int> syntheticSizes;
+  Settings settings;
+  bool parsers = false;
+  double maxError = 0;
+  int repeat = 0;
+  for (int i = 1; i < argc; i++) {
+    if (std::string("-repeat") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      repeat = atoi(argv[i]);
+      if (repeat < 1) { Usage(argv[0]); }
+    } else if (std::string("-parsers") == argv[i]) {
+      parsers = true;
+    } else if (std::string("-synthetic") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      int count = atoi(argv[i]);
+      if (count < 3) {
+        std::cerr << "Error: -synthetic needs at least 3 points on a side" << std::endl;
+        Usage(argv[0]);
+      }
+      syntheticSizes.push_back(count);
+    } else if (std::string("-mm") == argv[i]) {
+      settings.toMeters = 1e-3;
+    } else if (std::string("-verify_angles") == argv[i]) {
+      if (i + 5 >= argc) { Usage(argv[0]); }
+      settings.verifyAngles = true;
+      settings.xx = atof(argv[++i]);
+      settings.xy = atof(argv[++i]);
+      settings.yx = atof(argv[++i]);
+      settings.yy = atof(argv[++i]);
+      settings.maxAngleDiffDegrees = atof(argv[++i]);
+      settings.outlierPasses = 0;
+    } else if (std::string("-fit_outliers") == argv[i]) {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      double k = atof(argv[++i]);
+      int passes = atoi(argv[++i]);
+      if ((k <= 0) || (passes < 1)) { Usage(argv[0]); }
+      settings.outlierK = k;
+      settings.outlierPasses = static_cast<unsigned>(passes);
+      settings.verifyAngles = false;
+    } else if (std::string("-no_verify") == argv[i]) {
+      settings.verifyAngles = false;
+      settings.outlierPasses = 0;
+    } else if (std::string("-grid") == argv[i]) {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      int cols = atoi(argv[++i]);
+      int rows = atoi(argv[++i]);
+      if ((cols < 2) || (rows < 2)) { Usage(argv[0]); }
+      settings.gridCols = static_cast<size_t>(cols);
+      settings.gridRows = static_cast<size_t>(rows);
+      settings.adaptivePoints = 0;
+    } else if (std::string("-adaptive") == argv[i]) {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      double tolerance = atof(argv[++i]);
+      int points = atoi(argv[++i]);
+      if ((tolerance <= 0) || (points < 25)) { Usage(argv[0]); }
+      settings.adaptiveTolerance = tolerance;
+      settings.adaptivePoints = static_cast<size_t>(points);
+      settings.gridCols = settings.gridRows = 0;
+    } else if (std::string("-max_error") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      maxError = atof(argv[i]);
+    } else if (argv[i][0] == '-') {
+      Usage(argv[0]);
+    } else {
+      inputFileNames.push_back(argv[i]);
+    }
+  }
+
+  if (parsers) {
+    if (inputFileNames.size() == 0) { Usage(argv[0]); }
+    return compare_parsers(inputFileNames, repeat > 0 ? repeat : 20);
+  }
+  if (repeat == 0) { repeat = 3; }
+
+  //====================================================================
+  // Collect the tables.
+  if (inputFileNames.empty() && syntheticSizes.empty()) {
+    int sizes[] = { 11, 51, 101, 251, 500 };
+    syntheticSizes.assign(sizes, sizes + sizeof(sizes) / sizeof(sizes[0]));
+  }
+  std::vector<Dataset> datasets;
+  for (size_t i = 0; i < syntheticSizes.size(); i++) {
+    Dataset data;
+    std::ostringstream name;
+    name << "synthetic " << syntheticSizes[i] << "x" << syntheticSizes[i];
+    data.name = name.str();
+    data.text = synthetic_table(syntheticSizes[i]);
+    datasets.push_back(data);
+  }
+  for (size_t i = 0; i < inputFileNames.size(); i++) {
+    Dataset data;
+    data.name = data.fileName = inputFileNames[i];
+    data.toMeters = settings.toMeters;
+    datasets.push_back(data);
+  }
+
+  //====================================================================
+  // Run each table through the pipeline, measuring accuracy on the
+  // first pass; the mesh is the same each time.
+  std::cout << std::setw(40) << std::left << "table" << std::right
+    << std::setw(9) << "points" << std::setw(9) << "kept" << std::setw(9) << "mesh";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    std::cout << std::setw(14) << stageNames[s];
+  }
+  std::cout << std::setw(12) << "rms deg" << std::setw(12) << "max deg" << std::endl;
+  int ret = 0;
+  TaskPool pool;
+  for (size_t d = 0; d < datasets.size(); d++) {
+    Result result;
+    for (int r = 0; r < repeat; r++) {
+      if (!run_pipeline(datasets[d], settings, pool, r == 0, result)) {
+        return 2;
+      }
+    }
+    std::string name = datasets[d].name;
+    if (name.size() > 39) { name = "..." + name.substr(name.size() - 36); }
+    std::cout << std::setw(40) << std::left << name << std::right
+      << std::setw(9) << result.points << std::setw(9) << result.kept
+      << std::setw(9) << result.vertices
+      << std::fixed << std::setprecision(3);
+    for (int s = 0; s < NUM_STAGES; s++) {
+      std::cout << std::setw(14) << result.seconds[s] / repeat * 1e3;
+    }
+    std::cout << std::setprecision(5)
+      << std::setw(12) << result.rmsDegrees << std::setw(12) << result.maxDegrees
+      << std::defaultfloat << std::endl;
+    if ((maxError > 0) && (result.maxDegrees > maxError)) {
+      std::cerr << "Error: " << datasets[d].name << " has an error of "
+        << result.maxDegrees << " degrees, more than " << maxError << std::endl;
+      ret = 5;
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,240 @@
+/** @file
+    @brief Turns camera captures of the PresentPattern display into the
+           angle-to-screen tables that AnglesToConfig reads.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "pattern_capture.h"
+#include "threads.h"
+
+// Standard includes
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdlib.h> // For exit()
+
+// Global constants and variables
+static bool g_verbose = false;
+
+// PresentPatternRenderManager spaces its spheres so that this many fit
+// across half of the viewport width, unless -densities says otherwise.
+static const int PATTERN_SPHERES_X = 20;
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " -fov horizontal_degrees vertical_degrees | -camera fx fy cx cy"
+    <<   " (camera intrinsics, in pixels)"
+    << " [-camera_k k1 k2] (camera lens radial distortion, default 0 0)"
+    << " -spacing pixels | -viewport_width pixels"
+    <<   " (sphere spacing on the display, or the PresentPattern viewport width)"
+    << " [-spheres_x N] (the PresentPattern -densities entry the images show,"
+    <<   " which -viewport_width needs to find the spacing, default 20)"
+    << " [-pixel_mm size] (write screen locations in mm rather than pixels)"
+    << " [-threshold fraction] (of the brightest pixel, default 0.5)"
+    << " [-min_area pixels] (default 4)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-verbose] (default is not)"
+    << " -mono image.pnm outfile | -rgb red.pnm green.pnm blue.pnm outfile_prefix"
+    << std::endl
+    << "  Each image is a binary PGM or PPM camera capture, taken from the eye"
+    << " position, of PresentPatternRenderManager showing one color.  Writes the"
+    << " longitude latitude x y table for each color (with _red, _green and _blue"
+    << " appended to the prefix for -rgb)."
+    << std::endl;
+  exit(1);
+}
+
+struct Options {
+  bool haveCamera = false;
+  bool fov = false;
+  double fovX = 0, fovY = 0;
+  CameraModel camera;
+  double spacing = 0;           //!< Pixels between spheres on the display
+  double viewportWidth = 0;     //!< Zero means -spacing was given
+  int spheresX = PATTERN_SPHERES_X;
+  double pixelMM = 0;           //!< Zero means write pixels
+  double threshold = 0.5;
+  size_t minArea = 4;
+  unsigned threads = 0;
+  std::vector<std::string> images;
+  std::vector<std::string> outputs;
+};
+
+// Finds the spheres in one capture and writes their table.
+//   @return 0 on success, or the program's exit code on failure.
+static int process(const Options &opt, const std::string &imageName,
+  const std::string &outName, TaskPool &pool)
+{
+  CaptureImage image;
+  if (!read_pnm_image(imageName, image)) {
+    return 2;
+  }
+  CameraModel camera = opt.camera;
+  if (opt.fov) {
+    CameraModel fromFOV = CameraModel::from_fov(image.width, image.height, opt.fovX, opt.fovY);
+    fromFOV.k1 = camera.k1;
+    fromFOV.k2 = camera.k2;
+    camera = fromFOV;
+  }
+
+  float peak = image_peak(image, pool);
+  if (peak <= 0) {
+    std::cerr << "Error: " << imageName << " is black" << std::endl;
+    return 3;
+  }
+  std::vector<Blob> blobs;
+  if (!detect_blobs(image, static_cast<float>(opt.threshold * peak), opt.minArea, pool, blobs)) {
+    return 3;
+  }
+  std::vector<PatternSpot> spots;
+  if (!label_pattern_grid(blobs, spots)) {
+    std::cerr << "Error: Could not find the pattern in " << imageName << std::endl;
+    return 3;
+  }
+  if (g_verbose) {
+    std::cerr << imageName << ": " << image.width << "x" << image.height
+      << ", " << blobs.size() << " blobs, " << spots.size()
+      << " spheres identified" << std::endl;
+  }
+
+  std::ofstream out(outName.c_str());
+  if (!out) {
+    std::cerr << "Error: Could not open " << outName << " for writing" << std::endl;
+    return 4;
+  }
+  double scale = (opt.pixelMM > 0) ? opt.pixelMM : 1.0;
+  out << std::setprecision(7);
+  for (size_t i = 0; i < spots.size(); i++) {
+    double longitude, latitude;
+    camera.field_angles(spots[i].x, spots[i].y, longitude, latitude);
+    out << longitude << " " << latitude << " "
+      << spots[i].col * opt.spacing * scale << " "
+      << spots[i].row * opt.spacing * scale << "\n";
+  }
+  if (!out.good()) {
+    std::cerr << "Error: Could not write " << outName << std::endl;
+    return 4;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+
+  // Parse the command line
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-verbose") {
+      g_verbose = true;
+    } else if (arg == "-fov") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.fovX = atof(argv[++i]);
+      opt.fovY = atof(argv[++i]);
+      if ((opt.fovX <= 0) || (opt.fovX >= 180) || (opt.fovY <= 0) || (opt.fovY >= 180)) {
+        std::cerr << "Error: -fov angles must be between 0 and 180 degrees" << std::endl;
+        Usage(argv[0]);
+      }
+      opt.fov = true;
+      opt.haveCamera = true;
+    } else if (arg == "-camera") {
+      if (i + 4 >= argc) { Usage(argv[0]); }
+      opt.camera.fx = atof(argv[++i]);
+      opt.camera.fy = atof(argv[++i]);
+      opt.camera.cx = atof(argv[++i]);
+      opt.camera.cy = atof(argv[++i]);
+      if ((opt.camera.fx <= 0) || (opt.camera.fy <= 0)) {
+        std::cerr << "Error: -camera focal lengths must be positive" << std::endl;
+        Usage(argv[0]);
+      }
+      opt.fov = false;
+      opt.haveCamera = true;
+    } else if (arg == "-camera_k") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.camera.k1 = atof(argv[++i]);
+      opt.camera.k2 = atof(argv[++i]);
+    } else if (arg == "-spacing") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.spacing = atof(argv[i]);
+      opt.viewportWidth = 0;
+    } else if (arg == "-viewport_width") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.viewportWidth = atof(argv[i]);
+      opt.spacing = 0;
+    } else if (arg == "-spheres_x") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.spheresX = atoi(argv[i]);
+      if (opt.spheresX < 2) {
+        std::cerr << "Error: -spheres_x must be at least 2" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (arg == "-pixel_mm") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.pixelMM = atof(argv[i]);
+    } else if (arg == "-threshold") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.threshold = atof(argv[i]);
+      if ((opt.threshold <= 0) || (opt.threshold >= 1)) {
+        std::cerr << "Error: -threshold must be between 0 and 1" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (arg == "-min_area") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.minArea = static_cast<size_t>(atoi(argv[i]));
+    } else if (arg == "-threads") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.threads = static_cast<unsigned>(atoi(argv[i]));
+    } else if (arg == "-mono") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.images.assign(1, argv[++i]);
+      opt.outputs.assign(1, argv[++i]);
+    } else if (arg == "-rgb") {
+      if (i + 4 >= argc) { Usage(argv[0]); }
+      static const char *suffixes[] = { "_red", "_green", "_blue" };
+      opt.images.clear();
+      opt.outputs.clear();
+      for (size_t c = 0; c < 3; c++) { opt.images.push_back(argv[++i]); }
+      std::string prefix = argv[++i];
+      for (size_t c = 0; c < 3; c++) { opt.outputs.push_back(prefix + suffixes[c] + ".txt"); }
+    } else {
+      Usage(argv[0]);
+    }
+  }
+  if (opt.viewportWidth > 0) {
+    // The same spacing as MakeSphereLayout() in PresentPatternRenderManager
+    opt.spacing = (opt.viewportWidth / 2) / (opt.spheresX - 0.5);
+  }
+  if (!opt.haveCamera || (opt.spacing <= 0) || opt.images.empty()) {
+    Usage(argv[0]);
+  }
+
+  TaskPool pool(opt.threads);
+  for (size_t i = 0; i < opt.images.size(); i++) {
+    int ret = process(opt, opt.images[i], opt.outputs[i], pool);
+    if (ret != 0) { return ret; }
+  }
+  return 0;
+}
@@ -30,6 +30,8 @@
 #include "osvr/RenderKit/RenderManager.h"
 #include "types.h"
 #include "helper.h"
+#include "frame_timer.h"
+#include "profiler.h"
 
 // Needed for render buffer calls.  OSVR will have called glewInit() for us
 // when we open the display.
@@ -288,6 +290,11 @@ void Usage(std::string name)
     << " [-mm] (screen distance units in the config file, default is meters)"
     << " [-screen screen_left_meters screen_bottom_meters screen_right_meters screen_top_meters]"
     << " (default auto-compute based on ranges seen)"
+    << " [-timing] (show frame timing)"
+    << " [-timing_csv file.csv] (also log frame timing)"
+    << " [-refresh_hz HZ] (display refresh rate for missed-vsync counts, default 60)"
+    << " [-profile out_trace_file_name] (print the time spent processing the table"
+    << " and write a Chrome trace of it)"
     << std::endl
     << "  This program reads from standard input a configuration that has a list of" << std::endl
     << "x,y screen coordinates in meters followed by long,lat angles in" << std::endl
@@ -308,6 +315,10 @@ int main(int argc, char *argv[])
   double left, right, bottom, top;
   double depth = 2.0;
   double toMeters = 1.0;
+  bool timing = false;
+  std::string timingFileName;
+  std::string profileFileName;
+  double refreshHz = 60;
   int realParams = 0;
   for (int i = 1; i < argc; i++) {
     if (std::string("-mm") == argv[i]) {
@@ -338,6 +349,18 @@ int main(int argc, char *argv[])
         std::cerr << "Bad value for -eye: " << eye << ", expected left or right" << std::endl;
         Usage(argv[0]);
       }
+    } else if (std::string("-timing") == argv[i]) {
+      timing = true;
+    } else if (std::string("-timing_csv") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      timing = true;
+      timingFileName = argv[i];
+    } else if (std::string("-refresh_hz") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      refreshHz = atof(argv[i]);
+    } else if (std::string("-profile") == argv[i]) {
+      if (++i >= argc) { Usage(argv[0]); }
+      profileFileName = argv[i];
     } else if ((argv[i][0] == '-') && (atof(argv[i]) == 0.0)) {
       Usage(argv[0]);
     }
@@ -348,12 +371,17 @@ int main(int argc, char *argv[])
     }
   }
   if (realParams != 0) { Usage(argv[0]); }
+  Profiler profiler;
+  if (!profileFileName.empty()) { Profiler::setActive(&profiler); }
 
   //====================================================================
   // Parse the angle-configuration information from standard input.  Expect white-space
   // separation between numbers and also between entries (which may be on separate
   // lines).
+  ProfileScope profileRead("read", "standard input");
   std::vector<Mapping> mapping = read_from_infile(std::cin);
+  profileRead.count("points", static_cast<double>(mapping.size()));
+  profileRead.end();
   if (mapping.size() == 0) {
     std::cerr << "Error: No input points found" << std::endl;
     return 2;
@@ -363,6 +391,7 @@ int main(int argc, char *argv[])
   // If we've been asked to auto-range the screen coordinates, compute
   // them here.
   if (computeBounds) {
+    ProfileScope profile("bounds");
     left = right = mapping[0].xyLatLong.x;
     bottom = top = mapping[0].xyLatLong.y;
     for (size_t i = 1; i < mapping.size(); i++) {
@@ -532,8 +561,11 @@ int main(int argc, char *argv[])
   // where the angles are both 0.
   // @todo if exact sample not found, interpolate between nearest three
   // non-collinear points.
+  ProfileScope profileConvert("convert");
+  profileConvert.count("points", static_cast<double>(mapping.size()));
   convert_to_normalized_and_meters(mapping, toMeters, depth,
     left, bottom, right, top, useFieldAngles);
+  profileConvert.end();
   XY forward;
   forward.x = -1e5;    // Start out off-screen
   forward.y = -1e5;  // Start out off-screen
@@ -556,6 +588,14 @@ int main(int argc, char *argv[])
     rightForward.x = 1 - forward.x;
   }
 
+  // The table is processed once, before rendering starts, so the profile
+  // is finished here.  Failing to write it does not stop the program.
+  if (Profiler::active()) {
+    profiler.report(std::cerr);
+    profiler.writeTrace(profileFileName);
+    Profiler::setActive(nullptr);
+  }
+
     // If we're debugging the forwards direction, we need to turn off
     // distortion correction so that we draw the sphere directly into
     // screen coordinates.
@@ -596,8 +636,19 @@ int main(int argc, char *argv[])
         distortionParams);
     }
 
+    // Set up frame timing if it was asked for.
+    FrameTimer timer;
+    timer.setEnabled(timing);
+    timer.setRefreshRate(refreshHz);
+    if (!timingFileName.empty() && !timer.openLog(timingFileName)) {
+      delete render;
+      return 4;
+    }
+
     // Continue rendering until it is time to quit.
     while (!quit) {
+        timer.beginFrame();
+
         // Update the context so we get our callbacks called and
         // update analog and button states.
         context.update();
@@ -606,23 +657,30 @@ int main(int argc, char *argv[])
         OSVR_TimeValue  ignore;
         OSVR_AnalogState triggerValue = 0;
         osvrGetAnalogState(analogTrigger.get(), &ignore, &triggerValue);
+        timer.endStage(FrameTimer::STAGE_UPDATE);
 
         renderInfo = render->GetRenderInfo();
+        timer.endStage(FrameTimer::STAGE_RENDER_INFO);
 
         // Render into each buffer using the specified information.
         for (size_t i = 0; i < renderInfo.size(); i++) {
+          timer.beginGPU(i);
           RenderView(i, displayConfiguration, renderManagerConfig,
             renderInfo[i], frameBuffer,
             colorBuffers[i].OpenGL->colorBufferName,
             depthBuffers[i],
             leftForward, rightForward);
+          timer.endGPU(i);
+          timer.drawOverlay();
         }
+        timer.endStage(FrameTimer::STAGE_RENDER);
 
         // Send the rendered results to the screen
         if (!render->PresentRenderBuffers(colorBuffers, renderInfo)) {
           std::cerr << "PresentRenderBuffers() returned false, maybe because it was asked to quit" << std::endl;
           quit = true;
         }
+        timer.endStage(FrameTimer::STAGE_PRESENT);
     }
 
     // Clean up after ourselves.
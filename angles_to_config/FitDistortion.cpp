@@ -0,0 +1,328 @@
+/** @file
+    @brief Finds the calibration program's K1 (and optionally higher
+           radial terms) and center of projection for each color from
+           measured angle tables, rather than by adjusting them by eye.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "types.h"
+#include "helper.h"
+#include "display_config.h"
+#include "radial_fit.h"
+#include "threads.h"
+
+// Standard includes
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h> // For exit()
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-eye right|left] (eye the tables are for, default is right)"
+    << " [-latlong] (use latitude/longitude angles, default is field angles)"
+    << " [-mm] (screen distance units in the tables, default is meters)"
+    << " [-screen screen_left_meters screen_bottom_meters screen_right_meters screen_top_meters]"
+    <<   " (default auto-compute based on ranges seen)"
+    << " [-verify_angles xx xy yx yy max_degrees] (as for AnglesToConfig)"
+    << " [-max_angle degrees] (only fit points this close to straight ahead, default all)"
+    << " [-pixels width height] (calibration window size, default 1920 1080)"
+    << " [-fullscreen] (one eye fills the window, default is side by side)"
+    << " [-terms N] (number of radial terms K1..KN, default 1)"
+    << " [-cop_per_color] (fit a center of projection for each color)"
+    << " [-cop x y] (hold the center of projection fixed, as a fraction of the window)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-verbose] (default is not)"
+    << " [-o output_file] (default standard output)"
+    << " [-mono in_config_mono_file_name | -rgb red_file green_file blue_file]"
+    << std::endl
+    << "  This program fits the radial distortion model that the calibration" << std::endl
+    << "program draws with to the measured tables, and writes the result in" << std::endl
+    << "the HMD_Config.json format that the calibration program loads.  The" << std::endl
+    << "calibration program uses only K1 and one center; higher terms and" << std::endl
+    << "per-color centers are written in a separate fit section." << std::endl
+    << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  // Set defaults
+  std::vector<std::string> inputFileNames;
+  bool useRightEye = true;
+  bool computeBounds = true;
+  bool useFieldAngles = true;
+  bool verifyAngles = false;
+  bool verbose = false;
+  bool fullscreen = false;
+  double xx = 0, xy = 0, yx = 0, yy = 0, maxAngleDiffDegrees = 0;
+  double left = 0, right = 0, bottom = 0, top = 0;
+  double toMeters = 1.0;
+  double maxAngle = 0;
+  double width = 1920, height = 1080;
+  double copX = 0, copY = 0;
+  unsigned threads = 0;
+  std::string outputFileName;
+  RadialFitOptions fitOptions;
+
+  // Parse the command line
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-mm") {
+      toMeters = 1e-3;  // Convert input in millimeters to meters
+    } else if (arg == "-latlong") {
+      useFieldAngles = false;
+    } else if (arg == "-verbose") {
+      verbose = true;
+    } else if (arg == "-fullscreen") {
+      fullscreen = true;
+    } else if (arg == "-cop_per_color") {
+      fitOptions.sharedCOP = false;
+    } else if (arg == "-eye") {
+      if (++i >= argc) { Usage(argv[0]); }
+      std::string eye = argv[i];
+      if ((eye != "left") && (eye != "right")) {
+        std::cerr << "Bad value for -eye: " << eye << ", expected left or right" << std::endl;
+        Usage(argv[0]);
+      }
+      useRightEye = (eye == "right");
+    } else if (arg == "-screen") {
+      if (i + 4 >= argc) { Usage(argv[0]); }
+      computeBounds = false;
+      left = atof(argv[++i]);
+      bottom = atof(argv[++i]);
+      right = atof(argv[++i]);
+      top = atof(argv[++i]);
+    } else if (arg == "-verify_angles") {
+      if (i + 5 >= argc) { Usage(argv[0]); }
+      verifyAngles = true;
+      xx = atof(argv[++i]);
+      xy = atof(argv[++i]);
+      yx = atof(argv[++i]);
+      yy = atof(argv[++i]);
+      maxAngleDiffDegrees = atof(argv[++i]);
+    } else if (arg == "-max_angle") {
+      if (++i >= argc) { Usage(argv[0]); }
+      maxAngle = atof(argv[i]);
+    } else if (arg == "-pixels") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      width = atof(argv[++i]);
+      height = atof(argv[++i]);
+      if ((width < 1) || (height < 1)) { Usage(argv[0]); }
+    } else if (arg == "-terms") {
+      if (++i >= argc) { Usage(argv[0]); }
+      int terms = atoi(argv[i]);
+      if ((terms < 1) || (terms > 6)) {
+        std::cerr << "Error: -terms must be between 1 and 6" << std::endl;
+        Usage(argv[0]);
+      }
+      fitOptions.numTerms = static_cast<size_t>(terms);
+    } else if (arg == "-cop") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      fitOptions.fixedCOP = true;
+      copX = atof(argv[++i]);
+      copY = atof(argv[++i]);
+    } else if (arg == "-threads") {
+      if (++i >= argc) { Usage(argv[0]); }
+      threads = static_cast<unsigned>(atoi(argv[i]));
+    } else if (arg == "-o") {
+      if (++i >= argc) { Usage(argv[0]); }
+      outputFileName = argv[i];
+    } else if (arg == "-mono") {
+      if (++i >= argc) { Usage(argv[0]); }
+      inputFileNames.assign(1, argv[i]);
+    } else if (arg == "-rgb") {
+      if (i + 3 >= argc) { Usage(argv[0]); }
+      inputFileNames.clear();
+      for (int c = 0; c < 3; c++) { inputFileNames.push_back(argv[++i]); }
+    } else {
+      Usage(argv[0]);
+    }
+  }
+  if (inputFileNames.empty()) { Usage(argv[0]); }
+  fitOptions.width = width;
+
+  //====================================================================
+  // Read the tables and remove inconsistent points, as AnglesToConfig
+  // does.
+  std::vector< std::vector<Mapping> > mappings(inputFileNames.size());
+  for (size_t m = 0; m < mappings.size(); m++) {
+    if (!read_from_file(inputFileNames[m], mappings[m])) { return 1; }
+    if (mappings[m].empty()) {
+      std::cerr << "Error: No input points found in " << inputFileNames[m] << std::endl;
+      return 2;
+    }
+    if (verifyAngles) {
+      int removed = remove_invalid_points_based_on_angle(mappings[m], xx, xy, yx, yy,
+        maxAngleDiffDegrees);
+      if (removed < 0) {
+        std::cerr << "Error verifying angles for mesh " << m << std::endl;
+        return 60;
+      }
+      if (verbose) {
+        std::cerr << "Removed " << removed << " points from " << inputFileNames[m] << std::endl;
+      }
+    }
+  }
+  if (computeBounds) {
+    left = right = mappings[0][0].xyLatLong.x;
+    bottom = top = mappings[0][0].xyLatLong.y;
+    for (size_t m = 0; m < mappings.size(); m++) {
+      for (size_t i = 0; i < mappings[m].size(); i++) {
+        left = std::min(left, mappings[m][i].xyLatLong.x);
+        right = std::max(right, mappings[m][i].xyLatLong.x);
+        bottom = std::min(bottom, mappings[m][i].xyLatLong.y);
+        top = std::max(top, mappings[m][i].xyLatLong.y);
+      }
+    }
+    left *= toMeters;
+    right *= toMeters;
+    bottom *= toMeters;
+    top *= toMeters;
+  }
+  if ((right <= left) || (top <= bottom)) {
+    std::cerr << "Error: Screen has no area" << std::endl;
+    return 3;
+  }
+
+  //====================================================================
+  // Convert each point into calibration-window pixels (origin at the
+  // bottom left) and ray tangents.  Side by side, the calibration
+  // program stores the left eye's center in the left half of the
+  // window, so tables for the right eye are reflected into it.
+  bool reflect = !fullscreen && useRightEye;
+  double eyeWidth = fullscreen ? width : width / 2;
+  double eyeLeft = reflect ? -right : left;
+  double eyeRight = reflect ? -left : right;
+  double cosMax = cos(maxAngle * MY_PI / 180);
+  std::vector< std::vector<RadialSample> > samples(mappings.size());
+  for (size_t m = 0; m < mappings.size(); m++) {
+    const std::vector<Mapping> eyeMapping = reflect ? reflect_mapping(mappings[m]) : mappings[m];
+    for (size_t i = 0; i < eyeMapping.size(); i++) {
+      const XYLatLong &p = eyeMapping[i].xyLatLong;
+      XYZ d = angles_to_direction(p.longitude, p.latitude, useFieldAngles);
+      if (d.z >= 0) { continue; }
+      if ((maxAngle > 0) &&
+          (-d.z / sqrt(d.x * d.x + d.y * d.y + d.z * d.z) < cosMax)) {
+        continue;
+      }
+      RadialSample s;
+      s.tx = d.x / -d.z;
+      s.ty = d.y / -d.z;
+      s.sx = (p.x * toMeters - eyeLeft) / (eyeRight - eyeLeft) * eyeWidth;
+      s.sy = (p.y * toMeters - bottom) / (top - bottom) * height;
+      samples[m].push_back(s);
+    }
+    if (verbose) {
+      std::cerr << "Fitting " << samples[m].size() << " points from "
+        << inputFileNames[m] << std::endl;
+    }
+  }
+
+  //====================================================================
+  // Fit all colors at once.
+  TaskPool pool(threads);
+  std::vector<RadialModel> models(samples.size());
+  for (size_t c = 0; c < models.size(); c++) {
+    models[c].copX = copX * width;
+    models[c].copY = copY * height;
+  }
+  std::vector<RadialFitResult> results;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (!fit_radial_models(samples, fitOptions, pool, models, results)) {
+    return 4;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  static const char *colorNames[] = { "red", "green", "blue" };
+  for (size_t c = 0; c < models.size(); c++) {
+    std::cerr << (models.size() == 3 ? colorNames[c] : "mono") << ": K1 " << models[c].k[0];
+    for (size_t i = 1; i < models[c].k.size(); i++) {
+      std::cerr << " K" << i + 1 << " " << models[c].k[i];
+    }
+    std::cerr << ", COP " << models[c].copX / width << " " << models[c].copY / height
+      << ", rms " << results[c].rmsPixels << " pixels, max " << results[c].maxPixels
+      << " pixels, rms " << results[c].rmsDegrees << " degrees, max "
+      << results[c].maxDegrees << " degrees" << std::endl;
+    if (results[c].foldRadius > 0) {
+      std::cerr << "Warning: " << (models.size() == 3 ? colorNames[c] : "mono")
+        << " distortion turns back on itself at r " << results[c].foldRadius
+        << ", inside the measured points" << std::endl;
+    }
+  }
+  if (verbose || !results[0].converged) {
+    std::cerr << (results[0].converged ? "Converged" : "Warning: did not converge")
+      << " after " << results[0].iterations << " iterations in " << seconds * 1e3
+      << " ms" << std::endl;
+  }
+
+  //====================================================================
+  // Write the configuration the way OpenGL_Widget::saveConfigToJson()
+  // does, since loadConfigFromJson() reads it line by line.  With one
+  // table, all three colors get its K1.  The center is green's when
+  // each color has its own.
+  FILE *f = stdout;
+  if (!outputFileName.empty() && ((f = fopen(outputFileName.c_str(), "w")) == NULL)) {
+    std::cerr << "Error: Could not open " << outputFileName << " for writing" << std::endl;
+    return 5;
+  }
+  const RadialModel &red = models[0];
+  const RadialModel &green = models[models.size() == 3 ? 1 : 0];
+  const RadialModel &blue = models[models.size() == 3 ? 2 : 0];
+  bool extra = (fitOptions.numTerms > 1) || !fitOptions.sharedCOP;
+  fprintf(f, "{\n");
+  fprintf(f, "    \"hmd\": {\n");
+  fprintf(f, "        \"distortion\": {\n");
+  fprintf(f, "            \"k1_red\": %g,\n", red.k[0]);
+  fprintf(f, "            \"k1_green\": %g,\n", green.k[0]);
+  fprintf(f, "            \"k1_blue\": %g\n", blue.k[0]);
+  fprintf(f, "        },\n");
+  fprintf(f, "        \"eyes\": [\n");
+  fprintf(f, "            {\n");
+  fprintf(f, "                \"center_proj_x\": %f,\n", green.copX / width);
+  fprintf(f, "                \"center_proj_y\": %f\n", green.copY / height);
+  fprintf(f, "            }\n");
+  fprintf(f, "        ],\n");
+  fprintf(f, "        \"fullscreen\": %d%s\n", (int)fullscreen, extra ? "," : "");
+  if (extra) {
+    fprintf(f, "        \"fit\": {\n");
+    for (size_t c = 0; c < 3; c++) {
+      const RadialModel &m = (c == 0) ? red : ((c == 1) ? green : blue);
+      fprintf(f, "            \"%s\": { \"k\": [", colorNames[c]);
+      for (size_t i = 0; i < m.k.size(); i++) {
+        fprintf(f, "%s%g", i == 0 ? " " : ", ", m.k[i]);
+      }
+      fprintf(f, " ], \"center_proj_x\": %f, \"center_proj_y\": %f }%s\n",
+        m.copX / width, m.copY / height, c < 2 ? "," : "");
+    }
+    fprintf(f, "        }\n");
+  }
+  fprintf(f, "    }\n");
+  fprintf(f, "}\n");
+  if (f != stdout) { fclose(f); }
+
+  return 0;
+}
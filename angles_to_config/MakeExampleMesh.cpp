@@ -24,6 +24,7 @@
 // limitations under the License.
 
 // Internal Includes
+#include "threads.h"
 
 // Standard includes
 #include <iostream>
@@ -32,63 +33,386 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <stdint.h>
 #include <stdlib.h> // For exit()
 
 // Global constants and variables
 static bool g_verbose = false;
 #define MY_PI (4.0*atan(1.0))
 
+// Entries generated by each task; a few times the thread count of these
+// are formatted before each write.
+static const size_t BLOCK_ENTRIES = 4096;
+
 void Usage(std::string name)
 {
   std::cerr << "Usage: " << name
+    << " [-grid cols rows] (number of longitudes and latitudes, default 11 11)"
+    << " [-fov horizontal_degrees vertical_degrees] (default 90 90)"
+    << " [-radial red|green|blue|all k1 k2 k3] (default 0 0 0)"
+    << " [-tangential red|green|blue|all p1 p2] (default 0 0; naming one"
+    <<   " color needs -rgb)"
+    << " [-noise sigma] (standard deviation added to each screen coordinate,"
+    <<   " default 0)"
+    << " [-outliers fraction distance] (move this fraction of the entries"
+    <<   " this far in a random direction, default none)"
+    << " [-truth out_outlier_file_name] (list which entries are outliers)"
+    << " [-seed N] (default 1)"
+    << " [-precision N] (significant digits, default 6)"
+    << " [-binary] (write doubles rather than text)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-verbose] (default is not)"
+    << " [-o out_file_name | -rgb out_file_prefix] (default standard output)"
     << std::endl
-    << "  This program produces on standard output an example angles"
-    << " to display location file with a 90 degree field of view and."
+    << "  This program produces an example angles to display location table"
+    << " for AnglesToConfig, with longitude and latitude field angles in"
+    << " degrees followed by screen x and y in units of the screen distance."
+    << " The default is an 11 by 11 grid with a 90 degree field of view and"
     << " no distortion."
+    << std::endl
+    << "  The distortion is the Brown-Conrady model about the straight-ahead"
+    << " point.  With -rgb, one table is written per color, with _red, _green"
+    << " and _blue appended to the prefix, and each color can have its own"
+    << " distortion.  The noise and outliers come from the seed and the entry,"
+    << " so the output does not depend on the number of threads.  Binary"
+    << " tables hold four doubles per entry, in the machine's byte order and"
+    << " the layout that SampleSpan in mesh_generator.h takes."
     << std::endl;
   exit(1);
 }
 
-int main(int argc, char *argv[])
-{
-  // Set defaults
-  double xFOVDeg = 90.0;
-  double yFOVDeg = 90.0;
+/// Lens distortion for one color, applied to the undistorted screen
+/// point (x, y) with r^2 = x^2 + y^2:
+///   x' = x (1 + k1 r^2 + k2 r^4 + k3 r^6) + 2 p1 x y + p2 (r^2 + 2 x^2)
+///   y' = y (1 + k1 r^2 + k2 r^4 + k3 r^6) + p1 (r^2 + 2 y^2) + 2 p2 x y
+struct ColorModel {
+  std::string suffix;           //!< Appended to the -rgb prefix
+  double k1 = 0, k2 = 0, k3 = 0;
+  double p1 = 0, p2 = 0;
+
+  void distort(double x, double y, double &outX, double &outY) const
+  {
+    double r2 = x * x + y * y;
+    double radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    outX = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    outY = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+  }
+};
+
+struct Options {
   int xCount = 11;
   int yCount = 11;
+  double xFOVDeg = 90.0;
+  double yFOVDeg = 90.0;
+  std::vector<ColorModel> colors = std::vector<ColorModel>(1);
+  double noise = 0;
+  double outlierFraction = 0;
+  double outlierDistance = 0;
+  std::string truthFileName;
+  uint64_t seed = 1;
+  int precision = 6;
+  bool binary = false;
+  unsigned threads = 0;
+  std::string outputName;       //!< File for mono, prefix for -rgb
+};
+
+//====================================================================
+// Random numbers that depend only on the seed, color, entry and which
+// draw for the entry, so that any thread can make any entry.
+
+static uint64_t mix(uint64_t z)
+{
+  // splitmix64 finalizer
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1).
+static double uniform(uint64_t seed, size_t color, size_t entry, unsigned draw)
+{
+  uint64_t h = mix(mix(mix(seed) ^ color) ^ entry);
+  h = mix(h ^ draw);
+  return ((h >> 11) + 0.5) / 9007199254740992.0;   // 2^53
+}
+
+enum Draw { OUTLIER, DIRECTION, NOISE_R, NOISE_ANGLE };
+
+//====================================================================
+// Makes the entries of one color's table in [first, first + count),
+// with entries in order of longitude and then latitude.
+//   @param values Filled with four doubles per entry.
+//   @param outliers Gets the index of each entry that was moved.
+static void make_entries(const Options &opt, size_t color, size_t first,
+  size_t count, std::vector<double> &values, std::vector<size_t> &outliers)
+{
+  const ColorModel &model = opt.colors[color];
+  double xMin = - opt.xFOVDeg / 2;
+  double xStep = opt.xFOVDeg / (opt.xCount - 1);
+  double yMin = - opt.yFOVDeg / 2;
+  double yStep = opt.yFOVDeg / (opt.yCount - 1);
+  values.resize(4 * count);
+  outliers.clear();
+  for (size_t n = 0; n < count; n++) {
+    size_t i = first + n;
+    double xDeg = xMin + static_cast<int>(i / opt.yCount) * xStep;
+    double yDeg = yMin + static_cast<int>(i % opt.yCount) * yStep;
+    double x, y;
+    model.distort(tan(xDeg * MY_PI / 180), tan(yDeg * MY_PI / 180), x, y);
+    if (opt.noise > 0) {
+      // Box-Muller
+      double r = opt.noise *
+        sqrt(-2 * log(uniform(opt.seed, color, i, NOISE_R)));
+      double a = 2 * MY_PI * uniform(opt.seed, color, i, NOISE_ANGLE);
+      x += r * cos(a);
+      y += r * sin(a);
+    }
+    if (uniform(opt.seed, color, i, OUTLIER) < opt.outlierFraction) {
+      double a = 2 * MY_PI * uniform(opt.seed, color, i, DIRECTION);
+      x += opt.outlierDistance * cos(a);
+      y += opt.outlierDistance * sin(a);
+      outliers.push_back(i);
+    }
+    double *v = &values[4 * n];
+    v[0] = xDeg;
+    v[1] = yDeg;
+    v[2] = x;
+    v[3] = y;
+  }
+}
+
+// Formats the entries as text lines.  %g is what an ostream writes by
+// default, so the default table is the same as it has always been.
+static void format_entries(const std::vector<double> &values, int precision,
+  std::string &text)
+{
+  char line[128];
+  text.clear();
+  for (size_t i = 0; i < values.size(); i += 4) {
+    int len = snprintf(line, sizeof(line), "%.*g %.*g %.*g %.*g\n",
+      precision, values[i], precision, values[i + 1],
+      precision, values[i + 2], precision, values[i + 3]);
+    text.append(line, len);
+  }
+}
+
+// Writes one color's table to out, a batch of blocks at a time.
+//   @return 0 on success, or the program's exit code on failure.
+static int write_table(const Options &opt, size_t color, std::ostream &out,
+  const std::string &outName, TaskPool &pool, std::ostream *truth)
+{
+  size_t total = static_cast<size_t>(opt.xCount) * opt.yCount;
+  size_t numBlocks = (total + BLOCK_ENTRIES - 1) / BLOCK_ENTRIES;
+  size_t batch = 4 * static_cast<size_t>(pool.size());
+  std::vector<std::vector<double> > values(batch);
+  std::vector<std::vector<size_t> > outliers(batch);
+  std::vector<std::string> text(batch);
+  size_t numOutliers = 0;
+  for (size_t b = 0; b < numBlocks; b += batch) {
+    size_t count = std::min(batch, numBlocks - b);
+    pool.parallel_for(count, [&](size_t t) {
+      size_t first = (b + t) * BLOCK_ENTRIES;
+      make_entries(opt, color, first, std::min(BLOCK_ENTRIES, total - first),
+        values[t], outliers[t]);
+      if (!opt.binary) { format_entries(values[t], opt.precision, text[t]); }
+    });
+    for (size_t t = 0; t < count; t++) {
+      if (opt.binary) {
+        out.write(reinterpret_cast<const char *>(values[t].data()),
+          values[t].size() * sizeof(double));
+      } else {
+        out.write(text[t].data(), text[t].size());
+      }
+      numOutliers += outliers[t].size();
+      if (truth) {
+        for (size_t i = 0; i < outliers[t].size(); i++) {
+          *truth << color << " " << outliers[t][i] << "\n";
+        }
+      }
+    }
+  }
+  out.flush();
+  if (!out.good()) {
+    std::cerr << "Error: Could not write " << outName << std::endl;
+    return 2;
+  }
+  if (g_verbose) {
+    std::cerr << outName << ": " << total << " entries, " << numOutliers
+      << " outliers" << std::endl;
+  }
+  return 0;
+}
+
+// Lists the models that a color name on the command line selects.
+//   @return false if it is not a color name.
+static bool select_colors(const std::string &name, std::vector<size_t> &which)
+{
+  which.clear();
+  if (name == "red") { which.push_back(0); }
+  else if (name == "green") { which.push_back(1); }
+  else if (name == "blue") { which.push_back(2); }
+  else if (name == "all") { which = { 0, 1, 2 }; }
+  return !which.empty();
+}
+
+int main(int argc, char *argv[])
+{
+  // Set defaults.  The distortion is kept for all three colors until we
+  // know whether there is more than one.
+  Options opt;
+  ColorModel models[3];
+  bool rgb = false;
+  std::string perColorOption;   //!< Last -radial or -tangential for one color
 
   // Parse the command line
-  int realParams = 0;
+  std::vector<size_t> which;
   for (int i = 1; i < argc; i++) {
-    if (std::string("-verbose") == argv[i]) {
+    std::string arg = argv[i];
+    if (arg == "-verbose") {
       g_verbose = true;
-    } else if ((argv[i][0] == '-') && (atof(argv[i]) == 0.0)) {
+    } else if (arg == "-grid") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.xCount = atoi(argv[++i]);
+      opt.yCount = atoi(argv[++i]);
+      if ((opt.xCount < 2) || (opt.yCount < 2)) {
+        std::cerr << "Error: The grid needs at least 2 by 2 entries" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (arg == "-fov") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.xFOVDeg = atof(argv[++i]);
+      opt.yFOVDeg = atof(argv[++i]);
+      if ((opt.xFOVDeg <= 0) || (opt.xFOVDeg >= 180) ||
+          (opt.yFOVDeg <= 0) || (opt.yFOVDeg >= 180)) {
+        std::cerr << "Error: The field of view must be between 0 and 180"
+          << " degrees" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (arg == "-radial") {
+      if ((i + 4 >= argc) || !select_colors(argv[i + 1], which)) { Usage(argv[0]); }
+      if (which.size() == 1) { perColorOption = arg + " " + argv[i + 1]; }
+      i++;
+      double k1 = atof(argv[++i]);
+      double k2 = atof(argv[++i]);
+      double k3 = atof(argv[++i]);
+      for (size_t c : which) {
+        models[c].k1 = k1;
+        models[c].k2 = k2;
+        models[c].k3 = k3;
+      }
+    } else if (arg == "-tangential") {
+      if ((i + 3 >= argc) || !select_colors(argv[i + 1], which)) { Usage(argv[0]); }
+      if (which.size() == 1) { perColorOption = arg + " " + argv[i + 1]; }
+      i++;
+      double p1 = atof(argv[++i]);
+      double p2 = atof(argv[++i]);
+      for (size_t c : which) {
+        models[c].p1 = p1;
+        models[c].p2 = p2;
+      }
+    } else if (arg == "-noise") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.noise = atof(argv[i]);
+    } else if (arg == "-outliers") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      opt.outlierFraction = atof(argv[++i]);
+      opt.outlierDistance = atof(argv[++i]);
+    } else if (arg == "-truth") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.truthFileName = argv[i];
+    } else if (arg == "-seed") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.seed = strtoull(argv[i], nullptr, 10);
+    } else if (arg == "-precision") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.precision = atoi(argv[i]);
+      if ((opt.precision < 1) || (opt.precision > 17)) { Usage(argv[0]); }
+    } else if (arg == "-binary") {
+      opt.binary = true;
+    } else if (arg == "-threads") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.threads = static_cast<unsigned>(atoi(argv[i]));
+    } else if (arg == "-o") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.outputName = argv[i];
+      rgb = false;
+    } else if (arg == "-rgb") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.outputName = argv[i];
+      rgb = true;
+    } else {
       Usage(argv[0]);
     }
-    else switch (++realParams) {
-    case 1:
-    default:
-      Usage(argv[0]);
+  }
+  if (opt.binary && opt.outputName.empty()) {
+    std::cerr << "Error: -binary needs -o or -rgb" << std::endl;
+    Usage(argv[0]);
+  }
+  if (!rgb && !perColorOption.empty()) {
+    std::cerr << "Error: " << perColorOption << " needs -rgb; a mono table"
+      << " takes -radial all and -tangential all" << std::endl;
+    Usage(argv[0]);
+  }
+
+  // Mono tables use the green distortion, which -radial all and
+  // -tangential all also set.
+  if (rgb) {
+    static const char *suffixes[] = { "_red", "_green", "_blue" };
+    opt.colors.assign(models, models + 3);
+    for (size_t c = 0; c < 3; c++) { opt.colors[c].suffix = suffixes[c]; }
+  } else {
+    opt.colors.assign(1, models[1]);
+  }
+
+  std::ofstream truthFile;
+  if (!opt.truthFileName.empty()) {
+    truthFile.open(opt.truthFileName.c_str());
+    if (!truthFile) {
+      std::cerr << "Error: Could not open " << opt.truthFileName
+        << " for writing" << std::endl;
+      return 2;
+    }
+    truthFile << "# color entry, counting from 0 in that color's table\n";
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  TaskPool pool(opt.threads);
+  std::ios_base::openmode mode = std::ios::out;
+  if (opt.binary) { mode |= std::ios::binary; }
+  for (size_t c = 0; c < opt.colors.size(); c++) {
+    int ret;
+    if (opt.outputName.empty()) {
+      ret = write_table(opt, c, std::cout, "standard output", pool,
+        truthFile.is_open() ? &truthFile : nullptr);
+    } else {
+      std::string name = opt.outputName;
+      if (rgb) { name += opt.colors[c].suffix + (opt.binary ? ".bin" : ".txt"); }
+      std::ofstream out(name.c_str(), mode);
+      if (!out) {
+        std::cerr << "Error: Could not open " << name << " for writing" << std::endl;
+        return 2;
+      }
+      ret = write_table(opt, c, out, name, pool,
+        truthFile.is_open() ? &truthFile : nullptr);
     }
+    if (ret != 0) { return ret; }
   }
-  if (realParams != 0) { Usage(argv[0]); }
-
-  // Produce a mesh with the specified number of elements in X and
-  // Y that cover the specified total FOV in X and Y.
-  double xMin = - xFOVDeg / 2;
-  double xStep = xFOVDeg / (xCount - 1);
-  double yMin = - yFOVDeg / 2;
-  double yStep = yFOVDeg / (yCount - 1);
-  for (int x = 0; x < xCount; x++) {
-    double xDeg = xMin + x * xStep;
-    double xRad = xDeg * MY_PI / 180;
-    for (int y = 0; y < yCount; y++) {
-      double yDeg = yMin + y * yStep;
-      double yRad = yDeg * MY_PI / 180;
-      std::cout << xDeg << " " << yDeg << " "
-        << tan(xRad) << " " << tan(yRad) << std::endl;
+  if (truthFile.is_open()) {
+    truthFile.close();
+    if (truthFile.fail()) {
+      std::cerr << "Error: Could not write " << opt.truthFileName << std::endl;
+      return 2;
     }
   }
+  if (g_verbose) {
+    std::cerr << "Generated in "
+      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+      << " seconds" << std::endl;
+  }
 
   return 0;
 }
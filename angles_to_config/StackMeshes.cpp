@@ -0,0 +1,208 @@
+/** @file
+    @brief Stacks the configurations produced by AnglesToConfig for
+           several eye reliefs into one file of meshes on a shared grid,
+           and blends the mesh for any eye relief in between.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "types.h"
+#include "display_config.h"
+#include "mesh_interpolator.h"
+#include "mesh_io.h"
+#include "threads.h"
+
+// Standard includes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h> // For exit()
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-grid cols rows] (shared grid of input points, default 65 65)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-verbose] (default is not)"
+    << " -o out.dstack eye_relief_mm config.json [eye_relief_mm config.json...]"
+    << std::endl
+    << "   or: " << name << " -blend eye_relief_mm in.dstack out.dmesh"
+    << std::endl
+    << "  The first form resamples the meshes in each configuration written" << std::endl
+    << "by AnglesToConfig onto the same grid and stores them, with their" << std::endl
+    << "fields of view and centers of projection, as the layers of a mesh" << std::endl
+    << "stack.  The second blends the two layers on either side of the eye" << std::endl
+    << "relief, which must be within the stack's range, and writes the" << std::endl
+    << "result in the .dmesh format that AnglesToConfig -binary writes." << std::endl
+    << std::endl;
+  exit(1);
+}
+
+static int blend(double eyeRelief, const std::string &stackFileName,
+  const std::string &outFileName, bool verbose)
+{
+  MeshStack stack;
+  if (!stack.read(stackFileName)) { return 2; }
+
+  // Holding the end layer would quietly give the wrong mesh for a
+  // mistyped eye relief, so only blend within the stack.
+  double lowest = stack.layer(0).eyeRelief;
+  double highest = stack.layer(stack.numLayers() - 1).eyeRelief;
+  if (!(eyeRelief >= lowest) || !(eyeRelief <= highest)) {
+    std::cerr << "Error: Eye relief " << eyeRelief << " mm is outside the "
+      << lowest << " to " << highest << " mm of " << stackFileName << std::endl;
+    return 4;
+  }
+  if (verbose) {
+    size_t lower, upper;
+    double t;
+    stack.bracket(eyeRelief, lower, upper, t);
+    std::cerr << "Blending layers at " << stack.layer(lower).eyeRelief
+      << " and " << stack.layer(upper).eyeRelief << " mm, weight " << t
+      << std::endl;
+  }
+
+  ScreenDescription leftScreen, rightScreen;
+  stack.blendScreens(eyeRelief, leftScreen, rightScreen);
+  std::vector<MeshDescription> leftMeshes(stack.numColors());
+  std::vector<MeshDescription> rightMeshes(stack.numColors());
+  for (uint32_t color = 0; color < stack.numColors(); color++) {
+    stack.blendMesh(eyeRelief, color, 0, leftMeshes[color]);
+    stack.blendMesh(eyeRelief, color, 1, rightMeshes[color]);
+  }
+  if (!write_distortion_mesh_file(outFileName, leftMeshes, rightMeshes,
+        leftScreen, rightScreen)) {
+    return 3;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  // Parse the command line
+  size_t cols = 65, rows = 65;
+  unsigned threads = 0;
+  bool verbose = false;
+  std::string outputFileName;
+  std::vector<double> eyeReliefs;
+  std::vector<std::string> configFileNames;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-grid") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      int c = atoi(argv[++i]);
+      int r = atoi(argv[++i]);
+      if ((c < 2) || (r < 2)) {
+        std::cerr << "Error: -grid must be at least 2 x 2" << std::endl;
+        Usage(argv[0]);
+      }
+      cols = static_cast<size_t>(c);
+      rows = static_cast<size_t>(r);
+    } else if (arg == "-threads") {
+      if (++i >= argc) { Usage(argv[0]); }
+      threads = static_cast<unsigned>(atoi(argv[i]));
+    } else if (arg == "-verbose") {
+      verbose = true;
+    } else if (arg == "-o") {
+      if (++i >= argc) { Usage(argv[0]); }
+      outputFileName = argv[i];
+    } else if (arg == "-blend") {
+      if (i + 3 >= argc) { Usage(argv[0]); }
+      double eyeRelief = atof(argv[i + 1]);
+      return blend(eyeRelief, argv[i + 2], argv[i + 3], verbose);
+    } else if (arg[0] == '-') {
+      Usage(argv[0]);
+    } else {
+      if (i + 1 >= argc) { Usage(argv[0]); }
+      eyeReliefs.push_back(atof(argv[i]));
+      configFileNames.push_back(argv[++i]);
+    }
+  }
+  if (outputFileName.empty() || configFileNames.empty()) { Usage(argv[0]); }
+
+  //====================================================================
+  // Read the configurations and resample each of their meshes onto the
+  // shared grid, all at once.
+  size_t numConfigs = configFileNames.size();
+  std::vector<DisplayConfig> configs(numConfigs);
+  for (size_t c = 0; c < numConfigs; c++) {
+    if (!read_display_config(configFileNames[c], configs[c])) { return 2; }
+    if (configs[c].meshes[0].size() != configs[0].meshes[0].size()) {
+      std::cerr << "Error: " << configFileNames[c] << " does not have the same"
+        << " number of colors as " << configFileNames[0] << std::endl;
+      return 2;
+    }
+  }
+  uint32_t numColors = static_cast<uint32_t>(configs[0].meshes[0].size());
+  std::vector< std::vector<MeshDescription> > grids[2];
+  for (int eye = 0; eye < 2; eye++) {
+    grids[eye].assign(numConfigs, std::vector<MeshDescription>(numColors));
+  }
+  size_t numMeshes = numConfigs * numColors * 2;
+  std::vector<char> resampled(numMeshes);
+  TaskPool pool(threads);
+  pool.parallel_for(numMeshes, [&](size_t task) {
+    size_t c = task / (numColors * 2);
+    size_t color = (task / 2) % numColors;
+    int eye = static_cast<int>(task % 2);
+    resampled[task] = resample_mesh_to_grid(configs[c].meshes[eye][color],
+      cols, rows, grids[eye][c][color]);
+  });
+  for (size_t task = 0; task < numMeshes; task++) {
+    if (!resampled[task]) {
+      std::cerr << "Error: Could not resample the meshes in "
+        << configFileNames[task / (numColors * 2)] << std::endl;
+      return 3;
+    }
+  }
+
+  //====================================================================
+  // Stack them up and write the result.
+  MeshStack stack;
+  stack.reset(numColors, cols, rows);
+  for (size_t c = 0; c < numConfigs; c++) {
+    MeshStackLayer layer;
+    layer.eyeRelief = eyeReliefs[c];
+    layer.hFOVDegrees = configs[c].hFOVDegrees;
+    layer.vFOVDegrees = configs[c].vFOVDegrees;
+    layer.overlapPercent = configs[c].overlapPercent;
+    for (int eye = 0; eye < 2; eye++) {
+      layer.xCOP[eye] = configs[c].xCOP[eye];
+      layer.yCOP[eye] = configs[c].yCOP[eye];
+    }
+    if (!stack.addLayer(layer, grids[0][c], grids[1][c])) {
+      std::cerr << "  (adding " << configFileNames[c] << ")" << std::endl;
+      return 4;
+    }
+    if (verbose) {
+      std::cerr << "Layer at " << eyeReliefs[c] << " mm from "
+        << configFileNames[c] << std::endl;
+    }
+  }
+  if (!stack.write(outputFileName)) { return 5; }
+  if (verbose) {
+    std::cerr << "Wrote " << stack.numLayers() << " layers of " << numColors
+      << " color(s) on a " << cols << " x " << rows << " grid to "
+      << outputFileName << std::endl;
+  }
+  return 0;
+}
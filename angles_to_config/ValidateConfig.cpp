@@ -0,0 +1,690 @@
+/** @file
+    @brief Checks configurations produced by AnglesToConfig without a
+           display or OSVR server, by applying their distortion in
+           software and measuring how far rays land from where they
+           should.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "display_config.h"
+#include "helper.h"
+#include "mesh_interpolator.h"
+#include "threads.h"
+
+// Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h> // For exit()
+
+void Usage(std::string name)
+{
+  std::cerr << "Usage: " << name
+    << " [-eye right|left] (eye the angle tables are for, default is right)"
+    << " [-latlong] (tables use latitude/longitude angles, default is field angles)"
+    << " [-mm] (table screen units, default is meters)"
+    << " [-screen screen_left_meters screen_bottom_meters screen_right_meters screen_top_meters]"
+    << " (default auto-compute based on the ranges in the tables)"
+    << " [-mono table_file | -rgb red_table green_table blue_table]"
+    << " (angle tables to check the configurations against, default is none)"
+    << " [-grid_degrees D] (spacing of the synthetic grid, default 5)"
+    << " [-png] (write each eye's distorted grid next to its configuration)"
+    << " [-size width height] (pixels per eye for -png, default 1080 1200)"
+    << " [-max_error degrees] (exit with code 5 if any error is larger)"
+    << " [-threads N] (default is the number of hardware threads)"
+    << " [-verbose] (default is not)"
+    << " [-batch list_file_name]"
+    << "   Each non-empty line of the list that does not start with # is a"
+    << "   configuration file name followed by its angle table files (one or three)"
+    << " config.json ..."
+    << std::endl
+    << "  For each configuration, eye and color, this prints where the forward" << std::endl
+    << "direction lands on the screen (normalized, (0,0) at the bottom left)," << std::endl
+    << "the round-trip error of a synthetic grid of field angles through the" << std::endl
+    << "mesh, and, when angle tables are given, the error in degrees between" << std::endl
+    << "each measured direction and the direction the configuration renders" << std::endl
+    << "at that screen location." << std::endl
+    << std::endl;
+  exit(1);
+}
+
+// Settings shared by all configurations.
+struct Options {
+  bool useRightEye = true;
+  bool computeBounds = true;
+  bool useFieldAngles = true;
+  bool verbose = false;
+  bool png = false;
+  double left = 0, right = 0, bottom = 0, top = 0;
+  double toMeters = 1.0;
+  double gridDegrees = 5;
+  double maxError = 0;        //!< Zero means no limit
+  size_t width = 1080, height = 1200;
+  unsigned threads = 0;
+  std::vector<std::string> tableFileNames;
+  std::string batchFileName;
+};
+
+// One configuration to check and the angle tables it was made from.
+struct Job {
+  std::string configFileName;
+  std::vector<std::string> tableFileNames;
+};
+
+// Summary of the errors in one set of samples, in degrees.
+struct ErrorStats {
+  size_t count = 0;
+  double rms = 0;
+  double p95 = 0;
+  double max = 0;
+
+  void compute(std::vector<double> &errors)
+  {
+    count = errors.size();
+    if (count == 0) { return; }
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+      sum += errors[i] * errors[i];
+      max = std::max(max, errors[i]);
+    }
+    rms = sqrt(sum / count);
+    std::vector<double>::iterator p = errors.begin() + (count * 95) / 100;
+    if (p == errors.end()) { --p; }
+    std::nth_element(errors.begin(), p, errors.end());
+    p95 = *p;
+  }
+};
+
+// Results for one eye and color of a configuration.
+struct ColorResult {
+  bool forwardFound = false;
+  double forwardX = 0, forwardY = 0;
+  ErrorStats grid;
+  bool haveTable = false;
+  ErrorStats table;
+};
+
+//====================================================================
+// Uncompressed PNG writing, so that no image library is needed.
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, size_t length)
+{
+  static uint32_t table[256];
+  static bool haveTable = false;
+  static std::mutex tableMutex;
+  {
+    std::lock_guard<std::mutex> lock(tableMutex);
+    if (!haveTable) {
+      for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) { c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1); }
+        table[n] = c;
+      }
+      haveTable = true;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void put32(std::string &s, uint32_t v)
+{
+  s.push_back(static_cast<char>(v >> 24));
+  s.push_back(static_cast<char>(v >> 16));
+  s.push_back(static_cast<char>(v >> 8));
+  s.push_back(static_cast<char>(v));
+}
+
+static void addChunk(std::string &png, const char *type, const std::string &data)
+{
+  put32(png, static_cast<uint32_t>(data.size()));
+  std::string body = std::string(type, 4) + data;
+  png += body;
+  put32(png, crc32(0, reinterpret_cast<const unsigned char *>(body.data()), body.size()));
+}
+
+// Writes 8-bit RGB pixels, top row first, as a PNG whose image data is
+// stored in uncompressed deflate blocks.
+//   @return false (with a message on std::cerr) on failure.
+static bool write_png(const std::string &fileName, size_t width, size_t height,
+  const std::vector<unsigned char> &rgb)
+{
+  std::string header;
+  put32(header, static_cast<uint32_t>(width));
+  put32(header, static_cast<uint32_t>(height));
+  header += std::string("\x08\x02\x00\x00\x00", 5);   // 8-bit RGB, no interlace
+
+  // Each row is preceded by filter type 0 (none).
+  std::string raw;
+  raw.reserve(height * (3 * width + 1));
+  for (size_t y = 0; y < height; y++) {
+    raw.push_back('\0');
+    raw.append(reinterpret_cast<const char *>(&rgb[3 * width * y]), 3 * width);
+  }
+  std::string zlib("\x78\x01", 2);
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + static_cast<unsigned char>(raw[i])) % 65521;
+    b = (b + a) % 65521;
+  }
+  for (size_t start = 0; (start < raw.size()) || (start == 0); start += 65535) {
+    size_t length = std::min<size_t>(65535, raw.size() - start);
+    zlib.push_back((start + length >= raw.size()) ? '\x01' : '\x00');
+    zlib.push_back(static_cast<char>(length & 0xFF));
+    zlib.push_back(static_cast<char>(length >> 8));
+    zlib.push_back(static_cast<char>(~length & 0xFF));
+    zlib.push_back(static_cast<char>((~length >> 8) & 0xFF));
+    zlib.append(raw, start, length);
+  }
+  put32(zlib, (b << 16) | a);
+
+  std::string png("\x89PNG\r\n\x1a\n", 8);
+  addChunk(png, "IHDR", header);
+  addChunk(png, "IDAT", zlib);
+  addChunk(png, "IEND", std::string());
+
+  std::ofstream out(fileName.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!out.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  out.write(png.data(), png.size());
+  if (!out.good()) {
+    std::cerr << "Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//====================================================================
+// Software rendering of one eye: the synthetic grid is drawn into the
+// texture that RenderManager would render, and then each screen pixel
+// looks up its texture coordinate in the mesh for each color, as the
+// distortion pass does.
+
+// Field angles in degrees of the ray through a texture coordinate.
+static void field_angles(const EyeProjection &projection, double u, double v,
+  double &longitude, double &latitude)
+{
+  XYZ d = projection.direction(u, v);
+  longitude = atan2(d.x, -d.z) * 180 / MY_PI;
+  latitude = atan2(d.y, -d.z) * 180 / MY_PI;
+}
+
+// Draws grid lines every gridDegrees of field angle, one pixel wide, and
+// a disc of one degree around the forward direction.  Row 0 is at the
+// bottom.
+static void render_texture(const EyeProjection &projection, size_t width, size_t height,
+  double gridDegrees, TaskPool &pool, std::vector<float> &texture)
+{
+  texture.assign(width * height, 0.0f);
+  std::vector<double> cornerLong((width + 1) * (height + 1));
+  std::vector<double> cornerLat((width + 1) * (height + 1));
+  pool.parallel_for(height + 1, [&](size_t j) {
+    for (size_t i = 0; i <= width; i++) {
+      field_angles(projection, static_cast<double>(i) / width,
+        static_cast<double>(j) / height,
+        cornerLong[j * (width + 1) + i], cornerLat[j * (width + 1) + i]);
+    }
+  });
+  XYZ forward(0, 0, -1);
+  pool.parallel_for(height, [&](size_t j) {
+    for (size_t i = 0; i < width; i++) {
+      size_t c[4] = { j * (width + 1) + i, j * (width + 1) + i + 1,
+        (j + 1) * (width + 1) + i, (j + 1) * (width + 1) + i + 1 };
+      bool line = false;
+      for (size_t k = 1; k < 4; k++) {
+        line = line ||
+          (floor(cornerLong[c[k]] / gridDegrees) != floor(cornerLong[c[0]] / gridDegrees)) ||
+          (floor(cornerLat[c[k]] / gridDegrees) != floor(cornerLat[c[0]] / gridDegrees));
+      }
+      XYZ d = projection.direction((i + 0.5) / width, (j + 0.5) / height);
+      if (line || (angle_between_degrees(d, forward) < 1)) {
+        texture[j * width + i] = 1.0f;
+      }
+    }
+  });
+}
+
+// Bilinear lookup of a normalized texture coordinate, black outside.
+static float sample(const std::vector<float> &texture, size_t width, size_t height,
+  double u, double v)
+{
+  if ((u < 0) || (u > 1) || (v < 0) || (v > 1)) { return 0; }
+  double x = u * width - 0.5;
+  double y = v * height - 0.5;
+  double fx = floor(x), fy = floor(y);
+  double ax = x - fx, ay = y - fy;
+  long x0 = static_cast<long>(fx), y0 = static_cast<long>(fy);
+  long w = static_cast<long>(width), h = static_cast<long>(height);
+  long x1 = std::min(x0 + 1, w - 1), y1 = std::min(y0 + 1, h - 1);
+  x0 = std::max(x0, 0L);
+  y0 = std::max(y0, 0L);
+  return static_cast<float>(
+    (1 - ay) * ((1 - ax) * texture[y0 * w + x0] + ax * texture[y0 * w + x1]) +
+    ay * ((1 - ax) * texture[y1 * w + x0] + ax * texture[y1 * w + x1]));
+}
+
+// Renders what one eye's screen shows, top row first.
+static void render_screen(const std::vector<MeshInterpolator> &meshes,
+  const std::vector<float> &texture, size_t width, size_t height,
+  TaskPool &pool, std::vector<unsigned char> &rgb)
+{
+  rgb.assign(3 * width * height, 0);
+  pool.parallel_for(height, [&](size_t row) {
+    std::vector<MeshInterpolator::Hint> hints(meshes.size());
+    double y = 1 - (row + 0.5) / height;
+    for (size_t i = 0; i < width; i++) {
+      double x = (i + 0.5) / width;
+      for (size_t c = 0; c < 3; c++) {
+        size_t m = (meshes.size() == 3) ? c : 0;
+        std::array<double, 2> uv;
+        meshes[m].interpolate(x, y, uv, hints[m]);
+        float value = sample(texture, width, height, uv[0], uv[1]);
+        rgb[3 * (row * width + i) + c] = static_cast<unsigned char>(255 * value + 0.5f);
+      }
+    }
+  });
+}
+
+//====================================================================
+// Checking one configuration.
+
+// Finds the error statistics for one eye and color.  The table mapping,
+// if not empty, has already been normalized for this eye.
+static bool check_color(const MeshDescription &mesh, const EyeProjection &projection,
+  const std::vector<Mapping> &table, double gridDegrees, ColorResult &result)
+{
+  MeshInterpolator toTexture;
+  if (!toTexture.build(mesh)) { return false; }
+  MeshDescription inverse(mesh);
+  for (size_t i = 0; i < inverse.size(); i++) {
+    std::swap(inverse[i][0], inverse[i][1]);
+  }
+  MeshInterpolator toScreen;
+  if (!toScreen.build(inverse)) { return false; }
+
+  // Where straight ahead shows up on the screen.
+  double u, v;
+  std::array<double, 2> screen, uv;
+  if (projection.texture(XYZ(0, 0, -1), u, v)) {
+    result.forwardFound = toScreen.interpolate(u, v, screen);
+    result.forwardX = screen[0];
+    result.forwardY = screen[1];
+  }
+
+  // Round trip of a synthetic grid: from the rendered image back onto
+  // the screen and forwards again through the mesh.
+  std::vector<double> errors;
+  MeshInterpolator::Hint toScreenHint, toTextureHint;
+  int steps = static_cast<int>(89 / gridDegrees);
+  for (int j = -steps; j <= steps; j++) {
+    for (int i = -steps; i <= steps; i++) {
+      XYZ d = angles_to_direction(i * gridDegrees, j * gridDegrees, true);
+      if (!projection.texture(d, u, v) || (u < 0) || (u > 1) || (v < 0) || (v > 1)) {
+        continue;
+      }
+      if (!toScreen.interpolate(u, v, screen, toScreenHint) ||
+          (screen[0] < 0) || (screen[0] > 1) || (screen[1] < 0) || (screen[1] > 1)) {
+        continue;
+      }
+      if (!toTexture.interpolate(screen[0], screen[1], uv, toTextureHint)) { continue; }
+      errors.push_back(angle_between_degrees(d, projection.direction(uv[0], uv[1])));
+    }
+  }
+  result.grid.compute(errors);
+
+  // Measured directions against what is rendered at their screen
+  // locations.  Points off the screen are never shown.
+  if (!table.empty()) {
+    result.haveTable = true;
+    errors.clear();
+    for (size_t i = 0; i < table.size(); i++) {
+      double x = table[i].xyLatLong.x;
+      double y = table[i].xyLatLong.y;
+      if ((x < 0) || (x > 1) || (y < 0) || (y > 1)) { continue; }
+      if (!toTexture.interpolate(x, y, uv, toTextureHint)) { continue; }
+      errors.push_back(angle_between_degrees(table[i].xyz,
+        projection.direction(uv[0], uv[1])));
+    }
+    result.table.compute(errors);
+  }
+  return true;
+}
+
+// Checks one configuration, writing its report lines into report.
+//   @return 0 on success, or the program's exit code on failure.
+static int run_job(const Options &opt, const Job &job, TaskPool &pool,
+  std::string &report, double &worstError)
+{
+  worstError = 0;
+  DisplayConfig config;
+  if (!read_display_config(job.configFileName, config)) {
+    return 2;
+  }
+  size_t numColors = config.meshes[0].size();
+
+  //====================================================================
+  // Read the tables and find the screen boundaries the way AnglesToConfig
+  // does, then normalize a copy for each eye.
+  std::vector< std::vector<Mapping> > tables(job.tableFileNames.size());
+  for (size_t t = 0; t < tables.size(); t++) {
+    if (!read_from_file(job.tableFileNames[t], tables[t])) { return 3; }
+    if (tables[t].empty()) {
+      std::cerr << "Error: No points found in " << job.tableFileNames[t] << std::endl;
+      return 3;
+    }
+  }
+  if ((tables.size() > 1) && (tables.size() != numColors)) {
+    std::cerr << "Error: " << job.configFileName << " has " << numColors
+      << " colors but " << tables.size() << " angle tables were given" << std::endl;
+    return 3;
+  }
+  double left = opt.left, right = opt.right, bottom = opt.bottom, top = opt.top;
+  if (opt.computeBounds && !tables.empty()) {
+    left = right = tables[0][0].xyLatLong.x;
+    bottom = top = tables[0][0].xyLatLong.y;
+    for (size_t t = 0; t < tables.size(); t++) {
+      for (size_t i = 0; i < tables[t].size(); i++) {
+        left = std::min(left, tables[t][i].xyLatLong.x);
+        right = std::max(right, tables[t][i].xyLatLong.x);
+        bottom = std::min(bottom, tables[t][i].xyLatLong.y);
+        top = std::max(top, tables[t][i].xyLatLong.y);
+      }
+    }
+    left *= opt.toMeters;
+    right *= opt.toMeters;
+    bottom *= opt.toMeters;
+    top *= opt.toMeters;
+  }
+
+  //====================================================================
+  // Check each eye and color at once.  Task 2*c is the left eye for
+  // color c and task 2*c+1 the right eye.
+  std::vector<ColorResult> results(2 * numColors);
+  std::vector<char> ok(results.size());
+  pool.parallel_for(results.size(), [&](size_t task) {
+    int eye = static_cast<int>(task % 2);
+    size_t color = task / 2;
+    std::vector<Mapping> table;
+    if (!tables.empty()) {
+      const std::vector<Mapping> &source = tables[tables.size() == 1 ? 0 : color];
+      bool reflect = ((eye == 0) == opt.useRightEye);
+      table = reflect ? reflect_mapping(source) : source;
+      std::ostringstream ignored;   // Warnings are AnglesToConfig's job
+      if (reflect) {
+        convert_to_normalized_and_meters(table, opt.toMeters, 1.0,
+          -right, bottom, -left, top, opt.useFieldAngles, ignored);
+      } else {
+        convert_to_normalized_and_meters(table, opt.toMeters, 1.0,
+          left, bottom, right, top, opt.useFieldAngles, ignored);
+      }
+    }
+    EyeProjection projection(config, eye);
+    ok[task] = check_color(config.meshes[eye][color], projection, table,
+      opt.gridDegrees, results[task]);
+  });
+
+  static const char *eyeNames[] = { "left", "right" };
+  static const char *colorNames[] = { "red", "green", "blue" };
+  std::ostringstream s;
+  s << std::setprecision(4);
+  for (size_t task = 0; task < results.size(); task++) {
+    const char *eyeName = eyeNames[task % 2];
+    const char *colorName = (numColors == 3) ? colorNames[task / 2] : "mono";
+    if (!ok[task]) {
+      std::cerr << "Error: " << job.configFileName << ": the " << eyeName << " "
+        << colorName << " mesh could not be triangulated" << std::endl;
+      return 2;
+    }
+    const ColorResult &r = results[task];
+    s << job.configFileName << " " << eyeName << " " << colorName;
+    if (r.forwardFound) { s << " " << r.forwardX << " " << r.forwardY; }
+    else { s << " - -"; }
+    s << " " << r.grid.count << " " << r.grid.rms << " " << r.grid.max;
+    if (r.haveTable) {
+      s << " " << r.table.count << " " << r.table.rms << " " << r.table.p95
+        << " " << r.table.max;
+      worstError = std::max(worstError, r.table.max);
+    } else {
+      s << " - - - -";
+      worstError = std::max(worstError, r.grid.max);
+    }
+    s << "\n";
+  }
+  report = s.str();
+
+  //====================================================================
+  // Render each eye if asked.
+  if (opt.png) {
+    std::string stem = job.configFileName;
+    if ((stem.size() > 5) && (stem.compare(stem.size() - 5, 5, ".json") == 0)) {
+      stem.erase(stem.size() - 5);
+    }
+    for (int eye = 0; eye < 2; eye++) {
+      std::vector<MeshInterpolator> meshes(numColors);
+      for (size_t c = 0; c < numColors; c++) {
+        meshes[c].build(config.meshes[eye][c]);
+      }
+      std::vector<float> texture;
+      render_texture(EyeProjection(config, eye), opt.width, opt.height,
+        opt.gridDegrees, pool, texture);
+      std::vector<unsigned char> rgb;
+      render_screen(meshes, texture, opt.width, opt.height, pool, rgb);
+      if (!write_png(stem + "_" + eyeNames[eye] + ".png", opt.width, opt.height, rgb)) {
+        return 4;
+      }
+    }
+  }
+  return 0;
+}
+
+// Splits a line of a batch file into words, with double quotes around
+// words that contain spaces.
+static std::vector<std::string> splitLine(const std::string &line)
+{
+  std::vector<std::string> words;
+  std::string word;
+  bool quoted = false, inWord = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (c == '"') {
+      quoted = !quoted;
+      inWord = true;
+    } else if (!quoted && ((c == ' ') || (c == '\t') || (c == '\r'))) {
+      if (inWord) { words.push_back(word); }
+      word.clear();
+      inWord = false;
+    } else {
+      word.push_back(c);
+      inWord = true;
+    }
+  }
+  if (inWord) { words.push_back(word); }
+  return words;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+  std::vector<Job> jobs;
+
+  // Parse the command line
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-mm") {
+      opt.toMeters = 1e-3;  // Convert input in millimeters to meters
+    } else if (arg == "-latlong") {
+      opt.useFieldAngles = false;
+    } else if (arg == "-verbose") {
+      opt.verbose = true;
+    } else if (arg == "-png") {
+      opt.png = true;
+    } else if (arg == "-screen") {
+      if (i + 4 >= argc) { Usage(argv[0]); }
+      opt.computeBounds = false;
+      opt.left = atof(argv[++i]);
+      opt.bottom = atof(argv[++i]);
+      opt.right = atof(argv[++i]);
+      opt.top = atof(argv[++i]);
+    } else if (arg == "-eye") {
+      if (++i >= argc) { Usage(argv[0]); }
+      std::string eye = argv[i];
+      if ((eye != "left") && (eye != "right")) {
+        std::cerr << "Bad value for -eye: " << eye << ", expected left or right" << std::endl;
+        Usage(argv[0]);
+      }
+      opt.useRightEye = (eye == "right");
+    } else if (arg == "-mono") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.tableFileNames.assign(1, argv[i]);
+    } else if (arg == "-rgb") {
+      if (i + 3 >= argc) { Usage(argv[0]); }
+      opt.tableFileNames.clear();
+      for (int c = 0; c < 3; c++) { opt.tableFileNames.push_back(argv[++i]); }
+    } else if (arg == "-grid_degrees") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.gridDegrees = atof(argv[i]);
+      if ((opt.gridDegrees <= 0) || (opt.gridDegrees > 45)) {
+        std::cerr << "Error: -grid_degrees must be between 0 and 45" << std::endl;
+        Usage(argv[0]);
+      }
+    } else if (arg == "-size") {
+      if (i + 2 >= argc) { Usage(argv[0]); }
+      int width = atoi(argv[++i]);
+      int height = atoi(argv[++i]);
+      if ((width <= 0) || (height <= 0)) {
+        std::cerr << "Bad value for -size: " << width << " x " << height << std::endl;
+        Usage(argv[0]);
+      }
+      opt.width = static_cast<size_t>(width);
+      opt.height = static_cast<size_t>(height);
+    } else if (arg == "-max_error") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.maxError = atof(argv[i]);
+    } else if (arg == "-threads") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.threads = static_cast<unsigned>(atoi(argv[i]));
+    } else if (arg == "-batch") {
+      if (++i >= argc) { Usage(argv[0]); }
+      opt.batchFileName = argv[i];
+    } else if (arg[0] == '-') {
+      Usage(argv[0]);
+    } else {
+      Job job;
+      job.configFileName = arg;
+      jobs.push_back(job);
+    }
+  }
+  for (size_t j = 0; j < jobs.size(); j++) {
+    jobs[j].tableFileNames = opt.tableFileNames;
+  }
+
+  if (!opt.batchFileName.empty()) {
+    std::ifstream list(opt.batchFileName.c_str());
+    if (!list.good()) {
+      std::cerr << "Error: Could not open " << opt.batchFileName << std::endl;
+      return 1;
+    }
+    std::string line;
+    for (size_t lineNum = 1; std::getline(list, line); lineNum++) {
+      std::vector<std::string> words = splitLine(line);
+      if ((words.size() == 0) || (words[0][0] == '#')) { continue; }
+      if ((words.size() != 1) && (words.size() != 2) && (words.size() != 4)) {
+        std::cerr << "Error: " << opt.batchFileName << " line " << lineNum
+          << ": expected a configuration and zero, one or three angle tables" << std::endl;
+        return 1;
+      }
+      Job job;
+      job.configFileName = words[0];
+      job.tableFileNames.assign(words.begin() + 1, words.end());
+      jobs.push_back(job);
+    }
+  }
+  if (jobs.empty()) { Usage(argv[0]); }
+
+  //====================================================================
+  // Check all of the configurations at once.  Each also uses the pool
+  // for its eyes, colors and image rows.
+  TaskPool pool(opt.threads);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<int> results(jobs.size());
+  std::vector<std::string> reports(jobs.size());
+  std::vector<double> worst(jobs.size());
+  std::mutex reportMutex;
+  size_t finished = 0;
+  pool.parallel_for(jobs.size(), [&](size_t j) {
+    std::chrono::steady_clock::time_point jobStart = std::chrono::steady_clock::now();
+    results[j] = run_job(opt, jobs[j], pool, reports[j], worst[j]);
+    if (opt.verbose) {
+      std::lock_guard<std::mutex> lock(reportMutex);
+      std::cerr << "[" << ++finished << "/" << jobs.size() << "] "
+        << jobs[j].configFileName << (results[j] == 0 ? " done" : " FAILED")
+        << " (" << std::fixed << std::setprecision(3) << secondsSince(jobStart)
+        << " s)" << std::defaultfloat << std::endl;
+    }
+  });
+
+  std::cout << "# config eye color forward_x forward_y"
+    << " grid_points grid_rms_deg grid_max_deg"
+    << " table_points table_rms_deg table_p95_deg table_max_deg\n";
+  int ret = 0;
+  for (size_t j = 0; j < jobs.size(); j++) {
+    std::cout << reports[j];
+    if ((results[j] != 0) && (ret == 0)) { ret = results[j]; }
+  }
+  std::cout.flush();
+  if (opt.verbose) {
+    std::cerr << "Checked " << jobs.size() << " configurations in "
+      << std::fixed << std::setprecision(3) << secondsSince(start) << " s"
+      << std::defaultfloat << " using " << pool.size() << " threads" << std::endl;
+  }
+  if (ret != 0) { return ret; }
+
+  if (opt.maxError > 0) {
+    for (size_t j = 0; j < jobs.size(); j++) {
+      if (worst[j] > opt.maxError) {
+        std::cerr << "Error: " << jobs[j].configFileName << " has an error of "
+          << worst[j] << " degrees, more than " << opt.maxError << std::endl;
+        ret = 5;
+      }
+    }
+  }
+  return ret;
+}
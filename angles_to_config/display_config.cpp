@@ -0,0 +1,185 @@
+/** @file
+    @brief Implementation of display-description reading and the
+           RenderManager eye projection.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "display_config.h"
+
+#include <iostream>
+
+// Reads one eye's point samples: an array of [ [in x, in y], [out x, out y] ].
+static bool read_mesh(const JsonValue &samples, MeshDescription &mesh,
+  const std::string &name, const char *what)
+{
+  mesh.clear();
+  if (!samples.isArray()) {
+    std::cerr << "Error: " << name << ": " << what << " is not an array" << std::endl;
+    return false;
+  }
+  mesh.resize(samples.size());
+  for (size_t i = 0; i < samples.size(); i++) {
+    const JsonValue &entry = samples[i];
+    for (size_t side = 0; side < 2; side++) {
+      for (size_t axis = 0; axis < 2; axis++) {
+        const JsonValue &v = entry[side][axis];
+        if (!v.isNumber()) {
+          std::cerr << "Error: " << name << ": " << what << " entry " << i
+            << " is not a pair of coordinate pairs" << std::endl;
+          return false;
+        }
+        mesh[i][side][axis] = v.number();
+      }
+    }
+  }
+  return true;
+}
+
+// Reads the left and right eyes' meshes from an array of two.
+static bool read_eye_meshes(const JsonValue &eyes, DisplayConfig &config,
+  const std::string &name, const char *what)
+{
+  if (!eyes.isArray() || (eyes.size() != 2)) {
+    std::cerr << "Error: " << name << ": " << what
+      << " does not hold one mesh for each of two eyes" << std::endl;
+    return false;
+  }
+  for (int eye = 0; eye < 2; eye++) {
+    config.meshes[eye].push_back(MeshDescription());
+    if (!read_mesh(eyes[eye], config.meshes[eye].back(), name, what)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool display_config_from_json(const JsonValue &root, DisplayConfig &config,
+  const std::string &name)
+{
+  config = DisplayConfig();
+  const JsonValue *hmd = &root["display"]["hmd"];
+  if (hmd->isNull()) { hmd = &root["hmd"]; }
+  if (hmd->isNull()) { hmd = &root; }
+
+  const JsonValue &fov = (*hmd)["field_of_view"];
+  if (!fov["monocular_horizontal"].isNumber() || !fov["monocular_vertical"].isNumber()) {
+    std::cerr << "Error: " << name << ": no field_of_view found" << std::endl;
+    return false;
+  }
+  config.hFOVDegrees = fov["monocular_horizontal"].number();
+  config.vFOVDegrees = fov["monocular_vertical"].number();
+  if (fov["overlap_percent"].isNumber()) {
+    config.overlapPercent = fov["overlap_percent"].number();
+  }
+
+  const JsonValue &eyes = (*hmd)["eyes"];
+  for (int eye = 0; eye < 2; eye++) {
+    if (eyes[eye]["center_proj_x"].isNumber()) {
+      config.xCOP[eye] = eyes[eye]["center_proj_x"].number();
+    }
+    if (eyes[eye]["center_proj_y"].isNumber()) {
+      config.yCOP[eye] = eyes[eye]["center_proj_y"].number();
+    }
+  }
+
+  const JsonValue &distortion = (*hmd)["distortion"];
+  const std::string &type = distortion["type"].text();
+  if (type == "mono_point_samples") {
+    return read_eye_meshes(distortion["mono_point_samples"], config, name,
+      "mono_point_samples");
+  } else if (type == "rgb_point_samples") {
+    static const char *colors[] = {
+      "red_point_samples", "green_point_samples", "blue_point_samples"
+    };
+    for (size_t c = 0; c < 3; c++) {
+      if (!read_eye_meshes(distortion[colors[c]], config, name, colors[c])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  std::cerr << "Error: " << name << ": distortion type '" << type
+    << "' is not mono_point_samples or rgb_point_samples" << std::endl;
+  return false;
+}
+
+bool read_display_config(const std::string &fileName, DisplayConfig &config)
+{
+  JsonValue root;
+  if (!read_json_file(fileName, root)) { return false; }
+  return display_config_from_json(root, config, fileName);
+}
+
+EyeProjection::EyeProjection(const DisplayConfig &config, int eye)
+{
+  d_xScale = 2 * tan(config.hFOVDegrees / 2 * MY_PI / 180);
+  d_yScale = 2 * tan(config.vFOVDegrees / 2 * MY_PI / 180);
+  d_xCOP = config.xCOP[eye];
+  d_yCOP = config.yCOP[eye];
+
+  // This is how RenderManager turns the eyes apart; the left eye turns
+  // towards -X, which is positive rotation about Y.
+  double overlapFrac = config.overlapPercent / 100;
+  double rotateDegrees = (config.hFOVDegrees - config.hFOVDegrees * overlapFrac) / 2;
+  double rotate = (eye == 0 ? rotateDegrees : -rotateDegrees) * MY_PI / 180;
+  d_cos = cos(rotate);
+  d_sin = sin(rotate);
+}
+
+XYZ EyeProjection::direction(double u, double v) const
+{
+  double x = (u - d_xCOP) * d_xScale;
+  double y = (v - d_yCOP) * d_yScale;
+  double z = -1;
+  return XYZ(x * d_cos + z * d_sin, y, -x * d_sin + z * d_cos);
+}
+
+bool EyeProjection::texture(const XYZ &direction, double &u, double &v) const
+{
+  double x = direction.x * d_cos - direction.z * d_sin;
+  double z = direction.x * d_sin + direction.z * d_cos;
+  if (z >= 0) { return false; }
+  u = d_xCOP + (x / -z) / d_xScale;
+  v = d_yCOP + (direction.y / -z) / d_yScale;
+  return true;
+}
+
+XYZ angles_to_direction(double longitudeDeg, double latitudeDeg, bool useFieldAngles)
+{
+  double longitude = longitudeDeg * MY_PI / 180;
+  double latitude = latitudeDeg * MY_PI / 180;
+  if (useFieldAngles) {
+    return XYZ(tan(longitude), tan(latitude), -1);
+  }
+  return XYZ(sin(longitude) * cos(latitude), sin(latitude),
+    -cos(longitude) * cos(latitude));
+}
+
+double angle_between_degrees(const XYZ &a, const XYZ &b)
+{
+  // atan2 of the cross and dot products stays accurate for small angles.
+  double cx = a.y * b.z - a.z * b.y;
+  double cy = a.z * b.x - a.x * b.z;
+  double cz = a.x * b.y - a.y * b.x;
+  double dot = a.x * b.x + a.y * b.y + a.z * b.z;
+  return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * 180 / MY_PI;
+}
@@ -0,0 +1,89 @@
+/** @file
+    @brief Reading back the display descriptions that AnglesToConfig
+           writes, and the per-eye projection that RenderManager uses
+           to render them.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include "json_reader.h"
+
+#include <string>
+#include <vector>
+
+/// The parts of an OSVR display description that the distortion depends
+/// on.  Eye 0 is the left eye and eye 1 the right.
+struct DisplayConfig {
+  double hFOVDegrees = 0;
+  double vFOVDegrees = 0;
+  double overlapPercent = 100;
+  double xCOP[2] = { 0.5, 0.5 };
+  double yCOP[2] = { 0.5, 0.5 };
+  /// One mesh per color for each eye: one for mono_point_samples or
+  /// red, green and blue for rgb_point_samples.
+  std::vector<MeshDescription> meshes[2];
+};
+
+/// Fills in the configuration from a parsed file, which may be either a
+/// whole display description or the display section of one.
+///   @return false (with a message on std::cerr) if the distortion is
+/// not point samples or required fields are missing.
+extern bool display_config_from_json(const JsonValue &root,
+  DisplayConfig &config, const std::string &name = "input");
+
+/// Reads a configuration file written by AnglesToConfig.
+///   @return false (with a message on std::cerr) on failure.
+extern bool read_display_config(const std::string &fileName, DisplayConfig &config);
+
+/// How RenderManager renders one eye: a pinhole view whose image spans
+/// the field of view, with the center of projection at (xCOP, yCOP) of
+/// the image and the view turned outwards by half of the part of the
+/// field that the eyes don't share.  Head space has -Z forwards, +X to
+/// the right and +Y up, with the eye at the origin.  Texture coordinates
+/// are normalized, with (0, 0) at the bottom left of the rendered image.
+class EyeProjection {
+public:
+  EyeProjection(const DisplayConfig &config, int eye);
+
+  /// Head-space direction (not unit length) of the ray that renders to
+  /// texture coordinate (u, v).
+  XYZ direction(double u, double v) const;
+
+  /// Texture coordinate that a head-space direction renders to.
+  ///   @return false if the direction is not in front of the view.
+  bool texture(const XYZ &direction, double &u, double &v) const;
+
+private:
+  double d_xScale, d_yScale;    //!< Tangent per unit texture coordinate
+  double d_xCOP, d_yCOP;
+  double d_cos, d_sin;          //!< Rotation of the view about Y
+};
+
+/// Head-space direction for angles in degrees, as
+/// convert_to_normalized_and_meters() computes it.
+extern XYZ angles_to_direction(double longitudeDeg, double latitudeDeg,
+  bool useFieldAngles);
+
+/// Angle in degrees between two directions.
+extern double angle_between_degrees(const XYZ &a, const XYZ &b);
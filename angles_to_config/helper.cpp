@@ -26,80 +26,371 @@
 // Internal Includes
 #include "types.h"
 #include "helper.h"
+#include "point_transform.h"
+#include "threads.h"
 
 // Standard includes
 #include <string>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <locale>
 #include <cmath>
-#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <algorithm>
+#include <vector>
+
+// Powers of ten that are exactly representable as doubles, used by the
+// fast path of parse_number().
+static const double exactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/// Parse a floating-point number that spans the whole of [begin, end).
+/// Decimal numbers with up to 15 significant digits and small exponents,
+/// which covers everything written by the ray tracers, are converted
+/// directly with a single correctly-rounded multiply or divide.  Anything
+/// else is read by a stream in the classic "C" locale, so neither path
+/// depends on the locale the program is running in.
+/// @return True if the whole range was a valid number.
+static bool parse_number(const char *begin, const char *end, double &value)
+{
+  const char *p = begin;
+  bool negative = false;
+  if ((p < end) && ((*p == '-') || (*p == '+'))) {
+    negative = (*p == '-');
+    p++;
+  }
+  const char *digitsBegin = p;  // The number without its sign
+
+  unsigned long long mantissa = 0;
+  int digits = 0;         // Significant digits stored in the mantissa
+  int exponent = 0;       // Power of ten to apply to the mantissa
+  bool sawDigit = false;
+  bool tooManyDigits = false;
+  for (; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+    sawDigit = true;
+    if ((mantissa == 0) && (*p == '0')) { continue; }
+    if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; }
+    else { exponent++; tooManyDigits = true; }
+  }
+  if ((p < end) && (*p == '.')) {
+    for (p++; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+      sawDigit = true;
+      if ((mantissa == 0) && (*p == '0')) { exponent--; continue; }
+      if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits++; exponent--; }
+      else { tooManyDigits = true; }
+    }
+  }
+  if (!sawDigit) {
+    // Not a plain decimal number; see if it is something like "inf".
+    // These have no decimal point, so strtod() reads them the same way
+    // in every locale.
+    std::string token(begin, end);
+    char *tokenEnd;
+    value = strtod(token.c_str(), &tokenEnd);
+    return (tokenEnd != token.c_str()) && (*tokenEnd == '\0');
+  }
+  if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+    p++;
+    bool negativeExponent = false;
+    if ((p < end) && ((*p == '-') || (*p == '+'))) {
+      negativeExponent = (*p == '-');
+      p++;
+    }
+    if ((p == end) || (*p < '0') || (*p > '9')) { return false; }
+    int e = 0;
+    for (; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+      if (e < 100000) { e = e * 10 + (*p - '0'); }
+    }
+    exponent += negativeExponent ? -e : e;
+  }
+  if (p != end) { return false; }
+
+  if (!tooManyDigits && (mantissa <= (1ULL << 53)) &&
+      (exponent >= -22) && (exponent <= 22)) {
+    value = static_cast<double>(mantissa);
+    if (exponent < 0) { value /= exactPowersOfTen[-exponent]; }
+    else { value *= exactPowersOfTen[exponent]; }
+  } else {
+    std::istringstream token(std::string(digitsBegin, end));
+    token.imbue(std::locale::classic());
+    if (!(token >> value)) { return false; }
+  }
+  if (negative) { value = -value; }
+  return true;
+}
+
+static bool is_space(char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') ||
+    (c == '\f') || (c == '\v');
+}
+
+bool read_from_buffer(const char *buffer, size_t length,
+  std::vector<Mapping> &mapping, const std::string &name, std::ostream &log)
+{
+  mapping.clear();
+
+  // Each line normally holds one entry, so this is enough room to read
+  // the whole table without re-allocating.
+  mapping.reserve(std::count(buffer, buffer + length, '\n') + 1);
+
+  const char *p = buffer;
+  const char *end = buffer + length;
+  size_t line = 1;
+  size_t entryLine = 1;  // Line on which the current entry started
+  double values[4];
+  int numValues = 0;
+  while (p < end) {
+    if (is_space(*p)) {
+      if (*p == '\n') { line++; }
+      p++;
+      continue;
+    }
+    const char *tokenEnd = p;
+    while ((tokenEnd < end) && !is_space(*tokenEnd)) { tokenEnd++; }
+    if (numValues == 0) { entryLine = line; }
+    if (!parse_number(p, tokenEnd, values[numValues])) {
+      log << "Error: " << name << " line " << line
+        << ": expected a number, found '" << std::string(p, tokenEnd) << "'"
+        << std::endl;
+      mapping.clear();
+      return false;
+    }
+    p = tokenEnd;
+
+    if (++numValues == 4) {
+      // The entries are longitude, latitude, x, y.
+      mapping.push_back(Mapping(
+        XYLatLong(values[2], values[3], values[1], values[0]), XYZ()));
+      numValues = 0;
+    }
+  }
+  if (numValues != 0) {
+    log << "Error: " << name << " line " << entryLine
+      << ": incomplete entry at end of input (found " << numValues
+      << " of 4 values)" << std::endl;
+    mapping.clear();
+    return false;
+  }
+
+  return true;
+}
 
 std::vector<Mapping> read_from_infile(std::istream &in)
 {
   std::vector<Mapping> mapping;
 
-  while (!in.eof()) {
-    // Read the mapping info from the input file.
-    Mapping map;
-    in >> map.xyLatLong.longitude >> map.xyLatLong.latitude >> map.xyLatLong.x >> map.xyLatLong.y;
-    mapping.push_back(map);
-  }
-  // There will have been one extra added, when running into EOF.
-  mapping.pop_back();
+  // Read the whole stream into memory and then parse it in one go.
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  std::string buffer = contents.str();
+  read_from_buffer(buffer.data(), buffer.size(), mapping);
 
   return mapping;
 }
 
+bool read_from_file(const std::string &fileName, std::vector<Mapping> &mapping)
+{
+  mapping.clear();
+
+  // Find the size of the file and read it all in with a single call.
+  std::ifstream in(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!in.good()) {
+    std::cerr << "Error: Could not open " << fileName << std::endl;
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  std::streamoff size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  if (size < 0) {
+    std::cerr << "Error: Could not determine the size of " << fileName << std::endl;
+    return false;
+  }
+  std::vector<char> buffer(static_cast<size_t>(size));
+  if ((size > 0) && !in.read(buffer.data(), size)) {
+    std::cerr << "Error: Could not read " << fileName << std::endl;
+    return false;
+  }
+
+  return read_from_buffer(buffer.data(), buffer.size(), mapping, fileName);
+}
+
+// Bytes read from the file at a time by TableReader.
+static const size_t TABLE_CHUNK_SIZE = 1 << 20;
+
+bool TableReader::open(const std::string &fileName)
+{
+  d_in.close();
+  d_in.clear();
+  d_in.open(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+  d_name = fileName;
+  d_buffer.resize(TABLE_CHUNK_SIZE);
+  d_begin = d_end = 0;
+  d_atEnd = false;
+  d_line = 1;
+  d_count = 0;
+  if (!d_in.good()) {
+    std::cerr << "Error: Could not open " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void TableReader::refill()
+{
+  // Keep the part that has not been parsed, making room for a token
+  // longer than the buffer if need be.
+  size_t kept = d_end - d_begin;
+  if (d_begin > 0) {
+    memmove(d_buffer.data(), d_buffer.data() + d_begin, kept);
+  } else if (kept == d_buffer.size()) {
+    d_buffer.resize(2 * d_buffer.size());
+  }
+  d_begin = 0;
+  d_end = kept;
+  d_in.read(d_buffer.data() + d_end, d_buffer.size() - d_end);
+  d_end += static_cast<size_t>(d_in.gcount());
+  if (!d_in) { d_atEnd = true; }
+}
+
+bool TableReader::nextToken(const char *&begin, const char *&end)
+{
+  for (;;) {
+    while ((d_begin < d_end) && is_space(d_buffer[d_begin])) {
+      if (d_buffer[d_begin] == '\n') { d_line++; }
+      d_begin++;
+    }
+    if (d_begin == d_end) {
+      if (d_atEnd) { return false; }
+      refill();
+      continue;
+    }
+
+    // A token that runs to the end of the buffer may go on in the file.
+    size_t tokenEnd = d_begin;
+    while ((tokenEnd < d_end) && !is_space(d_buffer[tokenEnd])) { tokenEnd++; }
+    if ((tokenEnd == d_end) && !d_atEnd) {
+      refill();
+      continue;
+    }
+    begin = d_buffer.data() + d_begin;
+    end = d_buffer.data() + tokenEnd;
+    d_begin = tokenEnd;
+    return true;
+  }
+}
+
+bool TableReader::read(size_t maxEntries, std::vector<Mapping> &tile)
+{
+  tile.clear();
+  if (!d_in.is_open()) {
+    std::cerr << "TableReader::read(): Error: No file is open" << std::endl;
+    return false;
+  }
+
+  size_t entryLine = d_line;  // Line on which the current entry started
+  double values[4];
+  int numValues = 0;
+  const char *begin, *end;
+  while ((tile.size() < maxEntries) && nextToken(begin, end)) {
+    if (numValues == 0) { entryLine = d_line; }
+    if (!parse_number(begin, end, values[numValues])) {
+      std::cerr << "Error: " << d_name << " line " << d_line
+        << ": expected a number, found '" << std::string(begin, end) << "'"
+        << std::endl;
+      tile.clear();
+      return false;
+    }
+    if (++numValues == 4) {
+      // The entries are longitude, latitude, x, y.
+      tile.push_back(Mapping(
+        XYLatLong(values[2], values[3], values[1], values[0]), XYZ()));
+      numValues = 0;
+    }
+  }
+  if (numValues != 0) {
+    std::cerr << "Error: " << d_name << " line " << entryLine
+      << ": incomplete entry at end of input (found " << numValues
+      << " of 4 values)" << std::endl;
+    tile.clear();
+    return false;
+  }
+  d_count += tile.size();
+  return true;
+}
+
+std::vector<Mapping> reflect_mapping(const std::vector<Mapping> &mapping)
+{
+  std::vector<Mapping> ret;
+  for (size_t i = 0; i < mapping.size(); i++) {
+    ret.push_back(mapping[i]);
+    ret[i].xyLatLong.longitude *= -1;
+    ret[i].xyLatLong.x *= -1;
+  }
+
+  return ret;
+}
 
 bool convert_to_normalized_and_meters(
-  std::vector<Mapping> &mapping, double toMeters, double depth,
+  const std::vector<Mapping> &mapping, bool reflect,
+  MappingSet &out, size_t offset, double toMeters, double depth,
   double left, double bottom, double right, double top,
-  bool useFieldAngles)
+  bool useFieldAngles, std::ostream &log, size_t firstIndex)
 {
-  for (size_t i = 0; i < mapping.size(); i++) {
+  size_t n = mapping.size();
+  if (offset + n > out.size()) {
+    log << "convert_to_normalized_and_meters(): Error: Output set too small"
+      << std::endl;
+    return false;
+  }
+  double *x = out.x.data() + offset;
+  double *y = out.y.data() + offset;
+  double *latitude = out.latitude.data() + offset;
+  double *longitude = out.longitude.data() + offset;
+
+  // Reflecting negates X and longitude, which is exact, so it is folded
+  // into the conversion.
+  double sign = reflect ? -1 : 1;
+  for (size_t i = 0; i < n; i++) {
     //  Convert the input coordinates from its input space into meters
     // and then convert (using the screen dimensions) into normalized screen units.
-    mapping[i].xyLatLong.x *= toMeters;
-    mapping[i].xyLatLong.x = (mapping[i].xyLatLong.x - left) / (right - left);
-    mapping[i].xyLatLong.y *= toMeters;
-    mapping[i].xyLatLong.y = (mapping[i].xyLatLong.y - bottom) / (top - bottom);
+    const XYLatLong &in = mapping[i].xyLatLong;
+    x[i] = ((sign * in.x) * toMeters - left) / (right - left);
+    y[i] = (in.y * toMeters - bottom) / (top - bottom);
 
     // Convert the input latitude and longitude from degrees to radians.
-    mapping[i].xyLatLong.latitude *= MY_PI / 180;
-    mapping[i].xyLatLong.longitude *= MY_PI / 180;
-
-    if (useFieldAngles) {
-      // These are expressed as angles with respect to a screen that is
-      // straight ahead, independent in X and Y.  The -Z axis is straight
-      // ahead.  Positive rotation in longitude points towards +X,
-      // positive rotation in latitude points towards +Y.
-      mapping[i].xyz.x =  depth * tan(mapping[i].xyLatLong.longitude);
-      mapping[i].xyz.y =  depth * tan(mapping[i].xyLatLong.latitude);
-      mapping[i].xyz.z = -depth;
-    } else {
-      // Compute the 3D coordinate of the point w.r.t. the eye at the origin.
-      // longitude = 0, latitude = 0 points along the -Z axis in eye space.
-      // Positive rotation in longitude is towards -X and positive rotation in
-      // latitude points towards +Y.
-      double theta = mapping[i].xyLatLong.longitude;
-      double phi = MY_PI / 2 - mapping[i].xyLatLong.latitude;
-      mapping[i].xyz.y = depth * cos(phi);
-      mapping[i].xyz.z = -depth * cos(theta) * sin(phi);
-      mapping[i].xyz.x = -depth * (-sin(theta)) * sin(phi);
-    }
+    latitude[i] = in.latitude * (MY_PI / 180);
+    longitude[i] = (sign * in.longitude) * (MY_PI / 180);
   }
 
+  //  Compute the 3D coordinate of each point w.r.t. the eye at the origin.
+  // Field angles are expressed as angles with respect to a screen that is
+  // straight ahead, independent in X and Y.  Otherwise, longitude = 0,
+  // latitude = 0 points along the -Z axis in eye space.  Either way,
+  // positive rotation in longitude points towards +X and positive rotation
+  // in latitude points towards +Y.
+  angles_to_points(longitude, latitude, n, depth, useFieldAngles,
+    out.px.data() + offset, out.py.data() + offset, out.pz.data() + offset);
+
   // Make sure that the normalized screen coordinates are all within the range 0 to 1.
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if ((mapping[i].xyLatLong.x < 0) || (mapping[i].xyLatLong.x > 1)) {
-      std::cerr << "Warning: Point " << i << " (line " << i+1 << " in the file):"
+  for (size_t i = 0; i < n; i++) {
+    if ((x[i] < 0) || (x[i] > 1)) {
+      log << "Warning: Point " << firstIndex + i << " (line "
+        << firstIndex + i + 1 << " in the file):"
         << " x out of range [0,1]: "
-        << mapping[i].xyLatLong.x << " (increase bounds on -screen or don't specify it)"
+        << x[i] << " (increase bounds on -screen or don't specify it)"
         << std::endl;
     }
-    if ((mapping[i].xyLatLong.y < 0) || (mapping[i].xyLatLong.y > 1)) {
-      std::cerr << "Warning: Point " << i << " (line " << i + 1 << " in the file):"
+    if ((y[i] < 0) || (y[i] > 1)) {
+      log << "Warning: Point " << firstIndex + i << " (line "
+        << firstIndex + i + 1 << " in the file):"
         << " y out of range [0,1]: "
-        << mapping[i].xyLatLong.y << " (increase bounds on -screen or don't specify it)"
+        << y[i] << " (increase bounds on -screen or don't specify it)"
         << std::endl;
     }
   }
@@ -107,50 +398,98 @@ bool convert_to_normalized_and_meters(
   return true;
 }
 
-bool findScreen(const std::vector<Mapping> &mapping,
+bool convert_to_normalized_and_meters(
+  std::vector<Mapping> &mapping, double toMeters, double depth,
   double left, double bottom, double right, double top,
-  ScreenDescription &screen, bool verbose)
+  bool useFieldAngles, std::ostream &log)
 {
-  if (mapping.size() == 0) {
-    std::cerr << "findScreen(): Error: No points in mapping" 
-      << std::endl;
+  MappingSet converted(mapping.size());
+  if (!convert_to_normalized_and_meters(mapping, false, converted, 0,
+        toMeters, depth, left, bottom, right, top, useFieldAngles, log)) {
     return false;
   }
-
-  //====================================================================
-  // Figure out the X screen-space extents.
-  // The X screen-space extents are defined by the lines perpendicular to the
-  // Y axis passing through:
-  //  left: the point location whose reprojection into the Y = 0 plane has the most -
-  //        positive angle(note that this may not be the point with the largest
-  //        longitudinal coordinate, because of the impact of changing latitude on
-  //        X - Z position).
-  //  right : the point location whose reprojection into the Y = 0 plane has the most -
-  //        negative angle(note that this may not be the point with the smallest
-  //        longitudinal coordinate, because of the impact of changing latitude on
-  //        X - Z position).
-  XYZ &screenLeft = screen.screenLeft;
-  XYZ &screenRight = screen.screenRight;;
-  screenLeft = screenRight = mapping[0].xyz;
-  if (verbose) {
-    std::cerr << "First point rotation about Y (degrees): "
-      << screenLeft.rotationAboutY() * 180 / MY_PI << std::endl;
-  }
   for (size_t i = 0; i < mapping.size(); i++) {
-    if (mapping[i].xyz.rotationAboutY() > screenLeft.rotationAboutY()) {
-      screenLeft = mapping[i].xyz;
-    }
-    if (mapping[i].xyz.rotationAboutY() < screenRight.rotationAboutY()) {
-      screenRight = mapping[i].xyz;
+    mapping[i] = converted.get(i);
+  }
+  return true;
+}
+
+void find_table_bounds(const std::vector< std::vector<Mapping> > &mappings,
+  double toMeters, double &left, double &bottom, double &right, double &top)
+{
+  left = right = mappings[0][0].xyLatLong.x;
+  bottom = top = mappings[0][0].xyLatLong.y;
+  for (size_t m = 0; m < mappings.size(); m++) {
+    for (size_t i = 1; i < mappings[m].size(); i++) {
+      double x = mappings[m][i].xyLatLong.x;
+      double y = mappings[m][i].xyLatLong.y;
+      if (x < left) { left = x; }
+      if (x > right) { right = x; }
+      if (y < bottom) { bottom = y; }
+      if (y > top) { top = y; }
     }
   }
+  left *= toMeters;
+  right *= toMeters;
+  bottom *= toMeters;
+  top *= toMeters;
+}
+
+void mirror_screen_bounds(bool useRightEye,
+  double left, double bottom, double right, double top,
+  double leftEye[4], double rightEye[4])
+{
+  leftEye[1] = rightEye[1] = bottom;
+  leftEye[3] = rightEye[3] = top;
+  if (useRightEye) {
+    rightEye[0] = left;
+    rightEye[2] = right;
+    leftEye[0] = -right;
+    leftEye[2] = -left;
+  } else {
+    leftEye[0] = left;
+    leftEye[2] = right;
+    rightEye[0] = -right;
+    rightEye[2] = -left;
+  }
+}
+
+// Points handled together by each task in findScreen().
+static const size_t SCREEN_BLOCK_SIZE = 16384;
+
+bool findScreen(const std::vector<Mapping> &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose)
+{
+  return findScreen(MappingSet(mapping), left, bottom, right, top,
+    screen, verbose);
+}
+
+bool findScreen(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose)
+{
+  TaskPool pool(1);
+  ScreenProjection projection;
+  return findScreen(mapping, left, bottom, right, top, screen, pool,
+    projection, verbose, std::cerr);
+}
+
+// The steps of findScreen() that follow each of its passes over the
+// points, shared with ScreenFinder: finding the plane once the left and
+// right points are known, and the rest once the largest height is.
+static bool find_screen_plane(ScreenDescription &screen, bool verbose,
+  std::ostream &log)
+{
+  const XYZ &screenLeft = screen.screenLeft;
+  const XYZ &screenRight = screen.screenRight;
   if (verbose) {
-    std::cerr << "Horizontal angular range: "
+    log << "Horizontal angular range: "
       << 180 / MY_PI * (screenLeft.rotationAboutY() - screenRight.rotationAboutY())
       << std::endl;
   }
   if (screenLeft.rotationAboutY() - screenRight.rotationAboutY() >= MY_PI) {
-    std::cerr << "findScreen(): Error: Field of view > 180 degrees: found " <<
+    log << "findScreen(): Error: Field of view > 180 degrees: found " <<
       180 / MY_PI * (screenLeft.rotationAboutY() - screenRight.rotationAboutY())
       << std::endl;
     return false;
@@ -185,26 +524,26 @@ bool findScreen(const std::vector<Mapping> &mapping,
   C /= len;
   D = -(A*screenRight.x + B*screenRight.y + C*screenRight.z);
   if (verbose) {
-    std::cerr << "Plane of the screen A,B,C, D: "
+    log << "Plane of the screen A,B,C, D: "
       << A << "," << B << "," << C << ", " << D
       << std::endl;
   }
 
-  //====================================================================
-  // Figure out the Y screen-space extents.
-  // The Y screen-space extents are symmetric and correspond to the lines parallel
-  //  to the screen X axis that are within the plane of the X line specifying the
-  //  axis extents at the largest magnitude angle up or down from the horizontal.
-  // Find the highest-magnitude Y value of all points when they are
-  // projected into the plane of the screen.
-  double &maxY = screen.maxY;
-  maxY = fabs(mapping[0].xyz.projectOntoPlane(A, B, C, D).y);
-  for (size_t i = 1; i < mapping.size(); i++) {
-    double Y = fabs(mapping[i].xyz.projectOntoPlane(A, B, C, D).y);
-    if (Y > maxY) { maxY = Y; }
-  }
+  return true;
+}
+
+static void finish_screen(ScreenDescription &screen, bool verbose,
+  std::ostream &log)
+{
+  const XYZ &screenLeft = screen.screenLeft;
+  const XYZ &screenRight = screen.screenRight;
+  const double &maxY = screen.maxY;
+  const double &A = screen.A;
+  const double &B = screen.B;
+  const double &C = screen.C;
+  const double &D = screen.D;
   if (verbose) {
-    std::cerr << "Maximum-magnitude Y projection: " << maxY << std::endl;
+    log << "Maximum-magnitude Y projection: " << maxY << std::endl;
   }
 
   //====================================================================
@@ -222,12 +561,12 @@ bool findScreen(const std::vector<Mapping> &mapping,
   rightProj.y = 0;
   double screenWidth = leftProj.distanceFrom(rightProj);
   if (verbose) {
-    std::cerr << "Screen width: " << screenWidth << std::endl;
+    log << "Screen width: " << screenWidth << std::endl;
   }
   double hFOVRadians = 2 * atan((screenWidth / 2) / fabs(D));
   double hFOVDegrees = hFOVRadians * 180 / MY_PI;
   if (verbose) {
-    std::cerr << "Horizontal field of view (degrees): " << hFOVDegrees << std::endl;
+    log << "Horizontal field of view (degrees): " << hFOVDegrees << std::endl;
   }
 
   //====================================================================
@@ -237,7 +576,7 @@ bool findScreen(const std::vector<Mapping> &mapping,
   double vFOVRadians = 2 * atan(maxY / fabs(D));
   double vFOVDegrees = vFOVRadians * 180 / MY_PI;
   if (verbose) {
-    std::cerr << "Vertical field of view (degrees): " << vFOVDegrees << std::endl;
+    log << "Vertical field of view (degrees): " << vFOVDegrees << std::endl;
   }
 
   //====================================================================
@@ -269,12 +608,12 @@ bool findScreen(const std::vector<Mapping> &mapping,
   //  1 - 2*rotateEyesApart/hfov = overlapFrac
   double angleRadians = fabs(atan2(A, C));
   if (verbose) {
-    std::cerr << "Angle degrees: " << angleRadians * 180 / MY_PI << std::endl;
+    log << "Angle degrees: " << angleRadians * 180 / MY_PI << std::endl;
   }
   double overlapFrac = 1 - 2 * angleRadians / hFOVRadians;
   double overlapPercent = overlapFrac * 100;
   if (verbose) {
-    std::cerr << "Overlap percent: " << overlapPercent << std::endl;
+    log << "Overlap percent: " << overlapPercent << std::endl;
   }
 
   //====================================================================
@@ -294,7 +633,7 @@ bool findScreen(const std::vector<Mapping> &mapping,
   projection.z = -D * C;
   double xCOP = leftProj.distanceFrom(projection) / leftProj.distanceFrom(rightProj);
   if (verbose) {
-    std::cerr << "Center of projection x,y: " << xCOP << ", " << yCOP << std::endl;
+    log << "Center of projection x,y: " << xCOP << ", " << yCOP << std::endl;
   }
 
   //====================================================================
@@ -304,24 +643,230 @@ bool findScreen(const std::vector<Mapping> &mapping,
   screen.overlapPercent = overlapPercent;
   screen.xCOP = xCOP;
   screen.yCOP = yCOP;
+}
+
+bool findScreen(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, TaskPool &pool, ScreenProjection &projected,
+  bool verbose, std::ostream &log)
+{
+  if (mapping.size() == 0) {
+    log << "findScreen(): Error: No points in mapping" 
+      << std::endl;
+    return false;
+  }
 
+  //====================================================================
+  // Figure out the X screen-space extents.
+  // The X screen-space extents are defined by the lines perpendicular to the
+  // Y axis passing through:
+  //  left: the point location whose reprojection into the Y = 0 plane has the most -
+  //        positive angle(note that this may not be the point with the largest
+  //        longitudinal coordinate, because of the impact of changing latitude on
+  //        X - Z position).
+  //  right : the point location whose reprojection into the Y = 0 plane has the most -
+  //        negative angle(note that this may not be the point with the smallest
+  //        longitudinal coordinate, because of the impact of changing latitude on
+  //        X - Z position).
+  //  The rotation about Y is the negative of the longitude towards +X,
+  // so these are found once for all points rather than on each
+  // comparison.  Each block of points finds its own extremes, and the
+  // blocks are then combined in order so that ties go to the earliest
+  // point, as they would in a single pass.
+  XYZ &screenLeft = screen.screenLeft;
+  XYZ &screenRight = screen.screenRight;;
+  screenLeft = screenRight = mapping.point(0);
+  if (verbose) {
+    log << "First point rotation about Y (degrees): "
+      << screenLeft.rotationAboutY() * 180 / MY_PI << std::endl;
+  }
+  const double *px = mapping.px();
+  const double *py = mapping.py();
+  const double *pz = mapping.pz();
+  size_t n = mapping.size();
+  size_t blocks = (n + SCREEN_BLOCK_SIZE - 1) / SCREEN_BLOCK_SIZE;
+  std::vector<size_t> blockLeft(blocks), blockRight(blocks);
+  std::vector<double> blockMin(blocks), blockMax(blocks);
+  pool.parallel_for(blocks, [&](size_t b) {
+    size_t begin = b * SCREEN_BLOCK_SIZE;
+    size_t count = std::min(SCREEN_BLOCK_SIZE, n - begin);
+    std::vector<double> longitude(count), latitude(count);
+    points_to_angles(px + begin, py + begin, pz + begin, count, true,
+      longitude.data(), latitude.data());
+    size_t l = 0, r = 0;
+    for (size_t i = 1; i < count; i++) {
+      if (longitude[i] < longitude[l]) { l = i; }
+      if (longitude[i] > longitude[r]) { r = i; }
+    }
+    blockLeft[b] = begin + l;
+    blockRight[b] = begin + r;
+    blockMin[b] = longitude[l];
+    blockMax[b] = longitude[r];
+  });
+  size_t leftIndex = blockLeft[0], rightIndex = blockRight[0];
+  double minLongitude = blockMin[0], maxLongitude = blockMax[0];
+  for (size_t b = 1; b < blocks; b++) {
+    if (blockMin[b] < minLongitude) {
+      minLongitude = blockMin[b];
+      leftIndex = blockLeft[b];
+    }
+    if (blockMax[b] > maxLongitude) {
+      maxLongitude = blockMax[b];
+      rightIndex = blockRight[b];
+    }
+  }
+  screenLeft = mapping.point(leftIndex);
+  screenRight = mapping.point(rightIndex);
+  if (!find_screen_plane(screen, verbose, log)) {
+    return false;
+  }
+  double A = screen.A, B = screen.B, C = screen.C, D = screen.D;
+
+  //====================================================================
+  // Figure out the Y screen-space extents.
+  // The Y screen-space extents are symmetric and correspond to the lines parallel
+  //  to the screen X axis that are within the plane of the X line specifying the
+  //  axis extents at the largest magnitude angle up or down from the horizontal.
+  // Find the highest-magnitude Y value of all points when they are
+  // projected into the plane of the screen, keeping the projections.
+  double &maxY = screen.maxY;
+  projected.x.resize(n);
+  projected.y.resize(n);
+  std::vector<double> blockMaxY(blocks);
+  pool.parallel_for(blocks, [&](size_t b) {
+    size_t begin = b * SCREEN_BLOCK_SIZE;
+    size_t count = std::min(SCREEN_BLOCK_SIZE, n - begin);
+    std::vector<double> sz(count);
+    double *sy = projected.y.data() + begin;
+    project_onto_plane(px + begin, py + begin, pz + begin, count, A, B, C, D,
+      projected.x.data() + begin, sy, sz.data());
+    double m = fabs(sy[0]);
+    for (size_t i = 1; i < count; i++) {
+      double Y = fabs(sy[i]);
+      if (Y > m) { m = Y; }
+    }
+    blockMaxY[b] = m;
+  });
+  maxY = *std::max_element(blockMaxY.begin(), blockMaxY.end());
+  finish_screen(screen, verbose, log);
+  return true;
+}
+
+void ScreenFinder::addExtents(const MappingSpan &tile)
+{
+  size_t n = tile.size();
+  if (n == 0) { return; }
+  if (d_count == 0) {
+    d_left = d_right = tile.point(0);
+    if (d_verbose) {
+      *d_log << "First point rotation about Y (degrees): "
+        << d_left.rotationAboutY() * 180 / MY_PI << std::endl;
+    }
+  }
+
+  // Strict comparisons in order keep the earliest of tied points, as
+  // findScreen() does.
+  d_longitude.resize(n);
+  d_latitude.resize(n);
+  points_to_angles(tile.px(), tile.py(), tile.pz(), n, true,
+    d_longitude.data(), d_latitude.data());
+  for (size_t i = 0; i < n; i++) {
+    if ((d_count == 0) && (i == 0)) {
+      d_minLongitude = d_maxLongitude = d_longitude[0];
+      continue;
+    }
+    if (d_longitude[i] < d_minLongitude) {
+      d_minLongitude = d_longitude[i];
+      d_left = tile.point(i);
+    }
+    if (d_longitude[i] > d_maxLongitude) {
+      d_maxLongitude = d_longitude[i];
+      d_right = tile.point(i);
+    }
+  }
+  d_count += n;
+}
+
+bool ScreenFinder::findPlane(ScreenDescription &screen)
+{
+  if (d_count == 0) {
+    *d_log << "findScreen(): Error: No points in mapping"
+      << std::endl;
+    return false;
+  }
+  screen.screenLeft = d_left;
+  screen.screenRight = d_right;
+  d_maxY = 0;
+  return find_screen_plane(screen, d_verbose, *d_log);
+}
+
+void ScreenFinder::addHeights(const MappingSpan &tile, const ScreenDescription &screen)
+{
+  size_t n = tile.size();
+  d_sx.resize(n);
+  d_sy.resize(n);
+  d_sz.resize(n);
+  project_onto_plane(tile.px(), tile.py(), tile.pz(), n,
+    screen.A, screen.B, screen.C, screen.D, d_sx.data(), d_sy.data(), d_sz.data());
+  for (size_t i = 0; i < n; i++) {
+    double Y = fabs(d_sy[i]);
+    if (Y > d_maxY) { d_maxY = Y; }
+  }
+}
+
+bool ScreenFinder::finish(ScreenDescription &screen)
+{
+  if (d_count == 0) {
+    *d_log << "findScreen(): Error: No points in mapping"
+      << std::endl;
+    return false;
+  }
+  screen.maxY = d_maxY;
+  finish_screen(screen, d_verbose, *d_log);
   return true;
 }
 
 bool findMesh(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription const &screen, MeshDescription &mesh, bool verbose)
+{
+  return findMesh(MappingSet(mapping), left, bottom, right, top,
+    screen, mesh, verbose);
+}
+
+bool findMesh(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose)
+{
+  // Project the 3D points back into the plane of the screen all at once.
+  size_t n = mapping.size();
+  ScreenProjection projection;
+  projection.x.resize(n);
+  projection.y.resize(n);
+  std::vector<double> sz(n);
+  project_onto_plane(mapping.px(), mapping.py(), mapping.pz(), n,
+    screen.A, screen.B, screen.C, screen.D,
+    projection.x.data(), projection.y.data(), sz.data());
+  return findMesh(mapping, projection, 0, left, bottom, right, top,
+    screen, mesh, verbose);
+}
+
+bool findMesh(const MappingSpan &mapping,
+  const ScreenProjection &projection, size_t offset,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose,
+  std::ostream &log)
 {
   if (mapping.size() == 0) {
-    std::cerr << "findMesh(): Error: No points in mapping"
+    log << "findMesh(): Error: No points in mapping"
+      << std::endl;
+    return false;
+  }
+  if (offset + mapping.size() > projection.y.size()) {
+    log << "findMesh(): Error: Projection does not cover the mapping"
       << std::endl;
     return false;
   }
-
-  const double &A = screen.A;
-  const double &B = screen.B;
-  const double &C = screen.C;
-  const double &D = screen.D;
 
   //====================================================================
   // Map each incoming mesh coordinate into the corresponding output
@@ -336,7 +881,7 @@ bool findMesh(const std::vector<Mapping> &mapping,
   const XYZ &leftProj = screen.screenLeft;
   const XYZ &rightProj = screen.screenRight;
   if (leftProj.x == rightProj.x) {
-    std::cerr << "Error computing mesh: screen has no X extent" << std::endl;
+    log << "Error computing mesh: screen has no X extent" << std::endl;
     return false;
   }
   double xOutOffset = -leftProj.x;
@@ -344,22 +889,29 @@ bool findMesh(const std::vector<Mapping> &mapping,
   double yOutOffset = screen.maxY; // Negative of negative maxY is maxY
   double yOutScale = 1 / (2 * screen.maxY);
 
-  for (size_t i = 0; i < mapping.size(); i++) {
+  // The points' projections into the plane of the screen.
+  size_t n = mapping.size();
+  const double *sx = projection.x.data() + offset;
+  const double *sy = projection.y.data() + offset;
+
+  const double *xIn = mapping.x();
+  const double *yIn = mapping.y();
+  mesh.reserve(n);
+  for (size_t i = 0; i < n; i++) {
 
     // Input point coordinates are already normalized.
-    double xNormIn = mapping[i].xyLatLong.x;
-    double yNormIn = mapping[i].xyLatLong.y;
+    double xNormIn = xIn[i];
+    double yNormIn = yIn[i];
     std::array<double, 2> in;
     in[0] = xNormIn;
     in[1] = yNormIn;
 
-    // Project the 3D points back into the plane of the screen and determine
-    // the normalized coordinates in the coordinate system with the lower left
-    // corner at (0,0) and the upper right at (1,1).  Because we oversized the
-    // screen, these will all be in this range.  Otherwise, they might not be.
-    XYZ onScreen = mapping[i].xyz.projectOntoPlane(A, B, C, D);
-    double xNormOut = (onScreen.x + xOutOffset) * xOutScale;
-    double yNormOut = (onScreen.y + yOutOffset) * yOutScale;
+    // Determine the normalized coordinates of the projected point in the
+    // coordinate system with the lower left corner at (0,0) and the upper
+    // right at (1,1).  Because we oversized the screen, these will all be
+    // in this range.  Otherwise, they might not be.
+    double xNormOut = (sx[i] + xOutOffset) * xOutScale;
+    double yNormOut = (sy[i] + yOutOffset) * yOutScale;
     std::array<double, 2> out;
     out[0] = xNormOut;
     out[1] = yNormOut;
@@ -430,71 +982,166 @@ static double point_distance(double x1, double y1, double x2, double y2) {
   return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
 }
 
-/// Finds out how many neighbors of the specified index
-/// in the mapping violate the strictures of the
+namespace {
+
+/// Uniform grid over the (longitude, latitude) of each point in a
+/// mapping, used to find the nearest neighbors of a point in angle
+/// space without sorting every other point by distance.  Points can
+/// be removed from the grid as they are removed from consideration.
+class LatLongGrid {
+public:
+  LatLongGrid(const std::vector<Mapping> &mapping)
+    : d_mapping(mapping)
+  {
+    size_t n = mapping.size();
+    d_minX = d_maxX = n ? mapping[0].xyLatLong.longitude : 0;
+    d_minY = d_maxY = n ? mapping[0].xyLatLong.latitude : 0;
+    for (size_t i = 1; i < n; i++) {
+      d_minX = std::min(d_minX, mapping[i].xyLatLong.longitude);
+      d_maxX = std::max(d_maxX, mapping[i].xyLatLong.longitude);
+      d_minY = std::min(d_minY, mapping[i].xyLatLong.latitude);
+      d_maxY = std::max(d_maxY, mapping[i].xyLatLong.latitude);
+    }
+
+    // Size the cells so that there are about two points in each one
+    // for a uniformly-distributed set of points.  Handle degenerate
+    // cases where all points lie along a line or at a single point.
+    double width = d_maxX - d_minX;
+    double height = d_maxY - d_minY;
+    if ((width > 0) && (height > 0)) {
+      d_cellSize = sqrt(2 * width * height / std::max<size_t>(n, 1));
+    } else if (std::max(width, height) > 0) {
+      d_cellSize = 2 * std::max(width, height) / std::max<size_t>(n, 1);
+    } else {
+      d_cellSize = 1;
+    }
+    d_numX = static_cast<size_t>(width / d_cellSize) + 1;
+    d_numY = static_cast<size_t>(height / d_cellSize) + 1;
+
+    d_cells.resize(d_numX * d_numY);
+    for (size_t i = 0; i < n; i++) {
+      d_cells[cellIndex(i)].push_back(i);
+    }
+  }
+
+  /// Remove a point so that it is no longer returned as a neighbor.
+  void remove(size_t index)
+  {
+    std::vector<size_t> &cell = d_cells[cellIndex(index)];
+    cell.erase(std::find(cell.begin(), cell.end(), index));
+  }
+
+  /// Fill in the indices of the (up to) count nearest points to the
+  /// specified point in angle space, not including the point itself.
+  /// They are sorted by increasing distance, with ties broken by
+  /// increasing index.
+  void nearest(size_t index, size_t count, std::vector<size_t> &result) const
+  {
+    typedef std::pair<double, size_t> DistanceIndex;
+    std::vector<DistanceIndex> best;
+    double qx = d_mapping[index].xyLatLong.longitude;
+    double qy = d_mapping[index].xyLatLong.latitude;
+    long cx = static_cast<long>(cellX(qx));
+    long cy = static_cast<long>(cellY(qy));
+    long maxX = static_cast<long>(d_numX) - 1;
+    long maxY = static_cast<long>(d_numY) - 1;
+
+    // Look at rings of cells at increasing distance from the one that
+    // holds the point until we have enough points and all cells that
+    // have not been examined are further away than the farthest one.
+    for (long r = 0; ; r++) {
+      for (long y = std::max(cy - r, 0L); y <= std::min(cy + r, maxY); y++) {
+        bool edgeRow = (y == cy - r) || (y == cy + r);
+        long step = edgeRow ? 1 : 2 * r;
+        for (long x = cx - r; x <= cx + r; x += std::max(step, 1L)) {
+          if ((x < 0) || (x > maxX)) { continue; }
+          const std::vector<size_t> &cell = d_cells[y * d_numX + x];
+          for (size_t c = 0; c < cell.size(); c++) {
+            size_t i = cell[c];
+            if (i == index) { continue; }
+            DistanceIndex di(point_distance(qx, qy,
+              d_mapping[i].xyLatLong.longitude,
+              d_mapping[i].xyLatLong.latitude), i);
+            if ((best.size() < count) || (di < best.back())) {
+              best.insert(std::upper_bound(best.begin(), best.end(), di), di);
+              if (best.size() > count) { best.pop_back(); }
+            }
+          }
+        }
+      }
+
+      if ((cx - r <= 0) && (cx + r >= maxX) && (cy - r <= 0) && (cy + r >= maxY)) {
+        break;
+      }
+      if (best.size() == count) {
+        double bound = std::min(
+          std::min(qx - (d_minX + (cx - r) * d_cellSize),
+                   (d_minX + (cx + r + 1) * d_cellSize) - qx),
+          std::min(qy - (d_minY + (cy - r) * d_cellSize),
+                   (d_minY + (cy + r + 1) * d_cellSize) - qy));
+        if (best.back().first < bound) { break; }
+      }
+    }
+
+    result.clear();
+    for (size_t i = 0; i < best.size(); i++) {
+      result.push_back(best[i].second);
+    }
+  }
+
+private:
+  size_t cellX(double x) const {
+    return std::min(static_cast<size_t>((x - d_minX) / d_cellSize), d_numX - 1);
+  }
+  size_t cellY(double y) const {
+    return std::min(static_cast<size_t>((y - d_minY) / d_cellSize), d_numY - 1);
+  }
+  size_t cellIndex(size_t i) const {
+    return cellY(d_mapping[i].xyLatLong.latitude) * d_numX +
+      cellX(d_mapping[i].xyLatLong.longitude);
+  }
+
+  const std::vector<Mapping> &d_mapping;
+  double d_minX, d_maxX, d_minY, d_maxY;
+  double d_cellSize;
+  size_t d_numX, d_numY;
+  std::vector< std::vector<size_t> > d_cells;  //< Indices of points in each cell
+};
+
+/// Entry in the queue of points ordered by how many of their
+/// neighbor angles are invalid; the largest count comes out first,
+/// with ties going to the lowest index.
+struct OffenderEntry {
+  size_t count;
+  size_t index;
+  bool operator<(const OffenderEntry &o) const {
+    if (count != o.count) { return count < o.count; }
+    return index > o.index;
+  }
+};
+
+} // namespace
+
+/// Finds out how many of the specified neighbors of the specified
+/// index in the mapping violate the strictures of the
 /// remove_invalid_points_based_on_angle function.
-/// Checks up to 8 nearest neighbors in angle space.
 /// @return How many neighbor angle differences are too large.
 static size_t neighbor_errors(
   const std::vector<Mapping> &mapping, size_t index,
+  const std::vector<size_t> &neighbors,
   double xx, double xy,
   double yx, double yy, double minDotProduct)
 {
-  // Sort all points other than the one we're looking for
-  // based on distance from the one we are looking for.
-  typedef std::multimap<double, size_t> PointDistanceIndexMap;
-  PointDistanceIndexMap map;
-  for (size_t i = 0; i < mapping.size(); i++) {
-    if (i != index) {
-      map.insert(std::make_pair(
-        point_distance(
-        mapping[index].xyLatLong.longitude,
-        mapping[index].xyLatLong.latitude,
-        mapping[i].xyLatLong.longitude,
-        mapping[i].xyLatLong.latitude
-        ), i));
-    }
-  }
-
-  // Check the first 8 points on the list (if there are that many)
-  // and count up how many violate the angle condition.
   size_t ret = 0;
-  PointDistanceIndexMap::const_iterator it = map.begin();
-  for (size_t i = 0; (i < map.size()) && (i < 8); i++) {
-    if (neighbor_error(mapping, index, it->second,
+  for (size_t i = 0; i < neighbors.size(); i++) {
+    if (neighbor_error(mapping, index, neighbors[i],
         xx, xy, yx, yy, minDotProduct)) {
       ret++;
     }
-    it++;
   }
   return ret;
 }
 
-/// Looks through the mapping to see if there is a point whose
-/// neighbor angles violate the strictures of the
-/// remove_invalid_points_based_on_angle function.
-/// @return index of the point that has the largest number
-/// of invalid neighbor angles if one is found, size of mapping
-/// if not.
-static size_t find_index_of_angle_worst_offender(
-  std::vector<Mapping> &mapping, double xx, double xy,
-  double yx, double yy, double minDotProduct)
-{
-  size_t worstIndex = 0;
-  size_t worstCount = neighbor_errors(mapping, 0,
-    xx, xy, yx, yy, minDotProduct);
-  for (size_t i = 1; i < mapping.size(); i++) {
-    size_t count = neighbor_errors(mapping, i,
-      xx, xy, yx, yy, minDotProduct);
-    if (count > worstCount) {
-      worstCount = count;
-      worstIndex = i;
-    }
-  }
-  if (worstCount == 0) { return mapping.size(); }
-  return worstIndex;
-}
-
 int remove_invalid_points_based_on_angle(
   std::vector<Mapping> &mapping, double xx, double xy,
   double yx, double yy, double maxAngleDegrees)
@@ -506,21 +1153,317 @@ int remove_invalid_points_based_on_angle(
   // of the angle.
   double minDotProduct = cos(maxAngleDegrees / 180.0 * MY_PI);
 
+  // Checks up to 8 nearest neighbors in angle space.
+  const size_t numNeighbors = 8;
+
+  // Find the neighbors of each point and how many of them violate
+  // the angle condition.  Keep track of which points each point is
+  // a neighbor of, so that when a point is removed we only need to
+  // re-check the points that had it as a neighbor.  The reverse lists
+  // may hold stale entries, which are ignored when they are used.
+  size_t n = mapping.size();
+  LatLongGrid grid(mapping);
+  std::vector< std::vector<size_t> > neighbors(n);
+  std::vector< std::vector<size_t> > neighborOf(n);
+  std::vector<size_t> errors(n);
+  std::vector<bool> removed(n, false);
+  std::priority_queue<OffenderEntry> offenders;
+  for (size_t i = 0; i < n; i++) {
+    grid.nearest(i, numNeighbors, neighbors[i]);
+    for (size_t j = 0; j < neighbors[i].size(); j++) {
+      neighborOf[neighbors[i][j]].push_back(i);
+    }
+    errors[i] = neighbor_errors(mapping, i, neighbors[i],
+      xx, xy, yx, yy, minDotProduct);
+    OffenderEntry e = { errors[i], i };
+    offenders.push(e);
+  }
+
   // We remove the worst offender from the list each time,
-  // then re-start.  Assuming that we get the actual outlier,
-  // as opposed to one of its neighbors, this avoids trimming
-  // too many points from the vector.
-  bool foundOutlier;
-  do {
-    foundOutlier = false;
-    size_t off = find_index_of_angle_worst_offender(
-      mapping, xx, xy, yx, yy, minDotProduct);
-    if (off < mapping.size()) {
-      mapping.erase(mapping.begin() + off);
-      foundOutlier = true;
-      ret++;
+  // then re-check its neighbors.  Assuming that we get the actual
+  // outlier, as opposed to one of its neighbors, this avoids trimming
+  // too many points from the vector.  Queue entries whose count no
+  // longer matches the point's count are out of date and skipped.
+  std::vector<size_t> newNeighbors;
+  while (!offenders.empty()) {
+    OffenderEntry worst = offenders.top();
+    offenders.pop();
+    if (removed[worst.index] || (worst.count != errors[worst.index])) {
+      continue;
+    }
+    if (worst.count == 0) { break; }
+
+    size_t off = worst.index;
+    removed[off] = true;
+    grid.remove(off);
+    ret++;
+
+    for (size_t j = 0; j < neighborOf[off].size(); j++) {
+      size_t q = neighborOf[off][j];
+      if (removed[q] || (std::find(neighbors[q].begin(), neighbors[q].end(), off)
+          == neighbors[q].end())) {
+        continue;
+      }
+      grid.nearest(q, numNeighbors, newNeighbors);
+      for (size_t k = 0; k < newNeighbors.size(); k++) {
+        if (std::find(neighbors[q].begin(), neighbors[q].end(), newNeighbors[k])
+            == neighbors[q].end()) {
+          neighborOf[newNeighbors[k]].push_back(q);
+        }
+      }
+      neighbors[q].swap(newNeighbors);
+      size_t count = neighbor_errors(mapping, q, neighbors[q],
+        xx, xy, yx, yy, minDotProduct);
+      if (count != errors[q]) {
+        errors[q] = count;
+        OffenderEntry e = { count, q };
+        offenders.push(e);
+      }
+    }
+    std::vector<size_t>().swap(neighborOf[off]);
+  }
+
+  // Remove all of the points we found from the mapping in one pass,
+  // keeping the others in their original order.
+  size_t out = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!removed[i]) { mapping[out++] = mapping[i]; }
+  }
+  mapping.resize(out);
+
+  return ret;
+}
+
+// Nearest neighbors in angle space that each quadratic is fit to, and the
+// fewest that are enough for a fit; the quadratic has six coefficients.
+static const size_t FIT_NEIGHBORS = 12;
+static const size_t MIN_FIT_NEIGHBORS = 8;
+
+// Residuals smaller than this fraction of the spread of a point's
+// neighbors are never outliers, so that a table that fits very well
+// everywhere does not lose points to the rounding in its entries.
+static const double MIN_OUTLIER_RESIDUAL = 0.1;
+
+// Scale from the median absolute deviation to a standard deviation for
+// normally-distributed residuals.
+static const double MAD_TO_SIGMA = 1.4826;
+
+// Changes the order of the values.
+static double median_of(std::vector<double> &values)
+{
+  size_t mid = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + mid, values.end());
+  return values[mid];
+}
+
+/// Fits x and y on the screen as quadratics in longitude and latitude to
+/// the specified neighbors of the point and finds how far the fit is
+/// from the point, relative to the RMS distance of the neighbors from
+/// their centroid on the screen.  Also fills in the determinant of the
+/// fit's Jacobian at the point, whose sign tells which way around the
+/// screen is mapped there.
+/// @return The residual, or -1 if the neighbors do not determine a fit.
+static double local_fit_residual(const std::vector<Mapping> &mapping,
+  size_t index, const std::vector<size_t> &neighbors, double &determinant)
+{
+  size_t count = neighbors.size();
+  if (count < MIN_FIT_NEIGHBORS) { return -1; }
+
+  // Work relative to the point in angle space, scaled by the distance to
+  // the farthest neighbor, and relative to the neighbors' centroid on
+  // the screen, to keep the normal equations well conditioned.
+  const XYLatLong &p = mapping[index].xyLatLong;
+  double cx = 0, cy = 0, reach = 0;
+  for (size_t j = 0; j < count; j++) {
+    const XYLatLong &q = mapping[neighbors[j]].xyLatLong;
+    cx += q.x;
+    cy += q.y;
+    reach = std::max(reach, point_distance(p.longitude, p.latitude,
+      q.longitude, q.latitude));
+  }
+  cx /= count;
+  cy /= count;
+  double spread = 0;
+  for (size_t j = 0; j < count; j++) {
+    const XYLatLong &q = mapping[neighbors[j]].xyLatLong;
+    spread += (q.x - cx) * (q.x - cx) + (q.y - cy) * (q.y - cy);
+  }
+  spread = sqrt(spread / count);
+  if (!(reach > 0) || !(spread > 0)) { return -1; }
+
+  // Normal equations for the coefficients of 1, u, v, u^2, uv, v^2, with
+  // the right-hand sides for x and y in the last two columns.
+  const int N = 6;
+  double a[N][N + 2] = {};
+  for (size_t j = 0; j < count; j++) {
+    const XYLatLong &q = mapping[neighbors[j]].xyLatLong;
+    double u = (q.longitude - p.longitude) / reach;
+    double v = (q.latitude - p.latitude) / reach;
+    double b[N] = { 1, u, v, u * u, u * v, v * v };
+    for (int r = 0; r < N; r++) {
+      for (int c = r; c < N; c++) {
+        a[r][c] += b[r] * b[c];
+      }
+      a[r][N] += b[r] * (q.x - cx);
+      a[r][N + 1] += b[r] * (q.y - cy);
+    }
+  }
+  for (int r = 1; r < N; r++) {
+    for (int c = 0; c < r; c++) { a[r][c] = a[c][r]; }
+  }
+
+  // Gaussian elimination with partial pivoting.  The point is at
+  // u = v = 0, so only the constant and linear terms are needed.
+  double scale = a[0][0];
+  for (int col = 0; col < N; col++) {
+    int pivot = col;
+    for (int r = col + 1; r < N; r++) {
+      if (fabs(a[r][col]) > fabs(a[pivot][col])) { pivot = r; }
     }
-  } while (foundOutlier);
+    if (!(fabs(a[pivot][col]) > 1e-10 * scale)) { return -1; }
+    for (int c = 0; c < N + 2; c++) { std::swap(a[col][c], a[pivot][c]); }
+    for (int r = col + 1; r < N; r++) {
+      double f = a[r][col] / a[col][col];
+      for (int c = col; c < N + 2; c++) { a[r][c] -= f * a[col][c]; }
+    }
+  }
+  double coef[2][N];
+  for (int rhs = 0; rhs < 2; rhs++) {
+    for (int r = N - 1; r >= 0; r--) {
+      double sum = a[r][N + rhs];
+      for (int c = r + 1; c < N; c++) { sum -= a[r][c] * coef[rhs][c]; }
+      coef[rhs][r] = sum / a[r][r];
+    }
+  }
+
+  determinant = coef[0][1] * coef[1][2] - coef[0][2] * coef[1][1];
+  return point_distance(p.x, p.y, cx + coef[0][0], cy + coef[1][0]) / spread;
+}
+
+int remove_outliers_by_local_fit(
+  std::vector<Mapping> &mapping, double k, unsigned passes, TaskPool &pool,
+  std::vector<OutlierReport> *removedPoints, std::ostream &log)
+{
+  if (!(k > 0) || (passes == 0)) {
+    log << "remove_outliers_by_local_fit(): Need a positive k and"
+      << " at least one pass" << std::endl;
+    return -1;
+  }
+  if (removedPoints) { removedPoints->clear(); }
+
+  // Fit every point on the first pass.  After that, only points that
+  // had a removed point as a neighbor are re-fit; the others have the
+  // same neighbors they had before.  Points are handled in blocks to
+  // keep the cost of handing out tasks small.
+  size_t n = mapping.size();
+  LatLongGrid grid(mapping);
+  std::vector<char> removed(n, 0);
+  std::vector< std::vector<size_t> > neighbors(n);
+  std::vector<double> residual(n, -1);
+  std::vector<double> determinant(n, 0);
+  std::vector<size_t> toFit(n);
+  for (size_t i = 0; i < n; i++) { toFit[i] = i; }
+  const size_t blockSize = 256;
+  double threshold = 0;
+  double orientation = 0;
+  auto folded = [&](size_t i) {
+    return (orientation != 0) && !(determinant[i] * orientation > 0);
+  };
+  int ret = 0;
+  for (unsigned pass = 1; pass <= passes; pass++) {
+    pool.parallel_for((toFit.size() + blockSize - 1) / blockSize, [&](size_t b) {
+      size_t end = std::min(toFit.size(), (b + 1) * blockSize);
+      for (size_t t = b * blockSize; t < end; t++) {
+        size_t i = toFit[t];
+        grid.nearest(i, FIT_NEIGHBORS, neighbors[i]);
+        residual[i] = local_fit_residual(mapping, i, neighbors[i], determinant[i]);
+      }
+    });
+
+    // The threshold comes from the residuals of the whole table on the
+    // first pass, so that later passes only pick up outliers that were
+    // hidden behind worse neighbors rather than eating into the tail.
+    // Most of the table maps the screen the same way around; where a
+    // fit maps it the other way, the table has folded over itself.
+    if (pass == 1) {
+      std::vector<double> values;
+      for (size_t i = 0; i < n; i++) {
+        if (residual[i] >= 0) {
+          values.push_back(residual[i]);
+          orientation += (determinant[i] > 0) ? 1 : -1;
+        }
+      }
+      if (values.size() < 2) { break; }
+      double median = median_of(values);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = fabs(values[i] - median);
+      }
+      double mad = median_of(values);
+      threshold = std::max(median + k * MAD_TO_SIGMA * mad, MIN_OUTLIER_RESIDUAL);
+
+      // With as many fits one way around as the other, there is no
+      // telling which of them are folded, so none are removed for it.
+      if (orientation == 0) {
+        log << "Warning: remove_outliers_by_local_fit(): As many points"
+          << " map the screen one way around as the other; not removing"
+          << " folded points" << std::endl;
+      }
+    }
+
+    // Remove all of the folded points, and each outlier that does not
+    // have a worse outlier among its neighbors, which may be the cause
+    // of its own large residual.
+    std::vector<size_t> worst;
+    for (size_t i = 0; i < n; i++) {
+      if (removed[i] || (residual[i] < 0)) { continue; }
+      if (folded(i)) {
+        worst.push_back(i);
+        continue;
+      }
+      if (!(residual[i] > threshold)) { continue; }
+      bool isWorst = true;
+      for (size_t j = 0; j < neighbors[i].size(); j++) {
+        size_t q = neighbors[i][j];
+        if ((residual[q] > residual[i]) ||
+            ((residual[q] == residual[i]) && (q < i))) {
+          isWorst = false;
+          break;
+        }
+      }
+      if (isWorst) { worst.push_back(i); }
+    }
+    if (worst.empty()) { break; }
+    for (size_t w = 0; w < worst.size(); w++) {
+      size_t i = worst[w];
+      removed[i] = 1;
+      grid.remove(i);
+      if (removedPoints) {
+        OutlierReport report = { i, mapping[i], residual[i], threshold,
+          folded(i), pass };
+        removedPoints->push_back(report);
+      }
+    }
+    ret += static_cast<int>(worst.size());
+
+    toFit.clear();
+    for (size_t i = 0; i < n; i++) {
+      if (removed[i]) { continue; }
+      for (size_t j = 0; j < neighbors[i].size(); j++) {
+        if (removed[neighbors[i][j]]) {
+          toFit.push_back(i);
+          break;
+        }
+      }
+    }
+  }
+
+  // Remove all of the points we found from the mapping in one pass,
+  // keeping the others in their original order.
+  size_t out = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!removed[i]) { mapping[out++] = mapping[i]; }
+  }
+  mapping.resize(out);
 
   return ret;
 }
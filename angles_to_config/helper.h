@@ -26,12 +26,64 @@
 #pragma once
 
 #include "types.h"
+#include <fstream>
 #include <iostream>
 #include <vector>
+#include <string>
+
+class TaskPool;
 
 // Returns empty mapping if it fails to read anything.
 extern std::vector<Mapping> read_from_infile(std::istream &in);
 
+/// Reads the whitespace-separated longitude, latitude, x, y entries
+/// from a table held in memory.  Entries may be split across lines.
+/// Malformed entries are reported on log along with their line
+/// number in the named input.
+///   @return false (with an empty mapping) on error, true otherwise.
+extern bool read_from_buffer(const char *buffer, size_t length,
+  std::vector<Mapping> &mapping, const std::string &name = "input",
+  std::ostream &log = std::cerr);
+
+/// Reads the entire named file with one read and parses it using
+/// read_from_buffer().
+///   @return false (with an empty mapping) on error, true otherwise.
+extern bool read_from_file(const std::string &fileName,
+  std::vector<Mapping> &mapping);
+
+/// Reads a table the way read_from_file() does, but a tile of entries
+/// at a time, so that a table too large to hold in memory can be
+/// streamed through the pipeline.  The file is read in fixed-size
+/// chunks, and entries may still be split across lines.
+class TableReader {
+public:
+  /// Opens the named file, starting again from its beginning if it was
+  /// already open.
+  ///   @return false (with a message on std::cerr) on error.
+  bool open(const std::string &fileName);
+
+  /// Reads up to maxEntries entries into tile, replacing what it held.
+  /// The tile is left empty at the end of the table.
+  ///   @return false (with an empty tile and a message on std::cerr)
+  /// on error.
+  bool read(size_t maxEntries, std::vector<Mapping> &tile);
+
+  /// The number of entries read since the file was opened.
+  size_t count() const { return d_count; }
+
+private:
+  bool nextToken(const char *&begin, const char *&end);
+  void refill();
+
+  std::ifstream d_in;
+  std::string d_name;
+  std::vector<char> d_buffer;
+  size_t d_begin = 0, d_end = 0;  //!< Part of the buffer not yet parsed
+  bool d_atEnd = false;           //!< The whole file is in the buffer
+  size_t d_line = 1;
+  size_t d_count = 0;
+};
+
 /// This removes invalid points from the mesh if the angle
 /// between the vector from a point to its neighbor in lat/long
 /// space (when transformed by the specified mapping into screen
@@ -45,16 +97,149 @@ extern int remove_invalid_points_based_on_angle(
   std::vector<Mapping> &mapping, double xx, double xy,
   double yx, double yy, double maxAngleDegrees);
 
+/// A point that remove_outliers_by_local_fit() removed.
+struct OutlierReport {
+  size_t index;           //!< In the mapping as it was passed in
+  Mapping mapping;
+  double residual;        //!< Distance from the fit, relative to the neighborhood
+  double threshold;       //!< Residuals above this were outliers in its pass
+  bool folded;            //!< The fit maps the screen the other way around
+  unsigned pass;          //!< Starting from 1
+};
+
+/// This removes invalid points from the mesh if their screen location
+/// is far from where a smooth model of the angle-to-screen map puts
+/// them.  Each point's screen location is predicted by a quadratic fit
+/// to its nearest neighbors in angle space, leaving the point itself
+/// out.  The distance to the prediction, divided by the spread of the
+/// neighbors on the screen, is the point's residual.  Points whose
+/// residual is more than k times the median absolute deviation (scaled
+/// to estimate a standard deviation) above the median of the first
+/// pass are outliers.  So are points whose fit maps the screen the other
+/// way around from most of the table, where it has folded over itself;
+/// if neither way around is the more common, that is only warned about.
+/// All folded points and the outliers that have no worse outlier among
+/// their neighbors are removed at once, then the residuals near them are
+/// recomputed, for up to the specified number of passes or until none
+/// are found.  Unlike remove_invalid_points_based_on_angle(), this needs
+/// no screen orientation and the neighborhoods are fit in parallel
+/// using pool.
+///   @param removedPoints If not null, filled in with what was removed.
+///   @return -1 (with a message on log) on error, the number of points
+/// that were removed from the mesh otherwise.
+extern int remove_outliers_by_local_fit(
+  std::vector<Mapping> &mapping, double k, unsigned passes, TaskPool &pool,
+  std::vector<OutlierReport> *removedPoints = nullptr,
+  std::ostream &log = std::cerr);
+
+/// Produces a mapping that is reflected around X=0 in both angles and
+/// screen coordinates, for the opposite eye.  The pipeline itself uses
+/// the reflect argument of convert_to_normalized_and_meters() instead,
+/// which does not make a copy.
+extern std::vector<Mapping> reflect_mapping(const std::vector<Mapping> &mapping);
+
+/// Converts the screen coordinates in the mapping into normalized
+/// screen units and the angles into 3D points at the specified depth.
+/// Warnings about points outside the screen are written to log, so
+/// that callers running several conversions at once can keep them
+/// from interleaving.
 extern bool convert_to_normalized_and_meters(
   std::vector<Mapping> &mapping, double toMeters, double depth,
   double left, double bottom, double right, double top,
-  bool useFieldAngles = false);
+  bool useFieldAngles = false, std::ostream &log = std::cerr);
+
+/// As above, but reads the table from mapping and writes the converted
+/// entries into out[offset, offset + mapping.size()), which must already
+/// exist.  If reflect is true the table is mirrored as reflect_mapping()
+/// does while it is converted.  Several tables can be converted at once
+/// into separate ranges of the same set.  The warnings number the
+/// entries from firstIndex, for a table that is one tile of a larger one.
+extern bool convert_to_normalized_and_meters(
+  const std::vector<Mapping> &mapping, bool reflect,
+  MappingSet &out, size_t offset, double toMeters, double depth,
+  double left, double bottom, double right, double top,
+  bool useFieldAngles = false, std::ostream &log = std::cerr,
+  size_t firstIndex = 0);
 
+/// Bounds of the screen locations in all of the tables, converted to
+/// meters by multiplying by toMeters.  The tables must not be empty.
+extern void find_table_bounds(const std::vector< std::vector<Mapping> > &mappings,
+  double toMeters, double &left, double &bottom, double &right, double &top);
+
+/// Screen bounds for both eyes, each as left, bottom, right and top, given
+/// those of the eye the tables were made for.  The other eye's are the
+/// mirror image about x = 0.
+extern void mirror_screen_bounds(bool useRightEye,
+  double left, double bottom, double right, double top,
+  double leftEye[4], double rightEye[4]);
+
+extern bool findScreen(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, bool verbose = false);
 extern bool findScreen(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription &screen, bool verbose = false);
 
+/// As above, but finds the extents and the projection onto the plane
+/// with the pool a block of points at a time, keeps each point's
+/// projection for findMesh(), and writes its messages to log so that
+/// several screens can be found at once.
+extern bool findScreen(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription &screen, TaskPool &pool, ScreenProjection &projected,
+  bool verbose = false, std::ostream &log = std::cerr);
+
+extern bool findMesh(const MappingSpan &mapping,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose = false);
 extern bool findMesh(const std::vector<Mapping> &mapping,
   double left, double bottom, double right, double top,
   ScreenDescription const &screen, MeshDescription &mesh, bool verbose = false);
 
+/// As above, but takes the points' projection from the one that
+/// findScreen() made for the whole set, in which the mapping's points
+/// start at offset, and writes its messages to log.
+extern bool findMesh(const MappingSpan &mapping,
+  const ScreenProjection &projection, size_t offset,
+  double left, double bottom, double right, double top,
+  ScreenDescription const &screen, MeshDescription &mesh, bool verbose = false,
+  std::ostream &log = std::cerr);
+
+/// Finds a screen the way findScreen() does from a mapping set that is
+/// seen one tile at a time, in the order the whole set would hold them,
+/// and produces the same screen.  Each tile is needed twice: once for
+/// the horizontal extents, and again, once the plane of the screen is
+/// known from them, for the vertical extent.
+///   finder.addExtents(tile) for each tile
+///   finder.findPlane(screen)
+///   finder.addHeights(tile, screen) for each tile
+///   finder.finish(screen)
+/// Messages go to log as findScreen()'s do.
+class ScreenFinder {
+public:
+  ScreenFinder(bool verbose = false, std::ostream &log = std::cerr)
+    : d_verbose(verbose), d_log(&log) {}
+
+  void addExtents(const MappingSpan &tile);
+
+  /// Fills in the screen's left and right points and its plane.
+  ///   @return false (with a message) if there were no points or the
+  /// field of view is too wide.
+  bool findPlane(ScreenDescription &screen);
+
+  void addHeights(const MappingSpan &tile, const ScreenDescription &screen);
+
+  /// Fills in the rest of the screen.
+  ///   @return false (with a message) on error.
+  bool finish(ScreenDescription &screen);
+
+private:
+  bool d_verbose;
+  std::ostream *d_log;
+  size_t d_count = 0;
+  XYZ d_left, d_right;                    //!< Extreme points so far
+  double d_minLongitude = 0, d_maxLongitude = 0;
+  double d_maxY = 0;
+  std::vector<double> d_longitude, d_latitude, d_sx, d_sy, d_sz;
+};
+
@@ -0,0 +1,265 @@
+/** @file
+    @brief Implementation of the minimal Json reader.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "json_reader.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+static const JsonValue nullValue;
+
+const JsonValue &JsonValue::operator[](size_t i) const
+{
+  if ((d_type != ARRAY) || (i >= d_elements.size())) { return nullValue; }
+  return d_elements[i];
+}
+
+const JsonValue &JsonValue::operator[](const std::string &name) const
+{
+  if (d_type != OBJECT) { return nullValue; }
+  for (size_t i = 0; i < d_names.size(); i++) {
+    if (d_names[i] == name) { return d_elements[i]; }
+  }
+  return nullValue;
+}
+
+/// Recursive-descent parser over a buffer.  Nesting is limited so that
+/// a malformed file can't overflow the stack.
+class JsonParser {
+public:
+  JsonParser(const char *text, size_t length, const std::string &name)
+    : d_p(text), d_end(text + length), d_name(name) {}
+
+  bool parseDocument(JsonValue &value)
+  {
+    if (!parseValue(value, 0)) { return false; }
+    skipSpace();
+    if (d_p != d_end) { return error("unexpected text after the end of the document"); }
+    return true;
+  }
+
+private:
+  static const int MAX_DEPTH = 256;
+
+  bool error(const char *what)
+  {
+    std::cerr << "Error: " << d_name << " line " << d_line << ": " << what << std::endl;
+    return false;
+  }
+
+  void skipSpace()
+  {
+    for (; d_p < d_end; d_p++) {
+      if (*d_p == '\n') { d_line++; }
+      else if ((*d_p != ' ') && (*d_p != '\t') && (*d_p != '\r')) { return; }
+    }
+  }
+
+  bool literal(const char *word)
+  {
+    for (const char *w = word; *w != '\0'; w++, d_p++) {
+      if ((d_p == d_end) || (*d_p != *w)) { return error("unrecognized value"); }
+    }
+    return true;
+  }
+
+  bool parseValue(JsonValue &value, int depth)
+  {
+    if (depth > MAX_DEPTH) { return error("values nested too deeply"); }
+    skipSpace();
+    if (d_p == d_end) { return error("unexpected end of file"); }
+    switch (*d_p) {
+    case '{': return parseObject(value, depth);
+    case '[': return parseArray(value, depth);
+    case '"':
+      value.d_type = JsonValue::STRING;
+      return parseString(value.d_text);
+    case 't':
+      value.d_type = JsonValue::BOOLEAN;
+      value.d_number = 1;
+      return literal("true");
+    case 'f':
+      value.d_type = JsonValue::BOOLEAN;
+      value.d_number = 0;
+      return literal("false");
+    case 'n':
+      value.d_type = JsonValue::NUL;
+      return literal("null");
+    default:
+      return parseNumber(value);
+    }
+  }
+
+  bool parseNumber(JsonValue &value)
+  {
+    char buf[64];
+    size_t len = 0;
+    while ((d_p < d_end) && (len < sizeof(buf) - 1) &&
+        (((*d_p >= '0') && (*d_p <= '9')) || (*d_p == '-') || (*d_p == '+') ||
+         (*d_p == '.') || (*d_p == 'e') || (*d_p == 'E'))) {
+      buf[len++] = *d_p++;
+    }
+    buf[len] = '\0';
+    char *end;
+    value.d_number = strtod(buf, &end);
+    if ((len == 0) || (*end != '\0')) { return error("bad number"); }
+    value.d_type = JsonValue::NUMBER;
+    return true;
+  }
+
+  bool parseString(std::string &text)
+  {
+    d_p++;    // Opening quote
+    text.clear();
+    while (d_p < d_end) {
+      char c = *d_p++;
+      if (c == '"') { return true; }
+      if (c == '\n') { return error("unterminated string"); }
+      if (c != '\\') {
+        text.push_back(c);
+        continue;
+      }
+      if (d_p == d_end) { break; }
+      c = *d_p++;
+      switch (c) {
+      case '"': case '\\': case '/': text.push_back(c); break;
+      case 'b': text.push_back('\b'); break;
+      case 'f': text.push_back('\f'); break;
+      case 'n': text.push_back('\n'); break;
+      case 'r': text.push_back('\r'); break;
+      case 't': text.push_back('\t'); break;
+      case 'u': {
+        // Encode the code unit as UTF-8; surrogate pairs are not combined.
+        if (d_end - d_p < 4) { return error("bad \\u escape"); }
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++) {
+          char h = *d_p++;
+          code <<= 4;
+          if ((h >= '0') && (h <= '9')) { code |= h - '0'; }
+          else if ((h >= 'a') && (h <= 'f')) { code |= h - 'a' + 10; }
+          else if ((h >= 'A') && (h <= 'F')) { code |= h - 'A' + 10; }
+          else { return error("bad \\u escape"); }
+        }
+        if (code < 0x80) {
+          text.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+          text.push_back(static_cast<char>(0xC0 | (code >> 6)));
+          text.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+          text.push_back(static_cast<char>(0xE0 | (code >> 12)));
+          text.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+          text.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        break;
+      }
+      default:
+        return error("bad escape in string");
+      }
+    }
+    return error("unterminated string");
+  }
+
+  bool parseArray(JsonValue &value, int depth)
+  {
+    d_p++;    // [
+    value.d_type = JsonValue::ARRAY;
+    skipSpace();
+    if ((d_p < d_end) && (*d_p == ']')) {
+      d_p++;
+      return true;
+    }
+    while (true) {
+      value.d_elements.push_back(JsonValue());
+      if (!parseValue(value.d_elements.back(), depth + 1)) { return false; }
+      skipSpace();
+      if (d_p == d_end) { return error("unexpected end of file in array"); }
+      char c = *d_p++;
+      if (c == ']') { return true; }
+      if (c != ',') { return error("expected , or ] in array"); }
+    }
+  }
+
+  bool parseObject(JsonValue &value, int depth)
+  {
+    d_p++;    // {
+    value.d_type = JsonValue::OBJECT;
+    skipSpace();
+    if ((d_p < d_end) && (*d_p == '}')) {
+      d_p++;
+      return true;
+    }
+    while (true) {
+      skipSpace();
+      if ((d_p == d_end) || (*d_p != '"')) { return error("expected a member name in object"); }
+      value.d_names.push_back(std::string());
+      if (!parseString(value.d_names.back())) { return false; }
+      skipSpace();
+      if ((d_p == d_end) || (*d_p != ':')) { return error("expected : after member name"); }
+      d_p++;
+      value.d_elements.push_back(JsonValue());
+      if (!parseValue(value.d_elements.back(), depth + 1)) { return false; }
+      skipSpace();
+      if (d_p == d_end) { return error("unexpected end of file in object"); }
+      char c = *d_p++;
+      if (c == '}') { return true; }
+      if (c != ',') { return error("expected , or } in object"); }
+    }
+  }
+
+  const char *d_p;
+  const char *d_end;
+  const std::string &d_name;
+  size_t d_line = 1;
+};
+
+bool parse_json(const char *text, size_t length, JsonValue &value,
+  const std::string &name)
+{
+  value = JsonValue();
+  JsonParser parser(text, length, name);
+  return parser.parseDocument(value);
+}
+
+bool read_json_file(const std::string &fileName, JsonValue &value)
+{
+  std::ifstream in(fileName.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!in.good()) {
+    std::cerr << "Error: Could not open " << fileName << std::endl;
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  std::streamoff size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  if (size < 0) {
+    std::cerr << "Error: Could not determine the size of " << fileName << std::endl;
+    return false;
+  }
+  std::string buffer(static_cast<size_t>(size), '\0');
+  if ((size > 0) && !in.read(&buffer[0], size)) {
+    std::cerr << "Error: Could not read " << fileName << std::endl;
+    return false;
+  }
+  return parse_json(buffer.data(), buffer.size(), value, fileName);
+}
@@ -0,0 +1,82 @@
+/** @file
+    @brief Minimal Json reader for the configuration files that
+           AnglesToConfig writes.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// One parsed Json value.  Objects keep their members in file order and
+/// are searched linearly, which is fine for configuration files that
+/// have a handful of members per object and large arrays of numbers.
+///  Looking up a missing member or element gives a null value rather
+/// than failing, so paths can be followed without checking each step:
+///    root["display"]["hmd"]["field_of_view"]["monocular_horizontal"]
+class JsonValue {
+public:
+  enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+  JsonValue() {}
+
+  Type type() const { return d_type; }
+  bool isNull() const { return d_type == NUL; }
+  bool isNumber() const { return d_type == NUMBER; }
+  bool isString() const { return d_type == STRING; }
+  bool isArray() const { return d_type == ARRAY; }
+  bool isObject() const { return d_type == OBJECT; }
+
+  /// The value of a number or boolean (1 for true); 0 for other types.
+  double number() const { return d_number; }
+  /// The text of a string; empty for other types.
+  const std::string &text() const { return d_text; }
+
+  /// Number of elements of an array or members of an object.
+  size_t size() const { return d_elements.size(); }
+  /// Element of an array, or a null value if out of range.
+  const JsonValue &operator[](size_t i) const;
+  /// Member of an object, or a null value if there is none.
+  const JsonValue &operator[](const std::string &name) const;
+  const JsonValue &operator[](const char *name) const { return (*this)[std::string(name)]; }
+
+private:
+  friend class JsonParser;
+
+  Type d_type = NUL;
+  double d_number = 0;
+  std::string d_text;
+  std::vector<JsonValue> d_elements;  //!< Array elements or member values
+  std::vector<std::string> d_names;   //!< Member names, for objects
+};
+
+/// Parses a complete Json document.
+///   @param name Used in error messages, usually the file name.
+///   @return false (with a message, including the line, on std::cerr)
+/// if the text is not valid Json.
+extern bool parse_json(const char *text, size_t length, JsonValue &value,
+  const std::string &name = "input");
+
+/// Reads and parses the named file.
+///   @return false (with a message on std::cerr) on failure.
+extern bool read_json_file(const std::string &fileName, JsonValue &value);
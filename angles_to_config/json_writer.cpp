@@ -0,0 +1,105 @@
+/** @file
+    @brief Implementation of the buffered Json writer.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "json_writer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+void JsonWriter::setPrecision(int digits)
+{
+  if (digits < 1) { digits = 1; }
+  if (digits > 17) { digits = 17; }
+  d_precision = digits;
+}
+
+JsonWriter &JsonWriter::operator<<(int value)
+{
+  char buf[16];
+  int len = snprintf(buf, sizeof(buf), "%d", value);
+  d_buffer.append(buf, len);
+  return *this;
+}
+
+JsonWriter &JsonWriter::operator<<(double value)
+{
+  //  Up to 15 significant digits, a decimal that reads back as the same
+  // double has the same digits as %g at the full precision once the
+  // trailing zeros are removed, so %g is already the shortest form.
+  // Beyond that, look for the fewest digits that round-trip.
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%.*g", d_precision < 15 ? d_precision : 15, value);
+  for (int digits = 16; digits <= d_precision; digits++) {
+    if (strtod(buf, nullptr) == value) { break; }
+    len = snprintf(buf, sizeof(buf), "%.*g", digits, value);
+  }
+  d_buffer.append(buf, len);
+  return *this;
+}
+
+bool JsonWriter::write(std::ostream &out) const
+{
+  out.write(d_buffer.data(), d_buffer.size());
+  out.flush();
+  return !out.fail();
+}
+
+bool JsonWriter::writeFile(const std::string &fileName) const
+{
+  std::ofstream out(fileName.c_str());
+  if (!out.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  if (!write(out)) {
+    std::cerr << "Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void write_mesh_samples(JsonWriter &s, MeshDescription const &mesh,
+  int precision, bool first)
+{
+  // Each entry takes about 40 characters at the default precision.
+  s.reserve(s.str().size() + mesh.size() * (16 + 4 * (precision + 6)));
+  int oldPrecision = s.precision();
+  s.setPrecision(precision);
+  for (size_t i = 0; i < mesh.size(); i++) {
+    if (first && (i == 0)) { s << " "; }
+    else { s << ","; }
+    s << "[ [" << mesh[i][0][0] << "," << mesh[i][0][1] << "], ["
+      << mesh[i][1][0] << "," << mesh[i][1][1] << "] ]\n";
+  }
+  s.setPrecision(oldPrecision);
+}
+
+void write_mesh(JsonWriter &s, MeshDescription const &mesh, int precision)
+{
+  s << "[\n";
+  write_mesh_samples(s, mesh, precision, true);
+  s << "]\n";
+}
@@ -0,0 +1,84 @@
+/** @file
+    @brief Buffered writer for the hand-formatted Json output.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+
+#include <ostream>
+#include <string>
+
+/// Collects Json text into a single growable buffer so that it can be
+/// written out with one call, rather than flushing a stream on every
+/// line.  Text is appended as-is; the caller is responsible for the
+/// Json structure.  Numbers are written with at most precision()
+/// significant digits, using the shortest form that reads back as
+/// the same value.
+class JsonWriter {
+public:
+  JsonWriter() {}
+
+  /// Makes room for at least the specified number of bytes.
+  void reserve(size_t bytes) { d_buffer.reserve(bytes); }
+
+  /// Sets the maximum number of significant digits used for numbers
+  /// (1 through 17).  The default of 6 matches std::ostream.
+  void setPrecision(int digits);
+  int precision() const { return d_precision; }
+
+  JsonWriter &operator<<(const char *text) { d_buffer.append(text); return *this; }
+  JsonWriter &operator<<(const std::string &text) { d_buffer.append(text); return *this; }
+  JsonWriter &operator<<(char c) { d_buffer.push_back(c); return *this; }
+  JsonWriter &operator<<(int value);
+  JsonWriter &operator<<(double value);
+
+  const std::string &str() const { return d_buffer; }
+
+  /// Empties the buffer, keeping the precision, so that a large
+  /// document can be written out a piece at a time.
+  void clear() { d_buffer.clear(); }
+
+  /// Writes the whole buffer to the stream with a single write.
+  ///   @return false if the write failed.
+  bool write(std::ostream &out) const;
+
+  /// Writes the whole buffer to the named file, replacing it.
+  ///   @return false (with a message on std::cerr) on failure.
+  bool writeFile(const std::string &fileName) const;
+
+private:
+  std::string d_buffer;
+  int d_precision = 6;
+};
+
+/// Appends a mesh as a Json array of [ [in x, in y], [out x, out y] ]
+/// entries, one per line, with the specified number of significant
+/// digits.
+extern void write_mesh(JsonWriter &s, MeshDescription const &mesh, int precision);
+
+/// Appends just the entries of a mesh as write_mesh() writes them, for
+/// a mesh that is written a tile at a time between its own "[\n" and
+/// "]\n".  first is true for the tile that starts the mesh.
+extern void write_mesh_samples(JsonWriter &s, MeshDescription const &mesh,
+  int precision, bool first);
@@ -0,0 +1,177 @@
+/** @file
+    @brief Implementation of lookup-texture baking and export.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lut_export.h"
+#include "mesh_interpolator.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const char *lut_format_extension(LutFormat format)
+{
+  switch (format) {
+  case LUT_RG32F: return ".rg32f";
+  case LUT_RG16F: return ".rg16f";
+  case LUT_PFM:
+  default: return ".pfm";
+  }
+}
+
+bool bake_distortion_lut(const MeshDescription &mesh,
+  size_t width, size_t height, TaskPool &pool, std::vector<float> &texels)
+{
+  texels.clear();
+  if ((width == 0) || (height == 0)) {
+    std::cerr << "Error: bake_distortion_lut(): empty texture size" << std::endl;
+    return false;
+  }
+  MeshInterpolator interp;
+  if (!interp.build(mesh)) { return false; }
+
+  // Hand out bands of rows so that each task walks the triangulation
+  // from texel to neighboring texel.
+  texels.resize(3 * width * height);
+  const size_t rowsPerTask = 16;
+  size_t tasks = (height + rowsPerTask - 1) / rowsPerTask;
+  pool.parallel_for(tasks, [&](size_t task) {
+    MeshInterpolator::Hint hint;
+    size_t end = std::min(height, (task + 1) * rowsPerTask);
+    for (size_t r = task * rowsPerTask; r < end; r++) {
+      double y = (r + 0.5) / height;
+      float *row = &texels[3 * width * r];
+      for (size_t c = 0; c < width; c++) {
+        double x = (c + 0.5) / width;
+        std::array<double, 2> out;
+        bool inside = interp.interpolate(x, y, out, hint);
+        row[3 * c + 0] = static_cast<float>(out[0]);
+        row[3 * c + 1] = static_cast<float>(out[1]);
+        row[3 * c + 2] = inside ? 1.0f : 0.0f;
+      }
+    }
+  });
+  return true;
+}
+
+// Converts to IEEE half precision, rounding to nearest even.  Values
+// too large for a half become infinity.
+static uint16_t to_half(float value)
+{
+  uint32_t f;
+  memcpy(&f, &value, 4);
+  uint32_t sign = (f >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((f >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = f & 0x7fffff;
+
+  if (((f >> 23) & 0xff) == 0xff) {   // Inf or NaN
+    return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+  if (exponent >= 31) {               // Overflow
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  if (exponent <= 0) {                // Subnormal or zero
+    if (exponent < -10) { return static_cast<uint16_t>(sign); }
+    mantissa |= 0x800000;
+    uint32_t shift = static_cast<uint32_t>(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if ((rest > halfway) || ((rest == halfway) && (half & 1))) { half++; }
+    return static_cast<uint16_t>(sign | half);
+  }
+  uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1))) { half++; }
+  return static_cast<uint16_t>(sign | half);
+}
+
+static void put_le32(std::vector<char> &buf, size_t at, uint32_t v)
+{
+  for (int i = 0; i < 4; i++) { buf[at + i] = static_cast<char>(v >> (8 * i)); }
+}
+
+bool write_distortion_lut(const std::string &fileName, LutFormat format,
+  size_t width, size_t height, const std::vector<float> &texels)
+{
+  if (texels.size() != 3 * width * height) {
+    std::cerr << "Error: write_distortion_lut(): texel count does not match "
+      << width << " x " << height << std::endl;
+    return false;
+  }
+
+  //====================================================================
+  // Format the whole file in memory, little-endian regardless of the
+  // machine, then write it at once.
+  std::vector<char> buf;
+  size_t count = width * height;
+  switch (format) {
+  case LUT_PFM: {
+    // A negative scale in the header marks the data as little-endian.
+    std::ostringstream header;
+    header << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::string h = header.str();
+    buf.resize(h.size() + 12 * count);
+    memcpy(&buf[0], h.data(), h.size());
+    for (size_t i = 0; i < 3 * count; i++) {
+      uint32_t bits;
+      memcpy(&bits, &texels[i], 4);
+      put_le32(buf, h.size() + 4 * i, bits);
+    }
+    } break;
+  case LUT_RG32F:
+    buf.resize(8 * count);
+    for (size_t i = 0; i < count; i++) {
+      uint32_t bits;
+      memcpy(&bits, &texels[3 * i + 0], 4);
+      put_le32(buf, 8 * i, bits);
+      memcpy(&bits, &texels[3 * i + 1], 4);
+      put_le32(buf, 8 * i + 4, bits);
+    }
+    break;
+  case LUT_RG16F:
+    buf.resize(4 * count);
+    for (size_t i = 0; i < count; i++) {
+      uint16_t x = to_half(texels[3 * i + 0]);
+      uint16_t y = to_half(texels[3 * i + 1]);
+      put_le32(buf, 4 * i, uint32_t(x) | (uint32_t(y) << 16));
+    }
+    break;
+  }
+
+  std::ofstream out(fileName.c_str(), std::ios::binary);
+  if (!out.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  out.write(buf.empty() ? nullptr : &buf[0], buf.size());
+  out.close();
+  if (out.fail()) {
+    std::cerr << "Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
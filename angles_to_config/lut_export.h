@@ -0,0 +1,61 @@
+/** @file
+    @brief Baking distortion meshes into lookup textures.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+#include "threads.h"
+
+#include <string>
+#include <vector>
+
+/// File formats for lookup textures.
+enum LutFormat {
+  LUT_PFM,    //!< Portable float map: R, G = output x, y; B = 1 inside the samples, 0 outside
+  LUT_RG32F,  //!< Raw little-endian float32 pairs (output x, y)
+  LUT_RG16F   //!< Raw little-endian half-float pairs (output x, y)
+};
+
+/// Extension used for files of each format, including the dot.
+extern const char *lut_format_extension(LutFormat format);
+
+/// Evaluates the mesh's in->out mapping at the center of each texel of
+/// a width x height texture that covers the normalized input screen
+/// coordinates [0,1] x [0,1] (the convention that
+/// convert_to_normalized_and_meters() produces), with row 0 at the
+/// bottom (y near 0).  Three floats are stored per texel: output x,
+/// output y, and 1 if the texel was inside the sampled region or 0 if
+/// it was outside it and took the value at the nearest point on the
+/// region's edge (see MeshInterpolator).  Rows are spread across the
+/// pool's threads.
+///   @return false (with a message on std::cerr) on failure.
+extern bool bake_distortion_lut(const MeshDescription &mesh,
+  size_t width, size_t height, TaskPool &pool, std::vector<float> &texels);
+
+/// Writes texels from bake_distortion_lut() in the specified format.
+/// Rows are written from the bottom up, which is the order both PFM
+/// and glTexImage2D() expect.
+///   @return false (with a message on std::cerr) on failure.
+extern bool write_distortion_lut(const std::string &fileName, LutFormat format,
+  size_t width, size_t height, const std::vector<float> &texels);
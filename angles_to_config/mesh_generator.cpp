@@ -0,0 +1,198 @@
+/** @file
+    @brief Implementation of generate_meshes().
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mesh_generator.h"
+#include "helper.h"
+#include "threads.h"
+
+// Standard includes
+#include <sstream>
+#include <string>
+#include <vector>
+
+bool generate_meshes(const SampleSpan *colors, size_t numColors,
+  const MeshGeneratorSettings &settings, TaskPool &pool,
+  MeshBuffers *meshes, ScreenDescription &leftScreen,
+  ScreenDescription &rightScreen, std::ostream &log)
+{
+  if (numColors == 0) {
+    log << "generate_meshes(): Error: No colors" << std::endl;
+    return false;
+  }
+
+  //====================================================================
+  // The filters work on Mapping entries, so the caller's tables are
+  // copied into them, in the order that read_from_file() makes them.
+  std::vector< std::vector<Mapping> > mappings(numColors);
+  for (size_t c = 0; c < numColors; c++) {
+    if (colors[c].count == 0) {
+      log << "generate_meshes(): Error: No samples for color " << c << std::endl;
+      return false;
+    }
+    const double *s = colors[c].samples;
+    mappings[c].reserve(colors[c].count);
+    for (size_t i = 0; i < colors[c].count; i++, s += 4) {
+      mappings[c].push_back(Mapping(XYLatLong(s[2], s[3], s[1], s[0]), XYZ()));
+    }
+  }
+
+  //====================================================================
+  // Remove the inconsistent points, each color in parallel.  Like the
+  // other stages, each task keeps its messages until they can all be
+  // written to log in order.
+  std::vector<int> removed(numColors, 0);
+  std::vector<std::string> taskLogs(2 * numColors);
+  pool.parallel_for(numColors, [&](size_t c) {
+    std::ostringstream taskLog;
+    if (settings.verifyAngles) {
+      removed[c] = remove_invalid_points_based_on_angle(mappings[c],
+        settings.xx, settings.xy, settings.yx, settings.yy,
+        settings.maxAngleDiffDegrees);
+    }
+    if ((removed[c] >= 0) && (settings.outlierPasses > 0)) {
+      removed[c] = remove_outliers_by_local_fit(mappings[c], settings.outlierK,
+        settings.outlierPasses, pool, nullptr, taskLog);
+    }
+    taskLogs[c] = taskLog.str();
+  });
+  for (size_t c = 0; c < numColors; c++) {
+    log << taskLogs[c];
+    if (removed[c] < 0) {
+      log << "generate_meshes(): Error: Could not remove outliers from color "
+        << c << std::endl;
+      return false;
+    }
+    if (mappings[c].empty()) {
+      log << "generate_meshes(): Error: No samples left for color " << c
+        << std::endl;
+      return false;
+    }
+  }
+
+  //====================================================================
+  // Find the screen bounds for each eye.
+  double left = settings.left, bottom = settings.bottom;
+  double right = settings.right, top = settings.top;
+  if (settings.computeBounds) {
+    find_table_bounds(mappings, settings.toMeters, left, bottom, right, top);
+  }
+  double bounds[2][4];
+  mirror_screen_bounds(settings.useRightEye, left, bottom, right, top,
+    bounds[0], bounds[1]);
+
+  //====================================================================
+  // Convert each color for each eye into one set per eye, reflecting the
+  // tables for the eye they were not made for.  Task 2*c is the left
+  // eye for color c and task 2*c+1 the right.
+  std::vector<size_t> offsets(numColors + 1, 0);
+  for (size_t c = 0; c < numColors; c++) {
+    offsets[c + 1] = offsets[c] + mappings[c].size();
+  }
+  MappingSet sets[2] = { MappingSet(offsets.back()), MappingSet(offsets.back()) };
+  std::vector<char> ok(2 * numColors);
+  pool.parallel_for(2 * numColors, [&](size_t task) {
+    size_t c = task / 2;
+    int eye = static_cast<int>(task % 2);
+    bool reflect = ((eye == 0) == settings.useRightEye);
+    const double *b = bounds[eye];
+    std::ostringstream taskLog;
+    ok[task] = convert_to_normalized_and_meters(mappings[c], reflect,
+      sets[eye], offsets[c], settings.toMeters, settings.depth,
+      b[0], b[1], b[2], b[3], settings.useFieldAngles, taskLog);
+    taskLogs[task] = taskLog.str();
+  });
+  for (size_t task = 0; task < taskLogs.size(); task++) {
+    log << taskLogs[task];
+    if (!ok[task]) {
+      log << "generate_meshes(): Error: Could not convert color " << task / 2
+        << std::endl;
+      return false;
+    }
+  }
+
+  //====================================================================
+  // Find both screens at once.
+  ScreenDescription *screens[2] = { &leftScreen, &rightScreen };
+  ScreenProjection projections[2];
+  std::ostringstream screenLogs[2];
+  pool.parallel_for(2, [&](size_t eye) {
+    const double *b = bounds[eye];
+    ok[eye] = findScreen(sets[eye], b[0], b[1], b[2], b[3], *screens[eye],
+      pool, projections[eye], false, screenLogs[eye]);
+  });
+  for (int eye = 0; eye < 2; eye++) {
+    log << screenLogs[eye].str();
+    if (!ok[eye]) {
+      log << "generate_meshes(): Error: Could not find the "
+        << (eye == 0 ? "left" : "right") << " screen" << std::endl;
+      return false;
+    }
+  }
+
+  //====================================================================
+  // Find each color's mesh for each eye and copy it out.  The buffers
+  // are checked first so that nothing is written if one is too small.
+  for (size_t c = 0; c < numColors; c++) {
+    meshes[c].count = mappings[c].size();
+  }
+  for (size_t c = 0; c < numColors; c++) {
+    if ((meshes[c].count > meshes[c].capacity) || !meshes[c].left ||
+        !meshes[c].right) {
+      log << "generate_meshes(): Error: Color " << c << " needs room for "
+        << meshes[c].count << " vertices per eye, has " << meshes[c].capacity
+        << std::endl;
+      return false;
+    }
+  }
+  pool.parallel_for(2 * numColors, [&](size_t task) {
+    size_t c = task / 2;
+    int eye = static_cast<int>(task % 2);
+    const double *b = bounds[eye];
+    MeshDescription mesh;
+    std::ostringstream taskLog;
+    ok[task] = findMesh(MappingSpan(sets[eye], offsets[c], mappings[c].size()),
+      projections[eye], offsets[c], b[0], b[1], b[2], b[3], *screens[eye], mesh,
+      false, taskLog);
+    taskLogs[task] = taskLog.str();
+    if (!ok[task]) { return; }
+    double *out = (eye == 0) ? meshes[c].left : meshes[c].right;
+    for (size_t i = 0; i < mesh.size(); i++, out += 4) {
+      out[0] = mesh[i][0][0];
+      out[1] = mesh[i][0][1];
+      out[2] = mesh[i][1][0];
+      out[3] = mesh[i][1][1];
+    }
+  });
+  for (size_t task = 0; task < 2 * numColors; task++) {
+    log << taskLogs[task];
+    if (!ok[task]) {
+      log << "generate_meshes(): Error: Could not find the "
+        << (task % 2 == 0 ? "left" : "right") << " mesh for color " << task / 2
+        << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,88 @@
+/** @file
+    @brief In-process form of the AnglesToConfig pipeline, for programs
+           that would otherwise run it and read back its Json.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+
+#include <iostream>
+#include <stddef.h>
+
+class TaskPool;
+
+/// One color's table, owned by the caller: count entries of four
+/// doubles each, in the order of the text tables that AnglesToConfig
+/// reads, which is longitude and latitude in degrees followed by screen
+/// x and y in the units that toMeters converts from.
+struct SampleSpan {
+  const double *samples = nullptr;
+  size_t count = 0;
+};
+
+/// How the tables are turned into meshes.  Each setting matches the
+/// AnglesToConfig option named next to it, and the defaults are the
+/// ones it uses.
+struct MeshGeneratorSettings {
+  bool useRightEye = true;             //!< -eye
+  bool useFieldAngles = true;          //!< -latlong makes this false
+  double toMeters = 1.0;               //!< -mm makes this 1e-3
+  double depth = 2.0;                  //!< -depth_meters
+  bool computeBounds = true;           //!< -screen makes this false...
+  double left = 0, bottom = 0, right = 0, top = 0;  //!< ...and sets these
+  bool verifyAngles = false;           //!< -verify_angles
+  double xx = 0, xy = 0, yx = 0, yy = 0;
+  double maxAngleDiffDegrees = 0;
+  double outlierK = 0;                 //!< -fit_outliers, when
+  unsigned outlierPasses = 0;          //!< outlierPasses > 0
+};
+
+/// Where one color's meshes go, owned by the caller.  left and right
+/// each have room for capacity vertices of four doubles: the input x
+/// and y followed by the output x and y, in normalized screen units, as
+/// AnglesToConfig writes them.  count is set to the number of vertices
+/// in each, which is the number of samples that were kept, even when
+/// that is more than the capacity and nothing is written.
+struct MeshBuffers {
+  double *left = nullptr;
+  double *right = nullptr;
+  size_t capacity = 0;
+  size_t count = 0;
+};
+
+/// Runs what AnglesToConfig does between reading its tables and writing
+/// its Json: the angle and outlier checks, finding the screen bounds,
+/// mirroring the tables for the other eye, converting them, and finding
+/// each eye's screen and each color's meshes.  The colors and eyes are
+/// handled in parallel with the pool.  All of the messages, including
+/// those of each stage, go to log; nothing is written to std::cerr.
+///   @param colors One table per color, so one for mono and three for
+/// RGB.  They are not changed.
+///   @param meshes One set of buffers per color.
+///   @return false (with a message) on error, including when a buffer
+/// is too small.
+extern bool generate_meshes(const SampleSpan *colors, size_t numColors,
+  const MeshGeneratorSettings &settings, TaskPool &pool,
+  MeshBuffers *meshes, ScreenDescription &leftScreen,
+  ScreenDescription &rightScreen, std::ostream &log = std::cerr);
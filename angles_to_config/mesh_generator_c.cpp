@@ -0,0 +1,250 @@
+/** @file
+    @brief Implementation of the C interface to generate_meshes().
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mesh_generator_c.h"
+#include "mesh_generator.h"
+#include "helper.h"
+#include "threads.h"
+
+// Standard includes
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct A2C_Pool {
+  explicit A2C_Pool(unsigned threads) : pool(threads) {}
+  TaskPool pool;
+};
+
+static thread_local std::string lastError;
+static thread_local std::string lastWarnings;
+
+// Exceptions must not leave the library, because a C caller cannot
+// catch them.  Each entry point that can throw catches them and sets
+// the last error to what went wrong.
+static void setException(const char *function, const std::exception *e)
+{
+  lastError = std::string(function) + ": Error: " +
+    (e ? e->what() : "Unknown exception");
+}
+
+// Splits the messages logged by a call into its warnings, whose lines
+// start with "Warning:", and the rest, which say why it failed.
+static void splitLog(const std::string &log, std::string &errors,
+  std::string &warnings)
+{
+  errors.clear();
+  warnings.clear();
+  std::istringstream in(log);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::string &to = (line.compare(0, 8, "Warning:") == 0) ? warnings : errors;
+    to += line;
+    to += '\n';
+  }
+}
+
+int a2c_api_version(void)
+{
+  return A2C_API_VERSION;
+}
+
+A2C_Pool *a2c_create_pool(unsigned threads)
+{
+  try {
+    return new A2C_Pool(threads);
+  } catch (const std::exception &e) {
+    setException("a2c_create_pool()", &e);
+  } catch (...) {
+    setException("a2c_create_pool()", nullptr);
+  }
+  return nullptr;
+}
+
+void a2c_destroy_pool(A2C_Pool *pool)
+{
+  try {
+    delete pool;
+  } catch (const std::exception &e) {
+    setException("a2c_destroy_pool()", &e);
+  } catch (...) {
+    setException("a2c_destroy_pool()", nullptr);
+  }
+}
+
+void a2c_default_settings(A2C_Settings *settings)
+{
+  MeshGeneratorSettings d;
+  settings->use_right_eye = d.useRightEye;
+  settings->use_field_angles = d.useFieldAngles;
+  settings->to_meters = d.toMeters;
+  settings->depth = d.depth;
+  settings->compute_bounds = d.computeBounds;
+  settings->left = d.left;
+  settings->bottom = d.bottom;
+  settings->right = d.right;
+  settings->top = d.top;
+  settings->verify_angles = d.verifyAngles;
+  settings->xx = d.xx;
+  settings->xy = d.xy;
+  settings->yx = d.yx;
+  settings->yy = d.yy;
+  settings->max_angle_diff_degrees = d.maxAngleDiffDegrees;
+  settings->outlier_k = d.outlierK;
+  settings->outlier_passes = d.outlierPasses;
+}
+
+static void copyScreen(const ScreenDescription &from, A2C_Screen *to)
+{
+  if (!to) { return; }
+  to->h_fov_degrees = from.hFOVDegrees;
+  to->v_fov_degrees = from.vFOVDegrees;
+  to->overlap_percent = from.overlapPercent;
+  to->x_cop = from.xCOP;
+  to->y_cop = from.yCOP;
+}
+
+static int generate(A2C_Pool *pool, const A2C_Settings *settings,
+  A2C_Color *colors, size_t num_colors,
+  A2C_Screen *left_screen, A2C_Screen *right_screen)
+{
+  lastWarnings.clear();
+  if (!settings || (!colors && (num_colors > 0))) {
+    lastError = "a2c_generate(): Error: No settings or colors";
+    return -1;
+  }
+  MeshGeneratorSettings s;
+  s.useRightEye = settings->use_right_eye != 0;
+  s.useFieldAngles = settings->use_field_angles != 0;
+  s.toMeters = settings->to_meters;
+  s.depth = settings->depth;
+  s.computeBounds = settings->compute_bounds != 0;
+  s.left = settings->left;
+  s.bottom = settings->bottom;
+  s.right = settings->right;
+  s.top = settings->top;
+  s.verifyAngles = settings->verify_angles != 0;
+  s.xx = settings->xx;
+  s.xy = settings->xy;
+  s.yx = settings->yx;
+  s.yy = settings->yy;
+  s.maxAngleDiffDegrees = settings->max_angle_diff_degrees;
+  s.outlierK = settings->outlier_k;
+  s.outlierPasses = settings->outlier_passes;
+
+  std::vector<SampleSpan> spans(num_colors);
+  std::vector<MeshBuffers> buffers(num_colors);
+  for (size_t c = 0; c < num_colors; c++) {
+    spans[c].samples = colors[c].samples;
+    spans[c].count = colors[c].sample_count;
+    buffers[c].left = colors[c].left_mesh;
+    buffers[c].right = colors[c].right_mesh;
+    buffers[c].capacity = colors[c].mesh_capacity;
+  }
+
+  TaskPool serial(1);
+  TaskPool &p = pool ? pool->pool : serial;
+  ScreenDescription leftScreen, rightScreen;
+  std::ostringstream log;
+  bool ok = generate_meshes(spans.data(), num_colors, s, p, buffers.data(),
+    leftScreen, rightScreen, log);
+  for (size_t c = 0; c < num_colors; c++) {
+    colors[c].mesh_count = buffers[c].count;
+  }
+  std::string errors;
+  splitLog(log.str(), errors, lastWarnings);
+  if (!ok) {
+    lastError = errors;
+    return -1;
+  }
+  copyScreen(leftScreen, left_screen);
+  copyScreen(rightScreen, right_screen);
+  return 0;
+}
+
+int a2c_generate(A2C_Pool *pool, const A2C_Settings *settings,
+  A2C_Color *colors, size_t num_colors,
+  A2C_Screen *left_screen, A2C_Screen *right_screen)
+{
+  try {
+    return generate(pool, settings, colors, num_colors, left_screen, right_screen);
+  } catch (const std::exception &e) {
+    setException("a2c_generate()", &e);
+  } catch (...) {
+    setException("a2c_generate()", nullptr);
+  }
+  return -1;
+}
+
+static int parseSamples(const char *text, size_t length,
+  double *samples, size_t capacity, size_t *count)
+{
+  std::vector<Mapping> mapping;
+  std::ostringstream log;
+  if (!read_from_buffer(text, length, mapping, "a2c_parse_samples()", log)) {
+    lastError = log.str();
+    return -1;
+  }
+  if (count) { *count = mapping.size(); }
+  if (mapping.size() > capacity) {
+    std::ostringstream msg;
+    msg << "a2c_parse_samples(): Error: The table has " << mapping.size()
+      << " entries, room for " << capacity;
+    lastError = msg.str();
+    return -1;
+  }
+  for (size_t i = 0; i < mapping.size(); i++, samples += 4) {
+    const XYLatLong &p = mapping[i].xyLatLong;
+    samples[0] = p.longitude;
+    samples[1] = p.latitude;
+    samples[2] = p.x;
+    samples[3] = p.y;
+  }
+  return 0;
+}
+
+int a2c_parse_samples(const char *text, size_t length,
+  double *samples, size_t capacity, size_t *count)
+{
+  try {
+    return parseSamples(text, length, samples, capacity, count);
+  } catch (const std::exception &e) {
+    setException("a2c_parse_samples()", &e);
+  } catch (...) {
+    setException("a2c_parse_samples()", nullptr);
+  }
+  return -1;
+}
+
+const char *a2c_last_error(void)
+{
+  return lastError.c_str();
+}
+
+const char *a2c_last_warnings(void)
+{
+  return lastWarnings.c_str();
+}
@@ -0,0 +1,126 @@
+/** @file
+    @brief C interface to generate_meshes(), for programs that are not
+           written in C++ or that load the library at run time.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(MESH_GENERATOR_EXPORTS)
+#    define MESH_GENERATOR_API __declspec(dllexport)
+#  else
+#    define MESH_GENERATOR_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define MESH_GENERATOR_API __attribute__((visibility("default")))
+#else
+#  define MESH_GENERATOR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Version of this interface.  It changes whenever a structure or
+/// function below does, so a program should check that
+/// a2c_api_version() returns the A2C_API_VERSION it was built with.
+#define A2C_API_VERSION 2
+MESH_GENERATOR_API int a2c_api_version(void);
+
+/// Threads to run the work on, which can be kept and used for many
+/// calls.  Zero threads selects the number of hardware threads.
+/// a2c_create_pool() returns NULL, with a2c_last_error() saying why, if
+/// the threads cannot be started.
+typedef struct A2C_Pool A2C_Pool;
+MESH_GENERATOR_API A2C_Pool *a2c_create_pool(unsigned threads);
+MESH_GENERATOR_API void a2c_destroy_pool(A2C_Pool *pool);
+
+/// The settings of MeshGeneratorSettings, with flags as ints.  Fill them
+/// in with a2c_default_settings() before changing any.
+typedef struct A2C_Settings {
+  int use_right_eye;
+  int use_field_angles;
+  double to_meters;
+  double depth;
+  int compute_bounds;
+  double left, bottom, right, top;
+  int verify_angles;
+  double xx, xy, yx, yy;
+  double max_angle_diff_degrees;
+  double outlier_k;
+  unsigned outlier_passes;
+} A2C_Settings;
+MESH_GENERATOR_API void a2c_default_settings(A2C_Settings *settings);
+
+/// One color's table and the buffers for its meshes, all owned by the
+/// caller, as in SampleSpan and MeshBuffers: sample_count entries of
+/// longitude, latitude, x and y, and room for mesh_capacity vertices of
+/// input x, y and output x, y in each mesh.  mesh_count is set to the
+/// number of vertices in each mesh.
+typedef struct A2C_Color {
+  const double *samples;
+  size_t sample_count;
+  double *left_mesh;
+  double *right_mesh;
+  size_t mesh_capacity;
+  size_t mesh_count;
+} A2C_Color;
+
+/// What AnglesToConfig writes about each eye's screen.
+typedef struct A2C_Screen {
+  double h_fov_degrees;
+  double v_fov_degrees;
+  double overlap_percent;
+  double x_cop;
+  double y_cop;
+} A2C_Screen;
+
+/// Runs generate_meshes() on the pool, which may be NULL to run on the
+/// calling thread.  Its warnings, such as table entries outside the
+/// screen, are kept for a2c_last_warnings() whether or not it succeeds.
+///   @return 0 on success, or -1 with a2c_last_error() saying why.
+MESH_GENERATOR_API int a2c_generate(A2C_Pool *pool,
+  const A2C_Settings *settings, A2C_Color *colors, size_t num_colors,
+  A2C_Screen *left_screen, A2C_Screen *right_screen);
+
+/// Parses a table in the text form AnglesToConfig reads into samples,
+/// which has room for capacity entries.  *count is set to the number of
+/// entries in the table even when they do not fit, in which case none
+/// are written.
+///   @return 0 on success, or -1 with a2c_last_error() saying why.
+MESH_GENERATOR_API int a2c_parse_samples(const char *text, size_t length,
+  double *samples, size_t capacity, size_t *count);
+
+/// Message about the last call on this thread that failed.  It has only
+/// the reasons for the failure, one per line, and not any warnings.
+MESH_GENERATOR_API const char *a2c_last_error(void);
+
+/// Warnings from the last call to a2c_generate() on this thread, one
+/// per line, or an empty string if there were none.
+MESH_GENERATOR_API const char *a2c_last_warnings(void);
+
+#ifdef __cplusplus
+}
+#endif
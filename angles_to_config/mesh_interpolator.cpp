@@ -0,0 +1,664 @@
+/** @file
+    @brief Implementation of the scattered-sample mesh interpolator.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mesh_interpolator.h"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <cmath>
+#include <iostream>
+#include <stdint.h>
+
+double MeshInterpolator::orient(int a, int b, double x, double y) const
+{
+  const std::array<double, 2> &pa = d_in[a];
+  const std::array<double, 2> &pb = d_in[b];
+  return (pb[0] - pa[0]) * (y - pa[1]) - (pb[1] - pa[1]) * (x - pa[0]);
+}
+
+// Returns a positive value if p is inside the circle through the
+// counterclockwise triangle a, b, c, negative if outside.
+static double in_circle(const std::array<double, 2> &a, const std::array<double, 2> &b,
+  const std::array<double, 2> &c, const std::array<double, 2> &p)
+{
+  double adx = a[0] - p[0], ady = a[1] - p[1];
+  double bdx = b[0] - p[0], bdy = b[1] - p[1];
+  double cdx = c[0] - p[0], cdy = c[1] - p[1];
+  double ad = adx * adx + ady * ady;
+  double bd = bdx * bdx + bdy * bdy;
+  double cd = cdx * cdx + cdy * cdy;
+  return adx * (bdy * cd - bd * cdy)
+       - ady * (bdx * cd - bd * cdx)
+       + ad * (bdx * cdy - bdy * cdx);
+}
+
+// Squared distance from (x, y) to the segment from a to b, with t set
+// to how far along the segment the nearest point is, from 0 to 1.
+static double segment_distance2(const std::array<double, 2> &a,
+  const std::array<double, 2> &b, double x, double y, double &t)
+{
+  double dx = b[0] - a[0], dy = b[1] - a[1];
+  double len2 = dx * dx + dy * dy;
+  t = (len2 > 0) ? ((x - a[0]) * dx + (y - a[1]) * dy) / len2 : 0;
+  t = std::max(0.0, std::min(1.0, t));
+  double ex = a[0] + t * dx - x, ey = a[1] + t * dy - y;
+  return ex * ex + ey * ey;
+}
+
+int MeshInterpolator::locate(double x, double y, int start) const
+{
+  // Walk towards the point, stepping across any edge that has the point
+  // on its outside.  Starting from a different edge each step keeps the
+  // walk from cycling.
+  int t = start;
+  size_t maxSteps = 4 * d_tris.size() + 16;
+  for (size_t step = 0; step < maxSteps; step++) {
+    const Triangle &tri = d_tris[t];
+    int next = -1;
+    for (int k = 0; k < 3; k++) {
+      int i = static_cast<int>((k + step) % 3);
+      if (orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y) < 0) {
+        next = tri.n[i];
+        if (next < 0) { return t; } // Outside the whole triangulation
+        break;
+      }
+    }
+    if (next < 0) { return t; }
+    t = next;
+  }
+
+  // Should not happen, but fall back to checking every triangle.
+  for (size_t i = 0; i < d_tris.size(); i++) {
+    const Triangle &tri = d_tris[i];
+    if (tri.alive &&
+        (orient(tri.v[1], tri.v[2], x, y) >= 0) &&
+        (orient(tri.v[2], tri.v[0], x, y) >= 0) &&
+        (orient(tri.v[0], tri.v[1], x, y) >= 0)) {
+      return static_cast<int>(i);
+    }
+  }
+  return t;
+}
+
+void MeshInterpolator::insert(int p, int &last)
+{
+  const std::array<double, 2> &pt = d_in[p];
+  int t = locate(pt[0], pt[1], last);
+
+  //====================================================================
+  // Find the cavity: the connected set of triangles whose circumcircles
+  // contain the new point.
+  std::vector<int> &mark = d_mark;
+  if (mark.size() < d_tris.size()) { mark.resize(2 * d_tris.size() + 16, 0); }
+  int stamp = ++d_stamp;
+
+  std::vector<int> cavity;
+  cavity.push_back(t);
+  mark[t] = stamp;
+  for (size_t c = 0; c < cavity.size(); c++) {
+    const Triangle &tri = d_tris[cavity[c]];
+    for (int i = 0; i < 3; i++) {
+      int nb = tri.n[i];
+      if ((nb >= 0) && (mark[nb] != stamp)) {
+        const Triangle &n = d_tris[nb];
+        if (in_circle(d_in[n.v[0]], d_in[n.v[1]], d_in[n.v[2]], pt) > 0) {
+          mark[nb] = stamp;
+          cavity.push_back(nb);
+        }
+      }
+    }
+  }
+
+  //====================================================================
+  // Round-off can make the cavity not star-shaped around the point
+  // (for example, when four input points lie on a circle).  Drop any
+  // triangle with a boundary edge the point cannot see, and keep only
+  // what is still connected to the triangle that holds the point.
+  struct Edge { int a, b, outer; };
+  std::vector<Edge> boundary;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    boundary.clear();
+    for (size_t c = 0; c < cavity.size() && !changed; c++) {
+      const Triangle &tri = d_tris[cavity[c]];
+      for (int i = 0; i < 3; i++) {
+        int nb = tri.n[i];
+        if ((nb >= 0) && (mark[nb] == stamp)) { continue; }
+        Edge e = { tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], nb };
+        if ((cavity[c] != t) && (orient(e.a, e.b, pt[0], pt[1]) <= 0)) {
+          mark[cavity[c]] = 0;
+          changed = true;
+          break;
+        }
+        boundary.push_back(e);
+      }
+    }
+    if (changed) {
+      // Rebuild the cavity from the triangles still marked.
+      std::vector<int> kept;
+      int old = stamp;
+      int keep = stamp = ++d_stamp;
+      kept.push_back(t);
+      mark[t] = keep;
+      for (size_t c = 0; c < kept.size(); c++) {
+        const Triangle &tri = d_tris[kept[c]];
+        for (int i = 0; i < 3; i++) {
+          int nb = tri.n[i];
+          if ((nb >= 0) && (mark[nb] == old)) {
+            mark[nb] = keep;
+            kept.push_back(nb);
+          }
+        }
+      }
+      cavity.swap(kept);
+    }
+  }
+
+  //====================================================================
+  // Replace the cavity with a fan of triangles from the new point to
+  // each boundary edge, reusing the cavity's slots first.
+  for (size_t c = 0; c < cavity.size(); c++) {
+    d_tris[cavity[c]].alive = false;
+  }
+  std::vector<int> created(boundary.size());
+  for (size_t e = 0; e < boundary.size(); e++) {
+    int slot;
+    if (e < cavity.size()) {
+      slot = cavity[e];
+    } else {
+      slot = static_cast<int>(d_tris.size());
+      d_tris.push_back(Triangle());
+    }
+    created[e] = slot;
+  }
+  for (size_t e = 0; e < boundary.size(); e++) {
+    Triangle &tri = d_tris[created[e]];
+    tri.v[0] = p;
+    tri.v[1] = boundary[e].a;
+    tri.v[2] = boundary[e].b;
+    tri.n[0] = boundary[e].outer;
+    tri.n[1] = tri.n[2] = -1;
+    tri.alive = true;
+    if (boundary[e].outer >= 0) {
+      // The outer triangle has the same edge running the other way.
+      Triangle &o = d_tris[boundary[e].outer];
+      for (int j = 0; j < 3; j++) {
+        if ((o.v[(j + 1) % 3] == boundary[e].b) && (o.v[(j + 2) % 3] == boundary[e].a)) {
+          o.n[j] = created[e];
+        }
+      }
+    }
+  }
+  for (size_t e = 0; e < boundary.size(); e++) {
+    // The edge from b back to the new point is shared with the triangle
+    // whose edge starts at b, and the one from the point to a with the
+    // triangle whose edge ends at a.
+    Triangle &tri = d_tris[created[e]];
+    for (size_t f = 0; f < boundary.size(); f++) {
+      if (boundary[f].a == boundary[e].b) { tri.n[1] = created[f]; }
+      if (boundary[f].b == boundary[e].a) { tri.n[2] = created[f]; }
+    }
+  }
+  // Any unused cavity slots stay dead.
+  last = created.empty() ? t : created[0];
+}
+
+bool MeshInterpolator::build(const MeshDescription &mesh)
+{
+  d_in.clear();
+  d_out.clear();
+  d_tris.clear();
+  d_hull.clear();
+  d_numPoints = 0;
+  d_numReal = 0;
+  d_mark.clear();
+  d_stamp = 0;
+  d_hullEdges.clear();
+  d_hullNext.clear();
+  d_hullPrev.clear();
+  d_hullSimple = true;
+
+  //====================================================================
+  // Drop repeated input points.
+  std::vector<size_t> order(mesh.size());
+  for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+  std::sort(order.begin(), order.end(), [&mesh](size_t a, size_t b) {
+    if (mesh[a][0][0] != mesh[b][0][0]) { return mesh[a][0][0] < mesh[b][0][0]; }
+    if (mesh[a][0][1] != mesh[b][0][1]) { return mesh[a][0][1] < mesh[b][0][1]; }
+    return a < b;
+  });
+  std::vector<size_t> unique;
+  for (size_t i = 0; i < order.size(); i++) {
+    if ((i > 0) && (mesh[order[i]][0] == mesh[order[i - 1]][0])) { continue; }
+    unique.push_back(order[i]);
+  }
+  if (unique.size() < 3) {
+    std::cerr << "Error: MeshInterpolator: need at least three distinct points, found "
+      << unique.size() << std::endl;
+    return false;
+  }
+
+  double minX = mesh[unique[0]][0][0], maxX = minX;
+  double minY = mesh[unique[0]][0][1], maxY = minY;
+  for (size_t i = 1; i < unique.size(); i++) {
+    minX = std::min(minX, mesh[unique[i]][0][0]);
+    maxX = std::max(maxX, mesh[unique[i]][0][0]);
+    minY = std::min(minY, mesh[unique[i]][0][1]);
+    maxY = std::max(maxY, mesh[unique[i]][0][1]);
+  }
+  double size = std::max(maxX - minX, maxY - minY);
+  if (size <= 0) {
+    std::cerr << "Error: MeshInterpolator: points do not span an area" << std::endl;
+    return false;
+  }
+
+  //  Inserting the points row by row from a regular grid makes every
+  // new row fall inside the huge circumcircles of the triangles joining
+  // the previous row to the super-triangle, so the points are shuffled
+  // (with a fixed seed, so results are repeatable) and then inserted in
+  // rounds of doubling size, each sorted along a snake path through a
+  // grid of cells.
+  uint32_t seed = 12345;
+  for (size_t i = unique.size() - 1; i > 0; i--) {
+    seed = seed * 1664525u + 1013904223u;
+    std::swap(unique[i], unique[seed % (i + 1)]);
+  }
+  size_t side = static_cast<size_t>(std::sqrt(static_cast<double>(unique.size()))) + 1;
+  double cell = size / side;
+  auto snake = [&](size_t a, size_t b) {
+    size_t ay = static_cast<size_t>((mesh[a][0][1] - minY) / cell);
+    size_t by = static_cast<size_t>((mesh[b][0][1] - minY) / cell);
+    if (ay != by) { return ay < by; }
+    // Go back and forth across alternate rows.
+    double ax = mesh[a][0][0], bx = mesh[b][0][0];
+    if (ax != bx) { return (ay % 2 == 0) ? (ax < bx) : (ax > bx); }
+    return a < b;
+  };
+  for (size_t begin = 0, end = 1; begin < unique.size(); begin = end, end *= 2) {
+    std::sort(unique.begin() + begin,
+      unique.begin() + std::min(end, unique.size()), snake);
+  }
+
+  d_numPoints = static_cast<int>(unique.size());
+  for (size_t i = 0; i < unique.size(); i++) {
+    d_in.push_back(mesh[unique[i]][0]);
+    d_out.push_back(mesh[unique[i]][1]);
+  }
+
+  //====================================================================
+  // Start with a triangle that is much larger than the points, then
+  // add the points one at a time (Bowyer-Watson).
+  double cx = (minX + maxX) / 2, cy = (minY + maxY) / 2;
+  std::array<double, 2> s0 = { { cx - 20 * size, cy - 10 * size } };
+  std::array<double, 2> s1 = { { cx + 20 * size, cy - 10 * size } };
+  std::array<double, 2> s2 = { { cx, cy + 20 * size } };
+  d_in.push_back(s0);
+  d_in.push_back(s1);
+  d_in.push_back(s2);
+  Triangle super;
+  super.v[0] = d_numPoints;
+  super.v[1] = d_numPoints + 1;
+  super.v[2] = d_numPoints + 2;
+  super.n[0] = super.n[1] = super.n[2] = -1;
+  super.alive = true;
+  d_tris.reserve(2 * unique.size() + 16);
+  d_tris.push_back(super);
+
+  int last = 0;
+  for (int p = 0; p < d_numPoints; p++) {
+    insert(p, last);
+  }
+
+  //====================================================================
+  // Compact away dead triangles, renumbering the neighbor links.  The
+  // triangles touching the super-triangle stay so that walks from
+  // outside the hull still work.
+  std::vector<int> renumber(d_tris.size(), -1);
+  std::vector<Triangle> alive;
+  for (size_t i = 0; i < d_tris.size(); i++) {
+    if (d_tris[i].alive) {
+      renumber[i] = static_cast<int>(alive.size());
+      alive.push_back(d_tris[i]);
+    }
+  }
+  for (size_t i = 0; i < alive.size(); i++) {
+    for (int j = 0; j < 3; j++) {
+      if (alive[i].n[j] >= 0) { alive[i].n[j] = renumber[alive[i].n[j]]; }
+    }
+  }
+  d_tris.swap(alive);
+
+  // The edges between real triangles and the rest are the hull.  Each
+  // runs counterclockwise around it, so they are linked from each hull
+  // point to the next one (and back) for extrapolation to walk along.
+  d_hullNext.assign(d_numPoints, -1);
+  d_hullPrev.assign(d_numPoints, -1);
+  for (size_t i = 0; i < d_tris.size(); i++) {
+    const Triangle &tri = d_tris[i];
+    if (isSuper(tri.v[0]) || isSuper(tri.v[1]) || isSuper(tri.v[2])) { continue; }
+    d_numReal++;
+    bool onHull = false;
+    for (int j = 0; j < 3; j++) {
+      int nb = tri.n[j];
+      if ((nb < 0) || isSuper(d_tris[nb].v[0]) || isSuper(d_tris[nb].v[1]) ||
+          isSuper(d_tris[nb].v[2])) {
+        std::array<int, 2> edge = { { tri.v[(j + 1) % 3], tri.v[(j + 2) % 3] } };
+        if ((d_hullNext[edge[0]] >= 0) || (d_hullPrev[edge[1]] >= 0)) {
+          d_hullSimple = false;   // A point is on the hull twice
+        }
+        d_hullNext[edge[0]] = edge[1];
+        d_hullPrev[edge[1]] = edge[0];
+        d_hullEdges.push_back(edge);
+        onHull = true;
+      }
+    }
+    if (onHull) { d_hull.push_back(static_cast<int>(i)); }
+  }
+  if (d_numReal == 0) {
+    std::cerr << "Error: MeshInterpolator: points are collinear" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool MeshInterpolator::interpolate(double x, double y,
+  std::array<double, 2> &out, Hint &hint) const
+{
+  if (d_tris.empty()) {
+    out[0] = out[1] = 0;
+    return false;
+  }
+  int start = ((hint.triangle >= 0) && (hint.triangle < static_cast<int>(d_tris.size()))) ?
+    hint.triangle : d_hull[0];
+  int t = locate(x, y, start);
+  hint.triangle = t;
+
+  //====================================================================
+  // Inside a real triangle, this is an interpolation.
+  const Triangle &tri = d_tris[t];
+  if (!isSuper(tri.v[0]) && !isSuper(tri.v[1]) && !isSuper(tri.v[2])) {
+    const std::array<double, 2> &a = d_in[tri.v[0]];
+    double area = orient(tri.v[1], tri.v[2], a[0], a[1]);
+    out[0] = out[1] = 0;
+    for (int i = 0; i < 3; i++) {
+      double w = orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y) / area;
+      out[0] += w * d_out[tri.v[i]][0];
+      out[1] += w * d_out[tri.v[i]][1];
+    }
+    return true;
+  }
+
+  //====================================================================
+  // Outside, the point takes the value at the nearest point on the hull,
+  // interpolated along the hull edge it is on.  Extrapolating from the
+  // plane of a hull triangle instead runs away when the triangle is a
+  // thin sliver along the hull, as it often is.
+  //   The walk ended in a triangle touching the super-triangle, whose
+  // real vertices are on the hull near the point.  Walk along the hull
+  // both ways from one of them while the edges get closer.  Far enough
+  // outside it may have no real vertices, and if the hull touches itself
+  // the links are not a single loop, so then check every edge.
+  int bestA = -1, bestB = -1;
+  double bestDist = 1e300, bestT = 0;
+  auto consider = [&](int a, int b) {
+    double t;
+    double dist = segment_distance2(d_in[a], d_in[b], x, y, t);
+    if (dist >= bestDist) { return false; }
+    bestDist = dist;
+    bestA = a;
+    bestB = b;
+    bestT = t;
+    return true;
+  };
+  int from = -1;
+  for (int j = 0; j < 3; j++) {
+    if (!isSuper(tri.v[j])) { from = tri.v[j]; }
+  }
+  if ((from >= 0) && d_hullSimple && (d_hullNext[from] >= 0)) {
+    size_t steps = d_hullEdges.size();
+    consider(from, d_hullNext[from]);
+    for (int a = d_hullNext[from]; (steps-- > 0) && consider(a, d_hullNext[a]); ) {
+      a = d_hullNext[a];
+    }
+    steps = d_hullEdges.size();
+    for (int b = from; (steps-- > 0) && consider(d_hullPrev[b], b); ) {
+      b = d_hullPrev[b];
+    }
+  } else {
+    for (size_t e = 0; e < d_hullEdges.size(); e++) {
+      consider(d_hullEdges[e][0], d_hullEdges[e][1]);
+    }
+  }
+
+  for (int i = 0; i < 2; i++) {
+    out[i] = (1 - bestT) * d_out[bestA][i] + bestT * d_out[bestB][i];
+  }
+  return false;
+}
+
+bool resample_mesh_to_grid(const MeshDescription &mesh,
+  size_t cols, size_t rows, MeshDescription &grid)
+{
+  grid.clear();
+  if ((cols < 2) || (rows < 2)) {
+    std::cerr << "Error: resample_mesh_to_grid(): grid must be at least 2x2" << std::endl;
+    return false;
+  }
+  MeshInterpolator interp;
+  if (!interp.build(mesh)) { return false; }
+
+  grid.resize(cols * rows);
+  MeshInterpolator::Hint hint;
+  for (size_t r = 0; r < rows; r++) {
+    double y = static_cast<double>(r) / (rows - 1);
+    for (size_t c = 0; c < cols; c++) {
+      double x = static_cast<double>(c) / (cols - 1);
+      std::array< std::array<double, 2>, 2 > &element = grid[r * cols + c];
+      element[0][0] = x;
+      element[0][1] = y;
+      interp.interpolate(x, y, element[1], hint);
+    }
+  }
+  return true;
+}
+
+//====================================================================
+// Adaptive resampling.  Cells are squares in a quadtree whose corners
+// sit on a lattice with ADAPTIVE_SIDE points along each edge, so that
+// shared corners can be found by their lattice coordinates.
+
+static const int ADAPTIVE_LEVELS = 10;
+static const int ADAPTIVE_SIDE = (1 << ADAPTIVE_LEVELS) + 1;
+static const int ADAPTIVE_START = 2;  //!< Level of the starting grid
+
+namespace {
+
+struct AdaptiveCell {
+  int x, y;       //!< Lattice coordinates of the lower-left corner
+  int level;      //!< Cell side is 2^(ADAPTIVE_LEVELS - level) lattice steps
+  double error;
+  double priority;  //!< Error weighted by area, so cells are split worst first
+  bool operator<(const AdaptiveCell &o) const { return priority < o.priority; }
+};
+
+class AdaptiveSampler {
+public:
+  AdaptiveSampler(const MeshInterpolator &interp) : d_interp(interp) {}
+
+  /// Index of the sample at a lattice point, interpolating it the first
+  /// time it is asked for.
+  size_t sample(int x, int y)
+  {
+    int key = y * ADAPTIVE_SIDE + x;
+    std::unordered_map<int, size_t>::const_iterator found = d_index.find(key);
+    if (found != d_index.end()) { return found->second; }
+    std::array< std::array<double, 2>, 2 > element;
+    element[0][0] = static_cast<double>(x) / (ADAPTIVE_SIDE - 1);
+    element[0][1] = static_cast<double>(y) / (ADAPTIVE_SIDE - 1);
+    d_interp.interpolate(element[0][0], element[0][1], element[1], d_hint);
+    d_index[key] = d_points.size();
+    d_points.push_back(element);
+    d_keys.push_back(key);
+    return d_points.size() - 1;
+  }
+
+  const std::array<double, 2> &out(size_t i) const { return d_points[i][1]; }
+  size_t size() const { return d_points.size(); }
+
+  /// How far linear interpolation across the cell misses the mesh.  This
+  /// samples the points the cell's children would add, so splitting it
+  /// costs nothing more.
+  double cellError(const AdaptiveCell &c)
+  {
+    int side = 1 << (ADAPTIVE_LEVELS - c.level);
+    int half = side / 2;
+    size_t c00 = sample(c.x, c.y), c10 = sample(c.x + side, c.y);
+    size_t c01 = sample(c.x, c.y + side), c11 = sample(c.x + side, c.y + side);
+    double e = 0;
+    e = std::max(e, midpointError(c00, c10, sample(c.x + half, c.y)));
+    e = std::max(e, midpointError(c01, c11, sample(c.x + half, c.y + side)));
+    e = std::max(e, midpointError(c00, c01, sample(c.x, c.y + half)));
+    e = std::max(e, midpointError(c10, c11, sample(c.x + side, c.y + half)));
+    size_t center = sample(c.x + half, c.y + half);
+    e = std::max(e, midpointError(c00, c11, center));
+    e = std::max(e, midpointError(c10, c01, center));
+    return e;
+  }
+
+  /// Samples sorted by row and then column.
+  void extract(MeshDescription &mesh) const
+  {
+    std::vector<size_t> order(d_points.size());
+    for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+    std::sort(order.begin(), order.end(),
+      [this](size_t a, size_t b) { return d_keys[a] < d_keys[b]; });
+    mesh.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++) { mesh[i] = d_points[order[i]]; }
+  }
+
+private:
+  double midpointError(size_t a, size_t b, size_t mid) const
+  {
+    double dx = (out(a)[0] + out(b)[0]) / 2 - out(mid)[0];
+    double dy = (out(a)[1] + out(b)[1]) / 2 - out(mid)[1];
+    return sqrt(dx * dx + dy * dy);
+  }
+
+  const MeshInterpolator &d_interp;
+  MeshInterpolator::Hint d_hint;
+  std::unordered_map<int, size_t> d_index;
+  MeshDescription d_points;
+  std::vector<int> d_keys;
+};
+
+} // namespace
+
+bool resample_mesh_adaptive(const MeshDescription &mesh,
+  double tolerance, size_t maxPoints, MeshDescription &out, double *maxError)
+{
+  out.clear();
+  size_t startSide = (1 << ADAPTIVE_START) + 1;
+  if (maxPoints < startSide * startSide) {
+    std::cerr << "Error: resample_mesh_adaptive(): need room for at least "
+      << startSide * startSide << " points" << std::endl;
+    return false;
+  }
+  MeshInterpolator interp;
+  if (!interp.build(mesh)) { return false; }
+
+  // Only the corners of the cells are written out, but each cell's
+  // error is found from its children's corners, so the counts are of
+  // the corners alone.
+  //  Cells within tolerance, or too small to split, are never chosen.
+  // Of the others, the one with the most error times area goes first,
+  // so that a region of the mesh that folds on itself (where no amount
+  // of splitting gets within tolerance) does not take all the points.
+  AdaptiveSampler sampler(interp);
+  auto weigh = [tolerance](const AdaptiveCell &c) {
+    if ((c.error <= tolerance) || (c.level == ADAPTIVE_LEVELS)) { return 0.0; }
+    return c.error * ldexp(1.0, -2 * c.level);
+  };
+  std::priority_queue<AdaptiveCell> cells;
+  int side = 1 << (ADAPTIVE_LEVELS - ADAPTIVE_START);
+  for (int y = 0; y < (1 << ADAPTIVE_START); y++) {
+    for (int x = 0; x < (1 << ADAPTIVE_START); x++) {
+      AdaptiveCell c = { x * side, y * side, ADAPTIVE_START, 0, 0 };
+      c.error = sampler.cellError(c);
+      c.priority = weigh(c);
+      cells.push(c);
+    }
+  }
+
+  // Split cells until they are all good enough.  Splitting adds at most
+  // five corners.
+  std::vector<char> corner(ADAPTIVE_SIDE * ADAPTIVE_SIDE, 0);
+  size_t corners = 0;
+  auto addCorner = [&](int x, int y) {
+    char &c = corner[y * ADAPTIVE_SIDE + x];
+    if (!c) { c = 1; corners++; }
+  };
+  for (int y = 0; y < static_cast<int>(startSide); y++) {
+    for (int x = 0; x < static_cast<int>(startSide); x++) {
+      addCorner(x * side, y * side);
+    }
+  }
+  while ((cells.top().priority > 0) && (corners + 5 <= maxPoints)) {
+    AdaptiveCell c = cells.top();
+    cells.pop();
+    int half = 1 << (ADAPTIVE_LEVELS - c.level - 1);
+    addCorner(c.x + half, c.y);
+    addCorner(c.x, c.y + half);
+    addCorner(c.x + half, c.y + half);
+    addCorner(c.x + 2 * half, c.y + half);
+    addCorner(c.x + half, c.y + 2 * half);
+    for (int j = 0; j < 2; j++) {
+      for (int i = 0; i < 2; i++) {
+        AdaptiveCell child = { c.x + i * half, c.y + j * half, c.level + 1, 0, 0 };
+        child.error = sampler.cellError(child);
+        child.priority = weigh(child);
+        cells.push(child);
+      }
+    }
+  }
+
+  if (maxError) {
+    double worst = 0;
+    for (; !cells.empty(); cells.pop()) { worst = std::max(worst, cells.top().error); }
+    *maxError = worst;
+  }
+
+  // Write out the corners, skipping the samples that only served to
+  // check the cells that were not split.
+  MeshDescription all;
+  sampler.extract(all);
+  out.reserve(corners);
+  for (size_t i = 0; i < all.size(); i++) {
+    int x = static_cast<int>(all[i][0][0] * (ADAPTIVE_SIDE - 1) + 0.5);
+    int y = static_cast<int>(all[i][0][1] * (ADAPTIVE_SIDE - 1) + 0.5);
+    if (corner[y * ADAPTIVE_SIDE + x]) { out.push_back(all[i]); }
+  }
+  return true;
+}
@@ -0,0 +1,116 @@
+/** @file
+    @brief Interpolation of scattered distortion-mesh samples.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+
+#include <array>
+#include <vector>
+
+/// Interpolates the in->out mapping of a distortion mesh at arbitrary
+/// input locations.  The input points are Delaunay triangulated and
+/// the output is interpolated linearly (barycentric) within the
+/// triangle holding the query point.  Queries outside the convex hull
+/// of the inputs take the value at the nearest point on the hull, so
+/// they stay within the range of the hull points' outputs.
+///  Lookups are fastest when successive queries are near each other,
+/// as when scanning a grid, because each search starts where the last
+/// one ended.  A Hint lets several threads query the same interpolator.
+class MeshInterpolator {
+public:
+  /// Remembers where the last search ended.
+  struct Hint {
+    int triangle = -1;
+  };
+
+  MeshInterpolator() {}
+
+  /// Triangulates the input side of the mesh.  Repeated input points
+  /// are ignored after the first.
+  ///   @return false (with a message on std::cerr) if the points do
+  /// not span an area (fewer than three distinct, non-collinear points).
+  bool build(const MeshDescription &mesh);
+
+  /// Interpolates the output coordinate for the input location (x, y).
+  ///   @return true if (x, y) was inside the triangulation, false if
+  /// the value was taken from the nearest point on its hull.
+  bool interpolate(double x, double y, std::array<double, 2> &out, Hint &hint) const;
+  bool interpolate(double x, double y, std::array<double, 2> &out) const
+  {
+    Hint hint;
+    return interpolate(x, y, out, hint);
+  }
+
+  /// Number of triangles in the triangulation of the input points.
+  size_t numTriangles() const { return d_numReal; }
+
+private:
+  struct Triangle {
+    int v[3];   //!< Vertices, counterclockwise
+    int n[3];   //!< Neighbor across the edge opposite v[i], or -1
+    bool alive;
+  };
+
+  void insert(int p, int &last);
+  int locate(double x, double y, int start) const;
+  bool isSuper(int v) const { return v >= d_numPoints; }
+  double orient(int a, int b, double x, double y) const;
+
+  int d_numPoints = 0;        //!< Real points; the super-triangle follows
+  size_t d_numReal = 0;       //!< Triangles not touching the super-triangle
+  std::vector<std::array<double, 2> > d_in;
+  std::vector<std::array<double, 2> > d_out;
+  std::vector<Triangle> d_tris;
+  std::vector<int> d_hull;    //!< Real triangles with at least one hull edge
+  std::vector<std::array<int, 2> > d_hullEdges;  //!< Counterclockwise
+  std::vector<int> d_hullNext;  //!< Per point, the next point on the hull, or -1
+  std::vector<int> d_hullPrev;  //!< Per point, the previous point on the hull, or -1
+  bool d_hullSimple = true;     //!< No point is on the hull twice
+  std::vector<int> d_mark;    //!< Per-triangle cavity marks used by insert()
+  int d_stamp = 0;
+};
+
+/// Resamples the mesh onto a regular grid of cols x rows input points
+/// covering [0,1] in both X and Y, including the edges.  The result is
+/// in row-major order starting from the bottom-left point: entry
+/// (row * cols + col) has input (col / (cols-1), row / (rows-1)).
+///   @return false (with a message on std::cerr) on failure.
+extern bool resample_mesh_to_grid(const MeshDescription &mesh,
+  size_t cols, size_t rows, MeshDescription &grid);
+
+/// Resamples the mesh onto points that are dense only where it is not
+/// close to linear.  Starting from a 4 x 4 grid of cells over [0,1] in
+/// X and Y, the cell whose linear interpolation most misses the mesh
+/// (checked at its edge midpoints and center, which works for either
+/// diagonal) is split into four, until every cell is within tolerance
+/// (in normalized output units) or there would be more than maxPoints.
+/// The result is in the usual point-sample format, sorted by row from
+/// the bottom and then by column, so it is the same on every run.
+///   @param maxError If not NULL, set to the largest error left in any
+/// cell.
+///   @return false (with a message on std::cerr) on failure.
+extern bool resample_mesh_adaptive(const MeshDescription &mesh,
+  double tolerance, size_t maxPoints, MeshDescription &out,
+  double *maxError = nullptr);
@@ -0,0 +1,637 @@
+/** @file
+    @brief Implementation of the binary distortion-mesh format.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mesh_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static const char magic[8] = { 'O', 'S', 'V', 'R', 'D', 'M', 'S', 'H' };
+static const size_t headerSize = 64;
+static const size_t tableEntrySize = 16;
+
+// Returns true if this machine stores numbers little-endian, in which
+// case the mesh data can be used directly from the file.
+static bool little_endian()
+{
+  const uint32_t one = 1;
+  unsigned char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+static void put_u32(std::vector<unsigned char> &buf, size_t at, uint32_t v)
+{
+  for (int i = 0; i < 4; i++) { buf[at + i] = static_cast<unsigned char>(v >> (8 * i)); }
+}
+
+static void put_u64(std::vector<unsigned char> &buf, size_t at, uint64_t v)
+{
+  for (int i = 0; i < 8; i++) { buf[at + i] = static_cast<unsigned char>(v >> (8 * i)); }
+}
+
+static void put_f32(std::vector<unsigned char> &buf, size_t at, double v)
+{
+  float f = static_cast<float>(v);
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  put_u32(buf, at, bits);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+  return uint64_t(get_u32(p)) | (uint64_t(get_u32(p + 4)) << 32);
+}
+
+static float get_f32(const unsigned char *p)
+{
+  uint32_t bits = get_u32(p);
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+static size_t align16(size_t n)
+{
+  return (n + 15) & ~static_cast<size_t>(15);
+}
+
+bool write_distortion_mesh_file(const std::string &fileName,
+  const std::vector<MeshDescription> &leftMeshes,
+  const std::vector<MeshDescription> &rightMeshes,
+  const ScreenDescription &leftScreen, const ScreenDescription &rightScreen)
+{
+  if ((leftMeshes.size() == 0) || (leftMeshes.size() != rightMeshes.size())) {
+    std::cerr << "Error: write_distortion_mesh_file(): Need the same"
+      << " number of meshes for each eye" << std::endl;
+    return false;
+  }
+  size_t numMeshes = 2 * leftMeshes.size();
+  std::vector<size_t> sizes(numMeshes);
+  for (size_t m = 0; m < numMeshes; m++) {
+    sizes[m] = ((m % 2 == 0) ? leftMeshes[m / 2] : rightMeshes[m / 2]).size();
+  }
+  DistortionMeshWriter writer;
+  if (!writer.open(fileName, sizes, leftScreen, rightScreen)) {
+    return false;
+  }
+  for (size_t m = 0; m < numMeshes; m++) {
+    if (!writer.append((m % 2 == 0) ? leftMeshes[m / 2] : rightMeshes[m / 2])) {
+      return false;
+    }
+  }
+  return writer.close();
+}
+
+bool DistortionMeshWriter::open(const std::string &fileName,
+  const std::vector<size_t> &sizes,
+  const ScreenDescription &leftScreen, const ScreenDescription &rightScreen)
+{
+  const uint32_t numEyes = 2;
+  if ((sizes.size() == 0) || (sizes.size() % numEyes != 0)) {
+    std::cerr << "Error: DistortionMeshWriter::open(): Need the same"
+      << " number of meshes for each eye" << std::endl;
+    return false;
+  }
+  uint32_t numColors = static_cast<uint32_t>(sizes.size() / numEyes);
+
+  //====================================================================
+  // Lay out the file: header, mesh table, then each mesh's data.
+  size_t numMeshes = sizes.size();
+  d_sizes = sizes;
+  d_offsets.resize(numMeshes);
+  size_t size = align16(headerSize + numMeshes * tableEntrySize);
+  for (size_t m = 0; m < numMeshes; m++) {
+    d_offsets[m] = size;
+    size = align16(size + sizes[m] * 4 * sizeof(float));
+  }
+  d_fileSize = size;
+  d_fileName = fileName;
+  d_mesh = 0;
+  d_filled = 0;
+
+  std::vector<unsigned char> buf(d_offsets[0], 0);
+  memcpy(&buf[0], magic, sizeof(magic));
+  put_u32(buf, 8, DMESH_VERSION);
+  put_u32(buf, 12, static_cast<uint32_t>(headerSize));
+  put_u32(buf, 16, numColors);
+  put_u32(buf, 20, numEyes);
+  put_f32(buf, 24, rightScreen.hFOVDegrees);
+  put_f32(buf, 28, rightScreen.vFOVDegrees);
+  put_f32(buf, 32, rightScreen.overlapPercent);
+  put_f32(buf, 36, leftScreen.xCOP);
+  put_f32(buf, 40, leftScreen.yCOP);
+  put_f32(buf, 44, rightScreen.xCOP);
+  put_f32(buf, 48, rightScreen.yCOP);
+  for (size_t m = 0; m < numMeshes; m++) {
+    size_t entry = headerSize + m * tableEntrySize;
+    put_u64(buf, entry, d_offsets[m]);
+    put_u32(buf, entry + 8, static_cast<uint32_t>(sizes[m]));
+  }
+
+  d_out.close();
+  d_out.clear();
+  d_out.open(fileName.c_str(), std::ios::binary);
+  if (!d_out.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  d_out.write(reinterpret_cast<const char *>(&buf[0]), buf.size());
+  d_position = buf.size();
+  return true;
+}
+
+bool DistortionMeshWriter::pad(size_t offset)
+{
+  static const char zeros[16] = { 0 };
+  while (d_position < offset) {
+    size_t n = std::min(offset - d_position, sizeof(zeros));
+    d_out.write(zeros, n);
+    d_position += n;
+  }
+  return d_out.good();
+}
+
+bool DistortionMeshWriter::append(const MeshDescription &samples)
+{
+  size_t i = 0;
+  while (i < samples.size()) {
+    // Move on past the meshes that are full.
+    while ((d_mesh < d_sizes.size()) && (d_filled == d_sizes[d_mesh])) {
+      d_mesh++;
+      d_filled = 0;
+    }
+    if (d_mesh == d_sizes.size()) {
+      std::cerr << "Error: DistortionMeshWriter::append(): More samples"
+        << " than the meshes in " << d_fileName << " hold" << std::endl;
+      return false;
+    }
+    if (d_filled == 0) { pad(d_offsets[d_mesh]); }
+
+    size_t n = std::min(samples.size() - i, d_sizes[d_mesh] - d_filled);
+    d_buffer.resize(n * 4 * sizeof(float));
+    size_t at = 0;
+    for (size_t j = i; j < i + n; j++) {
+      put_f32(d_buffer, at, samples[j][0][0]); at += 4;
+      put_f32(d_buffer, at, samples[j][0][1]); at += 4;
+      put_f32(d_buffer, at, samples[j][1][0]); at += 4;
+      put_f32(d_buffer, at, samples[j][1][1]); at += 4;
+    }
+    d_out.write(reinterpret_cast<const char *>(d_buffer.data()), d_buffer.size());
+    d_position += d_buffer.size();
+    d_filled += n;
+    i += n;
+  }
+  if (!d_out.good()) {
+    std::cerr << "Error: Could not write " << d_fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool DistortionMeshWriter::close()
+{
+  while ((d_mesh < d_sizes.size()) && (d_filled == d_sizes[d_mesh])) {
+    d_mesh++;
+    d_filled = 0;
+  }
+  if (d_mesh != d_sizes.size()) {
+    std::cerr << "Error: DistortionMeshWriter::close(): Mesh " << d_mesh
+      << " of " << d_fileName << " is missing samples" << std::endl;
+    d_out.close();
+    return false;
+  }
+  pad(d_fileSize);
+  d_out.close();
+  if (d_out.fail()) {
+    std::cerr << "Error: Could not write " << d_fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool DistortionMeshView::open(const void *data, size_t size)
+{
+  d_data = nullptr;
+  d_offsets.clear();
+  d_counts.clear();
+
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  if ((size < headerSize) || (memcmp(p, magic, sizeof(magic)) != 0)) {
+    std::cerr << "Error: Not a distortion mesh file" << std::endl;
+    return false;
+  }
+  d_version = get_u32(p + 8);
+  if (d_version != DMESH_VERSION) {
+    std::cerr << "Error: Distortion mesh file version " << d_version
+      << " is not supported (expected " << DMESH_VERSION << ")" << std::endl;
+    return false;
+  }
+  size_t header = get_u32(p + 12);
+  d_numColors = get_u32(p + 16);
+  d_numEyes = get_u32(p + 20);
+  if ((header < headerSize) || (d_numColors == 0) || (d_numColors > 3) || (d_numEyes != 2)) {
+    std::cerr << "Error: Bad distortion mesh file header" << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < 7; i++) {
+    d_fields[i] = get_f32(p + 24 + 4 * i);
+  }
+
+  size_t numMeshes = d_numColors * d_numEyes;
+  if (header + numMeshes * tableEntrySize > size) {
+    std::cerr << "Error: Distortion mesh file is truncated" << std::endl;
+    return false;
+  }
+  for (size_t m = 0; m < numMeshes; m++) {
+    const unsigned char *entry = p + header + m * tableEntrySize;
+    uint64_t offset = get_u64(entry);
+    uint32_t count = get_u32(entry + 8);
+    if ((offset % 16 != 0) || (offset > size) ||
+        (uint64_t(count) * 4 * sizeof(float) > size - offset)) {
+      std::cerr << "Error: Distortion mesh file is truncated or corrupt" << std::endl;
+      return false;
+    }
+    d_offsets.push_back(offset);
+    d_counts.push_back(count);
+  }
+
+  if (!little_endian()) {
+    std::cerr << "Error: Distortion mesh files can only be used in place on"
+      << " little-endian machines" << std::endl;
+    return false;
+  }
+  if (reinterpret_cast<uintptr_t>(p) % sizeof(float) != 0) {
+    std::cerr << "Error: Distortion mesh buffer is not aligned for float access" << std::endl;
+    return false;
+  }
+
+  d_data = p;
+  return true;
+}
+
+size_t DistortionMeshView::meshSize(uint32_t color, uint32_t eye) const
+{
+  size_t m = color * d_numEyes + eye;
+  if (!d_data || (m >= d_counts.size())) { return 0; }
+  return d_counts[m];
+}
+
+const float *DistortionMeshView::meshData(uint32_t color, uint32_t eye) const
+{
+  size_t m = color * d_numEyes + eye;
+  if (!d_data || (m >= d_offsets.size())) { return nullptr; }
+  return reinterpret_cast<const float *>(d_data + d_offsets[m]);
+}
+
+void DistortionMeshView::getMesh(uint32_t color, uint32_t eye, MeshDescription &mesh) const
+{
+  mesh.clear();
+  const float *f = meshData(color, eye);
+  size_t count = meshSize(color, eye);
+  mesh.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    mesh[i][0][0] = f[4 * i + 0];
+    mesh[i][0][1] = f[4 * i + 1];
+    mesh[i][1][0] = f[4 * i + 2];
+    mesh[i][1][1] = f[4 * i + 3];
+  }
+}
+
+bool read_distortion_mesh_file(const std::string &fileName,
+  std::vector<float> &storage, DistortionMeshView &view)
+{
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in.good()) {
+    std::cerr << "Error: Could not open " << fileName << std::endl;
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  std::streamoff size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  if (size < 0) {
+    std::cerr << "Error: Could not determine the size of " << fileName << std::endl;
+    return false;
+  }
+
+  // Use a float vector so that the data is suitably aligned.
+  storage.assign((static_cast<size_t>(size) + sizeof(float) - 1) / sizeof(float), 0.0f);
+  if (size > 0 && !in.read(reinterpret_cast<char *>(&storage[0]), size)) {
+    std::cerr << "Error: Could not read " << fileName << std::endl;
+    return false;
+  }
+  if (!view.open(storage.empty() ? nullptr : &storage[0], static_cast<size_t>(size))) {
+    std::cerr << "  (reading " << fileName << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//====================================================================
+// MeshStack
+
+static const char stackMagic[8] = { 'O', 'S', 'V', 'R', 'D', 'S', 'T', 'K' };
+static const size_t stackLayerSize = 32;
+
+void MeshStack::reset(uint32_t numColors, size_t cols, size_t rows)
+{
+  d_numColors = numColors;
+  d_cols = cols;
+  d_rows = rows;
+  d_layers.clear();
+  d_outputs.clear();
+  d_inputs.resize(2 * numVertices());
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++) {
+      d_inputs[2 * (r * cols + c)] = static_cast<float>(static_cast<double>(c) / (cols - 1));
+      d_inputs[2 * (r * cols + c) + 1] = static_cast<float>(static_cast<double>(r) / (rows - 1));
+    }
+  }
+}
+
+bool MeshStack::addLayer(const MeshStackLayer &layer,
+  const std::vector<MeshDescription> &leftMeshes,
+  const std::vector<MeshDescription> &rightMeshes)
+{
+  if ((leftMeshes.size() != d_numColors) || (rightMeshes.size() != d_numColors)) {
+    std::cerr << "Error: MeshStack::addLayer(): Expected " << d_numColors
+      << " meshes for each eye" << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < d_layers.size(); i++) {
+    if (d_layers[i].eyeRelief == layer.eyeRelief) {
+      std::cerr << "Error: MeshStack::addLayer(): Two layers have eye relief "
+        << layer.eyeRelief << std::endl;
+      return false;
+    }
+  }
+
+  // Check that each mesh is on the grid and gather its outputs.
+  size_t n = numVertices();
+  std::vector<float> outputs(2 * n * d_numColors * 2);
+  for (uint32_t color = 0; color < d_numColors; color++) {
+    for (uint32_t eye = 0; eye < 2; eye++) {
+      const MeshDescription &mesh = (eye == 0) ? leftMeshes[color] : rightMeshes[color];
+      if (mesh.size() != n) {
+        std::cerr << "Error: MeshStack::addLayer(): Mesh has " << mesh.size()
+          << " points, expected a " << d_cols << " x " << d_rows << " grid" << std::endl;
+        return false;
+      }
+      float *out = &outputs[2 * n * (color * 2 + eye)];
+      for (size_t i = 0; i < n; i++) {
+        if ((fabs(mesh[i][0][0] - d_inputs[2 * i]) > 1e-6) ||
+            (fabs(mesh[i][0][1] - d_inputs[2 * i + 1]) > 1e-6)) {
+          std::cerr << "Error: MeshStack::addLayer(): Mesh is not on the stack's grid"
+            << std::endl;
+          return false;
+        }
+        out[2 * i] = static_cast<float>(mesh[i][1][0]);
+        out[2 * i + 1] = static_cast<float>(mesh[i][1][1]);
+      }
+    }
+  }
+
+  // Keep the layers in order of eye relief.
+  size_t at = 0;
+  while ((at < d_layers.size()) && (d_layers[at].eyeRelief < layer.eyeRelief)) { at++; }
+  d_layers.insert(d_layers.begin() + at, layer);
+  d_outputs.insert(d_outputs.begin() + at, outputs);
+  return true;
+}
+
+const float *MeshStack::outputs(size_t layer, uint32_t color, uint32_t eye) const
+{
+  if ((layer >= d_outputs.size()) || (color >= d_numColors) || (eye >= 2)) { return nullptr; }
+  return &d_outputs[layer][2 * numVertices() * (color * 2 + eye)];
+}
+
+void MeshStack::bracket(double eyeRelief, size_t &lower, size_t &upper, double &t) const
+{
+  lower = upper = 0;
+  t = 0;
+  if (d_layers.empty()) { return; }
+  if (eyeRelief <= d_layers.front().eyeRelief) { return; }
+  if (eyeRelief >= d_layers.back().eyeRelief) {
+    lower = upper = d_layers.size() - 1;
+    return;
+  }
+  upper = 1;
+  while (d_layers[upper].eyeRelief < eyeRelief) { upper++; }
+  lower = upper - 1;
+  t = (eyeRelief - d_layers[lower].eyeRelief) /
+    (d_layers[upper].eyeRelief - d_layers[lower].eyeRelief);
+}
+
+void MeshStack::blendScreens(double eyeRelief, ScreenDescription &leftScreen,
+  ScreenDescription &rightScreen) const
+{
+  size_t lower, upper;
+  double t;
+  bracket(eyeRelief, lower, upper, t);
+  const MeshStackLayer &a = d_layers[lower];
+  const MeshStackLayer &b = d_layers[upper];
+  ScreenDescription *screens[2] = { &leftScreen, &rightScreen };
+  for (int eye = 0; eye < 2; eye++) {
+    ScreenDescription &s = *screens[eye];
+    s.hFOVDegrees = a.hFOVDegrees + t * (b.hFOVDegrees - a.hFOVDegrees);
+    s.vFOVDegrees = a.vFOVDegrees + t * (b.vFOVDegrees - a.vFOVDegrees);
+    s.overlapPercent = a.overlapPercent + t * (b.overlapPercent - a.overlapPercent);
+    s.xCOP = a.xCOP[eye] + t * (b.xCOP[eye] - a.xCOP[eye]);
+    s.yCOP = a.yCOP[eye] + t * (b.yCOP[eye] - a.yCOP[eye]);
+  }
+}
+
+void MeshStack::blendMesh(double eyeRelief, uint32_t color, uint32_t eye,
+  MeshDescription &mesh) const
+{
+  mesh.clear();
+  size_t lower, upper;
+  double t;
+  bracket(eyeRelief, lower, upper, t);
+  const float *a = outputs(lower, color, eye);
+  const float *b = outputs(upper, color, eye);
+  if (!a || !b) { return; }
+  size_t n = numVertices();
+  mesh.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    mesh[i][0][0] = d_inputs[2 * i];
+    mesh[i][0][1] = d_inputs[2 * i + 1];
+    mesh[i][1][0] = a[2 * i] + t * (b[2 * i] - a[2 * i]);
+    mesh[i][1][1] = a[2 * i + 1] + t * (b[2 * i + 1] - a[2 * i + 1]);
+  }
+}
+
+bool MeshStack::write(const std::string &fileName) const
+{
+  if (d_layers.empty()) {
+    std::cerr << "Error: MeshStack::write(): No layers" << std::endl;
+    return false;
+  }
+
+  //====================================================================
+  // Lay out the file: header, layer table, inputs, then the outputs.
+  size_t n = numVertices();
+  size_t meshBytes = align16(2 * n * sizeof(float));
+  size_t inputsAt = align16(headerSize + d_layers.size() * stackLayerSize);
+  size_t meshesPerLayer = d_numColors * 2;
+  size_t size = inputsAt + meshBytes * (1 + d_layers.size() * meshesPerLayer);
+  std::vector<unsigned char> buf(size, 0);
+
+  memcpy(&buf[0], stackMagic, sizeof(stackMagic));
+  put_u32(buf, 8, DSTACK_VERSION);
+  put_u32(buf, 12, static_cast<uint32_t>(headerSize));
+  put_u32(buf, 16, d_numColors);
+  put_u32(buf, 20, 2);
+  put_u32(buf, 24, static_cast<uint32_t>(d_layers.size()));
+  put_u32(buf, 28, static_cast<uint32_t>(d_cols));
+  put_u32(buf, 32, static_cast<uint32_t>(d_rows));
+  for (size_t l = 0; l < d_layers.size(); l++) {
+    const MeshStackLayer &layer = d_layers[l];
+    size_t at = headerSize + l * stackLayerSize;
+    put_f32(buf, at, layer.eyeRelief);
+    put_f32(buf, at + 4, layer.hFOVDegrees);
+    put_f32(buf, at + 8, layer.vFOVDegrees);
+    put_f32(buf, at + 12, layer.overlapPercent);
+    put_f32(buf, at + 16, layer.xCOP[0]);
+    put_f32(buf, at + 20, layer.yCOP[0]);
+    put_f32(buf, at + 24, layer.xCOP[1]);
+    put_f32(buf, at + 28, layer.yCOP[1]);
+  }
+  for (size_t i = 0; i < 2 * n; i++) {
+    put_f32(buf, inputsAt + 4 * i, d_inputs[i]);
+  }
+  for (size_t l = 0; l < d_layers.size(); l++) {
+    for (size_t m = 0; m < meshesPerLayer; m++) {
+      size_t at = inputsAt + meshBytes * (1 + l * meshesPerLayer + m);
+      const float *out = &d_outputs[l][2 * n * m];
+      for (size_t i = 0; i < 2 * n; i++) {
+        put_f32(buf, at + 4 * i, out[i]);
+      }
+    }
+  }
+
+  //====================================================================
+  // Write it all at once.
+  std::ofstream out(fileName.c_str(), std::ios::binary);
+  if (!out.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(&buf[0]), buf.size());
+  out.close();
+  if (out.fail()) {
+    std::cerr << "Error: Could not write " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool MeshStack::read(const std::string &fileName)
+{
+  d_layers.clear();
+  d_outputs.clear();
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in.good()) {
+    std::cerr << "Error: Could not open " << fileName << std::endl;
+    return false;
+  }
+  std::vector<unsigned char> buf((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+
+  //====================================================================
+  // Check the header and that the file is big enough for what it says.
+  const unsigned char *p = buf.data();
+  if ((buf.size() < headerSize) || (memcmp(p, stackMagic, sizeof(stackMagic)) != 0)) {
+    std::cerr << "Error: " << fileName << " is not a mesh stack file" << std::endl;
+    return false;
+  }
+  uint32_t version = get_u32(p + 8);
+  if (version != DSTACK_VERSION) {
+    std::cerr << "Error: Mesh stack file version " << version
+      << " is not supported (expected " << DSTACK_VERSION << ")" << std::endl;
+    return false;
+  }
+  size_t header = get_u32(p + 12);
+  uint32_t numColors = get_u32(p + 16);
+  uint32_t numEyes = get_u32(p + 20);
+  size_t numLayers = get_u32(p + 24);
+  size_t cols = get_u32(p + 28);
+  size_t rows = get_u32(p + 32);
+  if ((header < headerSize) || (numColors == 0) || (numColors > 3) || (numEyes != 2)
+      || (numLayers == 0) || (cols < 2) || (rows < 2)) {
+    std::cerr << "Error: Bad mesh stack header in " << fileName << std::endl;
+    return false;
+  }
+  uint64_t n = uint64_t(cols) * rows;
+  uint64_t meshBytes = align16(static_cast<size_t>(2 * n * sizeof(float)));
+  uint64_t inputsAt = align16(header + numLayers * stackLayerSize);
+  size_t meshesPerLayer = numColors * 2;
+  if (inputsAt + meshBytes * (1 + numLayers * meshesPerLayer) > buf.size()) {
+    std::cerr << "Error: Mesh stack file " << fileName << " is truncated" << std::endl;
+    return false;
+  }
+
+  //====================================================================
+  // Read the layers and meshes.
+  reset(numColors, cols, rows);
+  for (size_t i = 0; i < 2 * n; i++) {
+    d_inputs[i] = get_f32(p + inputsAt + 4 * i);
+  }
+  for (size_t l = 0; l < numLayers; l++) {
+    const unsigned char *entry = p + header + l * stackLayerSize;
+    MeshStackLayer layer;
+    layer.eyeRelief = get_f32(entry);
+    layer.hFOVDegrees = get_f32(entry + 4);
+    layer.vFOVDegrees = get_f32(entry + 8);
+    layer.overlapPercent = get_f32(entry + 12);
+    layer.xCOP[0] = get_f32(entry + 16);
+    layer.yCOP[0] = get_f32(entry + 20);
+    layer.xCOP[1] = get_f32(entry + 24);
+    layer.yCOP[1] = get_f32(entry + 28);
+    if ((l > 0) && !(layer.eyeRelief > d_layers.back().eyeRelief)) {
+      std::cerr << "Error: Mesh stack layers in " << fileName
+        << " are not in order of eye relief" << std::endl;
+      return false;
+    }
+    std::vector<float> outputs(2 * n * meshesPerLayer);
+    for (size_t m = 0; m < meshesPerLayer; m++) {
+      const unsigned char *at = p + inputsAt + meshBytes * (1 + l * meshesPerLayer + m);
+      for (size_t i = 0; i < 2 * n; i++) {
+        outputs[2 * n * m + i] = get_f32(at + 4 * i);
+      }
+    }
+    d_layers.push_back(layer);
+    d_outputs.push_back(outputs);
+  }
+  return true;
+}
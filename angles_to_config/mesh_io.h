@@ -0,0 +1,236 @@
+/** @file
+    @brief Compact binary file format for distortion meshes.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The .dmesh format holds the same data as the Json distortion
+// description: one mesh per color per eye, plus the field of view and
+// centers of projection.  Everything is little-endian.
+//
+//   offset  size  contents
+//        0     8  magic "OSVRDMSH"
+//        8     4  uint32 format version (DMESH_VERSION)
+//       12     4  uint32 header size in bytes (64)
+//       16     4  uint32 number of colors (1 for mono, 3 for R, G, B)
+//       20     4  uint32 number of eyes (2: left, then right)
+//       24    28  float32 hFOV, vFOV (degrees), overlap percent,
+//                 left xCOP, left yCOP, right xCOP, right yCOP
+//       52    12  reserved, zero
+//       64  16*N  one entry per mesh, ordered by color then eye:
+//                 uint64 byte offset of its data, uint32 number of
+//                 samples, uint32 reserved
+//
+// Each mesh's data starts on a 16-byte boundary and is count samples
+// of four float32 values: input x, input y, output x, output y.  A file
+// that is mapped or read into memory aligned to 16 bytes can therefore
+// be used in place without any parsing.
+
+static const uint32_t DMESH_VERSION = 1;
+
+/// Writes the meshes (one per color for each eye) and the screen
+/// descriptions in .dmesh format.
+///   @return false (with a message on std::cerr) on failure.
+extern bool write_distortion_mesh_file(const std::string &fileName,
+  const std::vector<MeshDescription> &leftMeshes,
+  const std::vector<MeshDescription> &rightMeshes,
+  const ScreenDescription &leftScreen, const ScreenDescription &rightScreen);
+
+/// Writes a .dmesh file a piece at a time, for meshes too large to hold
+/// in memory at once.  The samples are appended in file order, by color
+/// then eye, in as many calls as needed; each call may run on from one
+/// mesh into the next.
+class DistortionMeshWriter {
+public:
+  /// Creates the file and writes its header and mesh table.
+  ///   @param sizes The number of samples in each mesh, in file order.
+  ///   @return false (with a message on std::cerr) on failure.
+  bool open(const std::string &fileName, const std::vector<size_t> &sizes,
+    const ScreenDescription &leftScreen, const ScreenDescription &rightScreen);
+
+  ///   @return false (with a message on std::cerr) on failure or if
+  /// there are more samples than the meshes hold.
+  bool append(const MeshDescription &samples);
+
+  /// Finishes the file.
+  ///   @return false (with a message on std::cerr) on failure or if
+  /// the meshes are not full.
+  bool close();
+
+private:
+  bool pad(size_t offset);
+
+  std::ofstream d_out;
+  std::string d_fileName;
+  std::vector<size_t> d_sizes, d_offsets;
+  size_t d_fileSize = 0;
+  size_t d_position = 0;          //!< Bytes written so far
+  size_t d_mesh = 0;              //!< Mesh being filled
+  size_t d_filled = 0;            //!< Samples in it so far
+  std::vector<unsigned char> d_buffer;
+};
+
+/// Read-only view of a .dmesh file held in memory, which points
+/// directly into the caller's buffer.  The buffer must stay valid, and
+/// be aligned to at least 4 bytes, for as long as the view is used.
+class DistortionMeshView {
+public:
+  DistortionMeshView() {}
+
+  /// Checks the header and mesh table and sets up the view.
+  ///   @return false (with a message on std::cerr) if the buffer does
+  /// not hold a complete .dmesh file that this version can read.
+  bool open(const void *data, size_t size);
+
+  uint32_t version() const { return d_version; }
+  uint32_t numColors() const { return d_numColors; }
+  uint32_t numEyes() const { return d_numEyes; }
+
+  float hFOVDegrees() const { return d_fields[0]; }
+  float vFOVDegrees() const { return d_fields[1]; }
+  float overlapPercent() const { return d_fields[2]; }
+  /// @param eye 0 for left, 1 for right.
+  float xCOP(uint32_t eye) const { return d_fields[3 + 2 * eye]; }
+  float yCOP(uint32_t eye) const { return d_fields[4 + 2 * eye]; }
+
+  /// Number of samples in the mesh for the specified color and eye.
+  size_t meshSize(uint32_t color, uint32_t eye) const;
+  /// Pointer to 4 * meshSize() floats: in x, in y, out x, out y for
+  /// each sample.
+  const float *meshData(uint32_t color, uint32_t eye) const;
+
+  /// Copies a mesh into a MeshDescription.
+  void getMesh(uint32_t color, uint32_t eye, MeshDescription &mesh) const;
+
+private:
+  const unsigned char *d_data = nullptr;
+  uint32_t d_version = 0;
+  uint32_t d_numColors = 0;
+  uint32_t d_numEyes = 0;
+  float d_fields[7] = {};
+  std::vector<uint64_t> d_offsets;
+  std::vector<uint32_t> d_counts;
+};
+
+/// Reads a whole .dmesh file into storage and opens a view on it.
+///   @return false (with a message on std::cerr) on failure.
+extern bool read_distortion_mesh_file(const std::string &fileName,
+  std::vector<float> &storage, DistortionMeshView &view);
+
+// The .dstack format holds the distortion meshes for several eye
+// reliefs, all sampled at the same grid of input points, so that the
+// mesh for an eye relief between two layers is a per-vertex blend of
+// their outputs.  On the GPU the inputs and the two layers' outputs
+// can be bound as three vertex buffers with one index buffer for the
+// grid, and blended in the vertex shader.  Everything is little-endian.
+//
+//   offset  size  contents
+//        0     8  magic "OSVRDSTK"
+//        8     4  uint32 format version (DSTACK_VERSION)
+//       12     4  uint32 header size in bytes (64)
+//       16     4  uint32 number of colors (1 for mono, 3 for R, G, B)
+//       20     4  uint32 number of eyes (2: left, then right)
+//       24     4  uint32 number of layers
+//       28     8  uint32 grid columns, rows
+//       36    28  reserved, zero
+//       64  32*L  one entry per layer, in increasing eye relief:
+//                 float32 eye relief (mm), hFOV, vFOV (degrees), overlap
+//                 percent, left xCOP, left yCOP, right xCOP, right yCOP
+//
+// Then, each starting on a 16-byte boundary: the grid's input x, y
+// float32 pairs in row-major order from the bottom left (as written by
+// resample_mesh_to_grid()), and the output x, y pairs for each layer,
+// color and eye in that order.
+
+static const uint32_t DSTACK_VERSION = 1;
+
+/// Screen description for one layer of a MeshStack.
+struct MeshStackLayer {
+  double eyeRelief = 0;         //!< Millimeters
+  double hFOVDegrees = 0;
+  double vFOVDegrees = 0;
+  double overlapPercent = 100;
+  double xCOP[2] = { 0.5, 0.5 };
+  double yCOP[2] = { 0.5, 0.5 };
+};
+
+/// Distortion meshes for a range of eye reliefs on one grid of input
+/// points, from which the mesh for any eye relief in the range is
+/// blended.
+class MeshStack {
+public:
+  MeshStack() {}
+
+  /// Starts an empty stack with the specified number of colors on a
+  /// grid of cols x rows points.
+  void reset(uint32_t numColors, size_t cols, size_t rows);
+
+  /// Adds a layer.  The meshes (one per color for each eye) must be on
+  /// the stack's grid, as made by resample_mesh_to_grid().
+  ///   @return false (with a message on std::cerr) if they are not, or
+  /// there is already a layer with the same eye relief.
+  bool addLayer(const MeshStackLayer &layer,
+    const std::vector<MeshDescription> &leftMeshes,
+    const std::vector<MeshDescription> &rightMeshes);
+
+  ///   @return false (with a message on std::cerr) on failure.
+  bool write(const std::string &fileName) const;
+  bool read(const std::string &fileName);
+
+  uint32_t numColors() const { return d_numColors; }
+  size_t cols() const { return d_cols; }
+  size_t rows() const { return d_rows; }
+  size_t numVertices() const { return d_cols * d_rows; }
+  size_t numLayers() const { return d_layers.size(); }
+  const MeshStackLayer &layer(size_t i) const { return d_layers[i]; }
+
+  /// 2 * numVertices() floats: in x, in y for each grid point.
+  const float *inputs() const { return d_inputs.data(); }
+  /// 2 * numVertices() floats: out x, out y for each grid point.
+  const float *outputs(size_t layer, uint32_t color, uint32_t eye) const;
+
+  /// Finds the layers to blend for an eye relief and the weight of the
+  /// upper one.  Eye reliefs outside the stack use the nearest layer.
+  void bracket(double eyeRelief, size_t &lower, size_t &upper, double &t) const;
+
+  /// The screen descriptions and mesh for one color and eye, blended for
+  /// the specified eye relief.
+  void blendScreens(double eyeRelief, ScreenDescription &leftScreen,
+    ScreenDescription &rightScreen) const;
+  void blendMesh(double eyeRelief, uint32_t color, uint32_t eye,
+    MeshDescription &mesh) const;
+
+private:
+  uint32_t d_numColors = 0;
+  size_t d_cols = 0, d_rows = 0;
+  std::vector<MeshStackLayer> d_layers;
+  std::vector<float> d_inputs;
+  std::vector< std::vector<float> > d_outputs;  //!< Per layer, by color then eye
+};
@@ -0,0 +1,468 @@
+/** @file
+    @brief Implementation of sphere finding in PresentPattern captures.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pattern_capture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#define MY_PI (4.0*atan(1.0))
+
+//==========================================================================
+// Image reading.
+
+// Reads the next header number, skipping whitespace and comments.
+static bool read_pnm_number(std::istream &s, size_t &value)
+{
+  int c = s.get();
+  while (s.good() && (isspace(c) || (c == '#'))) {
+    if (c == '#') {
+      while (s.good() && (c != '\n')) { c = s.get(); }
+    }
+    c = s.get();
+  }
+  if (!s.good() || !isdigit(c)) { return false; }
+  value = 0;
+  while (s.good() && isdigit(c)) {
+    value = value * 10 + (c - '0');
+    c = s.get();
+  }
+  // The single whitespace character after the last number has been
+  // consumed, so the binary samples come next.
+  return s.good() && isspace(c);
+}
+
+bool read_pnm_image(const std::string &fileName, CaptureImage &image)
+{
+  std::ifstream s(fileName.c_str(), std::ios::binary);
+  if (!s) {
+    std::cerr << "Error: Could not open " << fileName << " for reading" << std::endl;
+    return false;
+  }
+  char magic[2];
+  if (!s.read(magic, 2) || (magic[0] != 'P') || ((magic[1] != '5') && (magic[1] != '6'))) {
+    std::cerr << "Error: " << fileName << " is not a binary PGM or PPM file" << std::endl;
+    return false;
+  }
+  size_t maxValue = 0;
+  if (!read_pnm_number(s, image.width) || !read_pnm_number(s, image.height)
+      || !read_pnm_number(s, maxValue) || (image.width == 0) || (image.height == 0)
+      || (maxValue == 0) || (maxValue > 65535)) {
+    std::cerr << "Error: Bad header in " << fileName << std::endl;
+    return false;
+  }
+  image.channels = (magic[1] == '5') ? 1 : 3;
+
+  size_t count = image.width * image.height * image.channels;
+  size_t bytesPerSample = (maxValue > 255) ? 2 : 1;
+  std::vector<unsigned char> raw(count * bytesPerSample);
+  if (!s.read(reinterpret_cast<char *>(raw.data()), raw.size())) {
+    std::cerr << "Error: " << fileName << " is truncated" << std::endl;
+    return false;
+  }
+  image.samples.resize(count);
+  float scale = 1.0f / maxValue;
+  for (size_t i = 0; i < count; i++) {
+    // 16-bit samples are big-endian.
+    unsigned value = (bytesPerSample == 2) ? ((raw[2 * i] << 8) | raw[2 * i + 1]) : raw[i];
+    image.samples[i] = value * scale;
+  }
+  return true;
+}
+
+//==========================================================================
+// Blob detection.  Each band of rows is scanned in parallel into runs
+// of bright pixels, with the brightness moments of each run.  The runs
+// are then joined into regions with a union-find pass, which only
+// touches the runs and so is cheap next to the scan.
+
+namespace {
+  struct Run {
+    size_t row;
+    size_t x0, x1;      //!< First and last pixel, inclusive
+    double weight, wx, wy;
+  };
+
+  class DisjointSets {
+  public:
+    explicit DisjointSets(size_t n) : d_parent(n)
+    {
+      for (size_t i = 0; i < n; i++) { d_parent[i] = i; }
+    }
+    size_t find(size_t i)
+    {
+      while (d_parent[i] != i) {
+        d_parent[i] = d_parent[d_parent[i]];
+        i = d_parent[i];
+      }
+      return i;
+    }
+    void join(size_t a, size_t b)
+    {
+      a = find(a);
+      b = find(b);
+      if (a != b) { d_parent[std::max(a, b)] = std::min(a, b); }
+    }
+  private:
+    std::vector<size_t> d_parent;
+  };
+}
+
+static float brightest_channel(const CaptureImage &image, size_t x, size_t y)
+{
+  float value = image.at(x, y, 0);
+  for (size_t c = 1; c < image.channels; c++) {
+    value = std::max(value, image.at(x, y, c));
+  }
+  return value;
+}
+
+// Splits the rows into bands, a few per thread so that they balance.
+static size_t band_count(const CaptureImage &image, TaskPool &pool)
+{
+  return std::max<size_t>(1, std::min(image.height, 4 * static_cast<size_t>(pool.size())));
+}
+
+float image_peak(const CaptureImage &image, TaskPool &pool)
+{
+  size_t bands = band_count(image, pool);
+  std::vector<float> peaks(bands, 0.0f);
+  pool.parallel_for(bands, [&](size_t b) {
+    for (size_t y = b * image.height / bands; y < (b + 1) * image.height / bands; y++) {
+      for (size_t x = 0; x < image.width; x++) {
+        peaks[b] = std::max(peaks[b], brightest_channel(image, x, y));
+      }
+    }
+  });
+  return *std::max_element(peaks.begin(), peaks.end());
+}
+
+bool detect_blobs(const CaptureImage &image, float threshold,
+  size_t minArea, TaskPool &pool, std::vector<Blob> &blobs)
+{
+  blobs.clear();
+  if ((image.width == 0) || (image.height == 0)) {
+    std::cerr << "Error: detect_blobs(): Empty image" << std::endl;
+    return false;
+  }
+
+  size_t bands = band_count(image, pool);
+  std::vector< std::vector<Run> > bandRuns(bands);
+  pool.parallel_for(bands, [&](size_t b) {
+    std::vector<Run> &runs = bandRuns[b];
+    for (size_t y = b * image.height / bands; y < (b + 1) * image.height / bands; y++) {
+      bool inRun = false;
+      Run run;
+      for (size_t x = 0; x < image.width; x++) {
+        float w = brightest_channel(image, x, y) - threshold;
+        if (w > 0) {
+          if (!inRun) {
+            inRun = true;
+            run.row = y;
+            run.x0 = x;
+            run.weight = run.wx = run.wy = 0;
+          }
+          run.x1 = x;
+          run.weight += w;
+          run.wx += w * x;
+          run.wy += w * y;
+        } else if (inRun) {
+          inRun = false;
+          runs.push_back(run);
+        }
+      }
+      if (inRun) { runs.push_back(run); }
+    }
+  });
+
+  // The bands are in row order, so concatenating them keeps the runs
+  // sorted by row and then by x.
+  std::vector<Run> runs;
+  for (size_t b = 0; b < bands; b++) {
+    runs.insert(runs.end(), bandRuns[b].begin(), bandRuns[b].end());
+  }
+
+  // Join runs on adjacent rows that touch, including diagonally.
+  DisjointSets sets(runs.size());
+  size_t prevStart = 0, prevEnd = 0;    // Runs on the row above
+  size_t start = 0;
+  while (start < runs.size()) {
+    size_t end = start;
+    while ((end < runs.size()) && (runs[end].row == runs[start].row)) { end++; }
+    bool adjacent = (prevEnd > prevStart) && (runs[prevStart].row + 1 == runs[start].row);
+    if (adjacent) {
+      size_t p = prevStart;
+      for (size_t r = start; r < end; r++) {
+        // Skip runs above that end before this one starts.
+        while ((p < prevEnd) && (runs[p].x1 + 1 < runs[r].x0)) { p++; }
+        for (size_t q = p; (q < prevEnd) && (runs[q].x0 <= runs[r].x1 + 1); q++) {
+          sets.join(q, r);
+        }
+      }
+    }
+    prevStart = start;
+    prevEnd = end;
+    start = end;
+  }
+
+  // Sum the moments of each region, noting the ones that touch the
+  // border.
+  std::map<size_t, std::pair<Blob, bool> > regions;
+  for (size_t r = 0; r < runs.size(); r++) {
+    std::pair<Blob, bool> &region = regions[sets.find(r)];
+    const Run &run = runs[r];
+    region.first.weight += run.weight;
+    region.first.x += run.wx;
+    region.first.y += run.wy;
+    region.first.area += run.x1 - run.x0 + 1;
+    if ((run.row == 0) || (run.row + 1 == image.height)
+        || (run.x0 == 0) || (run.x1 + 1 == image.width)) {
+      region.second = true;
+    }
+  }
+  for (std::map<size_t, std::pair<Blob, bool> >::iterator i = regions.begin();
+       i != regions.end(); ++i) {
+    Blob blob = i->second.first;
+    if (i->second.second || (blob.area < minArea) || (blob.weight <= 0)) { continue; }
+    blob.x /= blob.weight;
+    blob.y /= blob.weight;
+    blobs.push_back(blob);
+  }
+  return true;
+}
+
+//==========================================================================
+// Grid labeling.
+
+static double distance2(double x0, double y0, double x1, double y1)
+{
+  return (x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0);
+}
+
+// Index of the blob nearest (x, y) other than skip and accepted by
+// usable, or -1 if there is none.
+template <class Usable>
+static int nearest_blob(const std::vector<Blob> &blobs, double x, double y,
+  int skip, Usable usable)
+{
+  int best = -1;
+  double bestDist2 = 0;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    if ((static_cast<int>(i) == skip) || !usable(i)) { continue; }
+    double d2 = distance2(x, y, blobs[i].x, blobs[i].y);
+    if ((best < 0) || (d2 < bestDist2)) {
+      best = static_cast<int>(i);
+      bestDist2 = d2;
+    }
+  }
+  return best;
+}
+
+bool label_pattern_grid(const std::vector<Blob> &blobs,
+  std::vector<PatternSpot> &spots)
+{
+  spots.clear();
+  if (blobs.size() < 3) {
+    std::cerr << "Error: label_pattern_grid(): Only " << blobs.size()
+      << " blobs found" << std::endl;
+    return false;
+  }
+
+  // The markers are a quarter the area of the spheres, which are
+  // their nearest neighbors.  Spheres are near other spheres (or the
+  // markers), which are never much smaller than they are.  Spheres cut
+  // off by the edge of the lens can also look like this, so candidates
+  // are sorted out below.
+  std::vector<bool> isMarker(blobs.size(), false);
+  std::vector<int> markers;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    int n = nearest_blob(blobs, blobs[i].x, blobs[i].y, static_cast<int>(i),
+      [](size_t) { return true; });
+    if (2 * blobs[i].area < blobs[n].area) {
+      isMarker[i] = true;
+      markers.push_back(static_cast<int>(i));
+    }
+  }
+  std::function<bool(size_t)> isSphere = [&](size_t i) { return !isMarker[i]; };
+
+  // Each marker sits halfway between two spheres, and the origin is the
+  // sphere next to both of them.  If more than one pair of candidates
+  // fits, the pair nearest the middle of the pattern wins.
+  double middleX = 0, middleY = 0;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    middleX += blobs[i].x / blobs.size();
+    middleY += blobs[i].y / blobs.size();
+  }
+  std::vector< std::pair<int, int> > neighbors;
+  for (size_t m = 0; m < markers.size(); m++) {
+    const Blob &marker = blobs[markers[m]];
+    int a = nearest_blob(blobs, marker.x, marker.y, -1, isSphere);
+    int b = nearest_blob(blobs, marker.x, marker.y, a, isSphere);
+    neighbors.push_back(std::make_pair(a, b));
+  }
+  int origin = -1;
+  int pair[2] = { -1, -1 };
+  double bestDist2 = 0;
+  for (size_t m0 = 0; m0 < markers.size(); m0++) {
+    for (size_t m1 = m0 + 1; m1 < markers.size(); m1++) {
+      int shared = -1;
+      int a[2] = { neighbors[m0].first, neighbors[m0].second };
+      int b[2] = { neighbors[m1].first, neighbors[m1].second };
+      for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; j < 2; j++) {
+          if ((a[i] >= 0) && (a[i] == b[j])) { shared = a[i]; }
+        }
+      }
+      if (shared < 0) { continue; }
+      double d2 = distance2(middleX, middleY, blobs[shared].x, blobs[shared].y);
+      if ((origin < 0) || (d2 < bestDist2)) {
+        origin = shared;
+        pair[0] = markers[m0];
+        pair[1] = markers[m1];
+        bestDist2 = d2;
+      }
+    }
+  }
+  if (origin < 0) {
+    std::cerr << "Error: label_pattern_grid(): Could not find the axis markers ("
+      << markers.size() << " candidates)" << std::endl;
+    return false;
+  }
+
+  // The X marker is the one more to the side of the origin in the image
+  // (the camera is assumed not to be rolled more than 45 degrees).  Each
+  // grid step is twice the offset to its marker.
+  const Blob &o = blobs[origin];
+  double step[2][2];
+  for (size_t m = 0; m < 2; m++) {
+    step[m][0] = 2 * (blobs[pair[m]].x - o.x);
+    step[m][1] = 2 * (blobs[pair[m]].y - o.y);
+  }
+  if (fabs(step[0][0]) < fabs(step[1][0])) {
+    std::swap(step[0][0], step[1][0]);
+    std::swap(step[0][1], step[1][1]);
+  }
+
+  // Step out from the origin one neighbor at a time.  Each sphere keeps
+  // the grid steps measured on the way to it, so that predictions follow
+  // the distortion.  A sphere must be within a third of a step of where
+  // it was predicted and about the size of its neighbor; much larger or
+  // smaller blobs are spheres run together or cut off, whose centroids
+  // are off.
+  struct Found {
+    int blob;
+    double colStep[2], rowStep[2];
+  };
+  std::map<std::pair<int, int>, Found> grid;
+  std::vector<bool> used(blobs.size(), false);
+  std::deque< std::pair<int, int> > queue;
+  Found first = { origin, { step[0][0], step[0][1] }, { step[1][0], step[1][1] } };
+  grid[std::make_pair(0, 0)] = first;
+  used[origin] = true;
+  queue.push_back(std::make_pair(0, 0));
+  std::function<bool(size_t)> isFree = [&](size_t i) { return !isMarker[i] && !used[i]; };
+  while (!queue.empty()) {
+    std::pair<int, int> at = queue.front();
+    queue.pop_front();
+    Found here = grid[at];
+    const Blob &b = blobs[here.blob];
+    static const int moves[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+    for (size_t m = 0; m < 4; m++) {
+      std::pair<int, int> next(at.first + moves[m][0], at.second + moves[m][1]);
+      if (grid.count(next)) { continue; }
+      const double *s = (moves[m][0] != 0) ? here.colStep : here.rowStep;
+      double sign = moves[m][0] + moves[m][1];
+      double px = b.x + sign * s[0];
+      double py = b.y + sign * s[1];
+      int n = nearest_blob(blobs, px, py, -1, isFree);
+      if (n < 0) { continue; }
+      double reach2 = (s[0] * s[0] + s[1] * s[1]) / 9;
+      if (distance2(px, py, blobs[n].x, blobs[n].y) > reach2) { continue; }
+      if ((2 * blobs[n].area > 3 * b.area) || (3 * blobs[n].area < 2 * b.area)) { continue; }
+
+      Found found = here;
+      found.blob = n;
+      double *measured = (moves[m][0] != 0) ? found.colStep : found.rowStep;
+      measured[0] = sign * (blobs[n].x - b.x);
+      measured[1] = sign * (blobs[n].y - b.y);
+      grid[next] = found;
+      used[n] = true;
+      queue.push_back(next);
+    }
+  }
+
+  // Rows count up the display, which is towards smaller y in an upright
+  // image; the row steps found above point that way by construction.
+  for (std::map<std::pair<int, int>, Found>::const_iterator i = grid.begin();
+       i != grid.end(); ++i) {
+    PatternSpot spot;
+    spot.col = i->first.first;
+    spot.row = i->first.second;
+    spot.x = blobs[i->second.blob].x;
+    spot.y = blobs[i->second.blob].y;
+    spots.push_back(spot);
+  }
+  return true;
+}
+
+//==========================================================================
+// Camera model.
+
+CameraModel CameraModel::from_fov(size_t width, size_t height,
+  double horizontalDeg, double verticalDeg)
+{
+  CameraModel camera;
+  camera.cx = (width - 1) / 2.0;
+  camera.cy = (height - 1) / 2.0;
+  camera.fx = (width / 2.0) / tan(horizontalDeg / 2 * MY_PI / 180);
+  camera.fy = (height / 2.0) / tan(verticalDeg / 2 * MY_PI / 180);
+  return camera;
+}
+
+void CameraModel::field_angles(double x, double y, double &longitudeDeg,
+  double &latitudeDeg) const
+{
+  // Undo the camera's lens distortion by fixed-point iteration, which
+  // converges quickly for the mild distortion of measurement lenses.
+  double xd = (x - cx) / fx;
+  double yd = (y - cy) / fy;
+  double xu = xd, yu = yd;
+  for (int i = 0; i < 10; i++) {
+    double r2 = xu * xu + yu * yu;
+    double scale = 1 + r2 * (k1 + r2 * k2);
+    xu = xd / scale;
+    yu = yd / scale;
+  }
+
+  // Field angles are the tilts of the planes through the ray; image y
+  // is down but latitude is positive up.
+  longitudeDeg = atan(xu) * 180 / MY_PI;
+  latitudeDeg = atan(-yu) * 180 / MY_PI;
+}
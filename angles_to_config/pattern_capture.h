@@ -0,0 +1,118 @@
+/** @file
+    @brief Finding the PresentPattern spheres in camera captures of a
+           display, and converting them to view angles.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "threads.h"
+
+#include <string>
+#include <vector>
+
+/// A camera image with its samples scaled to [0,1].  Row 0 is the top
+/// of the image and channels are interleaved within each pixel.
+struct CaptureImage {
+  size_t width = 0;
+  size_t height = 0;
+  size_t channels = 0;        //!< 1 for gray, 3 for RGB
+  std::vector<float> samples;
+
+  float at(size_t x, size_t y, size_t c) const
+  {
+    return samples[(y * width + x) * channels + c];
+  }
+};
+
+/// Reads a binary PGM (P5) or PPM (P6) file with 8 or 16 bits per
+/// sample, as written by most camera raw converters.
+///   @return false (with a message on std::cerr) on failure.
+extern bool read_pnm_image(const std::string &fileName, CaptureImage &image);
+
+/// A connected bright region of an image.  Coordinates are in pixels with
+/// pixel centers at integer values, x to the right and y down.
+struct Blob {
+  double x = 0;         //!< Brightness-weighted centroid
+  double y = 0;
+  double weight = 0;    //!< Sum of brightness above the threshold
+  size_t area = 0;      //!< Number of pixels
+};
+
+/// Finds the 8-connected regions whose brightest channel is above
+/// threshold (in [0,1]) and computes their centroids, weighting each
+/// pixel by how far it is above the threshold so that the result has
+/// sub-pixel accuracy.  Regions that touch the image border, whose
+/// centroids would be biased, and those smaller than minArea pixels
+/// are dropped.  Rows are scanned in parallel bands over the pool.
+///   @return false (with a message on std::cerr) on failure.
+extern bool detect_blobs(const CaptureImage &image, float threshold,
+  size_t minArea, TaskPool &pool, std::vector<Blob> &blobs);
+
+/// Brightest value of any channel in the image.
+extern float image_peak(const CaptureImage &image, TaskPool &pool);
+
+/// One sphere of the PresentPattern grid found in an image.  Sphere
+/// (col, row) is drawn at (col, row) * spacing pixels from the center
+/// of projection, with +row up.
+struct PatternSpot {
+  int col = 0;
+  int row = 0;
+  double x = 0;         //!< Image location, as in Blob
+  double y = 0;
+};
+
+/// Works out which grid sphere each blob is.  PresentPattern draws two
+/// half-size axis markers, halfway from sphere (0, 0) towards spheres
+/// (1, 0) and (0, 1); they are found by being much smaller than their
+/// nearest neighbors and fix the origin and the initial grid steps.
+/// The rest of the grid is found by stepping outwards from neighbor to
+/// neighbor, predicting each sphere from the local grid steps, so it
+/// follows the lens distortion.  Blobs that are not near a predicted
+/// location are left out.
+///   @return false (with a message on std::cerr) if the markers could
+/// not be found.
+extern bool label_pattern_grid(const std::vector<Blob> &blobs,
+  std::vector<PatternSpot> &spots);
+
+/// Pinhole camera with two-term radial lens distortion, in the usual
+/// intrinsics convention (pixel centers at integer coordinates).
+struct CameraModel {
+  double fx = 0;        //!< Focal length in pixels
+  double fy = 0;
+  double cx = 0;        //!< Principal point in pixels
+  double cy = 0;
+  double k1 = 0;        //!< Radial distortion of the camera lens
+  double k2 = 0;
+
+  /// Camera whose principal point is at the image center and whose
+  /// full horizontal and vertical fields of view are as specified.
+  static CameraModel from_fov(size_t width, size_t height,
+    double horizontalDeg, double verticalDeg);
+
+  /// Field angles in degrees (as AnglesToConfig reads them, positive
+  /// right and up) of the ray through image location (x, y).  The
+  /// camera is assumed to be at the eye looking along the forward-gaze
+  /// direction.
+  void field_angles(double x, double y, double &longitudeDeg,
+    double &latitudeDeg) const;
+};
@@ -0,0 +1,217 @@
+/** @file
+    @brief Implementation of the -profile timers and trace writer.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+Profiler *Profiler::s_active = nullptr;
+
+size_t peak_memory_bytes()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);          // Bytes
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;   // Kilobytes
+#endif
+#endif
+}
+
+static double microseconds(Profiler::Clock::duration d)
+{
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+static double mebibytes(size_t bytes)
+{
+  return bytes / (1024.0 * 1024.0);
+}
+
+void Profiler::clear()
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  d_events.clear();
+  d_threads.clear();
+  d_origin = Clock::now();
+}
+
+void Profiler::record(Event &event, Clock::time_point start, Clock::time_point end)
+{
+  event.startMicroseconds = microseconds(start - d_origin);
+  event.durationMicroseconds = microseconds(end - start);
+  event.peakBytes = peak_memory_bytes();
+
+  std::lock_guard<std::mutex> lock(d_mutex);
+  std::thread::id id = std::this_thread::get_id();
+  size_t t = std::find(d_threads.begin(), d_threads.end(), id) - d_threads.begin();
+  if (t == d_threads.size()) { d_threads.push_back(id); }
+  event.thread = static_cast<unsigned>(t);
+  d_events.push_back(std::move(event));
+}
+
+void Profiler::report(std::ostream &out) const
+{
+  // Totals for each stage, in the order they first finished.
+  struct Total {
+    const char *name;
+    size_t calls = 0;
+    double microseconds = 0;
+    std::vector<std::pair<const char *, double> > counts;
+  };
+  std::vector<Total> totals;
+  double wall = microseconds(Clock::now() - d_origin);
+  {
+    std::lock_guard<std::mutex> lock(d_mutex);
+    for (size_t i = 0; i < d_events.size(); i++) {
+      const Event &e = d_events[i];
+      size_t t = 0;
+      while ((t < totals.size()) && (std::string(totals[t].name) != e.name)) { t++; }
+      if (t == totals.size()) {
+        totals.push_back(Total());
+        totals[t].name = e.name;
+      }
+      Total &total = totals[t];
+      total.calls++;
+      total.microseconds += e.durationMicroseconds;
+      for (size_t c = 0; c < e.counts.size(); c++) {
+        size_t k = 0;
+        while ((k < total.counts.size()) &&
+               (std::string(total.counts[k].first) != e.counts[c].first)) {
+          k++;
+        }
+        if (k == total.counts.size()) {
+          total.counts.push_back(std::make_pair(e.counts[c].first, 0.0));
+        }
+        total.counts[k].second += e.counts[c].second;
+      }
+    }
+  }
+
+  std::ostringstream s;
+  s << "Profile: " << std::fixed << std::setprecision(3) << wall / 1000
+    << " ms wall time; stage times are summed over threads" << std::endl;
+  for (size_t t = 0; t < totals.size(); t++) {
+    const Total &total = totals[t];
+    s << "  " << std::left << std::setw(20) << total.name << std::right
+      << std::setw(12) << total.microseconds / 1000 << " ms"
+      << std::setw(6) << total.calls << (total.calls == 1 ? " call" : " calls");
+    if ((total.calls == 1) && !total.counts.empty()) { s << " "; }
+    for (size_t c = 0; c < total.counts.size(); c++) {
+      s << "  " << total.counts[c].first << " " << std::setprecision(0)
+        << total.counts[c].second << std::setprecision(3);
+    }
+    s << std::endl;
+  }
+  s << "  peak memory " << std::setprecision(1) << mebibytes(peak_memory_bytes())
+    << " MiB" << std::endl;
+  out << s.str();
+}
+
+// Writes the string as a Json string, with quotes.
+static void write_json_string(std::ostream &out, const std::string &s)
+{
+  out << '"';
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if ((c == '"') || (c == '\\')) {
+      out << '\\' << s[i];
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+        << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      out << s[i];
+    }
+  }
+  out << '"';
+}
+
+bool Profiler::writeTrace(const std::string &fileName) const
+{
+  std::ofstream out(fileName.c_str());
+  if (!out) {
+    std::cerr << "Profiler::writeTrace(): Error: Could not open " << fileName
+      << " for writing" << std::endl;
+    return false;
+  }
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  std::lock_guard<std::mutex> lock(d_mutex);
+  for (size_t t = 0; t < d_threads.size(); t++) {
+    out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+      << ", \"args\": {\"name\": \"thread " << t << "\"}},\n";
+  }
+  for (size_t i = 0; i < d_events.size(); i++) {
+    const Event &e = d_events[i];
+    out << "{\"name\": ";
+    write_json_string(out, e.name);
+    out << ", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+      << ", \"ts\": " << e.startMicroseconds
+      << ", \"dur\": " << e.durationMicroseconds << ", \"args\": {";
+    const char *separator = "";
+    if (!e.detail.empty()) {
+      out << "\"detail\": ";
+      write_json_string(out, e.detail);
+      separator = ", ";
+    }
+    for (size_t c = 0; c < e.counts.size(); c++) {
+      out << separator;
+      write_json_string(out, e.counts[c].first);
+      out << ": " << std::setprecision(0) << e.counts[c].second << std::setprecision(3);
+      separator = ", ";
+    }
+    out << "}},\n";
+    out << "{\"name\": \"peak memory\", \"ph\": \"C\", \"pid\": 1, \"ts\": "
+      << e.startMicroseconds + e.durationMicroseconds
+      << ", \"args\": {\"MiB\": " << mebibytes(e.peakBytes) << "}}"
+      << ((i + 1 < d_events.size()) ? ",\n" : "\n");
+  }
+  out << "]}\n";
+  out.close();
+  if (out.fail()) {
+    std::cerr << "Profiler::writeTrace(): Error: Could not write " << fileName
+      << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,126 @@
+/** @file
+    @brief Per-stage timers and counts for -profile, written as a summary
+           and as a Chrome trace-event file.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Peak resident memory of the process so far, in bytes, or 0 where
+/// the system does not tell us.
+extern size_t peak_memory_bytes();
+
+/// Collects the stages timed by ProfileScope while it is the active
+/// profiler.  Stages may finish on any thread; each is recorded with the
+/// thread it ran on and the peak memory when it finished.
+class Profiler {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Event {
+    const char *name;                 //!< Stage, a string literal
+    std::string detail;               //!< Which color, eye or file
+    double startMicroseconds;         //!< From when the profiler started
+    double durationMicroseconds;
+    unsigned thread;                  //!< 0 is the first thread seen
+    size_t peakBytes;
+    std::vector<std::pair<const char *, double> > counts;
+  };
+
+  Profiler() : d_origin(Clock::now()) { }
+
+  /// Makes this the profiler that ProfileScope records into, or turns
+  /// recording off with nullptr.  Set it before starting any work.
+  static void setActive(Profiler *profiler) { s_active = profiler; }
+  static Profiler *active() { return s_active; }
+
+  /// Forgets the events so far and restarts the clock.
+  void clear();
+
+  void record(Event &event, Clock::time_point start, Clock::time_point end);
+
+  /// Prints the wall time, the total time, calls and counts for each
+  /// stage in the order they first finished, and the peak memory.
+  void report(std::ostream &out) const;
+
+  /// Writes the events as a Chrome trace-event file, which can be
+  /// loaded into chrome://tracing or https://ui.perfetto.dev, with each
+  /// stage's counts as its arguments and the peak memory as a counter.
+  ///   @return false (with a message on std::cerr) on error.
+  bool writeTrace(const std::string &fileName) const;
+
+private:
+  static Profiler *s_active;
+
+  mutable std::mutex d_mutex;
+  Clock::time_point d_origin;
+  std::vector<Event> d_events;
+  std::vector<std::thread::id> d_threads;
+};
+
+/// Times the scope it is declared in as one stage for the active
+/// profiler, if there is one.  Without one, it only tests a pointer.
+class ProfileScope {
+public:
+  ProfileScope(const char *name, const std::string &detail = std::string())
+    : d_profiler(Profiler::active())
+  {
+    if (d_profiler) {
+      d_event.name = name;
+      d_event.detail = detail;
+      d_start = Profiler::Clock::now();
+    }
+  }
+
+  ~ProfileScope() { end(); }
+
+  /// Ends the stage before the scope does.
+  void end()
+  {
+    if (d_profiler) {
+      d_profiler->record(d_event, d_start, Profiler::Clock::now());
+      d_profiler = nullptr;
+    }
+  }
+
+  /// Adds a count, such as the number of points removed, to the stage.
+  void count(const char *key, double value)
+  {
+    if (d_profiler) { d_event.counts.push_back(std::make_pair(key, value)); }
+  }
+
+private:
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+  Profiler *d_profiler;
+  Profiler::Event d_event;
+  Profiler::Clock::time_point d_start;
+};
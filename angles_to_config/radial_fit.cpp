@@ -0,0 +1,433 @@
+/** @file
+    @brief Implementation of the radial distortion fit.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "radial_fit.h"
+#include "point_transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+void RadialModel::apply(double tx, double ty, double width, double &sx, double &sy) const
+{
+  double a = scaleX * tx;
+  double b = scaleY * ty;
+  double q = (a * a + b * b) / (width * width);
+  double d = 1, qi = 1;
+  for (size_t i = 0; i < k.size(); i++) {
+    qi *= q;
+    d -= k[i] * qi;
+  }
+  sx = copX + d * a;
+  sy = copY + d * b;
+}
+
+//====================================================================
+// The parameters of all colors are solved together so that they can
+// share a center of projection.  Each color has local parameters
+// (copX, copY, scaleX, scaleY, K1..Kn), which are mapped to places in
+// the global parameter vector, or to -1 if they are held fixed.
+
+namespace {
+
+  class Problem {
+  public:
+    Problem(const std::vector< std::vector<RadialSample> > &samples,
+        const RadialFitOptions &options)
+      : d_samples(samples), d_options(options)
+    {
+      d_numLocal = 4 + options.numTerms;
+      d_numParams = 0;
+      d_index.resize(samples.size());
+      for (size_t c = 0; c < samples.size(); c++) {
+        d_index[c].resize(d_numLocal);
+        for (size_t j = 0; j < d_numLocal; j++) {
+          if (j < 2) {
+            if (options.fixedCOP) {
+              d_index[c][j] = -1;
+            } else if (options.sharedCOP && (c > 0)) {
+              d_index[c][j] = d_index[0][j];
+            } else {
+              d_index[c][j] = static_cast<int>(d_numParams++);
+            }
+          } else {
+            d_index[c][j] = static_cast<int>(d_numParams++);
+          }
+        }
+      }
+      d_total = 0;
+      for (size_t c = 0; c < samples.size(); c++) {
+        d_starts.push_back(d_total);
+        d_total += samples[c].size();
+      }
+    }
+
+    size_t numParams() const { return d_numParams; }
+
+    void toVector(const std::vector<RadialModel> &models, std::vector<double> &params) const
+    {
+      params.assign(d_numParams, 0);
+      for (size_t c = 0; c < models.size(); c++) {
+        std::vector<double> local;
+        toLocal(models[c], local);
+        for (size_t j = 0; j < d_numLocal; j++) {
+          if (d_index[c][j] >= 0) { params[d_index[c][j]] = local[j]; }
+        }
+      }
+    }
+
+    void fromVector(const std::vector<double> &params, std::vector<RadialModel> &models) const
+    {
+      for (size_t c = 0; c < models.size(); c++) {
+        std::vector<double> local;
+        toLocal(models[c], local);
+        for (size_t j = 0; j < d_numLocal; j++) {
+          if (d_index[c][j] >= 0) { local[j] = params[d_index[c][j]]; }
+        }
+        models[c].copX = local[0];
+        models[c].copY = local[1];
+        models[c].scaleX = local[2];
+        models[c].scaleY = local[3];
+        models[c].k.assign(local.begin() + 4, local.end());
+      }
+    }
+
+    /// Finds the sum of squared residuals and, if normal is not null,
+    /// the normal equations J^T J (row-major) and J^T r.  The samples
+    /// are split into chunks that are each summed on their own thread
+    /// and then added in order, so the result does not depend on the
+    /// number of threads.
+    double evaluate(const std::vector<RadialModel> &models, TaskPool &pool,
+      std::vector<double> *normal, std::vector<double> *gradient) const
+    {
+      const size_t CHUNK = 1024;
+      size_t numChunks = (d_total + CHUNK - 1) / CHUNK;
+      size_t n = d_numParams;
+      bool wantNormal = (normal != nullptr);
+      std::vector<double> costs(numChunks, 0);
+      std::vector< std::vector<double> > normals(wantNormal ? numChunks : 0);
+      std::vector< std::vector<double> > gradients(wantNormal ? numChunks : 0);
+      pool.parallel_for(numChunks, [&](size_t chunk) {
+        std::vector<double> jx(d_numLocal), jy(d_numLocal);
+        if (wantNormal) {
+          normals[chunk].assign(n * n, 0);
+          gradients[chunk].assign(n, 0);
+        }
+        size_t end = std::min(d_total, (chunk + 1) * CHUNK);
+        for (size_t s = chunk * CHUNK; s < end; s++) {
+          size_t c = std::upper_bound(d_starts.begin(), d_starts.end(), s) - d_starts.begin() - 1;
+          const RadialSample &sample = d_samples[c][s - d_starts[c]];
+          double ex, ey;
+          residual(models[c], sample, ex, ey, wantNormal ? &jx[0] : nullptr,
+            wantNormal ? &jy[0] : nullptr);
+          costs[chunk] += ex * ex + ey * ey;
+          if (!wantNormal) { continue; }
+          const std::vector<int> &index = d_index[c];
+          for (size_t a = 0; a < d_numLocal; a++) {
+            if (index[a] < 0) { continue; }
+            double *row = &normals[chunk][index[a] * n];
+            for (size_t b = 0; b < d_numLocal; b++) {
+              if (index[b] < 0) { continue; }
+              row[index[b]] += jx[a] * jx[b] + jy[a] * jy[b];
+            }
+            gradients[chunk][index[a]] += jx[a] * ex + jy[a] * ey;
+          }
+        }
+      });
+      double cost = 0;
+      if (wantNormal) {
+        normal->assign(n * n, 0);
+        gradient->assign(n, 0);
+      }
+      for (size_t chunk = 0; chunk < numChunks; chunk++) {
+        cost += costs[chunk];
+        if (!wantNormal) { continue; }
+        for (size_t i = 0; i < n * n; i++) { (*normal)[i] += normals[chunk][i]; }
+        for (size_t i = 0; i < n; i++) { (*gradient)[i] += gradients[chunk][i]; }
+      }
+      return cost;
+    }
+
+    /// Residual (model - measured) for one sample, and its derivatives
+    /// with respect to the local parameters if jx and jy are not null.
+    void residual(const RadialModel &m, const RadialSample &s, double &ex, double &ey,
+      double *jx, double *jy) const
+    {
+      double w2 = d_options.width * d_options.width;
+      double a = m.scaleX * s.tx;
+      double b = m.scaleY * s.ty;
+      double q = (a * a + b * b) / w2;
+      double d = 1, dq = 0, qi = 1;
+      for (size_t i = 0; i < m.k.size(); i++) {
+        dq -= (i + 1) * m.k[i] * qi;      // d(d)/dq uses q^i before it is advanced
+        qi *= q;
+        d -= m.k[i] * qi;
+      }
+      ex = m.copX + d * a - s.sx;
+      ey = m.copY + d * b - s.sy;
+      if (jx == nullptr) { return; }
+
+      double dqdx = 2 * a * s.tx / w2;
+      double dqdy = 2 * b * s.ty / w2;
+      jx[0] = 1; jy[0] = 0;
+      jx[1] = 0; jy[1] = 1;
+      jx[2] = d * s.tx + a * dq * dqdx;
+      jy[2] = b * dq * dqdx;
+      jx[3] = a * dq * dqdy;
+      jy[3] = d * s.ty + b * dq * dqdy;
+      qi = 1;
+      for (size_t i = 0; i < m.k.size(); i++) {
+        qi *= q;
+        jx[4 + i] = -qi * a;
+        jy[4 + i] = -qi * b;
+      }
+    }
+
+  private:
+    void toLocal(const RadialModel &m, std::vector<double> &local) const
+    {
+      local.assign(d_numLocal, 0);
+      local[0] = m.copX;
+      local[1] = m.copY;
+      local[2] = m.scaleX;
+      local[3] = m.scaleY;
+      for (size_t i = 0; (i < m.k.size()) && (4 + i < d_numLocal); i++) {
+        local[4 + i] = m.k[i];
+      }
+    }
+
+    const std::vector< std::vector<RadialSample> > &d_samples;
+    const RadialFitOptions &d_options;
+    size_t d_numLocal;
+    size_t d_numParams;
+    std::vector< std::vector<int> > d_index;
+    std::vector<size_t> d_starts;     //!< First flattened sample of each color
+    size_t d_total;
+  };
+
+  /// Solves the symmetric positive-definite system A x = b in place by
+  /// Cholesky decomposition.
+  ///   @return false if A is not positive definite.
+  bool solve_spd(std::vector<double> &A, std::vector<double> &b, size_t n)
+  {
+    for (size_t j = 0; j < n; j++) {
+      double diag = A[j * n + j];
+      for (size_t k = 0; k < j; k++) { diag -= A[j * n + k] * A[j * n + k]; }
+      if (!(diag > 0)) { return false; }
+      diag = sqrt(diag);
+      A[j * n + j] = diag;
+      for (size_t i = j + 1; i < n; i++) {
+        double v = A[i * n + j];
+        for (size_t k = 0; k < j; k++) { v -= A[i * n + k] * A[j * n + k]; }
+        A[i * n + j] = v / diag;
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      for (size_t k = 0; k < i; k++) { b[i] -= A[i * n + k] * b[k]; }
+      b[i] /= A[i * n + i];
+    }
+    for (size_t i = n; i-- > 0; ) {
+      for (size_t k = i + 1; k < n; k++) { b[i] -= A[k * n + i] * b[k]; }
+      b[i] /= A[i * n + i];
+    }
+    return true;
+  }
+
+  /// Least-squares line s = c + f t, or only f if the center is fixed.
+  bool fit_line(const std::vector<RadialSample> &samples, bool useX, bool fixedCenter,
+    double &center, double &scale)
+  {
+    double st = 0, ss = 0, stt = 0, sts = 0;
+    size_t n = samples.size();
+    for (size_t i = 0; i < n; i++) {
+      double t = useX ? samples[i].tx : samples[i].ty;
+      double s = useX ? samples[i].sx : samples[i].sy;
+      if (fixedCenter) { s -= center; }
+      st += t; ss += s; stt += t * t; sts += t * s;
+    }
+    if (fixedCenter) {
+      if (stt <= 0) { return false; }
+      scale = sts / stt;
+      return true;
+    }
+    double det = n * stt - st * st;
+    if (!(fabs(det) > 0)) { return false; }
+    scale = (n * sts - st * ss) / det;
+    center = (ss - scale * st) / n;
+    return true;
+  }
+}
+
+// Runs each measured screen point back through the inverse of the
+// model, over the range of radii the samples cover, and finds the angle
+// between the ray that gives and the one that was measured.
+static void measure_angles(const RadialModel &m,
+  const std::vector<RadialSample> &samples, double width, RadialFitResult &result)
+{
+  // The model moves radius r to r - K1 r^3 - K2 r^5 - ...
+  std::vector<double> coefficients(2 + 2 * m.k.size(), 0);
+  coefficients[1] = 1;
+  for (size_t i = 0; i < m.k.size(); i++) {
+    coefficients[3 + 2 * i] = -m.k[i];
+  }
+  double maxRadius = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    maxRadius = std::max(maxRadius, sqrt(pow(m.scaleX * samples[i].tx, 2) +
+      pow(m.scaleY * samples[i].ty, 2)) / width);
+  }
+  RadialInverse inverse;
+  if (!inverse.build(coefficients, maxRadius)) { return; }
+  if (inverse.maxRadius() < maxRadius) {
+    result.foldRadius = inverse.maxRadius();
+  }
+
+  // Undistort all of the points at once, in units of the width.
+  std::vector<double> x(samples.size()), y(samples.size());
+  for (size_t i = 0; i < samples.size(); i++) {
+    x[i] = samples[i].sx / width;
+    y[i] = samples[i].sy / width;
+  }
+  double copX = m.copX / width;
+  double copY = m.copY / width;
+  inverse.undistortPoints(x.data(), y.data(), samples.size(), copX, copY,
+    x.data(), y.data());
+
+  static const double RADIANS_TO_DEGREES = 180 / (4 * atan(1.0));
+  double sum = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    const RadialSample &s = samples[i];
+    double tx = (x[i] - copX) * width / m.scaleX;
+    double ty = (y[i] - copY) * width / m.scaleY;
+
+    // Angle between (tx, ty, -1) and (s.tx, s.ty, -1)
+    double cx = ty - s.ty;
+    double cy = s.tx - tx;
+    double cz = tx * s.ty - ty * s.tx;
+    double dot = tx * s.tx + ty * s.ty + 1;
+    double degrees = atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * RADIANS_TO_DEGREES;
+    sum += degrees * degrees;
+    result.maxDegrees = std::max(result.maxDegrees, degrees);
+  }
+  result.rmsDegrees = sqrt(sum / samples.size());
+}
+
+bool fit_radial_models(const std::vector< std::vector<RadialSample> > &samples,
+  const RadialFitOptions &options, TaskPool &pool,
+  std::vector<RadialModel> &models, std::vector<RadialFitResult> &results)
+{
+  if ((options.numTerms < 1) || (options.numTerms > 6)) {
+    std::cerr << "Error: fit_radial_models(): " << options.numTerms
+      << " terms requested, 1 through 6 are supported" << std::endl;
+    return false;
+  }
+  models.resize(samples.size());
+  results.assign(samples.size(), RadialFitResult());
+
+  //====================================================================
+  // Start from the best distortion-free model for each color.
+  double copX = 0, copY = 0;
+  for (size_t c = 0; c < samples.size(); c++) {
+    if (samples[c].size() < 4 + options.numTerms) {
+      std::cerr << "Error: fit_radial_models(): only " << samples[c].size()
+        << " samples for color " << c << std::endl;
+      return false;
+    }
+    RadialModel &m = models[c];
+    m.k.assign(options.numTerms, 0);
+    if (!fit_line(samples[c], true, options.fixedCOP, m.copX, m.scaleX) ||
+        !fit_line(samples[c], false, options.fixedCOP, m.copY, m.scaleY)) {
+      std::cerr << "Error: fit_radial_models(): samples for color " << c
+        << " do not span the field of view" << std::endl;
+      return false;
+    }
+    copX += m.copX / samples.size();
+    copY += m.copY / samples.size();
+  }
+  if (options.sharedCOP && !options.fixedCOP) {
+    for (size_t c = 0; c < models.size(); c++) {
+      models[c].copX = copX;
+      models[c].copY = copY;
+    }
+  }
+
+  //====================================================================
+  // Levenberg-Marquardt, with the damping scaled by the diagonal of
+  // J^T J so that parameters in pixels and unitless K terms are treated
+  // alike.
+  Problem problem(samples, options);
+  size_t n = problem.numParams();
+  std::vector<double> params, normal, gradient;
+  problem.toVector(models, params);
+  double cost = problem.evaluate(models, pool, &normal, &gradient);
+  double lambda = 1e-3;
+  int iteration = 0;
+  bool converged = false;
+  std::vector<RadialModel> trial = models;
+  while ((iteration < options.maxIterations) && !converged) {
+    iteration++;
+    std::vector<double> A = normal;
+    std::vector<double> step(n);
+    for (size_t i = 0; i < n; i++) {
+      A[i * n + i] += lambda * std::max(normal[i * n + i], 1e-12);
+      step[i] = -gradient[i];
+    }
+    if (!solve_spd(A, step, n)) {
+      lambda *= 10;
+      continue;
+    }
+    std::vector<double> next(n);
+    for (size_t i = 0; i < n; i++) { next[i] = params[i] + step[i]; }
+    problem.fromVector(next, trial);
+    double nextCost = problem.evaluate(trial, pool, nullptr, nullptr);
+    if (nextCost < cost) {
+      converged = (cost - nextCost) <= 1e-12 * cost;
+      params.swap(next);
+      models = trial;
+      cost = problem.evaluate(models, pool, &normal, &gradient);
+      lambda = std::max(lambda / 10, 1e-12);
+    } else {
+      // No step in this direction helps any more, so we are at the bottom.
+      lambda *= 10;
+      converged = (lambda > 1e12);
+    }
+  }
+
+  //====================================================================
+  // Report how well each color fits.
+  for (size_t c = 0; c < samples.size(); c++) {
+    double sum = 0;
+    for (size_t i = 0; i < samples[c].size(); i++) {
+      double ex, ey;
+      problem.residual(models[c], samples[c][i], ex, ey, nullptr, nullptr);
+      double e2 = ex * ex + ey * ey;
+      sum += e2;
+      results[c].maxPixels = std::max(results[c].maxPixels, sqrt(e2));
+    }
+    results[c].rmsPixels = sqrt(sum / samples[c].size());
+    measure_angles(models[c], samples[c], options.width, results[c]);
+    results[c].iterations = iteration;
+    results[c].converged = converged;
+  }
+  return true;
+}
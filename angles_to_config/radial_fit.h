@@ -0,0 +1,87 @@
+/** @file
+    @brief Levenberg-Marquardt fit of the calibration program's radial
+           distortion model to measured angle tables.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "threads.h"
+
+#include <vector>
+
+/// One measured point: the ray whose tangents (x/-z, y/-z in eye space)
+/// are (tx, ty) is seen at screen pixel (sx, sy).
+struct RadialSample {
+  double tx, ty;
+  double sx, sy;
+};
+
+/// The calibration program's distortion for one color.  A straight line
+/// drawn at offset u (pixels) from the center of projection is moved to
+///   cop + (1 - K1 r^2 - K2 r^4 - ...) u
+/// where r is |u| divided by the window width, so that K1 has the same
+/// units as the k1_red/green/blue values in HMD_Config.json.  The lens
+/// straightens the lines when the ray through each drawn point has
+/// tangents proportional to u; u = (scaleX tx, scaleY ty).
+struct RadialModel {
+  double copX = 0, copY = 0;        //!< Pixels
+  double scaleX = 1, scaleY = 1;    //!< Pixels per unit tangent
+  std::vector<double> k;            //!< k[0] is K1
+
+  /// Screen location of the ray with tangents (tx, ty) for a window
+  /// that is width pixels wide.
+  void apply(double tx, double ty, double width, double &sx, double &sy) const;
+};
+
+struct RadialFitOptions {
+  size_t numTerms = 1;        //!< Number of K terms, 1 through 6
+  bool sharedCOP = true;      //!< One center of projection for all colors
+  bool fixedCOP = false;      //!< Keep the centers the models start with
+  double width = 1920;        //!< Window width in pixels, which scales r
+  int maxIterations = 200;
+};
+
+struct RadialFitResult {
+  int iterations = 0;
+  bool converged = false;
+  double rmsPixels = 0;       //!< Distance between measured and fit points
+  double maxPixels = 0;
+  double rmsDegrees = 0;      //!< Angle between each ray and the fit's ray
+  double maxDegrees = 0;      //!< back through its measured point
+  double foldRadius = 0;      //!< Where the fit turns back on itself within
+                              //!< the samples, in r units; 0 if it does not
+};
+
+/// Fits one model per color to that color's samples.  The scales (and,
+/// unless fixedCOP, the centers) start from a linear fit with no
+/// distortion.  Residuals and their analytic Jacobians are evaluated in
+/// parallel on the pool.  The angular errors undistort each measured
+/// point through the inverse of the fitted model, which is what a
+/// renderer predistorting with it will show.
+///   @param models On input, the centers to use if fixedCOP; on output,
+/// one fitted model per color.
+///   @return false (with a message on std::cerr) if a color has too few
+/// samples or the fit cannot start.
+extern bool fit_radial_models(const std::vector< std::vector<RadialSample> > &samples,
+  const RadialFitOptions &options, TaskPool &pool,
+  std::vector<RadialModel> &models, std::vector<RadialFitResult> &results);
@@ -0,0 +1,120 @@
+/** @file
+    @brief Checks that the border texels of a baked distortion lookup
+           texture, which lie outside the sampled region, stay bounded
+           and continuous with the texels inside it.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "lut_export.h"
+#include "test_meshes.h"
+
+// Standard includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+int main()
+{
+  MeshDescription mesh = scattered_disk_mesh(2000);
+  double minOut[2] = { 1e300, 1e300 }, maxOut[2] = { -1e300, -1e300 };
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (int j = 0; j < 2; j++) {
+      minOut[j] = std::min(minOut[j], mesh[i][1][j]);
+      maxOut[j] = std::max(maxOut[j], mesh[i][1][j]);
+    }
+  }
+
+  const size_t width = 64, height = 48;
+  TaskPool pool(2);
+  std::vector<float> texels;
+  if (!bake_distortion_lut(mesh, width, height, pool, texels)) { return 1; }
+  if (texels.size() != 3 * width * height) {
+    std::cerr << "Error: baked " << texels.size() << " floats, expected "
+      << 3 * width * height << std::endl;
+    return 1;
+  }
+  auto texel = [&](size_t c, size_t r) { return &texels[3 * (r * width + c)]; };
+
+  //====================================================================
+  // The disk of samples does not reach the edges of the texture, so
+  // every border texel is outside it.  Each must be marked so, be within
+  // the range of the samples, and step to the texel inside it no more
+  // than twice as far as any two neighboring texels inside the samples.
+  double insideStep = 0;
+  for (size_t r = 0; r + 1 < height; r++) {
+    for (size_t c = 0; c + 1 < width; c++) {
+      const float *t = texel(c, r);
+      const float *right = texel(c + 1, r);
+      const float *up = texel(c, r + 1);
+      if ((t[2] == 1) && (right[2] == 1)) {
+        insideStep = std::max(insideStep,
+          std::hypot(static_cast<double>(right[0] - t[0]),
+                     static_cast<double>(right[1] - t[1])));
+      }
+      if ((t[2] == 1) && (up[2] == 1)) {
+        insideStep = std::max(insideStep,
+          std::hypot(static_cast<double>(up[0] - t[0]),
+                     static_cast<double>(up[1] - t[1])));
+      }
+    }
+  }
+  if (insideStep == 0) {
+    std::cerr << "Error: no neighboring texels inside the samples" << std::endl;
+    return 1;
+  }
+
+  int ret = 0;
+  for (size_t r = 0; (r < height) && (ret == 0); r++) {
+    for (size_t c = 0; (c < width) && (ret == 0); c++) {
+      bool left = (c == 0), right = (c + 1 == width);
+      bool bottom = (r == 0), top = (r + 1 == height);
+      if (!left && !right && !bottom && !top) { continue; }
+      const float *t = texel(c, r);
+      const float *in = texel(left ? 1 : (right ? width - 2 : c),
+        bottom ? 1 : (top ? height - 2 : r));
+      if (t[2] != 0) {
+        std::cerr << "Error: border texel " << c << ", " << r
+          << " is marked inside the samples" << std::endl;
+        ret = 1;
+      }
+      for (int j = 0; j < 2; j++) {
+        // The texels are floats, so allow for their rounding.
+        if (!(t[j] >= minOut[j] - 1e-6) || !(t[j] <= maxOut[j] + 1e-6)) {
+          std::cerr << "Error: border texel " << c << ", " << r << " is "
+            << t[0] << ", " << t[1] << ", out of the sample range" << std::endl;
+          ret = 1;
+          break;
+        }
+      }
+      double step = std::hypot(static_cast<double>(in[0] - t[0]),
+                               static_cast<double>(in[1] - t[1]));
+      if ((ret == 0) && (step > 2 * insideStep)) {
+        std::cerr << "Error: border texel " << c << ", " << r << " steps "
+          << step << " from its neighbor, but texels inside the samples only "
+          << insideStep << std::endl;
+        ret = 1;
+      }
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,161 @@
+/** @file
+    @brief Checks, from C, that the AnglesToConfigC interface keeps its
+           warnings apart from the reasons a call failed.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mesh_generator_c.h"
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int fail(const char *what)
+{
+  fprintf(stderr, "Error: %s\nLast error: %s\n", what, a2c_last_error());
+  return 1;
+}
+
+// Reads the whole named file into a buffer that the caller frees.
+static char *read_file(const char *name, size_t *length)
+{
+  FILE *f = fopen(name, "rb");
+  char *text;
+  long size;
+  if (!f) { return NULL; }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  text = (size >= 0) ? (char *)malloc((size_t)size + 1) : NULL;
+  if (text && (fread(text, 1, (size_t)size, f) != (size_t)size)) {
+    free(text);
+    text = NULL;
+  }
+  fclose(f);
+  *length = (size_t)size;
+  return text;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *bad = "1 2 3 4\n5 six 7 8\n";
+  char *text;
+  size_t length, count = 0;
+  double *samples;
+  double *meshes;
+  A2C_Settings settings;
+  A2C_Color color;
+  A2C_Screen left, right;
+  A2C_Pool *pool;
+  int ret = 0;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s table_file\n", argv[0]);
+    return 1;
+  }
+  if (a2c_api_version() != A2C_API_VERSION) { return fail("API version mismatch"); }
+
+  //====================================================================
+  // A parse error comes back through a2c_last_error() with its line.
+  if (a2c_parse_samples(bad, strlen(bad), NULL, 0, &count) == 0) {
+    return fail("Parsed a table with a word in it");
+  }
+  if (!strstr(a2c_last_error(), "line 2") || !strstr(a2c_last_error(), "six")) {
+    return fail("Parse error does not name the line and word");
+  }
+
+  //====================================================================
+  // Parse a measured table and make its meshes with the settings used in
+  // the documentation, which put some entries off the screen.
+  text = read_file(argv[1], &length);
+  if (!text) {
+    fprintf(stderr, "Error: Could not read %s\n", argv[1]);
+    return 1;
+  }
+  a2c_parse_samples(text, length, NULL, 0, &count);
+  samples = (double *)malloc(4 * count * sizeof(double));
+  meshes = (double *)malloc(8 * count * sizeof(double));
+  if (a2c_parse_samples(text, length, samples, count, &count) != 0) {
+    return fail("Could not parse the table");
+  }
+  free(text);
+
+  a2c_default_settings(&settings);
+  settings.to_meters = 1e-3;
+  settings.compute_bounds = 0;
+  settings.left = -0.032;
+  settings.bottom = -0.03402;
+  settings.right = 0.02848;
+  settings.top = 0.03402;
+  settings.verify_angles = 1;
+  settings.xx = 1; settings.xy = 0; settings.yx = 0; settings.yy = 1;
+  settings.max_angle_diff_degrees = 80;
+
+  color.samples = samples;
+  color.sample_count = count;
+  color.left_mesh = meshes;
+  color.right_mesh = meshes + 4 * count;
+  color.mesh_capacity = count;
+  pool = a2c_create_pool(2);
+  if (!pool) { return fail("Could not create a pool"); }
+  if (a2c_generate(pool, &settings, &color, 1, &left, &right) != 0) {
+    ret = fail("Could not generate the meshes");
+  } else if (!strstr(a2c_last_warnings(), "Warning:")) {
+    ret = fail("No warnings for the entries off the screen");
+  }
+
+  //====================================================================
+  // When it fails, the error has only the reasons and the warnings are
+  // still there.
+  color.mesh_capacity = 1;
+  if (ret == 0) {
+    if (a2c_generate(pool, &settings, &color, 1, &left, &right) == 0) {
+      ret = fail("Generated meshes into buffers that were too small");
+    } else if (strstr(a2c_last_error(), "Warning:") ||
+               !strstr(a2c_last_error(), "needs room")) {
+      ret = fail("The error is not just the reason for the failure");
+    } else if (!strstr(a2c_last_warnings(), "Warning:")) {
+      ret = fail("The warnings were lost when the call failed");
+    }
+  }
+
+  //====================================================================
+  // A stage's own message about why it failed is part of the error,
+  // rather than going to standard error.
+  color.mesh_capacity = count;
+  settings.outlier_k = -1;
+  settings.outlier_passes = 1;
+  if (ret == 0) {
+    if (a2c_generate(pool, &settings, &color, 1, &left, &right) == 0) {
+      ret = fail("Generated meshes with a negative outlier k");
+    } else if (!strstr(a2c_last_error(), "remove_outliers_by_local_fit()")) {
+      ret = fail("The outlier stage's message is not in the error");
+    }
+  }
+
+  a2c_destroy_pool(pool);
+  free(samples);
+  free(meshes);
+  return ret;
+}
@@ -0,0 +1,110 @@
+/** @file
+    @brief Checks that MeshInterpolator stays bounded and continuous
+           outside the hull of scattered samples.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "mesh_interpolator.h"
+#include "test_meshes.h"
+
+// Standard includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+int main()
+{
+  MeshDescription mesh = scattered_disk_mesh(2000);
+  double minOut[2] = { 1e300, 1e300 }, maxOut[2] = { -1e300, -1e300 };
+  for (size_t i = 0; i < mesh.size(); i++) {
+    for (int j = 0; j < 2; j++) {
+      minOut[j] = std::min(minOut[j], mesh[i][1][j]);
+      maxOut[j] = std::max(maxOut[j], mesh[i][1][j]);
+    }
+  }
+
+  MeshInterpolator interp;
+  if (!interp.build(mesh)) { return 1; }
+
+  //====================================================================
+  // Sample a grid that reaches well outside the hull, as -grid does.
+  const size_t cols = 33, rows = 33;
+  std::vector<std::array<double, 2> > out(cols * rows);
+  std::vector<bool> inside(cols * rows);
+  MeshInterpolator::Hint hint;
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++) {
+      size_t i = r * cols + c;
+      inside[i] = interp.interpolate(static_cast<double>(c) / (cols - 1),
+        static_cast<double>(r) / (rows - 1), out[i], hint);
+    }
+  }
+
+  //====================================================================
+  // Points outside the hull must stay within the range of the samples,
+  // and no step to or from a grid point outside the hull may be much
+  // larger than the largest step between neighbors inside it.
+  int ret = 0;
+  size_t outside = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    if (inside[i]) { continue; }
+    outside++;
+    for (int j = 0; (j < 2) && (ret == 0); j++) {
+      if (!(out[i][j] >= minOut[j]) || !(out[i][j] <= maxOut[j])) {
+        std::cerr << "Error: grid point " << i << " outside the hull is at "
+          << out[i][0] << ", " << out[i][1] << ", out of the sample range"
+          << std::endl;
+        ret = 1;
+      }
+    }
+  }
+  if (outside == 0) {
+    std::cerr << "Error: no grid points were outside the hull" << std::endl;
+    return 1;
+  }
+
+  double insideStep = 0, outsideStep = 0;
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++) {
+      size_t i = r * cols + c;
+      size_t neighbors[2] = { i + 1, i + cols };
+      bool valid[2] = { c + 1 < cols, r + 1 < rows };
+      for (int k = 0; k < 2; k++) {
+        if (!valid[k]) { continue; }
+        size_t n = neighbors[k];
+        double step = std::hypot(out[n][0] - out[i][0], out[n][1] - out[i][1]);
+        if (inside[i] && inside[n]) {
+          insideStep = std::max(insideStep, step);
+        } else {
+          outsideStep = std::max(outsideStep, step);
+        }
+      }
+    }
+  }
+  if (outsideStep > 2 * insideStep) {
+    std::cerr << "Error: largest step outside the hull is " << outsideStep
+      << ", but only " << insideStep << " inside it" << std::endl;
+    ret = 1;
+  }
+  return ret;
+}
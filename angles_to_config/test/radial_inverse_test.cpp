@@ -0,0 +1,127 @@
+/** @file
+    @brief Checks that RadialInverse undoes its radial distortion across
+           the range it was built for, one radius or a batch of points
+           at a time.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "point_transform.h"
+
+// Standard includes
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Checks distort(undistort(rd)) against rd over the distorted range and
+// undistort(distort(r)) against r over the undistorted one, and then
+// checks undistortPoints() against undistort().
+//   @param foldRadius Where the model turns over before maxRadius, or 0.
+static int check(const char *name, const std::vector<double> &coefficients,
+  double maxRadius, double foldRadius)
+{
+  RadialInverse inverse;
+  if (!inverse.build(coefficients, maxRadius)) {
+    std::cerr << "Error: " << name << ": could not build the inverse" << std::endl;
+    return 1;
+  }
+  double expected = (foldRadius > 0) ? foldRadius : maxRadius;
+  if (std::fabs(inverse.maxRadius() - expected) > 1e-9) {
+    std::cerr << "Error: " << name << ": range ends at " << inverse.maxRadius()
+      << ", expected " << expected << std::endl;
+    return 1;
+  }
+
+  // Accuracy falls off right next to a fold, where the slope goes to 0,
+  // so leave the last bit of a folded range out.
+  double top = (foldRadius > 0) ? 0.95 * foldRadius : maxRadius;
+  const size_t steps = 10000;
+  for (size_t i = 0; i <= steps; i++) {
+    double r = top * i / steps;
+    double back = inverse.undistort(inverse.distort(r));
+    if (std::fabs(back - r) > 1e-9) {
+      std::cerr << "Error: " << name << ": undistort(distort(" << r << ")) is "
+        << back << std::endl;
+      return 1;
+    }
+    double rd = inverse.distort(top) * i / steps;
+    double forward = inverse.distort(inverse.undistort(rd));
+    if (std::fabs(forward - rd) > 1e-6) {
+      std::cerr << "Error: " << name << ": distort(undistort(" << rd << ")) is "
+        << forward << std::endl;
+      return 1;
+    }
+  }
+
+  // The batch inverse, on points around an off-center center of
+  // projection, must land on the radius undistort() gives and keep each
+  // point's direction.
+  const double copX = 0.1, copY = -0.05;
+  const size_t n = 1001;
+  std::vector<double> x(n), y(n), ux(n), uy(n);
+  for (size_t i = 0; i < n; i++) {
+    double rd = inverse.distort(top) * i / (n - 1);
+    double angle = 0.37 * i;
+    x[i] = copX + rd * cos(angle);
+    y[i] = copY + rd * sin(angle);
+  }
+  inverse.undistortPoints(x.data(), y.data(), n, copX, copY, ux.data(), uy.data());
+  for (size_t i = 0; i < n; i++) {
+    double dx = x[i] - copX, dy = y[i] - copY;
+    double rd = sqrt(dx * dx + dy * dy);
+    double r = inverse.undistort(rd);
+    double ex = copX + ((rd > 0) ? r / rd : 1) * dx;
+    double ey = copY + ((rd > 0) ? r / rd : 1) * dy;
+    if ((std::fabs(ux[i] - ex) > 1e-12) || (std::fabs(uy[i] - ey) > 1e-12)) {
+      std::cerr << "Error: " << name << ": undistortPoints() moved (" << x[i]
+        << ", " << y[i] << ") to (" << ux[i] << ", " << uy[i] << "), expected ("
+        << ex << ", " << ey << ")" << std::endl;
+      return 1;
+    }
+  }
+
+  // In place, as the outputs may be the inputs.
+  inverse.undistortPoints(x.data(), y.data(), n, copX, copY, x.data(), y.data());
+  if ((x != ux) || (y != uy)) {
+    std::cerr << "Error: " << name << ": undistortPoints() in place differs"
+      << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int ret = 0;
+
+  // The calibration program's K1 model, r - k1 r^3, with a strong K1
+  // that folds at 1 / sqrt(3 k1) inside the range.
+  double k1 = 0.6;
+  ret |= check("K1", { 0, 1, 0, -k1 }, 1.0, 1 / sqrt(3 * k1));
+
+  // The same with a weak K1, which stays increasing, plus a K2 term.
+  ret |= check("K1 and K2", { 0, 1, 0, -0.1, 0, 0.02 }, 1.0, 0);
+
+  // The xbox tuner's form, with every power present.
+  ret |= check("polynomial", { 0, 1.02, 0.05, 0.2, -0.03 }, 1.5, 0);
+  return ret;
+}
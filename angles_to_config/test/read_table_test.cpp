@@ -0,0 +1,86 @@
+/** @file
+    @brief Checks that read_from_buffer() reads every number the way
+           strtod() does in the "C" locale, on both of its paths.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "helper.h"
+
+// Standard includes
+#include <clocale>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main()
+{
+  // Short decimals take the fast path; long mantissas and exponents
+  // outside +/-22 are read by the classic-locale stream.  Each is tried
+  // with both signs.
+  const char *numbers[] = {
+    "0", "1.5", "0.000123", "12345.678901234", "3e5", "2.5E-10",
+    "1.23456789012345678901", "4.5e-30", "6.02214076e23",
+    "9007199254740993", "0.1000000000000000055511151231257827",
+    "1e-300", "1.7e308"
+  };
+  setlocale(LC_NUMERIC, "C");
+  std::vector<std::string> tokens;
+  for (const char *number : numbers) {
+    tokens.push_back(number);
+    tokens.push_back(std::string("-") + number);
+    tokens.push_back(std::string("+") + number);
+  }
+  while (tokens.size() % 4 != 0) { tokens.push_back("0"); }
+
+  std::string table;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    table += tokens[i];
+    table += (i % 4 == 3) ? "\n" : " ";
+  }
+  std::vector<Mapping> mapping;
+  if (!read_from_buffer(table.data(), table.size(), mapping, "table")) {
+    std::cerr << "Error: could not read the table" << std::endl;
+    return 1;
+  }
+  if (mapping.size() != tokens.size() / 4) {
+    std::cerr << "Error: read " << mapping.size() << " entries, expected "
+      << tokens.size() / 4 << std::endl;
+    return 1;
+  }
+
+  int ret = 0;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    // The entries are longitude, latitude, x, y.
+    const XYLatLong &entry = mapping[i / 4].xyLatLong;
+    const double read[] = { entry.longitude, entry.latitude, entry.x, entry.y };
+    double expected = strtod(tokens[i].c_str(), nullptr);
+    if (read[i % 4] != expected) {
+      std::cerr.precision(17);
+      std::cerr << "Error: '" << tokens[i] << "' read as " << read[i % 4]
+        << ", expected " << expected << std::endl;
+      ret = 1;
+    }
+  }
+  return ret;
+}
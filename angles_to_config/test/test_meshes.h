@@ -0,0 +1,57 @@
+/** @file
+    @brief Synthetic distortion meshes shared by the tests.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "types.h"
+
+#include <cmath>
+#include <stdint.h>
+
+/// A mesh of count points scattered at random (with a fixed seed) over
+/// a disk of radius 0.4 in the middle of the unit square, like the
+/// samples measured through a round lens.  The random spacing leaves
+/// thin sliver triangles along the hull.  Each point is pushed out
+/// radially by a smooth barrel distortion.
+inline MeshDescription scattered_disk_mesh(size_t count)
+{
+  MeshDescription mesh;
+  uint32_t seed = 4242;
+  while (mesh.size() < count) {
+    double p[2];
+    for (int j = 0; j < 2; j++) {
+      seed = seed * 1664525u + 1013904223u;
+      p[j] = (seed >> 8) / 16777216.0 * 0.8 - 0.4;
+    }
+    double r2 = p[0] * p[0] + p[1] * p[1];
+    if (r2 > 0.4 * 0.4) { continue; }
+    MeshDescription::value_type entry;
+    for (int j = 0; j < 2; j++) {
+      entry[0][j] = 0.5 + p[j];
+      entry[1][j] = 0.5 + p[j] * (1 + 0.8 * r2);
+    }
+    mesh.push_back(entry);
+  }
+  return mesh;
+}
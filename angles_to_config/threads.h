@@ -0,0 +1,143 @@
+/** @file
+    @brief Minimal task pool used to run independent pieces of the
+           distortion-mesh pipeline concurrently.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads that pull work from a shared queue.
+/// A pool with one thread runs everything on the calling thread, so
+/// the results are the same as a serial program.
+class TaskPool {
+public:
+  /// @param threads Number of threads to use, including the caller.
+  /// Zero selects the number of hardware threads.
+  explicit TaskPool(unsigned threads = 0)
+  {
+    if (threads == 0) { threads = default_thread_count(); }
+    d_threads = threads;
+    for (unsigned i = 1; i < threads; i++) {
+      d_workers.push_back(std::thread(&TaskPool::worker, this));
+    }
+  }
+
+  ~TaskPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_done = true;
+    }
+    d_wake.notify_all();
+    for (size_t i = 0; i < d_workers.size(); i++) {
+      d_workers[i].join();
+    }
+  }
+
+  /// Number of threads that can be working at once.
+  unsigned size() const { return d_threads; }
+
+  static unsigned default_thread_count()
+  {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+  }
+
+  /// Calls func(i) for each i in [0, count) and returns once all of
+  /// them have finished.  The calling thread runs tasks while it waits,
+  /// so this may be called from inside another task without deadlock.
+  void parallel_for(size_t count, const std::function<void(size_t)> &func)
+  {
+    if (count == 0) { return; }
+    if ((d_threads == 1) || (count == 1)) {
+      for (size_t i = 0; i < count; i++) { func(i); }
+      return;
+    }
+
+    std::atomic<size_t> remaining(count);
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      for (size_t i = 0; i < count; i++) {
+        d_queue.push_back([&func, &remaining, i, this]() {
+          func(i);
+          if (--remaining == 0) {
+            // Lock so that the waiter can't miss the notification
+            // between checking the count and going to sleep.
+            std::lock_guard<std::mutex> lock(d_mutex);
+            d_wake.notify_all();
+          }
+        });
+      }
+    }
+    d_wake.notify_all();
+
+    std::unique_lock<std::mutex> lock(d_mutex);
+    while (remaining != 0) {
+      if (!d_queue.empty()) {
+        std::function<void()> task = d_queue.front();
+        d_queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+      } else {
+        d_wake.wait(lock);
+      }
+    }
+  }
+
+private:
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  void worker()
+  {
+    std::unique_lock<std::mutex> lock(d_mutex);
+    while (true) {
+      if (!d_queue.empty()) {
+        std::function<void()> task = d_queue.front();
+        d_queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+      } else if (d_done) {
+        return;
+      } else {
+        d_wake.wait(lock);
+      }
+    }
+  }
+
+  unsigned d_threads;
+  bool d_done = false;
+  std::vector<std::thread> d_workers;
+  std::deque< std::function<void()> > d_queue;
+  std::mutex d_mutex;
+  std::condition_variable d_wake;
+};
@@ -110,6 +110,68 @@ public:
   Mapping() {};
 };
 
+/// Mappings stored with one contiguous array per field rather than one
+/// object per entry, so that each stage of the pipeline streams through
+/// only the fields that it uses.  Entry i is (x[i], y[i], latitude[i],
+/// longitude[i]) with the 3D point (px[i], py[i], pz[i]).
+class MappingSet {
+public:
+  std::vector<double> x, y;                 //!< Screen location
+  std::vector<double> latitude, longitude;
+  std::vector<double> px, py, pz;           //!< 3D coordinate
+
+  MappingSet() {}
+  explicit MappingSet(size_t n) { resize(n); }
+  explicit MappingSet(std::vector<Mapping> const &mapping) {
+    resize(mapping.size());
+    for (size_t i = 0; i < mapping.size(); i++) { set(i, mapping[i]); }
+  }
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+  void resize(size_t n) {
+    x.resize(n); y.resize(n); latitude.resize(n); longitude.resize(n);
+    px.resize(n); py.resize(n); pz.resize(n);
+  }
+
+  void set(size_t i, Mapping const &m) {
+    x[i] = m.xyLatLong.x; y[i] = m.xyLatLong.y;
+    latitude[i] = m.xyLatLong.latitude; longitude[i] = m.xyLatLong.longitude;
+    px[i] = m.xyz.x; py[i] = m.xyz.y; pz[i] = m.xyz.z;
+  }
+  Mapping get(size_t i) const {
+    return Mapping(XYLatLong(x[i], y[i], latitude[i], longitude[i]), point(i));
+  }
+  XYZ point(size_t i) const { return XYZ(px[i], py[i], pz[i]); }
+};
+
+/// A contiguous range of the entries in a MappingSet, such as the points
+/// from one color's table, used in place of a copy of them.  The set must
+/// outlive the span.
+class MappingSpan {
+public:
+  MappingSpan(MappingSet const &set)
+    : d_set(&set), d_begin(0), d_count(set.size()) {}
+  MappingSpan(MappingSet const &set, size_t begin, size_t count)
+    : d_set(&set), d_begin(begin), d_count(count) {}
+
+  size_t size() const { return d_count; }
+  bool empty() const { return d_count == 0; }
+
+  const double *x() const { return d_set->x.data() + d_begin; }
+  const double *y() const { return d_set->y.data() + d_begin; }
+  const double *latitude() const { return d_set->latitude.data() + d_begin; }
+  const double *longitude() const { return d_set->longitude.data() + d_begin; }
+  const double *px() const { return d_set->px.data() + d_begin; }
+  const double *py() const { return d_set->py.data() + d_begin; }
+  const double *pz() const { return d_set->pz.data() + d_begin; }
+  XYZ point(size_t i) const { return d_set->point(d_begin + i); }
+
+private:
+  const MappingSet *d_set;
+  size_t d_begin, d_count;
+};
+
 // Description of a screen
 typedef struct {
   double hFOVDegrees;
@@ -127,6 +189,13 @@ typedef struct {
   double maxY;  //!< Maximum absolute value of Y for points on screen
 } ScreenDescription;
 
+/// Points of a mapping set projected into the plane of its screen.
+/// findScreen() makes them on the way to the screen's extent and
+/// findMesh() needs them again for each color, so they are kept.
+struct ScreenProjection {
+  std::vector<double> x, y;
+};
+
 /// Holds a list of mappings from physical-display normalized
 /// coordinates to canonical-display normalized coordinates.
 typedef std::vector<        //!< Vector of mappings
@@ -6,7 +6,7 @@
 
 # Modified to work with Qt5.
 
-QT       += core gui opengl widgets
+QT       += core gui opengl widgets network
 CONFIG += console
 
 TARGET = calibration
@@ -16,6 +16,7 @@ INCLUDEPATH += /usr/local/include
 INCLUDEPATH += C:/usr/local/include
 
 INCLUDEPATH += ../shaders
+INCLUDEPATH += ../common
 
 # Avoid some warnings on Windows
 DEFINES += _CRT_SECURE_NO_WARNINGS=1
@@ -27,10 +28,13 @@ DEFINES += GLEW_STATIC
 SOURCES += main.cpp\
         mainwindow.cpp \
     opengl_widget.cpp \
-    ../shaders/undistort_shader.cpp
+    ../shaders/undistort_shader.cpp \
+    ../common/point_transform.cpp
 
 HEADERS  += mainwindow.h \
     opengl_widget.h \
-    ../shaders/undistort_shader.h
+    ../shaders/undistort_shader.h \
+    ../shaders/quadratic_tri_color_shaders.h \
+    ../common/point_transform.h
 
 FORMS    += mainwindow.ui
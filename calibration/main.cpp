@@ -25,13 +25,42 @@
 
 #include <QApplication>
 #include "mainwindow.h"
+#include "opengl_widget.h"
+#include <iostream>
 
 int main(int argc, char *argv[])
 {
 
     QApplication a(argc, argv);
+
+    // Options for an automated sweep, which runs instead of waiting
+    // for keys to be pressed.
+    QString sweepFile, sweepSocket, sweepLog;
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if ((args[i] == "-sweep") && (i + 1 < args.size())) {
+            sweepFile = args[++i];
+        } else if ((args[i] == "-sweep_socket") && (i + 1 < args.size())) {
+            sweepSocket = args[++i];
+        } else if ((args[i] == "-sweep_log") && (i + 1 < args.size())) {
+            sweepLog = args[++i];
+        } else {
+            std::cerr << "Usage: " << args[0].toStdString()
+                      << " [-sweep parameter_file] [-sweep_socket name]"
+                      << " [-sweep_log file] (default stdout)" << std::endl;
+            return 1;
+        }
+    }
+
     MainWindow w;
     w.show();
 
+    if (!sweepFile.isEmpty() || !sweepSocket.isEmpty()) {
+        OpenGL_Widget *widget = w.findChild<OpenGL_Widget *>();
+        if (!widget || !widget->startSweep(sweepFile, sweepSocket, sweepLog)) {
+            return 2;
+        }
+    }
+
     return a.exec();
 }
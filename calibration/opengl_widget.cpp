@@ -26,6 +26,7 @@
 
 
 #include "opengl_widget.h"
+#include "point_transform.h"
 
 
 
@@ -33,7 +34,10 @@
 #include <QtOpenGL>
 #include <QColor>
 #include <QFileDialog>
+#include <QTimer>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <math.h>
 #include <stdio.h>
 
@@ -43,11 +47,55 @@
 
 #define CONFIG_FILE "HMD_Config.json"
 
+// Time for the window to settle on its screen at full size before a
+// sweep shows its first frame.
+static const int SWEEP_START_DELAY_MS = 1000;
+
+// The vertex shader applies the radial correction to each vertex of
+// the undistorted geometry, so that changing K1 or a center of
+// projection only changes uniforms.  When shaders are not available,
+// radial_distort_rgb() does the same thing for all three colors on the
+// CPU.
+//    x_d = distorted x; y_d = distorted y
+//    x_u = undistorted x; y_u = undistorted y
+//    x_c = center x; y_c = center y
+//    r = sqrt( (x_u - x_c)^2 +  (y_u - y_c)^2 )
+//    x_d = x_c + (1 - k1*r^2) * (x_u - x_c)
+//    y_d = y_c + (1 - k1*r^2) * (y_u - y_c)
+static const char *correctionVertexShader =
+    "#version 120\n"
+    "attribute vec2 vertex;  // In pixels\n"
+    "uniform vec2 cop;       // Center of projection, in pixels\n"
+    "uniform float k1;       // Scaled to pixel units\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 offset = vertex - cop;\n"
+    "    vec2 p = cop + (1.0 - k1 * dot(offset, offset)) * offset;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *correctionFragmentShader =
+    "#version 120\n"
+    "uniform vec3 color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = vec4(color, 1.0);\n"
+    "}\n";
+
 //----------------------------------------------------------------------
 // Helper functions
 
+// Multisampled, and synchronized to vertical retrace so that a burst
+// of repaint requests turns into at most one repaint per refresh.
+static QGLFormat widgetFormat()
+{
+    QGLFormat format(QGL::SampleBuffers);
+    format.setSwapInterval(1);
+    return format;
+}
+
 OpenGL_Widget::OpenGL_Widget(QWidget *parent)
-    : QGLWidget(QGLFormat(QGL::SampleBuffers), parent)
+    : QGLWidget(widgetFormat(), parent)
     , d_cop_l(QPoint(0,0))
     , d_cop_r(QPoint(0,0))
     , d_cop(QPoint(0,0))
@@ -55,6 +103,15 @@ OpenGL_Widget::OpenGL_Widget(QWidget *parent)
     , d_k1_green(0)
     , d_k1_blue(0)
     , fullscreen(false)
+    , d_multisample(NULL)
+    , d_useShader(false)
+    , d_useCache(false)
+    , d_sweepStepQueued(false)
+    , d_sweepWaiting(false)
+    , d_sweepQuitWhenDone(false)
+    , d_sweepFrame(0)
+    , d_sweepServer(NULL)
+    , d_sweepLog(NULL)
 {
     using namespace std;
     cout << "Distortion estimation for HMD using K1 (quadratic) term" << endl
@@ -75,6 +132,18 @@ OpenGL_Widget::OpenGL_Widget(QWidget *parent)
 
 OpenGL_Widget::~OpenGL_Widget()
 {
+    // The buffers, images, and shader belong to our context.
+    makeCurrent();
+    for (unsigned eye = 0; eye < 2; eye++) {
+        d_eyes[eye].buffer.destroy();
+        delete d_eyes[eye].image;
+    }
+    delete d_multisample;
+    d_program.removeAllShaders();
+
+    if (d_sweepLog && (d_sweepLog != stdout)) {
+        fclose(d_sweepLog);
+    }
 }
 
 void OpenGL_Widget::initializeGL()
@@ -93,6 +162,26 @@ void OpenGL_Widget::initializeGL()
     // Makes the colors for the primitives be what we want.
     glDisable(GL_LIGHTING);
 
+    // Set up the shader and buffers used to draw the corrected
+    // geometry.  If this does not work, we fall back to correcting
+    // each vertex on the CPU.
+    d_useShader = QGLShaderProgram::hasOpenGLShaderPrograms(context())
+        && d_program.addShaderFromSourceCode(QGLShader::Vertex, correctionVertexShader)
+        && d_program.addShaderFromSourceCode(QGLShader::Fragment, correctionFragmentShader)
+        && d_program.link()
+        && d_eyes[0].buffer.create()
+        && d_eyes[1].buffer.create();
+    if (!d_useShader) {
+        std::cerr << "OpenGL_Widget::initializeGL(): Could not set up"
+                  << " the correction shader, correcting on the CPU: "
+                  << d_program.log().toStdString() << std::endl;
+    }
+    for (unsigned eye = 0; eye < 2; eye++) {
+        d_eyes[eye].buffer.setUsagePattern(QGLBuffer::StaticDraw);
+    }
+
+    // Without framebuffer objects, every repaint draws both eyes.
+    d_useCache = QGLFramebufferObject::hasOpenGLFramebufferObjects();
 }
 
 // The distortion is with respect to a center of projection, which
@@ -116,13 +205,9 @@ void OpenGL_Widget::initializeGL()
 //          = (-1 + sqrt(1 + 4*K1*Rcorr)) / (2*K1)
 //    K1 > 0
 
-QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
+float OpenGL_Widget::scaledK1(unsigned color) const
 {
-    QPointF ret = p;
-    QPointF offset = p - cop;
-    float r2 = offset.x() * offset.x() + offset.y() * offset.y();
-    float r = sqrt(r2);
-    float k1;
+    float k1 = 0;
     switch (color) {
     case 0:
         k1 = d_k1_red;
@@ -134,74 +219,218 @@ QPointF OpenGL_Widget::transformPoint(QPointF p, QPoint cop, unsigned color)
         k1 = d_k1_blue;
         break;
     }
-    k1 = k1 / ((d_width / 4.0)*(d_width / 4.0) * 16);
-
-    //We will calculate the transformed point
-    //by calculating the new location using the
-    //following formula
-    //x_d = distorted x; y_d = distorted y
-    //x_u = undistorted x; y_u = undistorted y
-    //x_c = center x; y_c = center y
-    //r = sqrt( (x_u - x_c)^2 +  (y_u - y_c)^2 )
-    //x_d = x_u [(1 + k1*r^2) * (x_u - x_c) / r]
-    //y_d = y_u [(1 + k1*r^2) * (y_u - y_c) / r]
-    ret = cop + (1 - k1 * r*r) * offset;
-    return ret;
+    return k1 / ((d_width / 4.0)*(d_width / 4.0) * 16);
 }
 
-void OpenGL_Widget::drawCorrectedLine(QPoint begin, QPoint end,
-                                      QPoint cop, unsigned color)
+void OpenGL_Widget::addLine(QPoint begin, QPoint end, unsigned eye)
 {
+    std::vector<GLfloat> &vertices = d_eyes[eye].vertices;
     QPointF offset = end - begin;
     float len = sqrt(offset.x() * offset.x() + offset.y() * offset.y());
     QPointF offset_dir = offset / len;
-    glBegin(GL_LINE_STRIP);
-    for (float s = 0; s <=len; s++) {
+    QPointF last = begin;
+    for (float s = 1; s <= len; s++) {
         QPointF p = begin + s*offset_dir;
-        QPointF tp = transformPoint(p, cop, color);
-        glVertex2f(tp.x(), tp.y());
+        vertices.push_back(last.x());
+        vertices.push_back(last.y());
+        vertices.push_back(p.x());
+        vertices.push_back(p.y());
+        last = p;
     }
-    glEnd();
 }
 
-void OpenGL_Widget::drawCorrectedCircle(QPoint center, float radius,
-                                      QPoint cop, unsigned color)
+void OpenGL_Widget::addCircle(QPoint center, float radius, unsigned eye)
 {
-    glBegin(GL_LINE_STRIP);
+    std::vector<GLfloat> &vertices = d_eyes[eye].vertices;
     float step = 1 / radius;
-    for (float r = 0; r <= 2*M_PI; r += step) {
+    QPointF last(center.x() + radius, center.y());
+    for (float r = step; r <= 2*M_PI; r += step) {
         QPointF p(center.x() + radius * cos(r),
                    center.y() + radius * sin(r));
-        QPointF tp = transformPoint(p, cop, color);
-        glVertex2f(tp.x(), tp.y());
+        vertices.push_back(last.x());
+        vertices.push_back(last.y());
+        vertices.push_back(p.x());
+        vertices.push_back(p.y());
+        last = p;
     }
-    glEnd();
 }
 
-void OpenGL_Widget::drawCorrectedLines(QPoint begin, QPoint end, QPoint cop)
+QPoint OpenGL_Widget::eyeCOP(unsigned eye) const
 {
-    float bright = 0.5f;
-    glColor3f(bright, 0.0, 0.0);
-    drawCorrectedLine(begin, end, cop, 0);
+    if (fullscreen) {
+        return d_cop;
+    }
+    return (eye == 0) ? d_cop_l : d_cop_r;
+}
 
-    glColor3f(0.0, bright, 0.0);
-    drawCorrectedLine(begin, end, cop, 1);
+void OpenGL_Widget::updateDirtyFlags()
+{
+    for (unsigned eye = 0; eye < 2; eye++) {
+        EyeCache &cache = d_eyes[eye];
+        if ((cache.width != d_width) || (cache.height != d_height)
+            || (cache.fullscreen != fullscreen)
+            || (cache.cop != eyeCOP(eye))) {
+            cache.dirty |= DIRTY_GEOMETRY | DIRTY_IMAGE;
+        }
+        for (unsigned color = 0; color < 3; color++) {
+            if (cache.k1[color] != scaledK1(color)) {
+                cache.dirty |= DIRTY_IMAGE;
+            }
+        }
+    }
+}
 
-    glColor3f(0.0, 0.0, bright);
-    drawCorrectedLine(begin, end, cop, 2);
+void OpenGL_Widget::updateEye(unsigned eye)
+{
+    EyeCache &cache = d_eyes[eye];
+    if (cache.dirty & DIRTY_GEOMETRY) {
+        cache.width = d_width;
+        cache.height = d_height;
+        cache.fullscreen = fullscreen;
+        cache.cop = eyeCOP(eye);
+        cache.vertices.clear();
+        addGrid(eye);
+        addCircles(eye);
+        if (d_useShader) {
+            cache.buffer.bind();
+            cache.buffer.allocate(cache.vertices.empty() ? NULL : &cache.vertices[0],
+                static_cast<int>(cache.vertices.size() * sizeof(GLfloat)));
+            cache.buffer.release();
+        } else {
+            size_t n = cache.vertices.size() / 2;
+            cache.xs.resize(n);
+            cache.ys.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                cache.xs[i] = cache.vertices[2 * i];
+                cache.ys[i] = cache.vertices[2 * i + 1];
+            }
+        }
+    }
+    for (unsigned color = 0; color < 3; color++) {
+        cache.k1[color] = scaledK1(color);
+    }
+    if (!d_useCache || !(cache.dirty & (DIRTY_GEOMETRY | DIRTY_IMAGE))) {
+        cache.dirty = 0;
+        return;
+    }
+    cache.dirty = 0;
+
+    // (Re)make the image and the antialiased target it is resolved
+    // from when the window size changes.
+    QSize size(d_width, d_height);
+    if (!cache.image || (cache.image->size() != size)) {
+        delete cache.image;
+        cache.image = new QGLFramebufferObject(size);
+    }
+    bool multisample = QGLFramebufferObject::hasOpenGLFramebufferBlit()
+        && format().sampleBuffers();
+    if (multisample && (!d_multisample || (d_multisample->size() != size))) {
+        delete d_multisample;
+        QGLFramebufferObjectFormat msFormat;
+        msFormat.setSamples(format().samples() > 0 ? format().samples() : 4);
+        d_multisample = new QGLFramebufferObject(size, msFormat);
+    }
+    QGLFramebufferObject *target = multisample ? d_multisample : cache.image;
+
+    target->bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drawEyeGeometry(eye);
+    target->release();
+    if (multisample) {
+        QRect rect(QPoint(0, 0), size);
+        QGLFramebufferObject::blitFramebuffer(cache.image, rect, d_multisample, rect);
+    }
 }
 
-void OpenGL_Widget::drawCorrectedCircles(QPoint center, float radius, QPoint cop)
+void OpenGL_Widget::drawEyeGeometry(unsigned eye)
 {
+    const EyeCache &cache = d_eyes[eye];
+    int count = static_cast<int>(cache.vertices.size() / 2);
+    if (count == 0) {
+        return;
+    }
+
+    // Draw a red, green, and blue copy of the geometry with less
+    // than full brightness, each with its own correction.
     float bright = 0.5f;
-    glColor3f(bright, 0.0, 0.0);
-    drawCorrectedCircle(center, radius, cop, 0);
+    QPoint cop = eyeCOP(eye);
+    if (d_useShader) {
+        d_program.bind();
+        d_program.setUniformValue("cop", GLfloat(cop.x()), GLfloat(cop.y()));
+        // Casting away const only to bind; the buffer is not changed.
+        const_cast<QGLBuffer &>(cache.buffer).bind();
+        d_program.setAttributeBuffer("vertex", GL_FLOAT, 0, 2);
+        d_program.enableAttributeArray("vertex");
+        for (unsigned color = 0; color < 3; color++) {
+            d_program.setUniformValue("k1", scaledK1(color));
+            d_program.setUniformValue("color",
+                color == 0 ? bright : 0.0f,
+                color == 1 ? bright : 0.0f,
+                color == 2 ? bright : 0.0f);
+            glDrawArrays(GL_LINES, 0, count);
+        }
+        d_program.disableAttributeArray("vertex");
+        const_cast<QGLBuffer &>(cache.buffer).release();
+        d_program.release();
+    } else {
+        // Distort the vertices for all three colors in one pass.
+        float k1[3] = { scaledK1(0), scaledK1(1), scaledK1(2) };
+        std::vector<GLfloat> xd[3], yd[3];
+        float *outX[3], *outY[3];
+        for (unsigned color = 0; color < 3; color++) {
+            xd[color].resize(count);
+            yd[color].resize(count);
+            outX[color] = &xd[color][0];
+            outY[color] = &yd[color][0];
+        }
+        radial_distort_rgb(&cache.xs[0], &cache.ys[0], count,
+            GLfloat(cop.x()), GLfloat(cop.y()), k1, outX, outY);
+
+        for (unsigned color = 0; color < 3; color++) {
+            glColor3f(color == 0 ? bright : 0.0f,
+                      color == 1 ? bright : 0.0f,
+                      color == 2 ? bright : 0.0f);
+            glBegin(GL_LINES);
+            for (int i = 0; i < count; i++) {
+                glVertex2f(outX[color][i], outY[color][i]);
+            }
+            glEnd();
+        }
+    }
+}
 
-    glColor3f(0.0, bright, 0.0);
-    drawCorrectedCircle(center, radius, cop, 1);
+void OpenGL_Widget::drawEyeImage(unsigned eye)
+{
+    const EyeCache &cache = d_eyes[eye];
+    if (!cache.image) {
+        return;
+    }
+
+    // Use a projection that puts each texel exactly on its pixel.
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, d_width, 0, d_height, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, cache.image->texture());
+    glColor3f(1.0, 1.0, 1.0);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(0, 0);
+    glTexCoord2f(1, 0); glVertex2f(d_width, 0);
+    glTexCoord2f(1, 1); glVertex2f(d_width, d_height);
+    glTexCoord2f(0, 1); glVertex2f(0, d_height);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
 
-    glColor3f(0.0, 0.0, bright);
-    drawCorrectedCircle(center, radius, cop, 2);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
 }
 
 void OpenGL_Widget::drawCrossHairs()
@@ -233,29 +462,33 @@ void OpenGL_Widget::drawCrossHairs()
     }
 }
 
-void OpenGL_Widget::drawGrid()
+void OpenGL_Widget::addGrid(unsigned eye)
 {
-    // Draw a set of vertical grid lines to the right and left
-    // of the center of projection for each eye.  Draw a red,
-    // green, and blue line at each location with less than
-    // full brightness.  Draw from the top of the screen to
-    // the bottom.
+    // Add a set of vertical grid lines to the right and left
+    // of the center of projection for each eye, from the top
+    // of the screen to the bottom, and horizontal lines above
+    // and below it.
     int spacing = 40;
 
 
     if (fullscreen){
+        // There is only one center of projection, used for eye 0.
+        if (eye != 0) {
+            return;
+        }
+
         // Vertical lines
         for (int r = spacing; r < d_width; r += spacing) {
             // Vertical lines, left eye
             if (d_cop.x() + r < d_width) {
                 QPoint begin(d_cop.x() + r, 0);
                 QPoint end(d_cop.x() + r, d_height);
-                drawCorrectedLines(begin, end, d_cop);
+                addLine(begin, end, 0);
             }
             if (d_cop.x() - r >= 0) {
                 QPoint begin(d_cop.x() - r, 0);
                 QPoint end(d_cop.x() - r, d_height);
-                drawCorrectedLines(begin, end, d_cop);
+                addLine(begin, end, 0);
             }
         }
 
@@ -265,12 +498,12 @@ void OpenGL_Widget::drawGrid()
             if (d_cop.y() + r < d_height) {
                 QPoint begin(0, d_cop.y() + r);
                 QPoint end(d_width, d_cop.y() + r);
-                drawCorrectedLines(begin, end, d_cop);
+                addLine(begin, end, 0);
             }
             if (d_cop.y() - r >= 0) {
                 QPoint begin(0, d_cop.y() - r);
                 QPoint end(d_width, d_cop.y() - r);
-                drawCorrectedLines(begin, end, d_cop);
+                addLine(begin, end, 0);
             }
         }
     }
@@ -279,77 +512,72 @@ void OpenGL_Widget::drawGrid()
         // Vertical lines
         for (int r = spacing; r < d_width / 2; r += spacing) {
             // Vertical lines, left eye
-            if (d_cop_l.x() + r < d_width / 2) {
+            if ((eye == 0) && (d_cop_l.x() + r < d_width / 2)) {
                 QPoint begin(d_cop_l.x() + r, 0);
                 QPoint end(d_cop_l.x() + r, d_height);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addLine(begin, end, 0);
             }
-            if (d_cop_l.x() - r >= 0) {
+            if ((eye == 0) && (d_cop_l.x() - r >= 0)) {
                 QPoint begin(d_cop_l.x() - r, 0);
                 QPoint end(d_cop_l.x() - r, d_height);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addLine(begin, end, 0);
             }
 
             // Vertical lines, right eye
-            if (d_cop_r.x() + r < d_width) {
+            if ((eye == 1) && (d_cop_r.x() + r < d_width)) {
                 QPoint begin(d_cop_r.x() + r, 0);
                 QPoint end(d_cop_r.x() + r, d_height - 1);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addLine(begin, end, 1);
             }
-            if (d_cop_r.x() - r >= d_width / 2) {
+            if ((eye == 1) && (d_cop_r.x() - r >= d_width / 2)) {
                 QPoint begin(d_cop_r.x() - r, 0);
                 QPoint end(d_cop_r.x() - r, d_height - 1);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addLine(begin, end, 1);
             }
         }
 
         // Horizontal lines
         for (int r = spacing; r < d_height; r += spacing) {
             // Horizontal lines, left eye
-            if (d_cop_l.y() + r < d_height) {
+            if ((eye == 0) && (d_cop_l.y() + r < d_height)) {
                 QPoint begin(0, d_cop_l.y() + r);
                 QPoint end(d_width / 2 - 1, d_cop_l.y() + r);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addLine(begin, end, 0);
             }
-            if (d_cop_l.y() - r >= 0) {
+            if ((eye == 0) && (d_cop_l.y() - r >= 0)) {
                 QPoint begin(0, d_cop_l.y() - r);
                 QPoint end(d_width / 2 - 1, d_cop_l.y() - r);
-                drawCorrectedLines(begin, end, d_cop_l);
+                addLine(begin, end, 0);
             }
 
             // Horizontal lines, right eye
-            if (d_cop_r.y() + r < d_height) {
+            if ((eye == 1) && (d_cop_r.y() + r < d_height)) {
                 QPoint begin(d_width / 2, d_cop_r.y() + r);
                 QPoint end(d_width - 1, d_cop_r.y() + r);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addLine(begin, end, 1);
             }
-            if (d_cop_r.y() - r >= 0) {
+            if ((eye == 1) && (d_cop_r.y() - r >= 0)) {
                 QPoint begin(d_width / 2, d_cop_r.y() - r);
                 QPoint end(d_width - 1, d_cop_r.y() - r);
-                drawCorrectedLines(begin, end, d_cop_r);
+                addLine(begin, end, 1);
             }
         }
     }
 
 }
 
-void OpenGL_Widget::drawCircles()
+void OpenGL_Widget::addCircles(unsigned eye)
 {
-    if (fullscreen){
-        drawCorrectedCircles(d_cop, 0.1 * d_width / 4, d_cop);
-        drawCorrectedCircles(d_cop, 0.7 * d_width / 4, d_cop);
-    }
-    else{
-        drawCorrectedCircles(d_cop_l, 0.1 * d_width / 4, d_cop_l);
-        drawCorrectedCircles(d_cop_r, 0.1 * d_width / 4, d_cop_r);
-        drawCorrectedCircles(d_cop_l, 0.7 * d_width / 4, d_cop_l);
-        drawCorrectedCircles(d_cop_r, 0.7 * d_width / 4, d_cop_r);
+    if (fullscreen && (eye != 0)) {
+        return;
     }
+    QPoint cop = eyeCOP(eye);
+    addCircle(cop, 0.1 * d_width / 4, eye);
+    addCircle(cop, 0.7 * d_width / 4, eye);
 }
 
 void OpenGL_Widget::paintGL()
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
     glTranslatef(0.0, 0.0, -10.0);
 
@@ -364,10 +592,23 @@ void OpenGL_Widget::paintGL()
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_TEXTURE_2D);
 
+    // Bring each eye's image up to date, then add the eyes together
+    // and put the crosshairs on top.  Without framebuffer objects, the
+    // eyes are drawn directly.  Fullscreen mode only uses eye 0.
+    unsigned numEyes = fullscreen ? 1 : 2;
+    updateDirtyFlags();
+    for (unsigned eye = 0; eye < numEyes; eye++) {
+        updateEye(eye);
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for (unsigned eye = 0; eye < numEyes; eye++) {
+        if (d_useCache) {
+            drawEyeImage(eye);
+        } else {
+            drawEyeGeometry(eye);
+        }
+    }
     drawCrossHairs();
-    drawGrid();
-    drawCircles();
-
 }
 
 
@@ -544,7 +785,7 @@ void OpenGL_Widget::keyPressEvent(QKeyEvent *event)
         printf("Left eye coords: x: %d, y: %d; ", d_cop_l.x(), d_cop_l.y());
         printf("Right eye coords: x: %d, y: %d;\n", d_cop_r.x(), d_cop_r.y());
     }
-    updateGL();
+    update();
 }
 
 void OpenGL_Widget::mousePressEvent(QMouseEvent *event)
@@ -563,7 +804,7 @@ void OpenGL_Widget::mousePressEvent(QMouseEvent *event)
             d_cop_r = QPoint(d_width - d_cop_l.x(), d_cop_l.y());
         }
     }
-    updateGL();
+    update();
 //    d_last_pos = event->pos();
 }
 
@@ -602,6 +843,27 @@ QPoint OpenGL_Widget::relativeToPixel(QPointF cop){
 }
 
 
+QPointF OpenGL_Widget::relativeCOP()
+{
+    if (fullscreen){
+        return pixelToRelative(d_cop);
+    }
+    return pixelToRelative(d_cop_l);
+}
+
+void OpenGL_Widget::setRelativeCOP(QPointF cop)
+{
+    if (fullscreen){
+        d_cop = relativeToPixel(cop);
+    }
+    else{
+        d_cop_l = relativeToPixel(cop);
+        // Find the mirror of the left-eye's center of projection
+        // around the screen center to find the right eye's COP.
+        d_cop_r = QPoint(d_width - d_cop_l.x(), d_cop_l.y());
+    }
+}
+
 bool OpenGL_Widget::saveConfigToJson(QString filename)
 {
     FILE *f = fopen(filename.toStdString().c_str(), "w");
@@ -611,13 +873,7 @@ bool OpenGL_Widget::saveConfigToJson(QString filename)
         return false;
     }
     //convert from pixels to Relative screen size to use by shader
-    QPointF relative_cop;
-    if (fullscreen){
-        relative_cop = pixelToRelative(d_cop);
-    }
-    else{
-        relative_cop = pixelToRelative(d_cop_l);
-    }
+    QPointF relative_cop = relativeCOP();
 
     fprintf(f, "{\n");
     fprintf(f, "    \"hmd\": {\n");
@@ -740,17 +996,230 @@ bool OpenGL_Widget::loadConfigFromJson(QString filename)
         return false;
     }
     cop.setY(val);
+    setRelativeCOP(cop);
 
-    if (fullscreen){
-        d_cop = relativeToPixel(cop);
+    fclose(f);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// Automated sweeps
+
+// Parse a number or a first:last:count range into its values.
+static bool parseSweepValues(const std::string &token, std::vector<float> &values)
+{
+    std::istringstream s(token);
+    double first, last;
+    int count = 1;
+    char colon1, colon2, extra;
+    if (!(s >> first)) {
+        return false;
     }
-    else{
-        d_cop_l = relativeToPixel(cop);
-        // Find the mirror of the left-eye's center of projection
-        // around the screen center to find the right eye's COP.
-        d_cop_r = QPoint(d_width - d_cop_l.x(), d_cop_l.y());
+    if (s >> colon1) {
+        if ((colon1 != ':') || !(s >> last >> colon2 >> count)
+            || (colon2 != ':') || (count < 1) || (s >> extra)) {
+            return false;
+        }
     }
+    values.clear();
+    for (int i = 0; i < count; i++) {
+        values.push_back(static_cast<float>(
+            count == 1 ? first : first + (last - first) * i / (count - 1)));
+    }
+    return true;
+}
 
-    fclose(f);
+bool OpenGL_Widget::parseSweepLine(const std::string &line)
+{
+    std::istringstream s(line);
+    std::string token;
+    std::vector<float> values[5];
+    unsigned numTokens = 0;
+    while (s >> token) {
+        if ((numTokens == 0) && (token[0] == '#')) {
+            return true;
+        }
+        if ((numTokens == 5) || !parseSweepValues(token, values[numTokens])) {
+            return false;
+        }
+        numTokens++;
+    }
+    if (numTokens == 0) {
+        return true;
+    }
+    if (numTokens != 5) {
+        return false;
+    }
+
+    // Count through the combinations like the digits of a number.
+    unsigned index[5] = { 0, 0, 0, 0, 0 };
+    for (;;) {
+        SweepParams p;
+        for (unsigned color = 0; color < 3; color++) {
+            p.k1[color] = values[color][index[color]];
+        }
+        p.cop = QPointF(values[3][index[3]], values[4][index[4]]);
+        d_sweepQueue.push_back(p);
+
+        int digit = 4;
+        while ((digit >= 0) && (++index[digit] == values[digit].size())) {
+            index[digit] = 0;
+            digit--;
+        }
+        if (digit < 0) {
+            return true;
+        }
+    }
+}
+
+bool OpenGL_Widget::startSweep(QString paramFile, QString socketName, QString logFile)
+{
+    if (!paramFile.isEmpty()) {
+        std::ifstream in(paramFile.toStdString().c_str());
+        if (!in) {
+            fprintf(stderr, "OpenGL_Widget::startSweep(): Can't read %s\n",
+                paramFile.toStdString().c_str());
+            return false;
+        }
+        std::string line;
+        unsigned lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            if (!parseSweepLine(line)) {
+                fprintf(stderr, "OpenGL_Widget::startSweep(): Bad line %u in %s: %s\n",
+                    lineNumber, paramFile.toStdString().c_str(), line.c_str());
+                return false;
+            }
+        }
+    }
+
+    if (logFile.isEmpty()) {
+        d_sweepLog = stdout;
+    } else {
+        d_sweepLog = fopen(logFile.toStdString().c_str(), "w");
+        if (d_sweepLog == NULL) {
+            fprintf(stderr, "OpenGL_Widget::startSweep(): Can't write to %s\n",
+                logFile.toStdString().c_str());
+            return false;
+        }
+    }
+
+    if (!socketName.isEmpty()) {
+        // Clear out a socket left behind by a run that crashed.
+        QLocalServer::removeServer(socketName);
+        d_sweepServer = new QLocalServer(this);
+        if (!d_sweepServer->listen(socketName)) {
+            fprintf(stderr, "OpenGL_Widget::startSweep(): Can't listen on %s: %s\n",
+                socketName.toStdString().c_str(),
+                d_sweepServer->errorString().toStdString().c_str());
+            return false;
+        }
+        connect(d_sweepServer, SIGNAL(newConnection()), this, SLOT(sweepClientConnected()));
+    }
+    d_sweepQuitWhenDone = (d_sweepServer == NULL);
+
+    d_sweepStepQueued = true;
+    QTimer::singleShot(SWEEP_START_DELAY_MS, this, SLOT(stepSweep()));
     return true;
 }
+
+void OpenGL_Widget::queueSweepStep()
+{
+    if (!d_sweepStepQueued && !d_sweepWaiting) {
+        d_sweepStepQueued = true;
+        QTimer::singleShot(0, this, SLOT(stepSweep()));
+    }
+}
+
+void OpenGL_Widget::stepSweep()
+{
+    d_sweepStepQueued = false;
+    if (d_sweepWaiting) {
+        return;
+    }
+    if (d_sweepQueue.empty()) {
+        if (d_sweepQuitWhenDone) {
+            fflush(d_sweepLog);
+            QApplication::quit();
+        }
+        return;
+    }
+
+    SweepParams p = d_sweepQueue.front();
+    d_sweepQueue.pop_front();
+    d_k1_red = p.k1[0];
+    d_k1_green = p.k1[1];
+    d_k1_blue = p.k1[2];
+    setRelativeCOP(p.cop);
+
+    // Draw and swap now rather than on the next repaint.  With the swap
+    // synchronized to vertical retrace, glFinish() returns once the
+    // swap has happened, so the frame is on the display when it is
+    // reported.
+    updateGL();
+    makeCurrent();
+    glFinish();
+    reportSweepFrame();
+
+    d_sweepWaiting = !d_sweepClients.isEmpty();
+    queueSweepStep();
+}
+
+void OpenGL_Widget::reportSweepFrame()
+{
+    // One line with the fields that saveConfigToJson() writes.
+    QPointF relative_cop = relativeCOP();
+    char record[1024];
+    sprintf(record, "{ \"frame\": %lu, \"hmd\": { \"distortion\": {"
+        " \"k1_red\": %g, \"k1_green\": %g, \"k1_blue\": %g },"
+        " \"eyes\": [ { \"center_proj_x\": %f, \"center_proj_y\": %f } ],"
+        " \"fullscreen\": %d } }\n",
+        d_sweepFrame++, d_k1_red, d_k1_green, d_k1_blue,
+        relative_cop.x(), relative_cop.y(), (int)fullscreen);
+
+    fputs(record, d_sweepLog);
+    fflush(d_sweepLog);
+    for (int i = 0; i < d_sweepClients.size(); i++) {
+        d_sweepClients[i]->write(record);
+        d_sweepClients[i]->flush();
+    }
+}
+
+void OpenGL_Widget::sweepClientConnected()
+{
+    while (QLocalSocket *client = d_sweepServer->nextPendingConnection()) {
+        d_sweepClients.append(client);
+        connect(client, SIGNAL(readyRead()), this, SLOT(sweepClientReadable()));
+        connect(client, SIGNAL(disconnected()), this, SLOT(sweepClientDisconnected()));
+    }
+}
+
+void OpenGL_Widget::sweepClientReadable()
+{
+    // Each line is an acknowledgement of the last frame, when it is
+    // blank or "next", or more parameter sets to show.
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    while (client && client->canReadLine()) {
+        std::string line = QString::fromUtf8(client->readLine()).trimmed().toStdString();
+        if (line.empty() || (line == "next")) {
+            d_sweepWaiting = false;
+        } else if (!parseSweepLine(line)) {
+            client->write("error Bad parameter line\n");
+            client->flush();
+        }
+    }
+    queueSweepStep();
+}
+
+void OpenGL_Widget::sweepClientDisconnected()
+{
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    d_sweepClients.removeAll(client);
+    if (client) {
+        client->deleteLater();
+    }
+    if (d_sweepClients.isEmpty()) {
+        d_sweepWaiting = false;
+        queueSweepStep();
+    }
+}
@@ -26,6 +26,15 @@
 #pragma once
 #include "opengl_widget.h"
 #include <QGLWidget>
+#include <QGLShaderProgram>
+#include <QGLBuffer>
+#include <QGLFramebufferObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <deque>
+#include <stdio.h>
+#include <string>
+#include <vector>
 #include "undistort_shader.h"
 
 // There are three different indices of refraction for the three
@@ -63,7 +72,9 @@
 //
 // When there are nonzero coefficients for higher-order terms
 // (K2 and above), the result is a fourth-order polynomial that
-// is challenging to invert analytically.
+// is challenging to invert analytically.  RadialInverse in
+// common/point_transform.h inverts it (and the quadratic form)
+// numerically, from a table refined by Newton steps.
 
 class OpenGL_Widget : public QGLWidget
 {
@@ -73,8 +84,27 @@ public:
     OpenGL_Widget(QWidget *parent = 0);
     ~OpenGL_Widget();
 
+    /// Start showing parameter sets for a camera to capture, one per
+    // frame, as fast as the display allows.  The sets come from a
+    // file, from clients of a local socket, or both (see
+    // parseSweepLine() for the format).  After each frame is confirmed
+    // to be on the display, its parameters are written as a line of
+    // Json, with the fields that saveConfigToJson() writes, to the log
+    // (stdout if logFile is empty) and to each connected client.  While
+    // a client is connected, the next set waits until a client sends an
+    // empty line (or "next").  Without a socket, the application quits
+    // when the file has been shown.
+    //   @return false (with a message on stderr) on error.
+    bool startSweep(QString paramFile, QString socketName, QString logFile);
+
 public slots:
 
+private slots:
+    void stepSweep();
+    void sweepClientConnected();
+    void sweepClientReadable();
+    void sweepClientDisconnected();
+
 signals:
 
 protected:
@@ -92,36 +122,46 @@ protected:
 
     //------------------------------------------------------
     // Used as options in the rendering, depending on our
-    // mode.
+    // mode.  The grid and circles for an eye are added to its
+    // undistorted geometry, which drawEyeGeometry() draws.
     void drawCrossHairs();
-    void drawGrid();
-    void drawCircles();
+    void addGrid(unsigned eye);
+    void addCircles(unsigned eye);
 
     //------------------------------------------------------
     // Helper functions for the draw routines.
 
-    /// Draw a line from the specified begin point to the
-    // specified end, doing distortion correcton.  The line
-    // is drawn in short segments, with the correction applied
-    // to each segment endpoint.  The color index tells whether
-    // we use red (0), green (1), or blue (2) correction factors.
-    // It uses the specified center of projection.
-    void drawCorrectedLine(QPoint begin, QPoint end,
-                           QPoint cop, unsigned color);
-    void drawCorrectedCircle(QPoint center, float radius,
-                           QPoint cop, unsigned color);
-
-    /// Draw a set of 3 colored lines from the specified begin
-    // point to the specified end, doing distortion correcton.
-    void drawCorrectedLines(QPoint begin, QPoint end, QPoint cop);
-    void drawCorrectedCircles(QPoint center, float radius, QPoint cop);
-
-    /// Transform the specified pixel coordinate by the
-    // color-correction distortion matrix using the appropriate
-    // distortion correction.  The color index tells whether
-    // we use red (0), green (1), or blue (2) correction factors.
-    // It uses the specified center of projection.
-    QPointF transformPoint(QPointF p, QPoint cop, unsigned color);
+    /// Add a line from the specified begin point to the
+    // specified end to an eye's undistorted geometry.  The line
+    // is broken into one-pixel segments so that the distortion
+    // correction, which is applied to each segment endpoint when
+    // drawing, bends it smoothly.  Eye 0 is the left eye (or the
+    // whole screen in fullscreen mode) and eye 1 is the right eye.
+    void addLine(QPoint begin, QPoint end, unsigned eye);
+    void addCircle(QPoint center, float radius, unsigned eye);
+
+    /// Center of projection used for an eye in the current mode.
+    QPoint eyeCOP(unsigned eye) const;
+
+    /// Compare each eye's cache against the current state and mark
+    // what needs to be redone: the geometry when the window size,
+    // mode, or that eye's center of projection changed, and the
+    // image when the geometry or a K1 term changed.
+    void updateDirtyFlags();
+
+    /// Rebuild an eye's geometry and re-render its image as needed.
+    void updateEye(unsigned eye);
+
+    /// Draw an eye's geometry once per color, with the vertex shader
+    // applying that color's distortion correction.
+    void drawEyeGeometry(unsigned eye);
+
+    /// Draw an eye's cached image over the whole window, adding it
+    // to what is already there.
+    void drawEyeImage(unsigned eye);
+
+    /// The K1 term for a color, scaled to pixel units.
+    float scaledK1(unsigned color) const;
 
     // Set default values for center of projection
     // Also used to reset center during execution to default values
@@ -131,6 +171,32 @@ protected:
     QPointF pixelToRelative(QPointF cop);
     QPoint relativeToPixel(QPointF cop);
 
+    /// The relative center of projection that is saved and loaded: the
+    // fullscreen one, or the left eye's with the right eye mirroring it.
+    QPointF relativeCOP();
+    void setRelativeCOP(QPointF cop);
+
+    //------------------------------------------------------
+    // Automated sweeps.
+    struct SweepParams {
+        float k1[3];    //< Red, green and blue
+        QPointF cop;    //< Relative, as in the config file
+    };
+
+    /// Add the parameter sets that one line of a sweep describes to
+    // the end of the queue.  A line holds k1_red, k1_green, k1_blue,
+    // center_proj_x and center_proj_y, each either a number or a
+    // first:last:count range, and stands for every combination of
+    // them, with the later values changing fastest.  Blank lines and
+    // ones starting with # add nothing.
+    //   @return false if the line cannot be parsed.
+    bool parseSweepLine(const std::string &line);
+
+    /// Arrange for stepSweep() to be called, unless it already is or
+    // a client has yet to acknowledge the last frame.
+    void queueSweepStep();
+    void reportSweepFrame();
+
 private:
     int d_width, d_height;  //< Size of the window we're rendering into
     QPoint d_cop_l;         //< Center of projection for the left eye
@@ -140,4 +206,48 @@ private:
     float  d_k1_green;      //< Quadratic term for distortion of green
     float  d_k1_blue;       //< Quadratic term for distortion of blue
     bool fullscreen;
+
+    //------------------------------------------------------
+    // Each eye's undistorted grid and circles, and its corrected
+    // rendering cached in a window-sized framebuffer object.  The
+    // eyes' images are added together to make the display, so only
+    // an eye whose state changed has to be drawn again.
+    enum {
+        DIRTY_GEOMETRY = 1,  //< Vertices must be rebuilt
+        DIRTY_IMAGE = 2      //< Cached image must be re-rendered
+    };
+    struct EyeCache {
+        EyeCache() : dirty(DIRTY_GEOMETRY | DIRTY_IMAGE)
+            , width(0), height(0), fullscreen(false)
+            , buffer(QGLBuffer::VertexBuffer), image(NULL)
+        { k1[0] = k1[1] = k1[2] = 0; }
+
+        unsigned dirty;
+        std::vector<GLfloat> vertices;  //< (x, y) per vertex, drawn as GL_LINES
+        std::vector<GLfloat> xs, ys;    //< The same vertices split by axis, for radial_distort_rgb()
+
+        // State the geometry and image were built for.
+        int width, height;
+        bool fullscreen;
+        QPoint cop;
+        float k1[3];
+
+        QGLBuffer buffer;              //< vertices on the GPU
+        QGLFramebufferObject *image;   //< Cached rendering, or NULL
+    };
+    EyeCache d_eyes[2];
+    QGLFramebufferObject *d_multisample;  //< Antialiased target resolved into images, or NULL
+
+    QGLShaderProgram d_program;   //< Applies the correction to each vertex
+    bool d_useShader;             //< False if shaders are not available
+    bool d_useCache;              //< False if framebuffer objects are not available
+
+    std::deque<SweepParams> d_sweepQueue;  //< Sets still to be shown
+    bool d_sweepStepQueued;       //< A call to stepSweep() is pending
+    bool d_sweepWaiting;          //< The last frame is not acknowledged yet
+    bool d_sweepQuitWhenDone;     //< Quit when the queue empties
+    unsigned long d_sweepFrame;   //< Number of the next frame to report
+    QLocalServer *d_sweepServer;  //< Listens for capture clients, or NULL
+    QList<QLocalSocket *> d_sweepClients;
+    FILE *d_sweepLog;             //< Where frames are logged, or NULL
 };
@@ -0,0 +1,289 @@
+/** @file
+    @brief Implementation of the render-loop frame timer.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_timer.h"
+#include "font.h"
+
+// GLEW must come before the other OpenGL headers.
+#include <GL/glew.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+static const char *stageNames[FrameTimer::NUM_STAGES] = {
+  "update", "render_info", "render", "present"
+};
+
+void FrameTimer::Series::add(double value, size_t window)
+{
+  if (values.size() < window) {
+    values.push_back(value);
+  } else {
+    values[next] = value;
+    next = (next + 1) % window;
+  }
+}
+
+void FrameTimer::Series::stats(double &minimum, double &average, double &p99) const
+{
+  minimum = average = p99 = 0;
+  if (values.empty()) { return; }
+  std::vector<double> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+  double sum = 0;
+  for (size_t i = 0; i < sorted.size(); i++) { sum += sorted[i]; }
+  minimum = sorted.front();
+  average = sum / sorted.size();
+  size_t at = static_cast<size_t>(std::ceil(0.99 * sorted.size()));
+  p99 = sorted[(at > 0 ? at : 1) - 1];
+}
+
+FrameTimer::FrameTimer(size_t window)
+  : d_window(window > 0 ? window : 1)
+  , d_missedWindow(d_window, 0)
+{
+  for (size_t f = 0; f < QUERY_FRAMES; f++) {
+    for (size_t e = 0; e < MAX_EYES; e++) {
+      d_queries[f][e] = 0;
+    }
+  }
+}
+
+FrameTimer::~FrameTimer()
+{
+  // The OpenGL context may already be gone, so the queries are left for
+  // it to clean up.
+  d_log.close();
+}
+
+void FrameTimer::setRefreshRate(double hz)
+{
+  if (hz > 0) { d_periodMs = 1000.0 / hz; }
+}
+
+bool FrameTimer::openLog(const std::string &fileName)
+{
+  d_log.open(fileName.c_str());
+  if (!d_log.good()) {
+    std::cerr << "Error: Could not open " << fileName << " for writing" << std::endl;
+    return false;
+  }
+  d_log << "frame,interval_ms";
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    d_log << "," << stageNames[s] << "_ms";
+  }
+  for (size_t e = 0; e < MAX_EYES; e++) {
+    d_log << ",gpu_eye" << e << "_ms";
+  }
+  d_log << ",missed_vsync" << std::endl;
+  return true;
+}
+
+void FrameTimer::beginFrame()
+{
+  if (!d_enabled) { return; }
+  Clock::time_point now = Clock::now();
+  if (d_frame >= 0) { finishFrame(now); }
+
+  // Reuse the oldest slot, first reading back the GPU times for the
+  // frame that used it.
+  d_frame++;
+  size_t slot = static_cast<size_t>(d_frame % QUERY_FRAMES);
+  Record &record = d_records[slot];
+  if (record.frame >= 0) { collectGPU(record, slot); }
+
+  record.frame = d_frame;
+  record.intervalMs = 0;
+  record.missed = 0;
+  for (size_t s = 0; s < NUM_STAGES; s++) { record.stageMs[s] = 0; }
+  for (size_t e = 0; e < MAX_EYES; e++) { record.gpuIssued[e] = false; }
+  d_frameStart = d_mark = now;
+}
+
+void FrameTimer::endStage(Stage stage)
+{
+  if (!d_enabled || (d_frame < 0)) { return; }
+  Clock::time_point now = Clock::now();
+  Record &record = d_records[d_frame % QUERY_FRAMES];
+  record.stageMs[stage] +=
+    std::chrono::duration<double, std::milli>(now - d_mark).count();
+  d_mark = now;
+}
+
+// Completes the CPU side of the current frame now that the next one is
+// starting, so that its interval is known.
+void FrameTimer::finishFrame(Clock::time_point now)
+{
+  Record &record = d_records[d_frame % QUERY_FRAMES];
+  record.intervalMs =
+    std::chrono::duration<double, std::milli>(now - d_frameStart).count();
+  if (record.intervalMs > 1.5 * d_periodMs) {
+    record.missed = static_cast<int>(record.intervalMs / d_periodMs + 0.5) - 1;
+  }
+
+  d_interval.add(record.intervalMs, d_window);
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    d_stages[s].add(record.stageMs[s], d_window);
+  }
+  d_missedWindow[d_missedNext] = record.missed;
+  d_missedNext = (d_missedNext + 1) % d_window;
+  d_missedTotal += record.missed;
+}
+
+void FrameTimer::collectGPU(Record &record, size_t slot)
+{
+  double gpuMs[MAX_EYES];
+  for (size_t e = 0; e < MAX_EYES; e++) {
+    gpuMs[e] = -1;
+    if (!record.gpuIssued[e]) { continue; }
+    GLuint available = 0;
+    glGetQueryObjectuiv(d_queries[slot][e], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) { continue; }   // Drop it rather than wait
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(d_queries[slot][e], GL_QUERY_RESULT, &ns);
+    gpuMs[e] = ns * 1e-6;
+    d_gpu[e].add(gpuMs[e], d_window);
+  }
+
+  if (d_log.is_open()) {
+    char line[64];
+    d_log << record.frame;
+    sprintf(line, ",%.3f", record.intervalMs);
+    d_log << line;
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      sprintf(line, ",%.3f", record.stageMs[s]);
+      d_log << line;
+    }
+    for (size_t e = 0; e < MAX_EYES; e++) {
+      if (gpuMs[e] >= 0) {
+        sprintf(line, ",%.3f", gpuMs[e]);
+        d_log << line;
+      } else {
+        d_log << ",";
+      }
+    }
+    d_log << "," << record.missed << "\n";
+  }
+}
+
+void FrameTimer::beginGPU(size_t eye)
+{
+  if (!d_enabled || (d_frame < 0) || (eye >= MAX_EYES)) { return; }
+  if (d_gpuSupport < 0) {
+    d_gpuSupport = (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) ? 1 : 0;
+    if (d_gpuSupport) {
+      glGenQueries(QUERY_FRAMES * MAX_EYES, &d_queries[0][0]);
+    } else {
+      std::cerr << "FrameTimer: OpenGL timer queries not supported, "
+        << "not reporting GPU times" << std::endl;
+    }
+  }
+  if (!d_gpuSupport) { return; }
+  size_t slot = static_cast<size_t>(d_frame % QUERY_FRAMES);
+  glBeginQuery(GL_TIME_ELAPSED, d_queries[slot][eye]);
+  d_records[slot].gpuIssued[eye] = true;
+}
+
+void FrameTimer::endGPU(size_t eye)
+{
+  if (!d_enabled || (d_gpuSupport != 1) || (eye >= MAX_EYES)) { return; }
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+std::vector<std::string> FrameTimer::summary() const
+{
+  std::vector<std::string> lines;
+  char line[128];
+  double minimum, average, p99;
+
+  d_interval.stats(minimum, average, p99);
+  sprintf(line, "frame   %6.2f min %6.2f avg %6.2f p99 ms", minimum, average, p99);
+  lines.push_back(line);
+
+  int missed = 0;
+  for (size_t i = 0; i < d_missedWindow.size(); i++) { missed += d_missedWindow[i]; }
+  sprintf(line, "missed vsync %d of last %d frames, %lld total", missed,
+    static_cast<int>(d_interval.values.size()), d_missedTotal);
+  lines.push_back(line);
+
+  for (size_t s = 0; s < NUM_STAGES; s++) {
+    d_stages[s].stats(minimum, average, p99);
+    sprintf(line, "%-11s %6.2f avg %6.2f p99 ms", stageNames[s], average, p99);
+    lines.push_back(line);
+  }
+  for (size_t e = 0; e < MAX_EYES; e++) {
+    if (d_gpu[e].values.empty()) { continue; }
+    d_gpu[e].stats(minimum, average, p99);
+    sprintf(line, "gpu eye %d  %6.2f avg %6.2f p99 ms", static_cast<int>(e), average, p99);
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+void FrameTimer::drawOverlay()
+{
+  if (!d_enabled) { return; }
+  if (d_fontOffset == 0) {
+    d_fontOffset = loadFont(nullptr);
+    if (d_fontOffset == 0) { return; }
+  }
+
+  // Draw in pixel coordinates within the viewport, starting a bit in
+  // from the left and above the middle so that the text stays inside
+  // the part of the display seen through the lens.
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TRANSFORM_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_TEXTURE_2D);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, viewport[2], 0, viewport[3], -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  std::vector<std::string> lines = summary();
+  glColor3d(1, 1, 0);
+  double x = 0.3 * viewport[2];
+  double y = 0.6 * viewport[3];
+  for (size_t i = 0; i < lines.size(); i++) {
+    glRasterPos2d(x, y - 16.0 * i);
+    drawStringInFont(d_fontOffset, lines[i].c_str());
+  }
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glPopAttrib();
+}
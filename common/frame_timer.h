@@ -0,0 +1,150 @@
+/** @file
+    @brief Frame-timing instrumentation shared by the RenderManager test
+           programs.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// Measures how long each stage of a render loop takes on the CPU and how
+/// long each eye's drawing takes on the GPU, keeping statistics over the
+/// most recent frames.  The results can be drawn on top of an eye's view
+/// with the bitmap font and logged to a CSV file, one row per frame.
+///  A typical loop looks like:
+///
+///    timer.beginFrame();
+///    context.update();                timer.endStage(FrameTimer::STAGE_UPDATE);
+///    renderInfo = render->GetRenderInfo(); timer.endStage(FrameTimer::STAGE_RENDER_INFO);
+///    for (each eye i) {
+///      timer.beginGPU(i); RenderView(...); timer.endGPU(i);
+///      timer.drawOverlay();
+///    }
+///    timer.endStage(FrameTimer::STAGE_RENDER);
+///    render->PresentRenderBuffers(...); timer.endStage(FrameTimer::STAGE_PRESENT);
+///
+///  The distortion-correction pass happens inside PresentRenderBuffers(),
+/// so it shows up in the present stage along with the wait for vsync.
+///  Every call does nothing until setEnabled(true), so the calls can be
+/// left in place.  The GPU calls need a current OpenGL context with
+/// GLEW initialized; GPU times are skipped if timer queries are not
+/// supported.
+class FrameTimer {
+public:
+  /// CPU stages of the render loop.
+  enum Stage {
+    STAGE_UPDATE,       //!< context.update() and reading devices
+    STAGE_RENDER_INFO,  //!< GetRenderInfo()
+    STAGE_RENDER,       //!< RenderView() for all eyes
+    STAGE_PRESENT,      //!< PresentRenderBuffers(), including distortion
+    NUM_STAGES
+  };
+
+  /// Keeps statistics over the last window frames.
+  explicit FrameTimer(size_t window = 300);
+  ~FrameTimer();
+
+  void setEnabled(bool enabled) { d_enabled = enabled; }
+  bool enabled() const { return d_enabled; }
+
+  /// Frames that take longer than 1.5 refresh periods count as missing
+  /// one or more vsyncs.  Default 60 Hz.
+  void setRefreshRate(double hz);
+
+  /// Logs each frame to the named CSV file.  Rows are written a few
+  /// frames late, once the GPU times for that frame are available.
+  ///   @return false (with a message on std::cerr) if the file could
+  /// not be opened.
+  bool openLog(const std::string &fileName);
+
+  /// Marks the start of a frame; also ends the previous one.
+  void beginFrame();
+
+  /// Adds the CPU time since the previous mark (beginFrame() or
+  /// endStage()) to the specified stage of the current frame.
+  void endStage(Stage stage);
+
+  /// Brackets the GPU work for one eye's drawing.
+  void beginGPU(size_t eye);
+  void endGPU(size_t eye);
+
+  /// Draws the statistics into the currently bound framebuffer, on the
+  /// left side of the current viewport.  Leaves the OpenGL state as it
+  /// found it.
+  void drawOverlay();
+
+  /// Lines of text that drawOverlay() shows.
+  std::vector<std::string> summary() const;
+
+private:
+  // Number of frames the GPU queries are kept before their results are
+  // read, so that reading them does not wait for the GPU.
+  static const size_t QUERY_FRAMES = 4;
+  static const size_t MAX_EYES = 2;
+
+  typedef std::chrono::steady_clock Clock;
+
+  /// Rolling window of recent values, in milliseconds.
+  struct Series {
+    std::vector<double> values;
+    size_t next = 0;
+    void add(double value, size_t window);
+    void stats(double &minimum, double &average, double &p99) const;
+  };
+
+  struct Record {
+    long long frame = -1;
+    double intervalMs = 0;
+    double stageMs[NUM_STAGES];
+    int missed = 0;
+    bool gpuIssued[MAX_EYES];
+  };
+
+  void finishFrame(Clock::time_point now);
+  void collectGPU(Record &record, size_t slot);
+
+  bool d_enabled = false;
+  size_t d_window;
+  double d_periodMs = 1000.0 / 60;
+
+  long long d_frame = -1;
+  Clock::time_point d_frameStart;
+  Clock::time_point d_mark;
+  Record d_records[QUERY_FRAMES];
+
+  Series d_interval;
+  Series d_stages[NUM_STAGES];
+  Series d_gpu[MAX_EYES];
+  std::vector<int> d_missedWindow;  //!< Missed vsyncs per recent frame
+  size_t d_missedNext = 0;
+  long long d_missedTotal = 0;
+
+  int d_gpuSupport = -1;            //!< -1 until checked, then 0 or 1
+  unsigned d_queries[QUERY_FRAMES][MAX_EYES];
+
+  int d_fontOffset = 0;
+  std::ofstream d_log;
+};
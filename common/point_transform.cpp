@@ -0,0 +1,345 @@
+/** @file
+    @brief Implementation of the batch point transforms.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "point_transform.h"
+
+#include <cmath>
+#include <iostream>
+
+//====================================================================
+// Pick the widest instruction set the compiler is targeting and wrap
+// the few operations the kernels need, so that each kernel is written
+// once.  The double-precision operations are the same IEEE operations
+// in the same order as the scalar code, so the results match it
+// exactly (as long as the compiler does not fuse the scalar multiplies
+// and adds).
+
+#if defined(POINT_TRANSFORM_SCALAR)
+#define POINT_TRANSFORM_ISA "scalar"
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define POINT_TRANSFORM_AVX
+#define POINT_TRANSFORM_ISA "AVX"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define POINT_TRANSFORM_SSE2
+#define POINT_TRANSFORM_ISA "SSE2"
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define POINT_TRANSFORM_NEON
+#define POINT_TRANSFORM_ISA "NEON"
+#else
+#define POINT_TRANSFORM_ISA "scalar"
+#endif
+
+namespace {
+
+#if defined(POINT_TRANSFORM_AVX)
+  typedef __m256 vfloat;
+  typedef __m256d vdouble;
+  const size_t FLOAT_LANES = 8;
+  const size_t DOUBLE_LANES = 4;
+  inline vfloat load(const float *p) { return _mm256_loadu_ps(p); }
+  inline void store(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+  inline vfloat splat(float f) { return _mm256_set1_ps(f); }
+  inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+  inline vfloat sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+  inline vfloat mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+  inline vdouble load(const double *p) { return _mm256_loadu_pd(p); }
+  inline void store(double *p, vdouble v) { _mm256_storeu_pd(p, v); }
+  inline vdouble splat(double d) { return _mm256_set1_pd(d); }
+  inline vdouble add(vdouble a, vdouble b) { return _mm256_add_pd(a, b); }
+  inline vdouble mul(vdouble a, vdouble b) { return _mm256_mul_pd(a, b); }
+  inline vdouble div(vdouble a, vdouble b) { return _mm256_div_pd(a, b); }
+#elif defined(POINT_TRANSFORM_SSE2)
+  typedef __m128 vfloat;
+  typedef __m128d vdouble;
+  const size_t FLOAT_LANES = 4;
+  const size_t DOUBLE_LANES = 2;
+  inline vfloat load(const float *p) { return _mm_loadu_ps(p); }
+  inline void store(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+  inline vfloat splat(float f) { return _mm_set1_ps(f); }
+  inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+  inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+  inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+  inline vdouble load(const double *p) { return _mm_loadu_pd(p); }
+  inline void store(double *p, vdouble v) { _mm_storeu_pd(p, v); }
+  inline vdouble splat(double d) { return _mm_set1_pd(d); }
+  inline vdouble add(vdouble a, vdouble b) { return _mm_add_pd(a, b); }
+  inline vdouble mul(vdouble a, vdouble b) { return _mm_mul_pd(a, b); }
+  inline vdouble div(vdouble a, vdouble b) { return _mm_div_pd(a, b); }
+#elif defined(POINT_TRANSFORM_NEON)
+  typedef float32x4_t vfloat;
+  typedef float64x2_t vdouble;
+  const size_t FLOAT_LANES = 4;
+  const size_t DOUBLE_LANES = 2;
+  inline vfloat load(const float *p) { return vld1q_f32(p); }
+  inline void store(float *p, vfloat v) { vst1q_f32(p, v); }
+  inline vfloat splat(float f) { return vdupq_n_f32(f); }
+  inline vfloat add(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+  inline vfloat sub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+  inline vfloat mul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+  inline vdouble load(const double *p) { return vld1q_f64(p); }
+  inline void store(double *p, vdouble v) { vst1q_f64(p, v); }
+  inline vdouble splat(double d) { return vdupq_n_f64(d); }
+  inline vdouble add(vdouble a, vdouble b) { return vaddq_f64(a, b); }
+  inline vdouble mul(vdouble a, vdouble b) { return vmulq_f64(a, b); }
+  inline vdouble div(vdouble a, vdouble b) { return vdivq_f64(a, b); }
+#else
+  const size_t FLOAT_LANES = 1;
+  const size_t DOUBLE_LANES = 1;
+#endif
+
+  inline void distort_one(float x, float y, float copX, float copY, const float k1[3],
+    float *outX[3], float *outY[3], size_t i)
+  {
+    float dx = x - copX;
+    float dy = y - copY;
+    float r2 = dx * dx + dy * dy;
+    for (int c = 0; c < 3; c++) {
+      float s = 1.0f - k1[c] * r2;
+      outX[c][i] = copX + s * dx;
+      outY[c][i] = copY + s * dy;
+    }
+  }
+}
+
+const char *point_transform_isa()
+{
+  return POINT_TRANSFORM_ISA;
+}
+
+void radial_distort_rgb(const float *x, const float *y, size_t n,
+  float copX, float copY, const float k1[3], float *outX[3], float *outY[3])
+{
+  size_t i = 0;
+#if defined(POINT_TRANSFORM_AVX) || defined(POINT_TRANSFORM_SSE2) || defined(POINT_TRANSFORM_NEON)
+  vfloat cx = splat(copX), cy = splat(copY), one = splat(1.0f);
+  vfloat k[3] = { splat(k1[0]), splat(k1[1]), splat(k1[2]) };
+  for (; i + FLOAT_LANES <= n; i += FLOAT_LANES) {
+    vfloat dx = sub(load(x + i), cx);
+    vfloat dy = sub(load(y + i), cy);
+    vfloat r2 = add(mul(dx, dx), mul(dy, dy));
+    for (int c = 0; c < 3; c++) {
+      vfloat s = sub(one, mul(k[c], r2));
+      store(outX[c] + i, add(cx, mul(s, dx)));
+      store(outY[c] + i, add(cy, mul(s, dy)));
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    distort_one(x[i], y[i], copX, copY, k1, outX, outY, i);
+  }
+}
+
+//====================================================================
+// RadialInverse
+
+// Radii closer than this to the center of projection use the slope at
+// the center in place of f(r) / r, which is 0 / 0 there.
+static const double SMALL_RADIUS = 1e-12;
+
+bool RadialInverse::build(const std::vector<double> &coefficients,
+  double maxRadius, size_t entries, unsigned newtonSteps)
+{
+  d_table.clear();
+  if (coefficients.size() < 2 || !(maxRadius > 0) || (entries < 2)) {
+    std::cerr << "RadialInverse: Error: Need at least two coefficients,"
+      << " a positive radius and two table entries" << std::endl;
+    return false;
+  }
+  d_coefficients = coefficients;
+  d_newtonSteps = newtonSteps;
+  if (!(derivative(0) > 0)) {
+    std::cerr << "RadialInverse: Error: Distortion does not increase"
+      << " away from the center of projection" << std::endl;
+    return false;
+  }
+
+  // Look for the first place where the slope stops being positive,
+  // sampling more finely than the table so that a fold between two
+  // entries is not missed, and cut the range off there.
+  d_maxRadius = maxRadius;
+  size_t samples = 4 * entries;
+  for (size_t j = 1; j <= samples; j++) {
+    double r = maxRadius * j / samples;
+    if (derivative(r) <= 0) {
+      double lo = maxRadius * (j - 1) / samples, hi = r;
+      for (int k = 0; k < 60; k++) {
+        double mid = (lo + hi) / 2;
+        if (derivative(mid) > 0) { lo = mid; } else { hi = mid; }
+      }
+      d_maxRadius = lo;
+      break;
+    }
+  }
+
+  // Tabulate the inverse.  Bisection always converges on a monotone
+  // function; it is only done here, once per table entry.
+  d_minDistorted = distort(0);
+  d_maxDistorted = distort(d_maxRadius);
+  d_step = (d_maxDistorted - d_minDistorted) / (entries - 1);
+  d_table.resize(entries);
+  for (size_t i = 0; i < entries; i++) {
+    double rd = d_minDistorted + i * d_step;
+    double lo = 0, hi = d_maxRadius;
+    for (int k = 0; k < 60; k++) {
+      double mid = (lo + hi) / 2;
+      if (distort(mid) < rd) { lo = mid; } else { hi = mid; }
+    }
+    d_table[i] = static_cast<float>((lo + hi) / 2);
+  }
+  return true;
+}
+
+double RadialInverse::distort(double r) const
+{
+  // Horner's rule
+  double ret = 0;
+  for (size_t i = d_coefficients.size(); i-- > 0; ) {
+    ret = ret * r + d_coefficients[i];
+  }
+  return ret;
+}
+
+double RadialInverse::derivative(double r) const
+{
+  double ret = 0;
+  for (size_t i = d_coefficients.size(); i-- > 1; ) {
+    ret = ret * r + i * d_coefficients[i];
+  }
+  return ret;
+}
+
+double RadialInverse::lookup(double rd) const
+{
+  double t = (rd - d_minDistorted) / d_step;
+  double last = static_cast<double>(d_table.size() - 1);
+  if (!(t > 0)) { return d_table.front(); }
+  if (t >= last) { return d_table.back(); }
+  size_t i = static_cast<size_t>(t);
+  double frac = t - i;
+  return d_table[i] + frac * (d_table[i + 1] - d_table[i]);
+}
+
+double RadialInverse::undistort(double rd) const
+{
+  if (d_table.empty()) { return rd; }
+  if (rd < d_minDistorted) { rd = d_minDistorted; }
+  if (rd > d_maxDistorted) { rd = d_maxDistorted; }
+  double r = lookup(rd);
+  for (unsigned k = 0; k < d_newtonSteps; k++) {
+    double slope = derivative(r);
+    if (!(slope > 0)) { break; }
+    r -= (distort(r) - rd) / slope;
+    if (r < 0) { r = 0; }
+    if (r > d_maxRadius) { r = d_maxRadius; }
+  }
+  return r;
+}
+
+void RadialInverse::distortPoints(const float *x, const float *y, size_t n,
+  float copX, float copY, float *outX, float *outY) const
+{
+  for (size_t i = 0; i < n; i++) {
+    double dx = x[i] - copX;
+    double dy = y[i] - copY;
+    double r = sqrt(dx * dx + dy * dy);
+    double scale = (r < SMALL_RADIUS) ? derivative(0) : distort(r) / r;
+    outX[i] = static_cast<float>(copX + scale * dx);
+    outY[i] = static_cast<float>(copY + scale * dy);
+  }
+}
+
+void RadialInverse::undistortPoints(const double *x, const double *y, size_t n,
+  double copX, double copY, double *outX, double *outY) const
+{
+  for (size_t i = 0; i < n; i++) {
+    double dx = x[i] - copX;
+    double dy = y[i] - copY;
+    double rd = sqrt(dx * dx + dy * dy);
+    double scale = (rd < SMALL_RADIUS) ? 1 / derivative(0) : undistort(rd) / rd;
+    outX[i] = copX + scale * dx;
+    outY[i] = copY + scale * dy;
+  }
+}
+
+// The trigonometric functions come from the C library, so that the
+// results are the same as the per-point code produced; the loops are
+// over plain arrays so that the compiler can vectorize the rest.
+void angles_to_points(const double *longitude, const double *latitude,
+  size_t n, double depth, bool useFieldAngles, double *x, double *y, double *z)
+{
+  if (useFieldAngles) {
+    for (size_t i = 0; i < n; i++) {
+      x[i] = depth * tan(longitude[i]);
+      y[i] = depth * tan(latitude[i]);
+      z[i] = -depth;
+    }
+  } else {
+    // The same expressions as convert_to_normalized_and_meters() used.
+    const double halfPi = 4.0 * atan(1.0) / 2;
+    for (size_t i = 0; i < n; i++) {
+      double theta = longitude[i];
+      double phi = halfPi - latitude[i];
+      y[i] = depth * cos(phi);
+      z[i] = -depth * cos(theta) * sin(phi);
+      x[i] = -depth * (-sin(theta)) * sin(phi);
+    }
+  }
+}
+
+void points_to_angles(const double *x, const double *y, const double *z,
+  size_t n, bool useFieldAngles, double *longitude, double *latitude)
+{
+  for (size_t i = 0; i < n; i++) {
+    double xi = x[i], yi = y[i], zi = z[i];
+    longitude[i] = atan2(xi, -zi);
+    latitude[i] = useFieldAngles ? atan2(yi, -zi) : atan2(yi, sqrt(xi * xi + zi * zi));
+  }
+}
+
+void project_onto_plane(const double *x, const double *y, const double *z,
+  size_t n, double A, double B, double C, double D,
+  double *outX, double *outY, double *outZ)
+{
+  size_t i = 0;
+#if defined(POINT_TRANSFORM_AVX) || defined(POINT_TRANSFORM_SSE2) || defined(POINT_TRANSFORM_NEON)
+  vdouble a = splat(A), b = splat(B), c = splat(C), negD = splat(-D);
+  for (; i + DOUBLE_LANES <= n; i += DOUBLE_LANES) {
+    vdouble xi = load(x + i), yi = load(y + i), zi = load(z + i);
+    vdouble s = div(negD, add(add(mul(a, xi), mul(b, yi)), mul(c, zi)));
+    store(outX + i, mul(s, xi));
+    store(outY + i, mul(s, yi));
+    store(outZ + i, mul(s, zi));
+  }
+#endif
+  for (; i < n; i++) {
+    double xi = x[i], yi = y[i], zi = z[i];
+    double s = -D / (A * xi + B * yi + C * zi);
+    outX[i] = s * xi;
+    outY[i] = s * yi;
+    outZ[i] = s * zi;
+  }
+}
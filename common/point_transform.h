@@ -0,0 +1,120 @@
+/** @file
+    @brief Batch point transforms over structure-of-arrays buffers, shared
+           by the calibration program and the angles_to_config tools.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+//  Each function transforms n points held in separate X, Y (and Z)
+// arrays.  The kernels use AVX, SSE2 or NEON (64-bit ARM) when the
+// compiler targets them, and plain loops otherwise; define
+// POINT_TRANSFORM_SCALAR to always use the plain loops.  Outputs may
+// be the same arrays as the inputs.
+
+/// Name of the instruction set the kernels were built for: "AVX",
+/// "SSE2", "NEON" or "scalar".
+extern const char *point_transform_isa();
+
+/// The calibration program's K1 distortion for red, green and blue at
+/// once.  Each point p moves to
+///   cop + (1 - k1[c] * r^2) (p - cop),  r = |p - cop|
+/// so k1 must already be scaled to the units of the points.
+extern void radial_distort_rgb(const float *x, const float *y, size_t n,
+  float copX, float copY, const float k1[3], float *outX[3], float *outY[3]);
+
+/// Maps radii both ways through a radial distortion
+///    rd = f(r) = c[0] + c[1] r + c[2] r^2 + ...
+/// given as the polynomial coefficients, such as the xbox tuner's
+/// parameters or the calibration program's K1 model, which is
+/// { 0, 1, 0, -k1 }.  A point p moves to cop + f(r) / r (p - cop).
+///  build() tabulates the undistorted radius at evenly-spaced distorted
+/// radii.  undistort() interpolates in the table and then takes a fixed
+/// number of Newton steps, so each radius costs the same small amount.
+/// Accuracy falls off right next to a fold, where the slope goes to 0.
+/// Each color has its own inverse; the point functions handle a whole
+/// batch of points for one of them.
+class RadialInverse {
+public:
+  /// Builds the table for radii from 0 to maxRadius.  An inverse only
+  /// exists while f is increasing, so if f turns over before maxRadius
+  /// the range is cut off there; check maxRadius() afterwards.
+  ///   @return false (with a message on std::cerr) if f does not
+  /// increase away from 0 or the arguments are unusable.
+  bool build(const std::vector<double> &coefficients, double maxRadius,
+    size_t entries = 1024, unsigned newtonSteps = 2);
+
+  /// f(r).  Valid after build().
+  double distort(double r) const;
+
+  /// The r for which f(r) = rd, clamped to the table's range.
+  double undistort(double rd) const;
+
+  /// Moves each point p by the distortion about the center of
+  /// projection.  Outputs may be the same arrays as inputs.
+  void distortPoints(const float *x, const float *y, size_t n,
+    float copX, float copY, float *outX, float *outY) const;
+
+  /// Finds the point that distorts to each of the inputs, by undistort()
+  /// on its radius.  These are in double precision, because they are
+  /// used to measure how well a fit matches its samples.  Outputs may be
+  /// the same arrays as inputs.
+  void undistortPoints(const double *x, const double *y, size_t n,
+    double copX, double copY, double *outX, double *outY) const;
+
+  /// Undistorted radius the table reaches, which may be less than the
+  /// one asked for, and the distorted radius there.
+  double maxRadius() const { return d_maxRadius; }
+  double maxDistortedRadius() const { return d_maxDistorted; }
+
+private:
+  double derivative(double r) const;
+  double lookup(double rd) const;        //!< Table value, without Newton steps
+
+  std::vector<double> d_coefficients;
+  std::vector<float> d_table;
+  double d_maxRadius = 0;
+  double d_minDistorted = 0;
+  double d_maxDistorted = 0;
+  double d_step = 0;                     //!< Distorted radius between entries
+  unsigned d_newtonSteps = 0;
+};
+
+/// Points at the specified depth in the directions given by longitude and
+/// latitude in radians, as convert_to_normalized_and_meters() computes
+/// them.  Field angles are independent tangents in X and Y; otherwise they
+/// are spherical latitude and longitude.  -Z is straight ahead.
+extern void angles_to_points(const double *longitude, const double *latitude,
+  size_t n, double depth, bool useFieldAngles, double *x, double *y, double *z);
+
+/// Inverse of angles_to_points(), for points in front of the eye.
+extern void points_to_angles(const double *x, const double *y, const double *z,
+  size_t n, bool useFieldAngles, double *longitude, double *latitude);
+
+/// Projects each point from the origin onto the plane Ax + By + Cz + D = 0,
+/// as XYZ::projectOntoPlane() does.
+extern void project_onto_plane(const double *x, const double *y, const double *z,
+  size_t n, double A, double B, double C, double D,
+  double *outX, double *outY, double *outZ);
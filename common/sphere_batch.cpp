@@ -0,0 +1,289 @@
+/** @file
+    @brief Implementation of instanced sphere drawing.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sphere_batch.h"
+
+// GLEW must come before the other OpenGL headers.
+#include <GL/glew.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+// Vertex attribute locations, bound before linking.
+enum { ATTRIB_POSITION = 0, ATTRIB_CENTER = 1, ATTRIB_COLOR = 2 };
+
+// The unit-sphere position is also its normal.  The lighting matches
+// what fixed-function GL_LIGHT0 does with GL_COLOR_MATERIAL, no
+// specular, and no attenuation, which is how the test programs set it up.
+static const char *vertexShader =
+  "#version 120\n"
+  "attribute vec3 position;\n"
+  "attribute vec3 center;      // x, y, radius\n"
+  "attribute vec3 color;\n"
+  "uniform vec3 offset;\n"
+  "uniform bool lit;\n"
+  "varying vec3 shade;\n"
+  "void main()\n"
+  "{\n"
+  "  vec4 eye = gl_ModelViewMatrix *\n"
+  "    vec4(position * center.z + vec3(center.xy, 0.0) + offset, 1.0);\n"
+  "  gl_Position = gl_ProjectionMatrix * eye;\n"
+  "  shade = color;\n"
+  "  if (lit) {\n"
+  "    vec3 normal = normalize(gl_NormalMatrix * position);\n"
+  "    vec4 light = gl_LightSource[0].position;\n"
+  "    vec3 toLight = normalize(light.w == 0.0 ? light.xyz : light.xyz - eye.xyz);\n"
+  "    shade = color * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+  "      + gl_LightSource[0].diffuse.rgb * max(dot(normal, toLight), 0.0));\n"
+  "  }\n"
+  "}\n";
+
+static const char *fragmentShader =
+  "#version 120\n"
+  "varying vec3 shade;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor = vec4(shade, 1.0);\n"
+  "}\n";
+
+static GLuint compileShader(GLenum type, const char *source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (ok != GL_TRUE) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    std::cerr << "SphereBatch: Could not compile shader: " << log << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+SphereBatch::SphereBatch(unsigned slices, unsigned stacks)
+  : d_slices(slices < 3 ? 3 : slices)
+  , d_stacks(stacks < 2 ? 2 : stacks)
+{
+}
+
+SphereBatch::~SphereBatch()
+{
+  if (!d_setup) { return; }
+  glDeleteBuffers(1, &d_vertexBuffer);
+  glDeleteBuffers(1, &d_indexBuffer);
+  glDeleteBuffers(1, &d_instanceBuffer);
+  if (d_program != 0) {
+    glDeleteProgram(d_program);
+  }
+}
+
+void SphereBatch::setInstances(const std::vector<Instance> &instances)
+{
+  if ((instances.size() == d_instances.size()) && (instances.empty() ||
+      (memcmp(instances.data(), d_instances.data(),
+        instances.size() * sizeof(Instance)) == 0))) {
+    return;
+  }
+  d_instances = instances;
+  d_dirty = true;
+}
+
+void SphereBatch::setup()
+{
+  // Unit sphere around the Z axis, as gluSphere() makes it, so that it
+  // has a round outline when looked at down the axis.
+  const double pi = 3.14159265358979323846;
+  std::vector<GLfloat> vertices;
+  for (unsigned i = 0; i <= d_stacks; i++) {
+    double phi = pi * i / d_stacks;
+    for (unsigned j = 0; j <= d_slices; j++) {
+      double theta = 2 * pi * j / d_slices;
+      vertices.push_back(static_cast<GLfloat>(sin(phi) * cos(theta)));
+      vertices.push_back(static_cast<GLfloat>(sin(phi) * sin(theta)));
+      vertices.push_back(static_cast<GLfloat>(cos(phi)));
+    }
+  }
+  std::vector<GLuint> indices;
+  for (unsigned i = 0; i < d_stacks; i++) {
+    for (unsigned j = 0; j < d_slices; j++) {
+      GLuint a = i * (d_slices + 1) + j;
+      GLuint b = a + d_slices + 1;
+      indices.push_back(a);
+      indices.push_back(b);
+      indices.push_back(a + 1);
+      indices.push_back(a + 1);
+      indices.push_back(b);
+      indices.push_back(b + 1);
+    }
+  }
+  d_indexCount = static_cast<int>(indices.size());
+
+  glGenBuffers(1, &d_vertexBuffer);
+  glGenBuffers(1, &d_indexBuffer);
+  glGenBuffers(1, &d_instanceBuffer);
+  GLint oldArray = 0, oldElements = 0;
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &oldArray);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &oldElements);
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+    vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+    indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(oldArray));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLuint>(oldElements));
+
+  if (!GLEW_VERSION_3_3) {
+    std::cerr << "SphereBatch: OpenGL 3.3 not supported, "
+      << "drawing spheres one at a time" << std::endl;
+    return;
+  }
+  GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexShader);
+  GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentShader);
+  if ((vertex == 0) || (fragment == 0)) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return;
+  }
+  d_program = glCreateProgram();
+  glAttachShader(d_program, vertex);
+  glAttachShader(d_program, fragment);
+  glBindAttribLocation(d_program, ATTRIB_POSITION, "position");
+  glBindAttribLocation(d_program, ATTRIB_CENTER, "center");
+  glBindAttribLocation(d_program, ATTRIB_COLOR, "color");
+  glLinkProgram(d_program);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+  GLint ok = GL_FALSE;
+  glGetProgramiv(d_program, GL_LINK_STATUS, &ok);
+  if (ok != GL_TRUE) {
+    char log[1024];
+    glGetProgramInfoLog(d_program, sizeof(log), nullptr, log);
+    std::cerr << "SphereBatch: Could not link shader program: " << log << std::endl;
+    glDeleteProgram(d_program);
+    d_program = 0;
+    return;
+  }
+  d_offsetLocation = glGetUniformLocation(d_program, "offset");
+  d_litLocation = glGetUniformLocation(d_program, "lit");
+  d_instanced = true;
+}
+
+void SphereBatch::draw(double xOffset, double yOffset, double zOffset)
+{
+  if (!d_setup) {
+    setup();
+    d_setup = true;
+  }
+  if (d_instances.empty()) { return; }
+  if (!d_instanced) {
+    drawEach(xOffset, yOffset, zOffset);
+    return;
+  }
+
+  GLint oldProgram = 0, oldArray = 0, oldElements = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &oldProgram);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &oldArray);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &oldElements);
+
+  glBindBuffer(GL_ARRAY_BUFFER, d_instanceBuffer);
+  if (d_dirty) {
+    glBufferData(GL_ARRAY_BUFFER, d_instances.size() * sizeof(Instance),
+      d_instances.data(), GL_STATIC_DRAW);
+    d_dirty = false;
+  }
+  glVertexAttribPointer(ATTRIB_CENTER, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+    reinterpret_cast<const GLvoid *>(offsetof(Instance, x)));
+  glVertexAttribPointer(ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+    reinterpret_cast<const GLvoid *>(offsetof(Instance, color)));
+  glVertexAttribDivisor(ATTRIB_CENTER, 1);
+  glVertexAttribDivisor(ATTRIB_COLOR, 1);
+  glEnableVertexAttribArray(ATTRIB_CENTER);
+  glEnableVertexAttribArray(ATTRIB_COLOR);
+
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(ATTRIB_POSITION);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+
+  glUseProgram(d_program);
+  glUniform3f(d_offsetLocation, static_cast<GLfloat>(xOffset),
+    static_cast<GLfloat>(yOffset), static_cast<GLfloat>(zOffset));
+  glUniform1i(d_litLocation, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+  glDrawElementsInstanced(GL_TRIANGLES, d_indexCount, GL_UNSIGNED_INT, nullptr,
+    static_cast<GLsizei>(d_instances.size()));
+
+  glDisableVertexAttribArray(ATTRIB_POSITION);
+  glDisableVertexAttribArray(ATTRIB_CENTER);
+  glDisableVertexAttribArray(ATTRIB_COLOR);
+  glVertexAttribDivisor(ATTRIB_CENTER, 0);
+  glVertexAttribDivisor(ATTRIB_COLOR, 0);
+  glUseProgram(static_cast<GLuint>(oldProgram));
+  glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(oldArray));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLuint>(oldElements));
+}
+
+void SphereBatch::drawEach(double xOffset, double yOffset, double zOffset)
+{
+  GLint oldArray = 0, oldElements = 0;
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &oldArray);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &oldElements);
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+  // Scaling the unit sphere would also scale its normals.
+  glEnable(GL_RESCALE_NORMAL);
+  glBindBuffer(GL_ARRAY_BUFFER, d_vertexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, nullptr);
+  glNormalPointer(GL_FLOAT, 0, nullptr);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d_indexBuffer);
+
+  glMatrixMode(GL_MODELVIEW);
+  for (size_t i = 0; i < d_instances.size(); i++) {
+    const Instance &s = d_instances[i];
+    glPushMatrix();
+    glTranslated(s.x + xOffset, s.y + yOffset, zOffset);
+    glScaled(s.radius, s.radius, s.radius);
+    glColor3fv(s.color);
+    glDrawElements(GL_TRIANGLES, d_indexCount, GL_UNSIGNED_INT, nullptr);
+    glPopMatrix();
+  }
+
+  glPopClientAttrib();
+  glPopAttrib();
+  glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(oldArray));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLuint>(oldElements));
+}
@@ -0,0 +1,85 @@
+/** @file
+    @brief Instanced drawing of the sphere grids shown by the RenderManager
+           test programs.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+
+/// Draws many spheres of a few sizes and colors with a single draw call.
+/// One tessellated unit sphere is kept in a vertex buffer and each sphere's
+/// position, radius and color in an instance buffer, which is only
+/// re-uploaded when the list changes.  The spheres are drawn with the
+/// current projection and modelview matrices; if fixed-function lighting is
+/// enabled when draw() is called, the shader applies GL_LIGHT0 and the
+/// light model ambient the way GL_COLOR_MATERIAL would.  A typical use is:
+///
+///    batch.setInstances(instances);     // In RenderView(), every frame
+///    batch.draw(xOffset, yOffset, 0);   // One instanced draw per eye
+///
+///  Buffers and the shader are made on the first draw(), which needs a
+/// current OpenGL context with GLEW initialized.  Without OpenGL 3.3 the
+/// spheres are drawn one at a time from the same vertex buffer.
+class SphereBatch {
+public:
+  struct Instance {
+    float x, y;         //!< Center, in the caller's drawing units
+    float radius;
+    float color[3];
+  };
+
+  /// The sphere is split into slices around its axis and stacks along it,
+  /// as for gluSphere().
+  explicit SphereBatch(unsigned slices = 32, unsigned stacks = 16);
+  ~SphereBatch();
+
+  /// Sets the spheres to draw.  Cheap when they are the same as last time.
+  void setInstances(const std::vector<Instance> &instances);
+
+  /// Draws all of the spheres, each moved by the offset.  Leaves the
+  /// OpenGL state as it found it.
+  void draw(double xOffset, double yOffset, double zOffset);
+
+private:
+  SphereBatch(const SphereBatch &) = delete;
+  SphereBatch &operator=(const SphereBatch &) = delete;
+
+  void setup();
+  void drawEach(double xOffset, double yOffset, double zOffset);
+
+  unsigned d_slices;
+  unsigned d_stacks;
+  std::vector<Instance> d_instances;
+  bool d_dirty = true;              //!< Instance buffer needs uploading
+
+  bool d_setup = false;             //!< Buffers and shader have been made
+  bool d_instanced = false;         //!< Instanced drawing is supported
+  unsigned d_vertexBuffer = 0;
+  unsigned d_indexBuffer = 0;
+  unsigned d_instanceBuffer = 0;
+  int d_indexCount = 0;
+  unsigned d_program = 0;
+  int d_offsetLocation = -1;
+  int d_litLocation = -1;
+};
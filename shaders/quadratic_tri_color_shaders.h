@@ -0,0 +1,118 @@
+/** @file
+    @brief Default undistortion shaders, compiled into the program so that
+           Undistort_Shader does not depend on finding files at run time.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Passes through a textured quad drawn with the fixed-function
+// attributes; the distortion is applied per fragment.
+static const char *quadratic_tri_color_vert =
+    "#version 120\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = ftransform();\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "}\n";
+
+// Undistorts the texture bound to unit 0 around a separate center of
+// projection for each color, using the model picked by the variant
+// #defines that Undistort_Shader inserts.  The parameters come from the
+// uniform block filled in by Undistort_Shader; keep the two layouts in
+// sync.
+static const char *quadratic_tri_color_frag =
+    "#version 120\n"
+    "#extension GL_ARB_uniform_buffer_object : require\n"
+    "\n"
+    "// Variant selection, injected by Undistort_Shader: one of\n"
+    "// UNDISTORT_MODEL_K1, UNDISTORT_MODEL_POLYNOMIAL or UNDISTORT_MODEL_MESH,\n"
+    "// plus optionally UNDISTORT_CHROMATIC and UNDISTORT_MONO.\n"
+    "#if !defined(UNDISTORT_MODEL_K1) && !defined(UNDISTORT_MODEL_MESH) && !defined(UNDISTORT_MODEL_POLYNOMIAL)\n"
+    "#define UNDISTORT_MODEL_POLYNOMIAL\n"
+    "#endif\n"
+    "\n"
+    "layout(std140) uniform Distortion {\n"
+    "    vec4 radial[3];         // K1, K2, K3, unused\n"
+    "    vec4 tangentCenter[3];  // P1, P2, COP x, COP y\n"
+    "};\n"
+    "\n"
+    "uniform sampler2D tex;\n"
+    "\n"
+    "#ifdef UNDISTORT_MODEL_MESH\n"
+    "uniform sampler2D lutRed;\n"
+    "uniform sampler2D lutGreen;\n"
+    "uniform sampler2D lutBlue;\n"
+    "#define DISTORT_RED(p)      texture2D(lutRed, p).rg\n"
+    "#define DISTORT_GREEN(p)    texture2D(lutGreen, p).rg\n"
+    "#define DISTORT_BLUE(p)     texture2D(lutBlue, p).rg\n"
+    "#else\n"
+    "vec2 Distort(vec2 p, int color)\n"
+    "{\n"
+    "    vec4 k = radial[color];\n"
+    "    vec4 tc = tangentCenter[color];\n"
+    "    vec2 d = p - tc.zw;\n"
+    "    float r2 = dot(d, d);\n"
+    "#ifdef UNDISTORT_MODEL_K1\n"
+    "    return tc.zw + d * (1.0 + k.x * r2);\n"
+    "#else\n"
+    "    float scale = 1.0 + r2 * (k.x + r2 * (k.y + r2 * k.z));\n"
+    "    vec2 tangent = vec2(\n"
+    "        2.0 * tc.x * d.x * d.y + tc.y * (r2 + 2.0 * d.x * d.x),\n"
+    "        tc.x * (r2 + 2.0 * d.y * d.y) + 2.0 * tc.y * d.x * d.y);\n"
+    "    return tc.zw + d * scale + tangent;\n"
+    "#endif\n"
+    "}\n"
+    "#define DISTORT_RED(p)      Distort(p, 0)\n"
+    "#define DISTORT_GREEN(p)    Distort(p, 1)\n"
+    "#define DISTORT_BLUE(p)     Distort(p, 2)\n"
+    "#endif\n"
+    "\n"
+    "bool Inside(vec2 uv)\n"
+    "{\n"
+    "    return all(greaterThan(uv, vec2(0.0))) && all(lessThan(uv, vec2(1.0)));\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 uv = gl_TexCoord[0].st;\n"
+    "\n"
+    "    // Each color goes black where it samples from outside the image.\n"
+    "#if defined(UNDISTORT_CHROMATIC) && !defined(UNDISTORT_MONO)\n"
+    "    vec2 uv_red   = DISTORT_RED(uv);\n"
+    "    vec2 uv_green = DISTORT_GREEN(uv);\n"
+    "    vec2 uv_blue  = DISTORT_BLUE(uv);\n"
+    "    gl_FragColor = vec4(\n"
+    "        Inside(uv_red)   ? texture2D(tex, uv_red).r   : 0.0,\n"
+    "        Inside(uv_green) ? texture2D(tex, uv_green).g : 0.0,\n"
+    "        Inside(uv_blue)  ? texture2D(tex, uv_blue).b  : 0.0,\n"
+    "        1.0);\n"
+    "#else\n"
+    "    vec2 uv_green = DISTORT_GREEN(uv);\n"
+    "    vec3 color = Inside(uv_green) ? texture2D(tex, uv_green).rgb : vec3(0.0);\n"
+    "#ifdef UNDISTORT_MONO\n"
+    "    color = vec3(dot(color, vec3(0.299, 0.587, 0.114)));\n"
+    "#endif\n"
+    "    gl_FragColor = vec4(color, 1.0);\n"
+    "#endif\n"
+    "}\n";
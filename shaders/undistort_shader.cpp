@@ -24,37 +24,69 @@
 // limitations under the License.
 
 #include "undistort_shader.h"
+#include "quadratic_tri_color_shaders.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+// Name of the uniform block in the shaders and the binding point it is
+// attached to.  The block is laid out std140, as two arrays of vec4
+// indexed by color:
+//    layout(std140) uniform Distortion {
+//        vec4 radial[3];         // K1, K2, K3, unused
+//        vec4 tangentCenter[3];  // P1, P2, COP x, COP y
+//    };
+static const char *DISTORTION_BLOCK_NAME = "Distortion";
+static const GLuint DISTORTION_BLOCK_BINDING = 0;
+
+// Host copy of the uniform block.  Arrays of vec4 have a 16-byte stride
+// under std140, so this matches the shader's layout exactly.
+struct Distortion_Block
+{
+    GLfloat radial[Undistort_Shader::NUM_COLORS][4];
+    GLfloat tangentCenter[Undistort_Shader::NUM_COLORS][4];
+};
+
+// Names of the texture samplers in the shaders, with the texture unit
+// each one is assigned.
+static const struct { const char *name; GLint unit; } samplerUnits[] =
+{
+    { "tex", 0 },
+    { "lutRed", 1 },
+    { "lutGreen", 2 },
+    { "lutBlue", 3 },
+    { NULL, 0 }
+};
 
 class Undistort_Shader_Private
 {
 public:
     Undistort_Shader_Private()
-        : d_shader_id(Undistort_Shader::NO_SHADER) {};
-
-    // Read a shader string from a file into a string.  Returns an empty
-    // string on failure.
-    std::string readShaderFromFile(std::string filename);
-
-    // Load, compile, and link the shaders.
-    static int loadShaders(const char *vertexShader, const char *fragmentShader);
-
-    // TODO: Figure out which parameters can be uniform
-    GLuint  d_shader_id;        //< The index of our shader program
-    GLint   d_k1RedParam;       //< The location of the K1 param for Red
-    GLint   d_k1GreenParam;     //< The location of the K1 param for Green
-    GLint   d_k1BlueParam;      //< The location of the K1 param for Blue
-    GLint    d_centerParam;
-    GLint    d_radiusParam;
-
-    GLfloat d_k1Red;        // K1 red value to use in shader
-    GLfloat d_k1Green;      // K1 green value to use in shader
-    GLfloat d_k1Blue;       // K1 blue value to use in shader
-    GLfloat d_center[2];    // Center value to use in shader
-    GLfloat d_radius;        // Center value to use in shader
+        : d_ready(false)
+        , d_useCache(false)
+        , d_variant(Undistort_Shader::DEFAULT_VARIANT)
+        , d_buffer(0)
+        , d_dirty(true)
+    {
+        memset(&d_block, 0, sizeof(d_block));
+    };
+
+    bool    d_ready;            //< Sources loaded and OpenGL capable
+    std::string d_vertexSource;     //< Shader source before #defines
+    std::string d_fragmentSource;
+    std::string d_cacheDir;     //< Where program binaries are cached
+    bool    d_useCache;         //< Cache binaries in d_cacheDir
+    unsigned d_variant;         //< Variant key useShader() uses
+    std::map<unsigned, GLuint> d_programs;  //< Built variants, or NO_SHADER
+    GLuint  d_buffer;           //< Uniform buffer holding d_block
+    Distortion_Block d_block;   //< Parameters to use in the shader
+    bool    d_dirty;            //< d_block changed since last sent
 };
 
 // XXX List of shader attributes
@@ -96,33 +128,160 @@ static int shaderError(GLuint shader, const char *name)
 // Returns an empty string on failure.
 std::string Undistort_Shader::readShaderFromFile(std::string filename)
 {
-    std::string ret;
-
-    // TODO: Convert this to using only standard library calls.
-    FILE *f = fopen(filename.c_str(), "r");
-    if (f == NULL) { 
+    std::ifstream f(filename.c_str());
+    if (!f) {
         printf("No shader file with name %s found;", filename.c_str());
-        return ret; }
+        return std::string();
+    }
+
+    // Read the whole file at once.
+    std::ostringstream ret;
+    ret << f.rdbuf();
+    return ret.str();
+}
+
+//==========================================================================
+// Program binary cache.  A linked program is saved under a name made
+// from a hash of its source and of the OpenGL vendor, renderer, and
+// version strings, so a change to any of them picks a new file.  The
+// file starts with a header that repeats the hash:
+//    char magic[4] = "UDSB"
+//    uint32 version, uint64 hash, uint32 binary format, uint32 length
+// followed by the binary itself.
+
+static const char BINARY_CACHE_MAGIC[4] = { 'U', 'D', 'S', 'B' };
+static const GLuint BINARY_CACHE_VERSION = 1;
+
+struct Binary_Cache_Header
+{
+    char        magic[4];
+    GLuint      version;
+    GLuint64    hash;
+    GLenum      format;
+    GLuint      length;
+};
 
-    // Read each line of the file and append it to the string.
-    char line[4096];
-    while (fgets(line, sizeof(line), f) != NULL) {
-        ret += line;
+// Program binaries need OpenGL 4.1 or ARB_get_program_binary, and a
+// driver that offers at least one binary format.
+static bool binaryCacheSupported()
+{
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
     }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// 64-bit FNV-1a hash, continuing from a previous value.
+static GLuint64 hashString(const std::string &s, GLuint64 hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < s.size(); i++) {
+        hash ^= static_cast<unsigned char>(s[i]);
+        hash *= 1099511628211ULL;
+    }
+    // Separate this string from the next one.
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+    return hash;
+}
 
-    // Done; send the result after closing the file.
-    fclose(f);
-    return ret;
+static std::string glString(GLenum name)
+{
+    const GLubyte *s = glGetString(name);
+    return s ? reinterpret_cast<const char *>(s) : "";
+}
+
+static GLuint64 programHash(const std::string &vertexShader, const std::string &fragmentShader)
+{
+    GLuint64 hash = hashString(vertexShader);
+    hash = hashString(fragmentShader, hash);
+    hash = hashString(glString(GL_VENDOR), hash);
+    hash = hashString(glString(GL_RENDERER), hash);
+    hash = hashString(glString(GL_VERSION), hash);
+    return hash;
+}
+
+static std::string binaryCacheFileName(const std::string &dir, GLuint64 hash)
+{
+    char name[64];
+    sprintf(name, "undistort_%016llx.bin", static_cast<unsigned long long>(hash));
+    char last = dir[dir.size() - 1];
+    if ((last == '/') || (last == '\\')) {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+// Load a program from the cache.
+// Outputs
+//  handle of the linked shader program, or NO_SHADER if there is no
+// usable entry (missing, corrupt, or rejected by the driver).
+static int loadProgramBinary(const std::string &fileName, GLuint64 hash)
+{
+    std::ifstream f(fileName.c_str(), std::ios::binary);
+    if (!f) {
+        return Undistort_Shader::NO_SHADER;
+    }
+    Binary_Cache_Header header;
+    if (!f.read(reinterpret_cast<char *>(&header), sizeof(header))
+        || (memcmp(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic)) != 0)
+        || (header.version != BINARY_CACHE_VERSION) || (header.hash != hash)
+        || (header.length == 0)) {
+        return Undistort_Shader::NO_SHADER;
+    }
+    std::vector<char> binary(header.length);
+    if (!f.read(&binary[0], binary.size())) {
+        return Undistort_Shader::NO_SHADER;
+    }
+
+    // The driver may refuse a binary (after an update, for example) by
+    // failing the link.
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, &binary[0], header.length);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        glDeleteProgram(program);
+        return Undistort_Shader::NO_SHADER;
+    }
+    return program;
+}
+
+// Save a linked program to the cache, replacing any earlier entry.
+// Failures are reported but otherwise ignored; the program is fine.
+static void saveProgramBinary(GLuint program, const std::string &fileName, GLuint64 hash)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    Binary_Cache_Header header;
+    memcpy(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_CACHE_VERSION;
+    header.hash = hash;
+    glGetProgramBinary(program, length, &length, &header.format, &binary[0]);
+    header.length = length;
+
+    std::ofstream f(fileName.c_str(), std::ios::binary);
+    if (!f.write(reinterpret_cast<const char *>(&header), sizeof(header))
+        || !f.write(&binary[0], length)) {
+        fprintf(stderr, "Undistort_Shader: Could not write program cache %s\n",
+            fileName.c_str());
+    }
 }
 
 // Load a pair of vertex and fragment shaders
 // Inputs
 //  vertexShader:   vertex shader source code
 //  fragmentShader: fragment shader source code
-//  sbal:       list of generic vertex attributes to bind
+//  retrievable:    ask the driver to keep the binary for the cache
 // Outputs
 //  handle of the linked shader program, or NO_SHADER if a problem
-int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragmentShader)
+int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragmentShader,
+    bool retrievable)
 {
     GLuint program;
     GLint temp;
@@ -154,6 +313,9 @@ int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragment
         }
     }
 
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
 
     glDeleteShader(vertexShaderHandle);
@@ -170,40 +332,211 @@ int Undistort_Shader::loadShaders(const char *vertexShader, const char *fragment
 // Undistort_Shader Constructor
 Undistort_Shader::Undistort_Shader(
     std::string vert_shader_file_name
-    , std::string frag_shader_file_name)
+    , std::string frag_shader_file_name
+    , std::string binary_cache_dir)
   : d_p(new Undistort_Shader_Private)
 {
-    
+    // Set the default values; they are sent on the first useShader().
+    SetDefaultValues();
+
     // Read the vertex shader and the fragment shader from the specified
-    // files.  Bail if we can't get them.
-    std::string vertexProgram = readShaderFromFile(vert_shader_file_name);
-    std::string fragmentProgram = readShaderFromFile(frag_shader_file_name);
-    if ( (vertexProgram.size() == 0) || (fragmentProgram.size() == 0) ) {
+    // files, or use the built-in ones.  Bail if we can't get them.
+    d_p->d_vertexSource = vert_shader_file_name.empty()
+        ? std::string(quadratic_tri_color_vert) : readShaderFromFile(vert_shader_file_name);
+    d_p->d_fragmentSource = frag_shader_file_name.empty()
+        ? std::string(quadratic_tri_color_frag) : readShaderFromFile(frag_shader_file_name);
+    if ( (d_p->d_vertexSource.size() == 0) || (d_p->d_fragmentSource.size() == 0) ) {
         return;
     }
     glewInit();
-    // Load, compile, and link the shaders
-    if ((d_p->d_shader_id = loadShaders(vertexProgram.c_str(), fragmentProgram.c_str())) == NO_SHADER) {
+    if (!GLEW_VERSION_3_1 && !GLEW_ARB_uniform_buffer_object) {
+        fprintf(stderr, "Undistort_Shader: Uniform buffer objects not supported\n");
         return;
     }
+    d_p->d_cacheDir = binary_cache_dir;
+    d_p->d_useCache = !binary_cache_dir.empty() && binaryCacheSupported();
+    d_p->d_ready = true;
+
+    // Make the buffer that feeds the parameter block.
+    glGenBuffers(1, &d_p->d_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, d_p->d_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(d_p->d_block), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Build the default variant now so that problems with the shaders
+    // show up right away; others are built when first used.
+    program(d_p->d_variant);
+}
 
-    
-    // Get the uniform variable locations
-    d_p->d_k1RedParam = glGetUniformLocation(d_p->d_shader_id, "k1Red");
-    d_p->d_k1GreenParam = glGetUniformLocation(d_p->d_shader_id, "k1Green");
-    d_p->d_k1BlueParam = glGetUniformLocation(d_p->d_shader_id, "k1Blue");
-    
-    // Set the default values
-    SetDefaultValues();
-    
+// Reduce a variant key to the parts that change the program, so that
+// keys that build the same program share it.
+static unsigned normalizeVariant(unsigned key)
+{
+    key &= Undistort_Shader::MODEL_MASK | Undistort_Shader::CHROMATIC | Undistort_Shader::MONO;
+    if (key & Undistort_Shader::MONO) {
+        key &= ~static_cast<unsigned>(Undistort_Shader::CHROMATIC);
+    }
+    return key;
+}
+
+// Insert #defines selecting a variant just after the #version line,
+// which must stay first.
+static std::string specializeSource(const std::string &source, unsigned key)
+{
+    std::string defines;
+    switch (key & Undistort_Shader::MODEL_MASK) {
+    case Undistort_Shader::MODEL_K1: defines += "#define UNDISTORT_MODEL_K1\n"; break;
+    case Undistort_Shader::MODEL_POLYNOMIAL: defines += "#define UNDISTORT_MODEL_POLYNOMIAL\n"; break;
+    case Undistort_Shader::MODEL_MESH: defines += "#define UNDISTORT_MODEL_MESH\n"; break;
+    }
+    if (key & Undistort_Shader::CHROMATIC) { defines += "#define UNDISTORT_CHROMATIC\n"; }
+    if (key & Undistort_Shader::MONO) { defines += "#define UNDISTORT_MONO\n"; }
+
+    size_t at = 0;
+    size_t version = source.find("#version");
+    if (version != std::string::npos) {
+        at = source.find('\n', version);
+        at = (at == std::string::npos) ? source.size() : at + 1;
+    }
+    return source.substr(0, at) + defines + source.substr(at);
+}
+
+// Find the program for a variant, building it the first time.
+// Outputs
+//  handle of the linked shader program, or NO_SHADER if a problem.  A
+// failed variant is remembered so it is not retried every frame.
+int Undistort_Shader::program(unsigned key)
+{
+    key = normalizeVariant(key);
+    std::map<unsigned, GLuint>::const_iterator found = d_p->d_programs.find(key);
+    if (found != d_p->d_programs.end()) {
+        return found->second;
+    }
+    GLuint &id = d_p->d_programs[key];
+    id = NO_SHADER;
+    if (!d_p->d_ready) {
+        return NO_SHADER;
+    }
+    if ((key & MODEL_MASK) == MODEL_MASK) {
+        fprintf(stderr, "Undistort_Shader: Invalid variant %u\n", key);
+        return NO_SHADER;
+    }
+    std::string vertexProgram = specializeSource(d_p->d_vertexSource, key);
+    std::string fragmentProgram = specializeSource(d_p->d_fragmentSource, key);
+
+    // Use the cached program if there is one for this source and driver;
+    // otherwise load, compile, and link the shaders (and cache them).
+    GLuint64 hash = 0;
+    std::string cacheFileName;
+    if (d_p->d_useCache) {
+        hash = programHash(vertexProgram, fragmentProgram);
+        cacheFileName = binaryCacheFileName(d_p->d_cacheDir, hash);
+        id = loadProgramBinary(cacheFileName, hash);
+    }
+    if (id == NO_SHADER) {
+        if ((id = loadShaders(vertexProgram.c_str(), fragmentProgram.c_str(),
+                d_p->d_useCache)) == NO_SHADER) {
+            return NO_SHADER;
+        }
+        if (d_p->d_useCache) {
+            saveProgramBinary(id, cacheFileName, hash);
+        }
+    }
+
+    // Attach the parameter block to its binding point.  The mesh model
+    // does not use the block, so the compiler may have removed it.
+    GLuint blockIndex = glGetUniformBlockIndex(id, DISTORTION_BLOCK_NAME);
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(id, blockIndex, DISTORTION_BLOCK_BINDING);
+    } else if ((key & MODEL_MASK) != MODEL_MESH) {
+        fprintf(stderr, "Undistort_Shader: No uniform block named %s in shader\n",
+            DISTORTION_BLOCK_NAME);
+        glDeleteProgram(id);
+        id = NO_SHADER;
+        return NO_SHADER;
+    }
+
+    // Point the samplers at their texture units, leaving the caller's
+    // program bound afterwards.
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    glUseProgram(id);
+    for (int i = 0; samplerUnits[i].name != NULL; i++) {
+        GLint location = glGetUniformLocation(id, samplerUnits[i].name);
+        if (location >= 0) {
+            glUniform1i(location, samplerUnits[i].unit);
+        }
+    }
+    glUseProgram(previous);
+    return id;
+}
+
+// Select the variant used by useShader().
+// Input
+//  key:    Model ORed with flags; see Variant
+void Undistort_Shader::setVariant(unsigned key)
+{
+    d_p->d_variant = key;
+}
+
+unsigned Undistort_Shader::variant() const
+{
+    return d_p->d_variant;
+}
+
+// Build a variant ahead of time, so that the first frame using it does
+// not stall on the compile.
+// Outputs
+//  true if the variant's program is available
+bool Undistort_Shader::loadVariant(unsigned key)
+{
+    return program(key) != NO_SHADER;
 }
 
 // Set the Default Values for the Color Processing
 void Undistort_Shader::SetDefaultValues(void)
 {
-    setK1Red(0.0f);
-    setK1Green(0.0f);
-    setK1Blue(0.0f);
+    for (int c = 0; c < NUM_COLORS; c++) {
+        setRadial(static_cast<Color>(c), 0.0f, 0.0f, 0.0f);
+        setTangential(static_cast<Color>(c), 0.0f, 0.0f);
+        setCenter(static_cast<Color>(c), 0.5f, 0.5f);
+    }
+}
+
+// Set the radial parameters for one color
+// Input
+//  color:      Which color's parameters to set
+//  k1-k3:      Coefficients of r^2, r^4, and r^6
+void Undistort_Shader::setRadial(Color color, float k1, float k2, float k3)
+{
+    GLfloat *radial = d_p->d_block.radial[color];
+    radial[0] = k1;
+    radial[1] = k2;
+    radial[2] = k3;
+    radial[3] = 0.0f;
+    d_p->d_dirty = true;
+}
+
+// Set the tangential (decentering) parameters for one color
+// Input
+//  color:      Which color's parameters to set
+//  p1, p2:     Tangential coefficients
+void Undistort_Shader::setTangential(Color color, float p1, float p2)
+{
+    d_p->d_block.tangentCenter[color][0] = p1;
+    d_p->d_block.tangentCenter[color][1] = p2;
+    d_p->d_dirty = true;
+}
+
+// Set the center of projection for one color
+// Input
+//  color:      Which color's parameters to set
+//  x, y:       Center in texture coordinates (0-1)
+void Undistort_Shader::setCenter(Color color, float x, float y)
+{
+    d_p->d_block.tangentCenter[color][2] = x;
+    d_p->d_block.tangentCenter[color][3] = y;
+    d_p->d_dirty = true;
 }
 
 // Set the K1 parameter for the Red channel
@@ -211,11 +544,8 @@ void Undistort_Shader::SetDefaultValues(void)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Red(float val)
 {
-    d_p->d_k1Red = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1RedParam, d_p->d_k1Red);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    d_p->d_block.radial[RED][0] = val;
+    d_p->d_dirty = true;
 }
 
 // Set the K1 parameter for the Green channel
@@ -223,11 +553,8 @@ void Undistort_Shader::setK1Red(float val)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Green(float val)
 {
-    d_p->d_k1Green = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1GreenParam, d_p->d_k1Green);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    d_p->d_block.radial[GREEN][0] = val;
+    d_p->d_dirty = true;
 }
 
 // Set the K1 parameter for the Blue channel
@@ -235,30 +562,39 @@ void Undistort_Shader::setK1Green(float val)
 //  val:    The value to use in the shader
 void Undistort_Shader::setK1Blue(float val)
 {
-    d_p->d_k1Blue = val;
-    glUseProgram(d_p->d_shader_id);
-    glUniform1f(d_p->d_k1BlueParam, d_p->d_k1Blue);
-    // TODO: Push and pop to go back to the original.
-    glUseProgram(0);
+    d_p->d_block.radial[BLUE][0] = val;
+    d_p->d_dirty = true;
 }
 
-// Use the shader for rendering (set up the program)
+// Use the shader for rendering (set up the program), sending any
+// changed parameters first.
 void Undistort_Shader::useShader()
 {
-    
-    glUseProgram(d_p->d_shader_id);
-
-
-/* TODO Uniform parameters
-    glUniform1i(locCM, 0);
-    glUniform1i(locAL, 1);
-*/
+    int id = program(d_p->d_variant);
+    if (id == NO_SHADER) {
+        return;
+    }
+    if (d_p->d_dirty) {
+        glBindBuffer(GL_UNIFORM_BUFFER, d_p->d_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(d_p->d_block), &d_p->d_block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        d_p->d_dirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, DISTORTION_BLOCK_BINDING, d_p->d_buffer);
+    glUseProgram(id);
 }
 
 // Destructor
 Undistort_Shader::~Undistort_Shader()
 {
-    if (d_p->d_shader_id != NO_SHADER) {
-        glDeleteProgram(d_p->d_shader_id);
+    if (d_p->d_buffer != 0) {
+        glDeleteBuffers(1, &d_p->d_buffer);
+    }
+    std::map<unsigned, GLuint>::const_iterator i;
+    for (i = d_p->d_programs.begin(); i != d_p->d_programs.end(); ++i) {
+        if (i->second != NO_SHADER) {
+            glDeleteProgram(i->second);
+        }
     }
+    delete d_p;
 }
@@ -33,23 +33,73 @@ class Undistort_Shader_Private;
 class Undistort_Shader
 {
 public:
+    // Empty shader file names use the default shaders that are built
+    // into the program (quadratic_tri_color_shaders.h).  If
+    // binary_cache_dir is not empty and the driver supports program
+    // binaries, the linked program is saved in that directory and
+    // reused by later runs with the same shader source and driver,
+    // skipping the compile; anything wrong with the cache falls back
+    // to compiling from source.
     Undistort_Shader(
-        std::string vert_shader_file_name = "./quadratic_tri_color_vert.glsl",
-        std::string frag_shader_file_name = "./quadratic_tri_color_frag.glsl");
+        std::string vert_shader_file_name = "",
+        std::string frag_shader_file_name = "",
+        std::string binary_cache_dir = "");
     ~Undistort_Shader();
 
-    // Use the shader for rendering.
+    // Use the shader for rendering, with the current variant.  Any
+    // parameters changed since the last call are sent to the uniform
+    // block in a single update.
     void useShader();
 
-    // Set individual shader parameters
-    // XXX window/texture size?  COP.  K params for each color.
+    // Undistortion paths a program can be specialized for.  A variant
+    // key is one model ORed with any of the flags.  Each program is
+    // built from the same source with #defines selecting its path, so
+    // unused terms and channels are compiled out rather than skipped at
+    // run time.  A variant is compiled the first time it is used (or by
+    // loadVariant()) and kept until the shader is destroyed.
+    //  Without CHROMATIC, or with MONO, there is one texture fetch using
+    // the GREEN parameters.  MODEL_MESH reads the distorted coordinate
+    // from lookup textures (RG = texture coordinate) bound to units 1-3
+    // for red, green, and blue, ignoring the other parameters; the image
+    // to undistort is on unit 0 for every model.
+    enum Variant {
+        MODEL_K1 = 0,           // Radial K1 only
+        MODEL_POLYNOMIAL = 1,   // Radial K1-K3 and tangential P1/P2
+        MODEL_MESH = 2,         // Lookup textures
+        CHROMATIC = 4,          // Separate parameters and fetch per color
+        MONO = 8,               // Single-channel display: grayscale output
+        DEFAULT_VARIANT = MODEL_POLYNOMIAL | CHROMATIC
+    };
 
-    // Set the Parameters for the shader
+    // Not a variant: the bits of a key that hold its model.
+    static const unsigned MODEL_MASK = 3;
+
+    void setVariant(unsigned key);
+    unsigned variant() const;
+
+    // Build a variant now instead of on first use.  Returns false if it
+    // could not be built.
+    bool loadVariant(unsigned key);
+
+    // Colors that have their own distortion parameters.
+    enum Color { RED = 0, GREEN = 1, BLUE = 2, NUM_COLORS = 3 };
+
+    // Set the Parameters for the shader.  These only record the values;
+    // nothing is sent to OpenGL (and the bound program is left alone)
+    // until the next useShader().
+    //  The shader applies the Brown-Conrady model in texture coordinates
+    // around each color's center of projection:
+    //    r2 = dx*dx + dy*dy
+    //    dx' = dx*(1 + K1 r2 + K2 r2^2 + K3 r2^3) + 2 P1 dx dy + P2 (r2 + 2 dx^2)
+    //    dy' = dy*(1 + K1 r2 + K2 r2^2 + K3 r2^3) + P1 (r2 + 2 dy^2) + 2 P2 dx dy
+    void setRadial(Color color, float k1, float k2 = 0.0f, float k3 = 0.0f);
+    void setTangential(Color color, float p1, float p2);
+    void setCenter(Color color, float x, float y);
     void setK1Red(float val);
     void setK1Green(float val);
     void setK1Blue(float val);
 
-    // Sets the values back to their defaults.
+    // Sets the values back to their defaults (no distortion, centered).
     void SetDefaultValues(void);
 
     // No shader yet loaded.
@@ -61,7 +111,11 @@ protected:
     std::string readShaderFromFile(std::string filename);
 
     // Load, compile, and link the shaders.
-    static int loadShaders(const char *vertexShader, const char *fragmentShader);
+    static int loadShaders(const char *vertexShader, const char *fragmentShader,
+        bool retrievable = false);
+
+    // Find or build the program for a variant.
+    int program(unsigned key);
 
 private:
     Undistort_Shader_Private   *d_p;  //< Private objects requiring GL/GLEW
@@ -24,6 +24,9 @@ import sys
 import time
 import threading
 import json
+import array
+import os
+import struct
 from pprint import pprint
 
 from vizhmd import HMD
@@ -61,10 +64,120 @@ class DistortionEffect(vizfx.postprocess.BaseShaderEffect):
         self.uniforms.addFloat('center', [data["hmd"]["eyes"][0]["center_proj_x"], data["hmd"]["eyes"][0]["center_proj_y"]])
         json_config.close()
 
+"""
+" Alternate shader that looks the distortion up in the textures baked
+" by AnglesToConfig -lut instead of computing it
+"
+"""
+LUT_COLORS = ["red", "green", "blue"]
+DDS_FOURCC_A32B32G32R32F = 116
+
+def pfmToDds(pfmName, ddsName):
+    """Rewrites a float map from AnglesToConfig -lut as an uncompressed
+    RGBA float DDS file, which Vizard loads at full precision.  The rows
+    stay in the order of the map, bottom first, which is the order that
+    they are uploaded in."""
+    with open(pfmName, "rb") as pfm:
+        if pfm.readline().strip() != b"PF":
+            raise IOError(pfmName + " is not a color float map")
+        width, height = [int(v) for v in pfm.readline().split()]
+        scale = float(pfm.readline())
+        values = array.array('f')
+        values.fromfile(pfm, 3 * width * height)
+    # A negative scale marks little-endian data.
+    if (scale < 0) != (sys.byteorder == "little"):
+        values.byteswap()
+    texels = array.array('f', [1.0]) * (4 * width * height)
+    for c in range(3):
+        texels[c::4] = values[c::3]
+    if sys.byteorder != "little":
+        texels.byteswap()
+    header = struct.pack("<4s7I44x8I5I", b"DDS ",
+        124, 0x100F, height, width, 16 * width, 0, 0,
+        32, 0x4, DDS_FOURCC_A32B32G32R32F, 0, 0, 0, 0, 0,
+        0x1000, 0, 0, 0, 0)
+    with open(ddsName, "wb") as dds:
+        dds.write(header)
+        texels.tofile(dds)
+
+def loadLutTexture(pfmName):
+    """Loads one lookup texture, converting it again when the map is
+    newer than the last conversion."""
+    ddsName = os.path.splitext(pfmName)[0] + ".dds"
+    if (not os.path.exists(ddsName) or
+            os.path.getmtime(ddsName) < os.path.getmtime(pfmName)):
+        pfmToDds(pfmName, ddsName)
+    tex = viz.addTexture(ddsName)
+    tex.filter(viz.MIN_FILTER, viz.LINEAR)
+    tex.filter(viz.MAG_FILTER, viz.LINEAR)
+    tex.wrap(viz.WRAP_S, viz.CLAMP_TO_EDGE)
+    tex.wrap(viz.WRAP_T, viz.CLAMP_TO_EDGE)
+    return tex
+
+def loadLutTextures(prefix, eye):
+    """Returns the red, green and blue lookup textures for the eye,
+    which are all the same one for a mono configuration."""
+    base = prefix + "_" + eye
+    if os.path.exists(base + "_red.pfm"):
+        return [loadLutTexture(base + "_" + c + ".pfm") for c in LUT_COLORS]
+    tex = loadLutTexture(base + ".pfm")
+    return [tex, tex, tex]
+
+class LutDistortionEffect(vizfx.postprocess.BaseShaderEffect):
+
+    def __init__(self, textures, **kw):
+        vizfx.postprocess.BaseShaderEffect.__init__(self, **kw)
+        # Units 1 to 3, as bound in the fragment shader
+        for unit, tex in enumerate(textures):
+            self.texture(tex, unit=unit + 1)
+
+    def _getFragmentCode(self):
+        with open ("ShaderTestLut.frag", "r") as frag:
+           frag_shader=frag.read()
+        return frag_shader
+
+    def _getVertexCode(self):
+        with open ("ShaderTestLut.vert", "r") as vert:
+           vert_shader=vert.read()
+        return vert_shader
+
 global effect
 effect = DistortionEffect()
 vizfx.postprocess.addEffect(effect)
 
+# With a "lookup_textures" section in HMD.json, both shaders are loaded
+# and the T key switches between them.  As with the polynomial, one eye's
+# distortion is used for both.
+effects = [("polynomial", effect)]
+if "lookup_textures" in data["hmd"]:
+    lut = data["hmd"]["lookup_textures"]
+    lutEffect = LutDistortionEffect(loadLutTextures(lut["prefix"], lut.get("eye", "left")))
+    vizfx.postprocess.addEffect(lutEffect)
+    effects.append(("lookup texture", lutEffect))
+activeEffect = len(effects) - 1
+for i, (name, e) in enumerate(effects):
+    e.setEnabled(i == activeEffect)
+
+def toggleEffect():
+    global activeEffect
+    effects[activeEffect][1].setEnabled(False)
+    activeEffect = (activeEffect + 1) % len(effects)
+    effects[activeEffect][1].setEnabled(True)
+    del frameTimes[:]
+
+vizact.onkeydown('t', toggleEffect)
+
+# Prints the average frame time of the active shader about once a second.
+frameTimes = []
+def reportFrameTime():
+    frameTimes.append(viz.getFrameElapsed())
+    if sum(frameTimes) >= 1.0:
+        print("%s distortion: %.3f ms per frame" %
+            (effects[activeEffect][0], 1000.0 * sum(frameTimes) / len(frameTimes)))
+        del frameTimes[:]
+
+vizact.ontimer(0, reportFrameTime)
+
 viz.setMultiSample(4)
 
 screenMode=viz.FULLSCREEN
@@ -0,0 +1,52 @@
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Distortion from lookup textures baked by AnglesToConfig -lut: each
+// texel holds the point in the rendered image that shows at that point
+// on the screen, so each color costs one lookup fetch and one scene
+// fetch, whatever the shape of the distortion.
+
+#version 430 core
+
+in INFO {
+    vec2 texCoords; //Tex coords for a given gl_Vertex
+} fs_in;
+
+out vec4 color;
+
+layout (binding = 0) uniform sampler2D s;
+layout (binding = 1) uniform sampler2D lut_red;
+layout (binding = 2) uniform sampler2D lut_green;
+layout (binding = 3) uniform sampler2D lut_blue;
+
+void main()
+{
+    vec2 uv_red, uv_green, uv_blue;
+    vec4 color_red, color_green, color_blue;
+
+    uv_red      = texture(lut_red,   fs_in.texCoords).xy;
+    uv_green    = texture(lut_green, fs_in.texCoords).xy;
+    uv_blue     = texture(lut_blue,  fs_in.texCoords).xy;
+
+    color_red   = texture(s, uv_red   );
+    color_green = texture(s, uv_green );
+    color_blue  = texture(s, uv_blue  );
+
+    if (    ((uv_red.x>0)     && (uv_red.x<1)        && (uv_red.y>0)     && (uv_red.y<1)))
+    {
+        color = vec4(color_red.x, color_green.y, color_blue.z, 1.0);
+    } else {
+        color = vec4(0,0,0,0); //black
+    }
+}